@@ -0,0 +1,193 @@
+/*
+  BeatTracker.cpp   - Follows the tempo and beat phase of the music from the beats Max sends
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "BeatTracker.h"
+
+
+// *********************************************************************************
+//      CONSTRUCTOR
+// *********************************************************************************
+
+BeatTracker::BeatTracker()
+{
+}
+
+
+// *********************************************************************************
+//      BEATS
+// *********************************************************************************
+
+bool BeatTracker::OnBeat(uint32_t arrivalMicros, uint16_t bpm) {
+
+  // the same beat again ('B' and 'b' together)
+  uint32_t duplicateMicros = (_periodMicros ? _periodMicros : 60000000UL / BEAT_MAX_BPM) / 4;
+  if( _hasArrival && arrivalMicros - _lastArrivalMicros < duplicateMicros ){
+    return false;
+  }
+
+  uint32_t previousArrival = _lastArrivalMicros;
+  bool hadArrival = _hasArrival;
+  _lastArrivalMicros = arrivalMicros;
+  _hasArrival = true;
+
+  // Max told us the tempo. one that's clearly not ours (more than 2% out) starts again from this beat
+  if( bpm >= BEAT_MIN_BPM && bpm <= BEAT_MAX_BPM ){
+    uint32_t periodMicros = 60000000UL / bpm;
+    uint32_t difference = periodMicros > _periodMicros ? periodMicros - _periodMicros : _periodMicros - periodMicros;
+    if( difference > periodMicros / 50 ){
+      StartFrom( arrivalMicros, periodMicros );
+      return true;
+    }
+  }
+
+  // no tempo yet. the first two beats give us one
+  if( !_periodMicros ){
+    if( hadArrival && IsTempo(arrivalMicros - previousArrival) ){
+      StartFrom( arrivalMicros, arrivalMicros - previousArrival );
+      return true;
+    }
+    return false;
+  }
+
+  // how many beats on from the last one this is. after a long gap the phase is anyone's guess
+  uint32_t sinceBeat = arrivalMicros - _beatMicros;
+  uint32_t beats = (sinceBeat + _periodMicros / 2) / _periodMicros;
+  if( (int32_t)sinceBeat < 0 || beats == 0 ){
+    return false;
+  }
+  if( beats > BEAT_TIMEOUT_BEATS ){
+    StartFrom( arrivalMicros, _periodMicros );
+    return true;
+  }
+
+  // how far from the grid it landed
+  int32_t error = (int32_t)(sinceBeat - beats * _periodMicros);
+  uint32_t tolerance = _periodMicros / BEAT_PHASE_TOLERANCE_DIVISOR;
+
+  if( error > (int32_t)tolerance || error < -(int32_t)tolerance ){
+    _outlierCount++;
+    if( _outliersInRow++ == 0 ){
+      _firstOutlierMicros = arrivalMicros;
+    }
+
+    // the tempo changed. the outliers' average gap is the new one
+    if( _outliersInRow >= BEAT_RELOCK_OUTLIERS ){
+      uint32_t periodMicros = (arrivalMicros - _firstOutlierMicros) / (_outliersInRow - 1);
+      if( IsTempo(periodMicros) ){
+        StartFrom( arrivalMicros, periodMicros );
+        return true;
+      }
+      _outliersInRow = 0;
+    }
+    return false;
+  }
+
+  // nudge the phase most of the way and the period a little, so one late beat doesn't move the tempo
+  _outliersInRow = 0;
+  _beatMicros += beats * _periodMicros + error / 4;
+
+  int32_t periodMicros = (int32_t)_periodMicros + error / (int32_t)(16 * beats);
+  if( IsTempo(periodMicros) ){
+    _periodMicros = periodMicros;
+  }
+
+  if( _beatsInLock < BEAT_LOCK_COUNT ){
+    _beatsInLock++;
+  }
+  _locked = _beatsInLock >= BEAT_LOCK_COUNT;
+
+  return true;
+}
+
+
+void BeatTracker::StartFrom(uint32_t beatMicros, uint32_t periodMicros) {
+
+  _beatMicros = beatMicros;
+  _periodMicros = periodMicros;
+  _beatsInLock = 1;
+  _locked = false;
+  _outliersInRow = 0;
+}
+
+
+bool BeatTracker::IsTempo(uint32_t periodMicros) {
+  return periodMicros >= 60000000UL / BEAT_MAX_BPM && periodMicros <= 60000000UL / BEAT_MIN_BPM;
+}
+
+
+// *********************************************************************************
+//      ONCE PER FRAME
+// *********************************************************************************
+
+bool BeatTracker::Update(const FrameTime &frame) {
+
+  if( !_periodMicros ){
+    return false;
+  }
+
+  // the beats stopped. keep the tempo, but don't start anything on a grid we can't see anymore
+  if( _locked && (int32_t)(frame.micros - _lastArrivalMicros) > (int32_t)(BEAT_TIMEOUT_BEATS * _periodMicros) ){
+    _locked = false;
+    _beatsInLock = 0;
+  }
+
+  // the last beat on the grid at or before this frame, in the frame's millis. the phase
+  // correction can leave the grid's last beat just after the frame, so step back a beat for that
+  if( _locked ){
+    int32_t sinceBeat = (int32_t)(frame.micros - _beatMicros);
+    while( sinceBeat < 0 ){
+      sinceBeat += _periodMicros;
+    }
+    _gridMillis = frame.millis - ((uint32_t)sinceBeat % _periodMicros) / 1000;
+  }
+
+  return UpdateBPM();
+}
+
+
+// whole bpm, moved only when the estimate is clearly somewhere else so it doesn't flicker between two
+bool BeatTracker::UpdateBPM() {
+
+  uint32_t tenths = (600000000UL + _periodMicros / 2) / _periodMicros;
+  uint32_t current = (uint32_t)_bpm * 10;
+  uint32_t difference = tenths > current ? tenths - current : current - tenths;
+
+  if( difference < BEAT_BPM_HYSTERESIS_TENTHS ){
+    return false;
+  }
+
+  _bpm = (tenths + 5) / 10;
+  _version++;
+  return true;
+}
+
+
+uint32_t BeatTracker::SnapToBeat(uint32_t animationMillis) const {
+
+  if( !_locked ){
+    return animationMillis;
+  }
+
+  uint32_t sinceBeat = animationMillis - _gridMillis;
+  if( (int32_t)sinceBeat < 0 ){
+    return animationMillis;
+  }
+
+  // either side of the beat. a timebase a few ms ahead just starts the wave a few ms before its phase 0
+  uint32_t periodMillis = _periodMicros / 1000;
+  uint32_t window = periodMillis / BEAT_SNAP_DIVISOR;
+  sinceBeat %= periodMillis;
+
+  if( sinceBeat <= window ){
+    return animationMillis - sinceBeat;
+  }
+  if( periodMillis - sinceBeat <= window ){
+    return animationMillis + (periodMillis - sinceBeat);
+  }
+  return animationMillis;
+}
@@ -0,0 +1,106 @@
+/*
+  BeatTracker.h  - Follows the tempo and beat phase of the music from the beats Max sends
+                 -- a phase-locked loop: every beat is compared with where the current tempo says it should
+                    have landed, and the error nudges both the phase (by 1/4) and the period (by 1/16), so
+                    serial jitter averages out instead of shaking the fades
+                 -- a beat too far from the grid is an outlier and ignored. a run of them means the tempo
+                    really changed, and the tracker starts again from them
+                 -- 'B' on the downbeat and 'b' on the quarter notes can arrive together; a second beat
+                    within a quarter beat of the last one is the same beat
+                 -- controllers that follow it (LEDStripController::FollowTempo) scale their bpm with the
+                    tempo and start their fades on the beat, so nothing needs re-timing per command
+                 -- until it has locked the tempo is GLOBAL_BPM. when the beats stop it keeps the last tempo
+*/
+
+#ifndef BeatTracker_h
+#define BeatTracker_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include "FrameClock.h"
+
+// tempos outside this range are taken as missed or doubled beats
+#define BEAT_MIN_BPM 40
+#define BEAT_MAX_BPM 240
+
+// beats in a row on the grid before the phase is trusted for starting fades on
+#define BEAT_LOCK_COUNT 4
+
+// a beat further than 1/this of a beat from the grid is an outlier
+#define BEAT_PHASE_TOLERANCE_DIVISOR 6
+
+// outliers in a row that mean the tempo changed
+#define BEAT_RELOCK_OUTLIERS 3
+
+// beats without a beat from Max before the phase is no longer trusted
+#define BEAT_TIMEOUT_BEATS 8
+
+// a trigger within 1/this of a beat of a beat starts its fade on that beat
+#define BEAT_SNAP_DIVISOR 8
+
+// the tempo GetBPM() reports only moves once the estimate is this many tenths of a bpm away from it
+#define BEAT_BPM_HYSTERESIS_TENTHS 6
+
+
+// ******************************************************************
+//            BeatTracker class definitions
+// ******************************************************************
+class BeatTracker
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    BeatTracker();
+
+    // a beat arrived at arrivalMicros. bpm is the tempo Max says it's at (a SERIAL_OP_BEAT frame),
+    // or 0 to work it out. returns false if the beat was a duplicate or an outlier
+    bool OnBeat(uint32_t arrivalMicros, uint16_t bpm = 0);
+
+    // call once per frame, before anything is triggered. returns true if GetBPM() changed
+    bool Update(const FrameTime &frame);
+
+    uint16_t GetBPM() const { return _bpm; }
+    bool IsLocked() const { return _locked; }
+    bool HasTempo() const { return _periodMicros != 0; }   // a period, locked or not
+    uint32_t GetPeriodMicros() const { return _periodMicros; }
+    uint32_t GetBeatMicros() const { return _beatMicros; }  // the grid's last beat (0 until HasTempo())
+
+    // the beat on the grid nearest animationMillis, if it's within 1/BEAT_SNAP_DIVISOR of a beat
+    // and we're locked. otherwise animationMillis
+    uint32_t SnapToBeat(uint32_t animationMillis) const;
+
+    // bumped every time GetBPM() changes, so followers can tell they need to rescale
+    uint16_t GetVersion() const { return _version; }
+
+    uint16_t GetOutlierCount() const { return _outlierCount; }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    uint32_t _periodMicros = 0;       // 0 until two beats have given us one
+    uint32_t _beatMicros = 0;         // where the grid puts the last beat we accepted
+    uint32_t _lastArrivalMicros = 0;  // the last beat that arrived, accepted or not
+    bool _hasArrival = false;
+    uint8_t _beatsInLock = 0;
+    bool _locked = false;
+
+    // outliers in a row, and where the first of them arrived
+    uint8_t _outliersInRow = 0;
+    uint32_t _firstOutlierMicros = 0;
+    uint16_t _outlierCount = 0;
+
+    // the grid in frame clock millis, brought up to date by Update()
+    uint32_t _gridMillis = 0;
+
+    uint16_t _bpm = GLOBAL_BPM;
+    uint16_t _version = 0;
+
+    void StartFrom(uint32_t beatMicros, uint32_t periodMicros);
+    bool UpdateBPM();
+    static bool IsTempo(uint32_t periodMicros);
+};
+
+
+
+#endif
@@ -0,0 +1,160 @@
+/*
+  CommandQueue.cpp   - Holds commands from Max until the frame they are meant for
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "CommandQueue.h"
+
+
+// *********************************************************************************
+//      CONSTRUCTOR
+// *********************************************************************************
+
+CommandQueue::CommandQueue()
+{
+}
+
+
+// *********************************************************************************
+//      TIMING
+// *********************************************************************************
+
+void CommandQueue::SetTiming(uint8_t subdivision, uint32_t latencyMicros) {
+
+  _subdivision = subdivision;
+  _latencyMicros = latencyMicros;
+}
+
+
+// the beat reached us late by the same offset as every command, so it lands on the grid at the same delay
+void CommandQueue::MarkBeat(uint32_t arrivalMicros, uint16_t bpm) {
+
+  if( bpm == 0 ){
+    return;
+  }
+
+  SetBeatGrid(arrivalMicros + _latencyMicros, 60000000UL / bpm);
+}
+
+
+void CommandQueue::SetBeatGrid(uint32_t beatOriginMicros, uint32_t beatMicros) {
+
+  _beatOriginMicros = beatOriginMicros;
+  _beatMicros = beatMicros;
+}
+
+
+// arrival plus the offset, rounded to the nearest point on the grid that hasn't passed yet
+uint32_t CommandQueue::FireTime(uint32_t arrivalMicros) {
+
+  uint32_t target = arrivalMicros + _latencyMicros;
+
+  if( !_subdivision || !_beatMicros ){
+    return target;
+  }
+
+  // keep the origin within a beat of now, so the signed math below never wraps
+  uint32_t sinceOrigin = target - _beatOriginMicros;
+  if( (int32_t)sinceOrigin >= 0 ){
+    _beatOriginMicros += (sinceOrigin / _beatMicros) * _beatMicros;
+  }
+
+  uint32_t step = _beatMicros / _subdivision;
+  int32_t phase = (int32_t)(target - _beatOriginMicros) % (int32_t)step;
+  if( phase < 0 ){
+    phase += step;
+  }
+
+  uint32_t fireMicros = target - phase;
+  if( (uint32_t)phase >= step / 2 ){
+    fireMicros += step;
+  }
+
+  // a grid point already behind us would just mean "now", which is what quantizing is meant to avoid
+  if( (int32_t)(fireMicros - arrivalMicros) < 0 ){
+    fireMicros += step;
+  }
+
+  return fireMicros;
+}
+
+
+// *********************************************************************************
+//      THE QUEUE
+// *********************************************************************************
+
+bool CommandQueue::FiresBefore(const QueuedCommand &a, const QueuedCommand &b) {
+
+  int32_t difference = (int32_t)(a.fireMicros - b.fireMicros);
+  if( difference != 0 ){
+    return difference < 0;
+  }
+  return (int16_t)(a.sequence - b.sequence) < 0;
+}
+
+
+// a full queue refuses the command. running it now would put it ahead of the ones that came before it
+bool CommandQueue::Schedule(uint32_t arrivalMicros, QueuedCommand &command) {
+
+  if( _count == COMMAND_QUEUE_SIZE ){
+    _overflowCount++;
+    return false;
+  }
+
+  command.fireMicros = FireTime(arrivalMicros);
+  command.sequence = _nextSequence++;
+
+  // sift up
+  uint8_t i = _count++;
+  while( i > 0 ){
+    uint8_t parent = (i - 1) / 2;
+    if( !FiresBefore(command, _heap[parent]) ){
+      break;
+    }
+    _heap[i] = _heap[parent];
+    i = parent;
+  }
+  _heap[i] = command;
+
+  return true;
+}
+
+
+bool CommandQueue::PopDue(const FrameTime &frame, QueuedCommand &command) {
+
+  if( _count == 0 ){
+    return false;
+  }
+
+  // due on the frame closest to its fire time. anything older (we skipped frames) is overdue, so runs now
+  uint32_t halfFrame = FRAME_INTERVAL_MICROS / 2;
+  if( (int32_t)(_heap[0].fireMicros - frame.micros) >= (int32_t)halfFrame ){
+    return false;
+  }
+
+  command = _heap[0];
+
+  // move the last entry to the top and sift it down
+  QueuedCommand last = _heap[--_count];
+  uint8_t i = 0;
+  while( true ){
+    uint8_t child = 2 * i + 1;
+    if( child >= _count ){
+      break;
+    }
+    if( child + 1 < _count && FiresBefore(_heap[child + 1], _heap[child]) ){
+      child++;
+    }
+    if( !FiresBefore(_heap[child], last) ){
+      break;
+    }
+    _heap[i] = _heap[child];
+    i = child;
+  }
+  _heap[i] = last;
+
+  return true;
+}
@@ -0,0 +1,91 @@
+/*
+  CommandQueue.h  - Holds commands from Max until the frame they are meant for
+                  -- every command is stamped with a fire time when it arrives: the arrival time plus a
+                     fixed latency offset, optionally rounded to the nearest 1/subdivision of a beat
+                  -- the offset has to cover the worst serial delay plus a show() (~7 ms for 3 x 80 pixels),
+                     so commands that arrive with different delays still fire on the frame they were sent for.
+                     it can also be used to line the lights up with the audio system's output latency
+                  -- the beat grid is set by the sketch from its BeatTracker (or by MarkBeat() straight from
+                     one beat), and is offset the same way
+                  -- a bounded min-heap ordered by fire time, then arrival, so nothing is allocated and
+                     commands for the same frame run in the order they were sent
+                  -- with no offset and no quantization nothing waits, and commands run as they arrive
+*/
+
+#ifndef CommandQueue_h
+#define CommandQueue_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include "FrameClock.h"
+#include "SerialProtocol.h"
+
+// the most commands waiting for their frame at once is COMMAND_QUEUE_SIZE (GlobalVariables.h). a full
+// queue refuses new commands (and counts them), so nothing runs ahead of a command sent before it
+
+
+// a command waiting for its frame
+struct QueuedCommand {
+  uint32_t fireMicros;       // frame clock micros it's meant for
+  uint16_t sequence;         // arrival order
+  bool legacy;               // a single character command (legacyByte) rather than a frame (command)
+  uint8_t legacyByte;
+  SerialCommand command;
+};
+
+
+// ******************************************************************
+//            CommandQueue class definitions
+// ******************************************************************
+class CommandQueue
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    CommandQueue();
+
+    // subdivision 0 fires at arrival plus the offset, N rounds that to the nearest 1/N beat
+    void SetTiming(uint8_t subdivision, uint32_t latencyMicros);
+    uint8_t GetSubdivision() const { return _subdivision; }
+    uint32_t GetLatencyMicros() const { return _latencyMicros; }
+
+    // a beat arrived now (a SERIAL_OP_BEAT frame), at bpm
+    void MarkBeat(uint32_t arrivalMicros, uint16_t bpm);
+    void SetBeatGrid(uint32_t beatOriginMicros, uint32_t beatMicros);
+    uint32_t GetBeatMicros() const { return _beatMicros; }
+
+    // true if commands wait for a fire time at all (see the top of this file)
+    bool IsScheduling() const { return _latencyMicros || (_subdivision && _beatMicros); }
+
+    // stamp a command that arrived at arrivalMicros and hold it. only while IsScheduling(), otherwise
+    // commands just run as they arrive. returns false if the queue is full and the command was dropped
+    bool Schedule(uint32_t arrivalMicros, QueuedCommand &command);
+
+    // take the next command due by frame (the frame its fire time is closest to, or any later one).
+    // call until it returns false
+    bool PopDue(const FrameTime &frame, QueuedCommand &command);
+
+    uint8_t GetCount() const { return _count; }
+    uint16_t GetOverflowCount() const { return _overflowCount; }    // commands dropped, the queue was full
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    QueuedCommand _heap[COMMAND_QUEUE_SIZE];
+    uint8_t _count = 0;
+    uint16_t _nextSequence = 0;
+    uint16_t _overflowCount = 0;
+
+    uint8_t _subdivision = 0;
+    uint32_t _latencyMicros = 0;
+    uint32_t _beatOriginMicros = 0;   // a beat on the grid, kept within a beat of the last command
+    uint32_t _beatMicros = 0;         // 0 until the first beat is marked
+
+    uint32_t FireTime(uint32_t arrivalMicros);
+    static bool FiresBefore(const QueuedCommand &a, const QueuedCommand &b);
+};
+
+
+
+#endif
@@ -0,0 +1,152 @@
+/*
+  Compositing.h  - Layers drawn over a segment's base animation, and the blend kernels that composite them
+                 -- each LEDStripController holds up to MAX_LAYERS layers on top of its animation. after
+                    every render they are drawn in slot order, straight into the segment's pixels
+                 -- sparse layers (glitter, sparkle) only touch the pixels they draw, so there is no
+                    layer buffer and no full-frame copy. dense layers (envelope) blend every pixel once
+                 -- all kernels are 8 bit integer math. amount is how much of the layer shows through,
+                    and at 255 BLEND_ALPHA is an exact overwrite
+*/
+
+#ifndef Compositing_h
+#define Compositing_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include <FastLED.h>
+#include "PixelKernels.h"
+
+// the most layers a segment composites over its base animation
+#define MAX_LAYERS 3
+
+
+// ******************************************************************
+//    LAYER TYPES AND BLEND MODES
+// ******************************************************************
+enum LayerType : uint8_t {
+  LAYER_NONE,       // empty slot
+  LAYER_GLITTER,    // each tick, a param/256 chance of one random pixel in color
+  LAYER_SPARKLE,    // each tick, a param/256 chance of one random pixel in a random palette color
+  LAYER_ENVELOPE,   // the whole strip in color, scaled by a sine at param bpm on the animation's timebase.
+                    // white with BLEND_MULTIPLY is a brightness envelope
+  LAYER_TYPE_COUNT
+};
+
+enum BlendMode : uint8_t {
+  BLEND_ADD,        // saturating add
+  BLEND_MAX,        // the brighter of the two, per channel
+  BLEND_ALPHA,      // crossfade towards the layer
+  BLEND_MULTIPLY,   // darken by the layer (white leaves the pixel alone)
+  BLEND_MODE_COUNT
+};
+
+struct Layer {
+  LayerType type;
+  BlendMode blendMode;
+  uint8_t amount;      // how much of the layer shows through, 0 (none) to 255 (all of it)
+  uint8_t param;       // glitter and sparkle: chance per tick out of 256. envelope: bpm
+  CRGB color;          // glitter and envelope color. sparkle draws from the palette instead
+
+  bool operator==(const Layer &rhs) const {
+    return type == rhs.type && blendMode == rhs.blendMode && amount == rhs.amount && param == rhs.param && color == rhs.color;
+  }
+  bool operator!=(const Layer &rhs) const { return !(*this == rhs); }
+};
+
+
+// ******************************************************************
+//    BLEND KERNELS
+// ******************************************************************
+
+// what BLEND_MULTIPLY scales each channel by: amount moves it from white (no change) towards color
+inline CRGB BlendMultiplier(const CRGB &color, uint8_t amount) {
+  return CRGB( 255 - scale8(255 - color.r, amount), 255 - scale8(255 - color.g, amount), 255 - scale8(255 - color.b, amount) );
+}
+
+
+// one pixel
+inline void BlendPixel(CRGB &pixel, const CRGB &color, BlendMode blendMode, uint8_t amount) {
+
+  switch( blendMode ){
+    case BLEND_ADD:
+      pixel.r = qadd8( pixel.r, scale8(color.r, amount) );
+      pixel.g = qadd8( pixel.g, scale8(color.g, amount) );
+      pixel.b = qadd8( pixel.b, scale8(color.b, amount) );
+      break;
+
+    case BLEND_MAX: {
+      uint8_t r = scale8(color.r, amount), g = scale8(color.g, amount), b = scale8(color.b, amount);
+      if( r > pixel.r ) pixel.r = r;
+      if( g > pixel.g ) pixel.g = g;
+      if( b > pixel.b ) pixel.b = b;
+      break;
+    }
+
+    case BLEND_ALPHA:
+      pixel.r = blend8( pixel.r, color.r, amount );
+      pixel.g = blend8( pixel.g, color.g, amount );
+      pixel.b = blend8( pixel.b, color.b, amount );
+      break;
+
+    case BLEND_MULTIPLY:
+      // amount moves the multiplier from white (no change) towards color
+      pixel.r = scale8( pixel.r, 255 - scale8(255 - color.r, amount) );
+      pixel.g = scale8( pixel.g, 255 - scale8(255 - color.g, amount) );
+      pixel.b = scale8( pixel.b, 255 - scale8(255 - color.b, amount) );
+      break;
+
+    default:
+      break;
+  }
+}
+
+
+// every pixel. the per-color work is done once, then it's one of the whole-strip kernels (PixelKernels.h).
+// returns the channel sums of what it leaves, summed while the pixels are still in cache, for the power load
+inline ChannelSums BlendPixels(CRGB *pixels, uint16_t count, const CRGB &color, BlendMode blendMode, uint8_t amount) {
+
+  switch( blendMode ){
+    case BLEND_ADD:
+      PixelKernels::Add( pixels, count, CRGB(scale8(color.r, amount), scale8(color.g, amount), scale8(color.b, amount)) );
+      break;
+
+    case BLEND_MAX:
+      PixelKernels::Max( pixels, count, CRGB(scale8(color.r, amount), scale8(color.g, amount), scale8(color.b, amount)) );
+      break;
+
+    case BLEND_ALPHA:
+      PixelKernels::Blend( pixels, count, color, amount );
+      break;
+
+    case BLEND_MULTIPLY:
+      PixelKernels::ScaleByColor( pixels, count, BlendMultiplier(color, amount) );
+      break;
+
+    default:
+      break;
+  }
+
+  return PixelKernels::SumChannels( pixels, count );
+}
+
+
+// true if blending color over any pixel leaves it as it was, so a dense layer can skip the strip
+inline bool BlendIsNoOp(const CRGB &color, BlendMode blendMode, uint8_t amount) {
+
+  if( amount == 0 ){
+    return true;
+  }
+
+  switch( blendMode ){
+    case BLEND_ADD:
+    case BLEND_MAX:      return !(scale8(color.r, amount) | scale8(color.g, amount) | scale8(color.b, amount));
+    case BLEND_MULTIPLY: return (color.r & color.g & color.b) == 255;
+    case BLEND_ALPHA:    return false;
+    default:             return true;
+  }
+}
+
+
+
+#endif
@@ -0,0 +1,329 @@
+/*
+  EffectVM.cpp  - Animations uploaded over serial as small programs, run once per pixel per render
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "EffectVM.h"
+
+
+EffectProgram EffectVM::_programs[EFFECT_PROGRAM_SLOTS];
+EffectInstruction EffectVM::_staging[EFFECT_MAX_INSTRUCTIONS];
+
+#define X_REG 1
+#define Y_REG 2
+#define Z_REG 4
+
+const uint8_t EffectVM::_registerOperands[EFFECT_OPCODE_COUNT] = {
+  0,                          // EFFECT_END
+  X_REG,                      // EFFECT_LOAD
+  X_REG | Y_REG,              // EFFECT_MOV
+  X_REG | Y_REG | Z_REG,      // EFFECT_ADD
+  X_REG | Y_REG | Z_REG,      // EFFECT_SUB
+  X_REG | Y_REG | Z_REG,      // EFFECT_MUL
+  X_REG | Y_REG | Z_REG,      // EFFECT_DIV
+  X_REG | Y_REG | Z_REG,      // EFFECT_AND
+  X_REG | Y_REG | Z_REG,      // EFFECT_MIN
+  X_REG | Y_REG | Z_REG,      // EFFECT_MAX
+  X_REG | Y_REG,              // EFFECT_SHR
+  X_REG | Y_REG,              // EFFECT_SHL
+  X_REG | Y_REG | Z_REG,      // EFFECT_QADD8
+  X_REG | Y_REG | Z_REG,      // EFFECT_QSUB8
+  X_REG | Y_REG | Z_REG,      // EFFECT_SCALE8
+  X_REG | Y_REG | Z_REG,      // EFFECT_SCALE16
+  X_REG | Y_REG,              // EFFECT_SIN8
+  X_REG | Y_REG,              // EFFECT_SIN16
+  X_REG | Y_REG | Z_REG,      // EFFECT_NOISE
+  X_REG | Y_REG,              // EFFECT_BEAT8
+  X_REG | Y_REG,              // EFFECT_BEAT16
+  X_REG | Y_REG | Z_REG,      // EFFECT_LT
+  X_REG | Y_REG | Z_REG,      // EFFECT_EQ
+  X_REG,                      // EFFECT_JZ
+  0,                          // EFFECT_JMP
+  X_REG,                      // EFFECT_PARAM
+  X_REG,                      // EFFECT_TIME
+  X_REG,                      // EFFECT_TICKS
+  X_REG,                      // EFFECT_LENGTH
+  X_REG,                      // EFFECT_INDEX
+  X_REG | Y_REG,              // EFFECT_PALETTE
+  X_REG | Y_REG,              // EFFECT_PALETTE_ADD
+  X_REG | Y_REG | Z_REG,      // EFFECT_HSV
+  X_REG | Y_REG | Z_REG,      // EFFECT_RGB
+};
+
+
+// *********************************************************************************
+//      LOADING
+// *********************************************************************************
+
+bool EffectVM::StageCode(uint8_t index, const uint8_t *bytes, uint8_t instructionCount) {
+
+  if( index + instructionCount > EFFECT_MAX_INSTRUCTIONS ){
+    return false;
+  }
+
+  for( uint8_t i = 0; i < instructionCount; i++ ){
+    _staging[index + i].op = bytes[i * 4];
+    _staging[index + i].x = bytes[i * 4 + 1];
+    _staging[index + i].y = bytes[i * 4 + 2];
+    _staging[index + i].z = bytes[i * 4 + 3];
+  }
+  return true;
+}
+
+
+bool EffectVM::LoadStaged(uint8_t slot, uint8_t length, uint8_t fade, uint16_t updateInterval) {
+  return Load(slot, _staging, length, fade, updateInterval);
+}
+
+
+bool EffectVM::Load(uint8_t slot, const EffectInstruction *code, uint8_t length, uint8_t fade, uint16_t updateInterval) {
+
+  if( slot >= EFFECT_PROGRAM_SLOTS || updateInterval == 0 || !Validate(code, length) ){
+    return false;
+  }
+
+  EffectProgram &program = _programs[slot];
+  memcpy( program.code, code, length * sizeof(EffectInstruction) );
+  program.length = length;
+  program.perFrameLength = PerFrameLength(code, length);
+  program.fade = fade;
+  program.updateInterval = updateInterval;
+
+  // a program that fades builds on its last render, so it catches up on ticks like the other trails do.
+  // segments already playing the slot keep the interval they were triggered with
+  AnimationDefinition definition = { &InitProgram, &RenderProgram, updateInterval, fade != 0, RENDER_SHARED_MIRRORED };
+  return LEDStripController::RegisterAnimation( GetAnimation(slot), definition );
+}
+
+
+bool EffectVM::Validate(const EffectInstruction *code, uint8_t length) {
+
+  if( length == 0 || length > EFFECT_MAX_INSTRUCTIONS ){
+    return false;
+  }
+
+  for( uint8_t pc = 0; pc < length; pc++ ){
+    const EffectInstruction &instruction = code[pc];
+    if( instruction.op >= EFFECT_OPCODE_COUNT ){
+      return false;
+    }
+
+    uint8_t registers = _registerOperands[instruction.op];
+    if( ((registers & X_REG) && instruction.x >= EFFECT_REGISTERS) ||
+        ((registers & Y_REG) && instruction.y >= EFFECT_REGISTERS) ||
+        ((registers & Z_REG) && instruction.z >= EFFECT_REGISTERS) ){
+      return false;
+    }
+
+    switch( instruction.op ){
+      case EFFECT_SHR:
+      case EFFECT_SHL:
+        if( instruction.z > 15 ) return false;
+        break;
+      case EFFECT_BEAT8:
+      case EFFECT_BEAT16:
+        if( instruction.z > 1 ) return false;
+        break;
+      case EFFECT_PARAM:
+        if( instruction.y >= EFFECT_PARAM_COUNT ) return false;
+        break;
+      case EFFECT_JZ:
+        if( instruction.y <= pc || instruction.y > length ) return false;
+        break;
+      case EFFECT_JMP:
+        if( instruction.x <= pc || instruction.x > length ) return false;
+        break;
+    }
+  }
+
+  return true;
+}
+
+
+// everything up to the first instruction that depends on the pixel, jumps, or decides the pixel
+uint8_t EffectVM::PerFrameLength(const EffectInstruction *code, uint8_t length) {
+
+  uint8_t pc = 0;
+  while( pc < length ){
+    uint8_t op = code[pc].op;
+    if( op == EFFECT_END || op == EFFECT_INDEX || op == EFFECT_JZ || op == EFFECT_JMP || op >= EFFECT_PALETTE ){
+      break;
+    }
+    pc++;
+  }
+  return pc;
+}
+
+
+// *********************************************************************************
+//      RUNNING
+// *********************************************************************************
+
+void EffectVM::InitProgram(LEDStripController &strip) {
+  strip.InitTimebase();
+}
+
+
+// the animation id says which slot
+void EffectVM::RenderProgram(LEDStripController &strip) {
+
+  uint8_t slot = strip.GetActiveAnimationType() - FIRST_PROGRAM_ANIMATION;
+  if( slot < EFFECT_PROGRAM_SLOTS ){
+    Run( _programs[slot], strip );
+  }
+}
+
+
+// every instruction runs across the block before the next one is decoded, one lane per pixel. a lane that
+// jumps sits the instructions it jumped over out, and one that has its output sits out the rest, so each
+// pixel gets exactly what running the program on it alone would give. validated code can't read or jump
+// out of bounds, and the operands that aren't registers are masked so their rows are never out of range
+#define EFFECT_LANES(statement) \
+  for( uint8_t l = 0; l < lanes; l++ ){ if( block.resumeAt[l] <= pc ){ statement; } }
+
+void EffectVM::RunBlock(const EffectInstruction *code, uint8_t pc, uint8_t end, EffectBlock &block, uint8_t lanes,
+                        uint16_t firstIndex, const EffectContext &context) {
+
+  uint8_t finished = 0;
+
+  for( ; pc < end && finished < lanes; pc++ ){
+    const EffectInstruction &in = code[pc];
+    uint16_t *d = block.r[ in.x & (EFFECT_REGISTERS - 1) ];
+    const uint16_t *a = block.r[ in.y & (EFFECT_REGISTERS - 1) ];
+    const uint16_t *b = block.r[ in.z & (EFFECT_REGISTERS - 1) ];
+
+    switch( in.op ){
+      case EFFECT_LOAD: {
+        uint16_t value = in.y | (in.z << 8);
+        EFFECT_LANES( d[l] = value );
+        break;
+      }
+      case EFFECT_MOV:         EFFECT_LANES( d[l] = a[l] ); break;
+      case EFFECT_ADD:         EFFECT_LANES( d[l] = a[l] + b[l] ); break;
+      case EFFECT_SUB:         EFFECT_LANES( d[l] = a[l] - b[l] ); break;
+      case EFFECT_MUL:         EFFECT_LANES( d[l] = a[l] * b[l] ); break;
+      case EFFECT_DIV:         EFFECT_LANES( d[l] = b[l] ? a[l] / b[l] : 0 ); break;
+      case EFFECT_AND:         EFFECT_LANES( d[l] = a[l] & b[l] ); break;
+      case EFFECT_MIN:         EFFECT_LANES( d[l] = a[l] < b[l] ? a[l] : b[l] ); break;
+      case EFFECT_MAX:         EFFECT_LANES( d[l] = a[l] > b[l] ? a[l] : b[l] ); break;
+      case EFFECT_SHR:         EFFECT_LANES( d[l] = a[l] >> in.z ); break;
+      case EFFECT_SHL:         EFFECT_LANES( d[l] = a[l] << in.z ); break;
+      case EFFECT_QADD8:       EFFECT_LANES( d[l] = qadd8( a[l], b[l] ) ); break;
+      case EFFECT_QSUB8:       EFFECT_LANES( d[l] = qsub8( a[l], b[l] ) ); break;
+      case EFFECT_SCALE8:      EFFECT_LANES( d[l] = scale8( a[l], b[l] ) ); break;
+      case EFFECT_SCALE16:     EFFECT_LANES( d[l] = scale16( a[l], b[l] ) ); break;
+      case EFFECT_SIN8:        EFFECT_LANES( d[l] = sin8( a[l] ) ); break;
+      case EFFECT_SIN16:       EFFECT_LANES( d[l] = sin16( a[l] ) + 32768 ); break;
+      case EFFECT_NOISE:       EFFECT_LANES( d[l] = inoise8( a[l], b[l] ) ); break;
+      case EFFECT_BEAT8:       EFFECT_LANES( d[l] = beat8( a[l], in.z ? 0 : context.timebase ) ); break;
+      case EFFECT_BEAT16:      EFFECT_LANES( d[l] = beat16( a[l], in.z ? 0 : context.timebase ) ); break;
+      case EFFECT_LT:          EFFECT_LANES( d[l] = a[l] < b[l] ); break;
+      case EFFECT_EQ:          EFFECT_LANES( d[l] = a[l] == b[l] ); break;
+      case EFFECT_JZ:          EFFECT_LANES( if( !d[l] ) block.resumeAt[l] = in.y ); break;
+      case EFFECT_JMP:         EFFECT_LANES( block.resumeAt[l] = in.x ); break;
+      case EFFECT_PARAM:       EFFECT_LANES( d[l] = context.params[in.y] ); break;
+      case EFFECT_TIME:        EFFECT_LANES( d[l] = context.time ); break;
+      case EFFECT_TICKS:       EFFECT_LANES( d[l] = context.ticks ); break;
+      case EFFECT_LENGTH:      EFFECT_LANES( d[l] = context.length ); break;
+      case EFFECT_INDEX:       EFFECT_LANES( d[l] = firstIndex + l ); break;
+
+      // EFFECT_END and the outputs. the lane's done
+      default:
+        EFFECT_LANES(
+          block.output[l] = in.op;
+          block.values[0][l] = d[l];
+          block.values[1][l] = a[l];
+          block.values[2][l] = b[l];
+          block.resumeAt[l] = 0xFF;
+          finished++
+        );
+        break;
+    }
+  }
+}
+
+#undef EFFECT_LANES
+
+
+void EffectVM::Run(const EffectProgram &program, LEDStripController &strip) {
+
+  if( program.fade ){
+    strip.FadeStrip( program.fade );
+  }
+
+  EffectContext context;
+  context.timebase = strip.GetTimebase();
+  context.time = FrameClock::GetAnimationMillis() - context.timebase;
+  context.ticks = (uint32_t)(FrameClock::GetAnimationMillis() - context.timebase) / program.updateInterval;
+  context.length = strip.GetStripLength();
+  context.params[EFFECT_PARAM_HUE] = strip.GetHue();
+  context.params[EFFECT_PARAM_BRIGHTNESS] = strip.GetBrightness();
+  context.params[EFFECT_PARAM_BPM] = strip.GetBPM();
+  context.params[EFFECT_PARAM_BRIGHTNESS_HIGH] = strip.GetBrightnessHigh();
+  context.params[EFFECT_PARAM_BRIGHTNESS_LOW] = strip.GetBrightnessLow();
+  context.params[EFFECT_PARAM_HUE_INDEX_BPM] = strip.GetHueIndexBPM();
+
+  // the part that's the same for every pixel, once, in lane 0
+  EffectBlock block;
+  for( uint8_t reg = 0; reg < EFFECT_REGISTERS; reg++ ){
+    block.r[reg][0] = 0;
+  }
+  block.resumeAt[0] = 0;
+  RunBlock( program.code, 0, program.perFrameLength, block, 1, 0, context );
+
+  uint16_t frameRegisters[EFFECT_REGISTERS];
+  for( uint8_t reg = 0; reg < EFFECT_REGISTERS; reg++ ){
+    frameRegisters[reg] = block.r[reg][0];
+  }
+
+  uint16_t length = context.length;
+  bool inverted = strip.IsInverted();
+
+  for( uint16_t first = 0; first < length; first += EFFECT_BLOCK_PIXELS ){
+    uint8_t lanes = length - first < EFFECT_BLOCK_PIXELS ? length - first : EFFECT_BLOCK_PIXELS;
+
+    // every pixel starts where the once per render part left the registers
+    for( uint8_t reg = 0; reg < EFFECT_REGISTERS; reg++ ){
+      for( uint8_t l = 0; l < lanes; l++ ){
+        block.r[reg][l] = frameRegisters[reg];
+      }
+    }
+    memset( block.resumeAt, 0, lanes );
+    memset( block.output, EFFECT_END, lanes );
+
+    RunBlock( program.code, program.perFrameLength, program.length, block, lanes, first, context );
+
+    for( uint8_t l = 0; l < lanes; l++ ){
+      uint16_t pos = inverted ? length - 1 - (first + l) : first + l;
+
+      CRGB color;
+      switch( block.output[l] ){
+        case EFFECT_PALETTE:
+          color = strip.PaletteColor( block.values[0][l], block.values[1][l] );
+          break;
+        case EFFECT_PALETTE_ADD:
+          color = strip.PaletteColor( block.values[0][l], block.values[1][l] );
+          if( color.r | color.g | color.b ){
+            strip.AddPixelColor( pos, color );
+          }
+          continue;
+        case EFFECT_HSV:
+          color = CHSV( block.values[0][l], block.values[1][l], block.values[2][l] );
+          break;
+        case EFFECT_RGB:
+          color = CRGB( block.values[0][l], block.values[1][l], block.values[2][l] );
+          break;
+        default:
+          continue;
+      }
+
+      // most pixels of a slow program are what they were last render, and those aren't a change
+      if( strip.GetPixel(pos) != color ){
+        strip.SetPixelColor( pos, color );
+      }
+    }
+  }
+}
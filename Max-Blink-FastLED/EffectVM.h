@@ -0,0 +1,199 @@
+/*
+  EffectVM.h  - Animations uploaded over serial as small programs, run once per pixel per render
+              -- a program is up to EFFECT_MAX_INSTRUCTIONS four byte instructions: an opcode and three
+                 operands, each a register (r0 - r7, 16 bits, wrapping) or a small number, see below
+              -- every pixel runs the program from the top with the registers at 0, and the first output
+                 instruction (or the end) decides the pixel. jumps only go forward, so a program always ends
+              -- the instructions before the first EFFECT_INDEX, jump or output can't differ from pixel to
+                 pixel, so they run once per render and every pixel starts from their registers. put the
+                 beat, time and parameter work first and the per pixel work is a handful of instructions
+              -- the rest runs EFFECT_BLOCK_PIXELS pixels at a time, each instruction decoded once for the
+                 whole block rather than once a pixel
+              -- programs load into EFFECT_PROGRAM_SLOTS slots. slot n plays as animation id
+                 EffectVM::GetAnimation(n), the last custom ids, so SERIAL_OP_TRIGGER and SERIAL_OP_PRESET
+                 start it like any other animation. SERIAL_OP_PROGRAM_CODE and SERIAL_OP_PROGRAM_LOAD
+                 upload one (see SerialProtocol.h)
+              -- there's nothing random, and the pixel index counts from the segment's first pixel (its
+                 last, inverted), so segments running the same program share one render (see RenderGroups.h)
+              -- host/bench/AnimationBench.cpp has PALETTE and SINELON written as programs, and times them
+                 against the built-in ones
+
+  INSTRUCTIONS (d is the register written, a b c registers read, n t m k numbers)
+
+    EFFECT_END                       the pixel keeps what it has (as does running off the end)
+    EFFECT_LOAD        d, lo, hi     d = hi << 8 | lo
+    EFFECT_MOV         d, a
+    EFFECT_ADD         d, a, b       EFFECT_SUB, EFFECT_MUL, EFFECT_AND, EFFECT_MIN, EFFECT_MAX alike
+    EFFECT_DIV         d, a, b       0 if b is 0
+    EFFECT_SHR         d, a, n       n 0 - 15. EFFECT_SHL alike
+    EFFECT_QADD8       d, a, b       the low bytes, saturating at 255. EFFECT_QSUB8 at 0
+    EFFECT_SCALE8      d, a, b       scale8(a, b)
+    EFFECT_SCALE16     d, a, b       scale16(a, b), 0 - 65535 onto 0 - b
+    EFFECT_SIN8        d, a          sin8(a)
+    EFFECT_SIN16       d, a          sin16(a) + 32768, so 0 - 65535
+    EFFECT_NOISE       d, a, b       inoise8(a, b)
+    EFFECT_BEAT8       d, a, m       beat8() at a bpm. m 0 counts from the trigger, 1 runs free (like PALETTE)
+    EFFECT_BEAT16      d, a, m       beat16() alike
+    EFFECT_LT          d, a, b       1 if a < b, else 0. EFFECT_EQ alike
+    EFFECT_JZ          a, t          on to instruction t if a is 0. t has to be after this one
+    EFFECT_JMP         t
+    EFFECT_PARAM       d, k          one of the segment's EffectParam values
+    EFFECT_TIME        d             ms since the trigger
+    EFFECT_TICKS       d             renders since the trigger (the time over the program's interval)
+    EFFECT_LENGTH      d             the segment's pixels
+    EFFECT_INDEX       d             this pixel
+    EFFECT_PALETTE     a, b          the pixel is the palette's color a at brightness b
+    EFFECT_PALETTE_ADD a, b          that color is added to the pixel (for trails, with a fade)
+    EFFECT_HSV         a, b, c       the pixel is CHSV(a, b, c)
+    EFFECT_RGB         a, b, c       the pixel is CRGB(a, b, c)
+*/
+
+#ifndef EffectVM_h
+#define EffectVM_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include "LEDStripController.h"
+
+#define EFFECT_REGISTERS 8       // a power of two
+#define EFFECT_MAX_INSTRUCTIONS 32
+
+// pixels a render runs through the program together. the block is on the stack, about 25 bytes a pixel
+#define EFFECT_BLOCK_PIXELS 32
+
+#ifndef EFFECT_PROGRAM_SLOTS
+  #define EFFECT_PROGRAM_SLOTS 4
+#endif
+
+static_assert(EFFECT_PROGRAM_SLOTS <= MAX_CUSTOM_ANIMATIONS, "every program slot needs a custom animation id");
+
+
+enum EffectOpcode : uint8_t {
+  EFFECT_END,
+  EFFECT_LOAD,
+  EFFECT_MOV,
+  EFFECT_ADD,
+  EFFECT_SUB,
+  EFFECT_MUL,
+  EFFECT_DIV,
+  EFFECT_AND,
+  EFFECT_MIN,
+  EFFECT_MAX,
+  EFFECT_SHR,
+  EFFECT_SHL,
+  EFFECT_QADD8,
+  EFFECT_QSUB8,
+  EFFECT_SCALE8,
+  EFFECT_SCALE16,
+  EFFECT_SIN8,
+  EFFECT_SIN16,
+  EFFECT_NOISE,
+  EFFECT_BEAT8,
+  EFFECT_BEAT16,
+  EFFECT_LT,
+  EFFECT_EQ,
+  EFFECT_JZ,
+  EFFECT_JMP,
+  EFFECT_PARAM,
+  EFFECT_TIME,
+  EFFECT_TICKS,
+  EFFECT_LENGTH,
+  EFFECT_INDEX,
+  EFFECT_PALETTE,
+  EFFECT_PALETTE_ADD,
+  EFFECT_HSV,
+  EFFECT_RGB,
+  EFFECT_OPCODE_COUNT
+};
+
+// what EFFECT_PARAM reads, as set by SERIAL_OP_PARAMS and SERIAL_OP_HUE_INDEX_BPM
+enum EffectParam : uint8_t {
+  EFFECT_PARAM_HUE,
+  EFFECT_PARAM_BRIGHTNESS,
+  EFFECT_PARAM_BPM,               // scaled with the tracked tempo, like the built-in animations' bpm
+  EFFECT_PARAM_BRIGHTNESS_HIGH,
+  EFFECT_PARAM_BRIGHTNESS_LOW,
+  EFFECT_PARAM_HUE_INDEX_BPM,
+  EFFECT_PARAM_COUNT
+};
+
+struct EffectInstruction {
+  uint8_t op;
+  uint8_t x;
+  uint8_t y;
+  uint8_t z;
+};
+
+// everything a render reads from the segment and the clock, looked up once rather than per pixel
+struct EffectContext {
+  uint32_t timebase;
+  uint16_t time;
+  uint16_t ticks;
+  uint16_t length;
+  uint16_t params[EFFECT_PARAM_COUNT];
+};
+
+// a block of pixels part way through the program, a lane each
+struct EffectBlock {
+  uint16_t r[EFFECT_REGISTERS][EFFECT_BLOCK_PIXELS];
+  uint8_t resumeAt[EFFECT_BLOCK_PIXELS];        // the lane sits out instructions before this, 0xFF once it's done
+  uint8_t output[EFFECT_BLOCK_PIXELS];          // the output instruction it ended on, EFFECT_END to keep the pixel
+  uint16_t values[3][EFFECT_BLOCK_PIXELS];      // that instruction's operands
+};
+
+struct EffectProgram {
+  EffectInstruction code[EFFECT_MAX_INSTRUCTIONS];
+  uint8_t length;            // instructions, 0 for an empty slot
+  uint8_t perFrameLength;    // the leading instructions that run once per render
+  uint8_t fade;              // fadeToBlackBy() before every render, 0 draws every pixel fresh
+  uint16_t updateInterval;   // ms between renders
+};
+
+
+// ******************************************************************
+//            EffectVM class definitions
+// ******************************************************************
+class EffectVM
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    // copy instructions into the upload buffer, from instruction index on. false if they'd run past the end
+    static bool StageCode(uint8_t index, const uint8_t *bytes, uint8_t instructionCount);
+
+    // check the first length staged instructions and put them in slot, replacing what was there (segments
+    // playing it switch over on their next render). false, and the slot is untouched, if they don't check out
+    static bool LoadStaged(uint8_t slot, uint8_t length, uint8_t fade, uint16_t updateInterval);
+    static bool Load(uint8_t slot, const EffectInstruction *code, uint8_t length, uint8_t fade, uint16_t updateInterval);
+
+    static constexpr AnimationType GetAnimation(uint8_t slot) { return (AnimationType)(FIRST_PROGRAM_ANIMATION + slot); }
+    static bool IsLoaded(uint8_t slot) { return slot < EFFECT_PROGRAM_SLOTS && _programs[slot].length; }
+
+    // true if every instruction is one we know, reads and writes registers we have, and jumps forwards
+    static bool Validate(const EffectInstruction *code, uint8_t length);
+
+    static const uint8_t FIRST_PROGRAM_ANIMATION = FIRST_CUSTOM_ANIMATION + MAX_CUSTOM_ANIMATIONS - EFFECT_PROGRAM_SLOTS;
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    static EffectProgram _programs[EFFECT_PROGRAM_SLOTS];
+    static EffectInstruction _staging[EFFECT_MAX_INSTRUCTIONS];
+
+    // which operands are registers, one bit each for x, y and z, per opcode
+    static const uint8_t _registerOperands[EFFECT_OPCODE_COUNT];
+
+    // the AnimationFunctions every program slot is registered with
+    static void InitProgram(LEDStripController &strip);
+    static void RenderProgram(LEDStripController &strip);
+
+    static uint8_t PerFrameLength(const EffectInstruction *code, uint8_t length);
+    static void Run(const EffectProgram &program, LEDStripController &strip);
+    static void RunBlock(const EffectInstruction *code, uint8_t pc, uint8_t end, EffectBlock &block, uint8_t lanes,
+                         uint16_t firstIndex, const EffectContext &context);
+};
+
+
+
+#endif
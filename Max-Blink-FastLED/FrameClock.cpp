@@ -0,0 +1,104 @@
+/*
+  FrameClock.cpp   - One clock for the whole sketch: decides when a frame is due and what time it is
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "FrameClock.h"
+
+
+uint32_t FrameClock::_animationMillis = 0;
+
+
+// *********************************************************************************
+//      CONSTRUCTOR
+// *********************************************************************************
+
+FrameClock::FrameClock(uint32_t frameIntervalMicros)
+{
+  _frameIntervalMicros = frameIntervalMicros;
+}
+
+
+void FrameClock::Start(uint32_t nowMicros, uint32_t nowMillis) {
+
+  _nextFrameMicros = nowMicros;
+  _frameMillis = nowMillis;
+  _microsRemainder = 0;
+  _frameNumber = 0;
+  _animationMillis = nowMillis;
+
+  ResetStats();
+}
+
+
+void FrameClock::ResetStats() {
+
+  _lateFrameCount = 0;
+  _missedFrameCount = 0;
+  _maxLatenessMicros = 0;
+  _totalLatenessMicros = 0;
+}
+
+
+// *********************************************************************************
+//      FRAME TIMING
+// *********************************************************************************
+
+bool FrameClock::Poll(uint32_t nowMicros, FrameTime &frame) {
+
+  // not due yet. a signed difference stays correct across micros() rollover
+  if( (int32_t)(nowMicros - _nextFrameMicros) < 0 ){
+    return false;
+  }
+
+  // if we're more than a whole frame late, skip the frames we can no longer show on
+  // time rather than rendering a burst of them back to back
+  uint32_t lateness = nowMicros - _nextFrameMicros;
+  uint32_t missed = lateness / _frameIntervalMicros;
+  uint32_t scheduledMicros = _nextFrameMicros + missed * _frameIntervalMicros;
+  lateness -= missed * _frameIntervalMicros;
+
+  // how far the grid moved since the last frame we rendered
+  uint32_t delta = _frameNumber ? (missed + 1) * _frameIntervalMicros : 0;
+
+  // carry sub-millisecond remainders so frame millis never drift from the micros grid
+  _microsRemainder += delta;
+  _frameMillis += _microsRemainder / 1000;
+  _microsRemainder %= 1000;
+
+  frame.frameNumber = _frameNumber;
+  frame.micros = scheduledMicros;
+  frame.millis = _frameMillis;
+  frame.deltaMicros = delta;
+  frame.latenessMicros = lateness;
+  frame.missedFrames = missed > 0xFFFF ? 0xFFFF : (uint16_t)missed;
+
+  // the next deadline is on the grid, not "now + interval", so we never drift
+  _nextFrameMicros = scheduledMicros + _frameIntervalMicros;
+  _frameNumber++;
+
+  _missedFrameCount += missed;
+  _totalLatenessMicros += lateness;
+  if( lateness > _maxLatenessMicros ){
+    _maxLatenessMicros = lateness;
+  }
+  if( lateness > LATE_FRAME_THRESHOLD_MICROS ){
+    _lateFrameCount++;
+  }
+
+  _animationMillis = _frameMillis;
+
+  return true;
+}
+
+
+// *********************************************************************************
+//      FASTLED TIME SOURCE
+// *********************************************************************************
+
+uint32_t get_millisecond_timer() {
+  return FrameClock::GetAnimationMillis();
+}
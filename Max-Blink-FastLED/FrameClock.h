@@ -0,0 +1,90 @@
+/*
+  FrameClock.h  - One clock for the whole sketch: decides when a frame is due and what time it is
+                -- frames fall on a fixed microsecond grid; a late frame doesn't push later ones back
+                -- every comparison is a signed difference so micros()/millis() rollover is harmless
+                -- also provides the time FastLED's beat functions (beatsin8 etc.) see, so every
+                   segment rendered during a frame uses exactly the same timestamp
+*/
+
+#ifndef FrameClock_h
+#define FrameClock_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+// route FastLED's GET_MILLIS through get_millisecond_timer() below.
+// this header has to be included before FastLED.h for that to take effect
+#define USE_GET_MILLISECOND_TIMER
+#include <FastLED.h>
+#include "GlobalVariables.h"
+
+// the frame grid in microseconds
+#define FRAME_INTERVAL_MICROS (1000000UL / FRAMES_PER_SECOND)
+
+// a frame that starts more than this many microseconds after its deadline counts as late
+#define LATE_FRAME_THRESHOLD_MICROS 1000
+
+
+// everything a controller needs to know about the frame being rendered
+struct FrameTime {
+  uint32_t frameNumber;       // frames rendered since Start()
+  uint32_t micros;            // the scheduled (not actual) time of this frame
+  uint32_t millis;            // the same moment in milliseconds, continuous with millis()
+  uint32_t deltaMicros;       // scheduled time since the previous rendered frame
+  uint32_t latenessMicros;    // how long after its scheduled time the frame actually started
+  uint16_t missedFrames;      // whole frames skipped since the previous one because we were too late
+};
+
+
+// ******************************************************************
+//            FrameClock class definitions
+// ******************************************************************
+class FrameClock
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    FrameClock(uint32_t frameIntervalMicros = FRAME_INTERVAL_MICROS);
+
+    // begin the grid at the given moment. the first frame is due immediately
+    void Start(uint32_t nowMicros, uint32_t nowMillis);
+
+    // returns true and fills in frame when the next frame is due
+    bool Poll(uint32_t nowMicros, FrameTime &frame);
+
+    uint32_t GetFrameIntervalMicros() const { return _frameIntervalMicros; }
+    uint32_t GetFrameCount() const { return _frameNumber; }
+    uint32_t GetLateFrameCount() const { return _lateFrameCount; }
+    uint32_t GetMissedFrameCount() const { return _missedFrameCount; }
+    uint32_t GetMaxLatenessMicros() const { return _maxLatenessMicros; }
+    uint32_t GetMeanLatenessMicros() const { return _frameNumber ? (uint32_t)(_totalLatenessMicros / _frameNumber) : 0; }
+    void ResetStats();
+
+    // the time beat functions see. Poll() sets it to each frame's time, controllers
+    // move it to the time of each catch-up tick they render inside a frame
+    static void SetAnimationMillis(uint32_t animationMillis) { _animationMillis = animationMillis; }
+    static uint32_t GetAnimationMillis() { return _animationMillis; }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    uint32_t _frameIntervalMicros;
+    uint32_t _nextFrameMicros = 0;     // deadline of the next frame on the grid
+    uint32_t _frameMillis = 0;         // millis of the last frame
+    uint32_t _microsRemainder = 0;     // sub-millisecond part carried between frames
+    uint32_t _frameNumber = 0;
+
+    uint32_t _lateFrameCount = 0;
+    uint32_t _missedFrameCount = 0;
+    uint32_t _maxLatenessMicros = 0;
+    uint64_t _totalLatenessMicros = 0;
+
+    static uint32_t _animationMillis;
+};
+
+
+// FastLED calls this instead of millis() (see USE_GET_MILLISECOND_TIMER above)
+uint32_t get_millisecond_timer();
+
+
+#endif
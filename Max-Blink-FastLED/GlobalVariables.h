@@ -13,7 +13,7 @@
   const int BRIGHTNESS_FULL = 255;
   const int SATURATION_FULL = 255;
   const int WHITE_COLOR = 255;   
-  const uint16_t GLOBAL_BPM = 85;
+  const uint16_t GLOBAL_BPM = 85;         // the tempo until BeatTracker has found the music's
 
 
   // ******************************************************************************************
@@ -82,6 +82,11 @@
     const int CPIN = 22;     //pin number for StationC LED strip
     const int CLEN = 80;    //pixel count for StationC LED strip
 
+    // uncomment to send all three strips at once instead of one after another (a third of the show time).
+    // FastLED's parallel output uses the pins of port D, so StationA, B and C move to pins 2, 14 and 7
+    // and APIN/BPIN/CPIN above are ignored
+    // #define PARALLEL_OUTPUT
+
   #endif
 
 
@@ -95,6 +100,110 @@
   #endif
 
 
+  // *******  Palette cache ******* 
+  // expands palettes into 256 entry color tables (768 bytes of RAM each, PALETTE_REGISTRY_TABLES of them
+  // in PaletteRegistry.h) so palette animations do a lookup instead of a blend per pixel. the UNO doesn't
+  // have the RAM for it
+  #if !defined(__TURNERS_TESTING_UNO__)
+    #define PALETTE_CACHE_ENABLED
+  #endif
+
+
+  // *******  Power budget *******
+  // what each power supply can deliver to its strips, in mA (see PowerLimiter.h). the strips on a supply
+  // are dimmed together to stay under it. SERIAL_OP_POWER_BUDGET changes it while running, 0 doesn't limit
+  #ifndef POWER_SUPPLY_MILLIAMPS
+    #define POWER_SUPPLY_MILLIAMPS 8000
+  #endif
+
+
+  // *******  Pixel stream *******
+  // lets a PC send frames of pixels to show instead of the animations (see PixelStream.h). needs a
+  // second copy of every strip's pixels, which the UNO doesn't have the RAM for
+  #if !defined(__TURNERS_TESTING_UNO__)
+    #define PIXEL_STREAM_ENABLED
+  #endif
+
+
+  // *******  Telemetry *******
+  // profiling counters for every render, show and frame, asked for with SERIAL_OP_TELEMETRY (see
+  // Telemetry.h). about 1K of RAM, which the UNO doesn't have to spare
+  #if !defined(__TURNERS_TESTING_UNO__)
+    #define TELEMETRY_ENABLED
+  #endif
+
+
+  // *******  Effect programs *******
+  // animations uploaded over serial as bytecode and run per pixel (see EffectVM.h). about 700 bytes of
+  // RAM for the slots and the upload buffer, which the UNO doesn't have to spare
+  #if !defined(__TURNERS_TESTING_UNO__)
+    #define EFFECT_PROGRAMS_ENABLED
+  #endif
+
+
+  // *******  Spatial effects *******
+  // animations drawn from where each pixel is on the sculpture (see SpatialEffects.h). the pixel map is
+  // 6 bytes a pixel of constants, which the UNO would have to hold in RAM
+  #if !defined(__TURNERS_TESTING_UNO__)
+    #define SPATIAL_EFFECTS_ENABLED
+  #endif
+
+
+  // *******  Command queue *******
+  // commands held for the frame they're meant for (see CommandQueue.h). a queued command is about 64
+  // bytes, so the UNO keeps only a few
+  #ifndef COMMAND_QUEUE_SIZE
+    #if defined(__TURNERS_TESTING_UNO__)
+      #define COMMAND_QUEUE_SIZE 4
+    #else
+      #define COMMAND_QUEUE_SIZE 16
+    #endif
+  #endif
+
+
+  // *******  Preset edit slots *******
+  // keys Max can retune or add without reflashing (see Presets.h). a preset is 16 bytes of RAM, 14 of
+  // EEPROM. the UNO has room for a few
+  #ifndef PRESET_EDIT_SLOTS
+    #if defined(__TURNERS_TESTING_UNO__)
+      #define PRESET_EDIT_SLOTS 4
+    #else
+      #define PRESET_EDIT_SLOTS 16
+    #endif
+  #endif
+
+
+  // *******  Log level *******
+  // what LOG_ERROR/LOG_INFO/LOG_DEBUG lines are compiled in (see SerialLog.h). the testing setups say what
+  // they're doing; the show build says nothing, so the only thing Max reads back is its "K"s
+  #define LOG_LEVEL_NONE 0
+  #define LOG_LEVEL_ERROR 1
+  #define LOG_LEVEL_INFO 2
+  #define LOG_LEVEL_DEBUG 3
+  #ifndef LOG_LEVEL
+    #if defined(__TURNERS_TESTING_UNO__) || defined(__TURNERS_TESTING_TEENSY__)
+      #define LOG_LEVEL LOG_LEVEL_DEBUG
+    #else
+      #define LOG_LEVEL LOG_LEVEL_NONE
+    #endif
+  #endif
+
+
+  // *******  Session capture *******
+  // records everything Max sends (see SessionCapture.h) so a show that looked wrong can be replayed
+  // exactly. SERIAL_OP_DUMP_SESSION sends it back. a beat costs about 6 bytes, so 16K holds a long set
+  #if !defined(__TURNERS_TESTING_UNO__)
+    #define SESSION_CAPTURE_BYTES 16384
+  #endif
+
+  // uncomment to play back the capture in ReplayCapture.h (written by the host's replay_session tool)
+  // instead of listening to Max. the hash of every frame is printed when it ends
+  // #define REPLAY_CAPTURE
+
+  // with REPLAY_CAPTURE, render the frames back to back instead of on the frame clock and print frames/sec
+  // #define REPLAY_UNPACED
+
+
   // *******  Helper macro for calculating the length of an array ******* 
   // creates a macro that computes the length of an array (number of elements)
   // assuming all of the elements are the same size as the element in position 0
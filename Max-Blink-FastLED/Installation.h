@@ -0,0 +1,112 @@
+/*
+  Installation.h  - The sculpture this sketch drives: its strips, and the segments they're cut into
+                  -- a new sculpture (or a change to this one) is an edit to these tables and nothing else.
+                     the controllers, the pixel buffer, the power limiter's and pixel stream's strip lists
+                     and the tag group masks all come from them (see Topology.h)
+                  -- segments are numbered in table order, which is the bit they answer to in a group mask
+                     sent by Max, so keep the order the Max patch expects
+                  -- INSTALLATION_GEOMETRY says where each segment is in the room, for the spatial effects
+                     (see PixelMap.h). one row per segment, in the same order
+                  -- APIN/ALEN and the rest of the hardware are still in GlobalVariables.h
+*/
+
+#ifndef Installation_h
+#define Installation_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include "Topology.h"
+#include "PixelMap.h"
+
+// what a segment is part of. triggering a tag reaches every segment that carries it
+enum SegmentTag : uint8_t {
+  TAG_SIDE_TRIANGLE = 1 << 0,
+  TAG_TOP_TRIANGLE  = 1 << 1,
+};
+
+
+#if defined(__TURNERS_TESTING_UNO__) || defined(__TURNERS_TESTING_TEENSY__)
+  // Simple non-segmented version for testing
+  constexpr StripLayout INSTALLATION_STRIPS[] = {
+    // length  supply
+    {  ALEN,   0 },
+  };
+
+  constexpr SegmentLayout INSTALLATION_SEGMENTS[] = {
+    // strip  start  length  orientation     tags
+    {  0,     0,     ALEN,   !INVERT_STRIP,  TAG_SIDE_TRIANGLE | TAG_TOP_TRIANGLE },
+  };
+
+  // straight up a pole, about 3cm a pixel, with the apex at the top
+  constexpr SegmentGeometry INSTALLATION_GEOMETRY[] = {
+    // first pixel (x, y, z cm)    last pixel
+    { {  0,  0,  0 },              {  0,  0,  3 * (ALEN - 1) } },
+  };
+
+  constexpr PixelPoint INSTALLATION_APEX = { 0, 0, 3 * (ALEN - 1) };
+
+#else
+  // Segmented version for production: three strips, each two side triangles either side of the big top one
+  constexpr StripLayout INSTALLATION_STRIPS[] = {
+    // length  supply
+    {  ALEN,   0 },    // StationA
+    {  BLEN,   0 },    // StationB
+    {  CLEN,   0 },    // StationC
+  };
+
+  constexpr SegmentLayout INSTALLATION_SEGMENTS[] = {
+    // strip  start  length  orientation     tags
+    {  0,     0,     24,     !INVERT_STRIP,  TAG_SIDE_TRIANGLE },   // right side triangle
+    {  0,     24,    16,     !INVERT_STRIP,  TAG_TOP_TRIANGLE  },   // top big triangle
+    {  0,     40,    16,     INVERT_STRIP,   TAG_TOP_TRIANGLE  },   // top big triangle (inverted)
+    {  0,     56,    24,     INVERT_STRIP,   TAG_SIDE_TRIANGLE },   // left side triangle (inverted)
+
+    {  1,     0,     24,     !INVERT_STRIP,  TAG_SIDE_TRIANGLE },   // right side triangle
+    {  1,     24,    16,     !INVERT_STRIP,  TAG_TOP_TRIANGLE  },   // top big triangle
+    {  1,     40,    16,     INVERT_STRIP,   TAG_TOP_TRIANGLE  },   // top big triangle (inverted)
+    {  1,     56,    24,     INVERT_STRIP,   TAG_SIDE_TRIANGLE },   // left side triangle (inverted)
+
+    {  2,     0,     24,     !INVERT_STRIP,  TAG_SIDE_TRIANGLE },   // right side triangle
+    {  2,     24,    16,     !INVERT_STRIP,  TAG_TOP_TRIANGLE  },   // top big triangle
+    {  2,     40,    16,     INVERT_STRIP,   TAG_TOP_TRIANGLE  },   // top big triangle (inverted)
+    {  2,     56,    24,     INVERT_STRIP,   TAG_SIDE_TRIANGLE },   // left side triangle (inverted)
+  };
+
+  // the stations stand a third of a turn apart, 1m out from the middle and facing it: StationA on +y,
+  // B and C counterclockwise from it. each strip runs up the right side triangle, over the top of the
+  // big one and down the left side. the tops are 130cm up, and the apex is above the middle at that
+  // height. worked out from the floor plan rather than measured, so check them against the sculpture
+  constexpr SegmentGeometry INSTALLATION_GEOMETRY[] = {
+    // first pixel (x, y, z cm)    last pixel
+    { {  -45,  100,    0 },        {  -20,  100,   76 } },   // StationA right side triangle
+    { {  -18,  100,   80 },        {   -1,  100,  130 } },   // top big triangle
+    { {    1,  100,  130 },        {   18,  100,   80 } },   // top big triangle (inverted)
+    { {   20,  100,   76 },        {   45,  100,    0 } },   // left side triangle (inverted)
+
+    { {  -64,  -89,    0 },        {  -77,  -67,   76 } },   // StationB
+    { {  -78,  -66,   80 },        {  -86,  -51,  130 } },
+    { {  -87,  -49,  130 },        {  -96,  -34,   80 } },
+    { {  -97,  -33,   76 },        { -109,  -11,    0 } },
+
+    { {  109,  -11,    0 },        {   97,  -33,   76 } },   // StationC
+    { {   96,  -34,   80 },        {   87,  -49,  130 } },
+    { {   86,  -51,  130 },        {   78,  -66,   80 } },
+    { {   77,  -67,   76 },        {   64,  -89,    0 } },
+  };
+
+  constexpr PixelPoint INSTALLATION_APEX = { 0, 0, 130 };
+#endif
+
+static_assert(ARRAY_SIZE(INSTALLATION_GEOMETRY) == ARRAY_SIZE(INSTALLATION_SEGMENTS), "every segment needs a row in INSTALLATION_GEOMETRY");
+
+
+typedef Topology< INSTALLATION_STRIPS, ARRAY_SIZE(INSTALLATION_STRIPS),
+                  INSTALLATION_SEGMENTS, ARRAY_SIZE(INSTALLATION_SEGMENTS) > InstallationTopology;
+
+typedef PixelMap< INSTALLATION_SEGMENTS, ARRAY_SIZE(INSTALLATION_SEGMENTS),
+                  INSTALLATION_GEOMETRY, &INSTALLATION_APEX > InstallationPixelMap;
+
+
+
+#endif
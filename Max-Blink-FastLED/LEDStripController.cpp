@@ -9,6 +9,36 @@
 #include "LEDStripController.h"
 
 
+// *********************************************************************************
+//      ANIMATION TABLE
+//        One entry per AnimationType, in enum order. To add a built-in animation add its
+//        name to the enum, its method to the header and its row here. Animations that
+//        live outside this class can be added with RegisterAnimation() instead.
+//        Combinations like PALETTE_W_GLITTER are a base render plus a layer from init
+//        (see Compositing.h), and any other combination can be set up with SetLayer()
+// *********************************************************************************
+
+const AnimationDefinition LEDStripController::_builtinAnimations[] = {
+  //  init                                        render                                                        interval                     every tick  sharing
+  { nullptr,                                      &Invoke<&LEDStripController::AllOff>,                         DEFAULT_UPDATE_INTERVAL,     true,  RENDER_SHARED_MIRRORED   },   // ALL_OFF
+  { nullptr,                                      &Invoke<&LEDStripController::SolidColor>,                     DEFAULT_UPDATE_INTERVAL,     false, RENDER_SHARED_MIRRORED   },   // SOLID_COLOR
+  { &Invoke<&LEDStripController::InitOneShot>,    &Invoke<&LEDStripController::FadeOutBPM>,                     FADE_UPDATE_INTERVAL,        false, RENDER_SHARED_MIRRORED   },   // FADE_OUT_BPM
+  { &Invoke<&LEDStripController::InitOneShot>,    &Invoke<&LEDStripController::FadeLowBPM>,                     FADE_UPDATE_INTERVAL,        false, RENDER_SHARED_MIRRORED   },   // FADE_LOW_BPM
+  { &Invoke<&LEDStripController::InitTimebase>,   &Invoke<&LEDStripController::FadeInOutBPM>,                   FADE_UPDATE_INTERVAL,        false, RENDER_SHARED_MIRRORED   },   // FADE_IN_OUT_BPM
+  { nullptr,                                      &Invoke<&LEDStripController::Palette>,                        PALETTE_UPDATE_INTERVAL,     false, RENDER_SHARED            },   // PALETTE
+  { &Invoke<&LEDStripController::InitGlitter>,    &Invoke<&LEDStripController::Palette>,                        PALETTE_UPDATE_INTERVAL,     false, RENDER_SHARED            },   // PALETTE_W_GLITTER
+  { &Invoke<&LEDStripController::InitOneShot>,    &Invoke<&LEDStripController::PaletteFadeLowBPM>,              PALETTE_UPDATE_INTERVAL,     false, RENDER_SHARED            },   // PALETTE_FADE_LOW_BPM
+  { &Invoke<&LEDStripController::InitGlitterFadeLowBPM>,  &Invoke<&LEDStripController::PaletteFadeLowBPM>,  PALETTE_UPDATE_INTERVAL,     false, RENDER_SHARED            },   // PALETTE_W_GLITTER_FADE_LOW_BPM
+  { nullptr,                                      &Invoke<&LEDStripController::Confetti>,                       CONFETTI_UPDATE_INTERVAL,    true,  RENDER_UNIQUE            },   // CONFETTI
+  { &Invoke<&LEDStripController::InitTimebase>,   &Invoke<&LEDStripController::Sinelon>,                        SINELON_UPDATE_INTERVAL,     true,  RENDER_SHARED_MIRRORED   },   // SINELON
+  { &Invoke<&LEDStripController::InitSinepulse>,  &Invoke<&LEDStripController::Sinepulse>,                      SINEPULSE_UPDATE_INTERVAL,   true,  RENDER_SHARED_MIRRORED   },   // SINEPULSE
+  { &Invoke<&LEDStripController::InitOneShot>,    &Invoke<&LEDStripController::DDT_Experimental>,               PALETTE_UPDATE_INTERVAL,     true,  RENDER_UNIQUE            },   // DDT_EXPERIMENTAL
+  { nullptr,                                      nullptr,                                                      DEFAULT_UPDATE_INTERVAL,     false, RENDER_SHARED_MIRRORED   },   // NONE
+};
+
+AnimationDefinition LEDStripController::_customAnimations[MAX_CUSTOM_ANIMATIONS];
+
+
 // *********************************************************************************
 //      CONSTRUCTOR
 // *********************************************************************************
@@ -16,17 +46,27 @@
 //LEDStripController::LEDStripController(CRGB *leds, uint16_t stripLength)
 LEDStripController::LEDStripController( CRGB *leds, 
                                         uint16_t stripLength, 
-                                        CRGBPalette16 colorPalette, 
+                                        const CRGBPalette16 &colorPalette,
                                         uint8_t invertStrip, 
-                                        uint16_t stripStartIndex)
+                                        uint16_t stripStartIndex,
+                                        uint16_t *litPixels)
+  : _litPixels(litPixels), _colorPalette(colorPalette)
 {
 
   _leds = &leds[stripStartIndex];
   _stripLength = stripLength;
-  _colorPalette = colorPalette;
   _invertStrip = invertStrip;
 
   _activeAnimationType = ALL_OFF;
+  _renderAnimation = _builtinAnimations[ALL_OFF].render;
+  _renderEveryTick = _builtinAnimations[ALL_OFF].renderEveryTick;
+  _updateInterval = _builtinAnimations[ALL_OFF].updateInterval;
+  _renderSharing = _builtinAnimations[ALL_OFF].sharing;
+  _timeToUpdate = FrameClock::GetAnimationMillis();
+
+  for( uint8_t slot = 0; slot < MAX_LAYERS; slot++ ){
+    _layers[slot].type = LAYER_NONE;
+  }
   
 }
 
@@ -35,59 +75,186 @@ LEDStripController::LEDStripController( CRGB *leds,
 //      MAIN UPDATE FUNCTION
 // *********************************************************************************
 
-void LEDStripController::Update(uint32_t currentTime) { //keep this list sync'd with LEDStripController.h ANIMATION TYPES ENUM
+// called once per frame with the frame clock's time. returns true if any pixel in this
+// segment changed, so the caller knows whether the physical strip needs to be sent out again
+bool LEDStripController::Update(const FrameTime &frame) {
 
-  if( currentTime > _timeToUpdate ){
-    switch(_activeAnimationType) {
-      case ALL_OFF:
-        AllOff();
-        break;
-      case SOLID_COLOR:
-        SolidColor();
-        break;
-      case FADE_OUT_BPM:  
-        FadeOutBPM();
-        break;
-      case FADE_LOW_BPM:
-        FadeLowBPM();
-        break;
-      case FADE_IN_OUT_BPM:
-        FadeInOutBPM();
-        break;
-      case PALETTE:
-        Palette();
-        break;
-      case PALETTE_W_GLITTER:
-        PaletteWithGlitter();
-        break;
-      case PALETTE_FADE_LOW_BPM:
-        PaletteFadeLowBPM();
-        break;
-      case PALETTE_W_GLITTER_FADE_LOW_BPM:
-        PaletteWithGlitterFadeLowBPM();
-        break;
-      case CONFETTI:
-        Confetti();
-        break;
-      case SINELON:
-        Sinelon();
-        break;
-      case SINEPULSE:
-        Sinepulse();
-        break;
-      case DDT_EXPERIMENTAL:
-        DDT_Experimental();
-        break;
-      case NONE:
-        break;
-      default:
-        // do something for the default
-        break;
+  _stripChanged = false;
+
+  // a shared palette that moved on (a crossfade) makes any palette fill on the strip stale
+  if( _sharedPalette && _sharedPalette->GetVersion() != _sharedPaletteVersion ){
+    _sharedPaletteVersion = _sharedPalette->GetVersion();
+    if( _stripContents == CONTENTS_PALETTE ){
+      _stripContents = CONTENTS_UNKNOWN;
     }
-    
-    _timeToUpdate = currentTime + _updateInterval;
   }
 
+  // the tracked tempo moved, so everything beat based speeds up or slows down with it
+  if( _beatTracker && _beatTracker->GetVersion() != _beatTrackerVersion ){
+    _beatTrackerVersion = _beatTracker->GetVersion();
+    ApplyTempo( _beatTracker->GetBPM() );
+  }
+
+  // signed difference so millis rollover doesn't stall us
+  if( (int32_t)(frame.millis - _timeToUpdate) < 0 ){
+    return false;
+  }
+
+  // every deadline on our grid that has passed since the last frame
+  uint32_t ticksDue = (frame.millis - _timeToUpdate) / _updateInterval + 1;
+  _timeToUpdate += ticksDue * _updateInterval;
+
+  // time based animations look the same however many ticks passed, so only draw the latest.
+  // animations that build on their last tick (fade trails) catch up, within reason
+  if( !_renderEveryTick ){
+    ticksDue = 1;
+  }
+  else if( ticksDue > MAX_CATCH_UP_TICKS ){
+    ticksDue = MAX_CATCH_UP_TICKS;
+  }
+
+  // the last tick lands exactly on the frame time, so every segment is in phase with the show
+  for( uint32_t tick = ticksDue; tick > 0; tick-- ){
+    FrameClock::SetAnimationMillis( frame.millis - (tick - 1) * _updateInterval );
+
+    // resolved in SetActiveAnimationType(), nullptr for NONE
+    if( _renderAnimation ){
+      _renderAnimation(*this);
+      RenderLayers();
+    }
+  }
+  FrameClock::SetAnimationMillis( frame.millis );
+
+  return _stripChanged;
+}
+
+
+// *********************************************************************************
+//      RENDER GROUPS
+//        Segments in the same state render the same pixels, so RenderGroups renders one
+//        of them and copies the result into the rest (see RenderGroups.h)
+// *********************************************************************************
+
+bool LEDStripController::SharesRenderStateWith(const LEDStripController &leader, bool &mirrored) const {
+
+  if( _renderSharing == RENDER_UNIQUE || _stripLength != leader._stripLength ){
+    return false;
+  }
+
+  // random layers draw something different on every segment. the rest have to match
+  for( uint8_t slot = 0; slot < MAX_LAYERS; slot++ ){
+    if( _layers[slot].type == LAYER_GLITTER || _layers[slot].type == LAYER_SPARKLE || _layers[slot] != leader._layers[slot] ){
+      return false;
+    }
+  }
+
+  // palette fills run the other way on an inverted segment, so those only share with the same orientation
+  mirrored = _invertStrip != leader._invertStrip;
+  if( mirrored && _renderSharing != RENDER_SHARED_MIRRORED ){
+    return false;
+  }
+
+  // the state every render reads. the strip contents fields aren't here: once the pixels match
+  // too, the leader's knowledge of its pixels holds for ours
+  if( _activeAnimationType != leader._activeAnimationType ||
+      _renderAnimation != leader._renderAnimation ||
+      _timeToUpdate != leader._timeToUpdate ||
+      _updateInterval != leader._updateInterval ||
+      _hue != leader._hue ||
+      _saturation != leader._saturation ||
+      _brightness != leader._brightness ||
+      _brightnessHigh != leader._brightnessHigh ||
+      _brightnessLow != leader._brightnessLow ||
+      _bpm != leader._bpm ||
+      _paramBPM != leader._paramBPM ||
+      _paramTempo != leader._paramTempo ||
+      _beatTracker != leader._beatTracker ||
+      _hueIndexBPM != leader._hueIndexBPM ||
+      _reverseHueIndexDirection != leader._reverseHueIndexDirection ||
+      _bsTimebase != leader._bsTimebase ||
+      _showStrip != leader._showStrip ||
+      _paletteHue != leader._paletteHue ||
+      _lastPos != leader._lastPos ||
+      _sharedPalette != leader._sharedPalette ||
+      (!_sharedPalette && _colorPalette != leader._colorPalette) ){   // a handle compare, see PaletteRegistry.h
+    return false;
+  }
+
+  return true;
+}
+
+
+// fade trails draw on top of what's there, so sharing a render needs the pixels to match as well
+bool LEDStripController::ShowsSamePixelsAs(const LEDStripController &leader, bool mirrored) const {
+
+  for( uint16_t i = 0; i < _stripLength; i++ ){
+    if( _leds[i] != leader._leds[ mirrored ? _stripLength - 1 - i : i ] ){
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+bool LEDStripController::FollowRender(const LEDStripController &leader, bool leaderChanged, bool mirrored) {
+
+  // take on whatever state the leader's render moved along, so we can leave the group at any time
+  CopyRenderState(leader);
+
+  if( !leaderChanged ){
+    return false;
+  }
+
+  if( mirrored ){
+    const CRGB *source = leader._leds + _stripLength;
+    for( uint16_t i = 0; i < _stripLength; i++ ){
+      _leds[i] = *--source;
+    }
+  }
+  else {
+    memcpy( _leds, leader._leds, _stripLength * sizeof(CRGB) );
+  }
+
+  // the leader's lit pixels are ours now. it's pixel knowledge, so it goes with the pixels rather
+  // than in CopyRenderState()
+  _litCount = leader._litCount <= LitPixelLimit() ? leader._litCount : LIT_PIXELS_UNCOUNTED;
+  if( _litCount != LIT_PIXELS_UNCOUNTED ){
+    for( uint8_t i = 0; i < _litCount; i++ ){
+      _litPixels[i] = mirrored ? _stripLength - 1 - leader._litPixels[i] : leader._litPixels[i];
+    }
+  }
+
+  return true;
+}
+
+
+// everything a render reads or moves along, plus what we know about the pixels on the strip
+void LEDStripController::CopyRenderState(const LEDStripController &leader) {
+
+  _activeAnimationType = leader._activeAnimationType;
+  _renderAnimation = leader._renderAnimation;
+  _renderEveryTick = leader._renderEveryTick;
+  _renderSharing = leader._renderSharing;
+  _timeToUpdate = leader._timeToUpdate;
+  _updateInterval = leader._updateInterval;
+  _bpm = leader._bpm;
+  _beatTrackerVersion = leader._beatTrackerVersion;
+  _bsTimebase = leader._bsTimebase;
+  _showStrip = leader._showStrip;
+  _paletteHue = leader._paletteHue;
+  _lastPos = leader._lastPos;
+  _sharedPaletteVersion = leader._sharedPaletteVersion;
+
+  _stripContents = leader._stripContents;
+  _solidColor = leader._solidColor;
+  _paletteStartIndex = leader._paletteStartIndex;
+  _paletteBrightness = leader._paletteBrightness;
+  _fadeAmount = leader._fadeAmount;
+  _fadeStepsForAmount = leader._fadeStepsForAmount;
+  _fadeStepsToBlack = leader._fadeStepsToBlack;
+  _powerLoad = leader._powerLoad;
+  _powerLoadStale = leader._powerLoadStale;
 }
 
 
@@ -102,67 +269,111 @@ AnimationType LEDStripController::GetActiveAnimationType(){
 }
 
 // SET THE "AnimationType"
+// looks the animation up once here so Update() doesn't have to on every tick
 void LEDStripController::SetActiveAnimationType(AnimationType newAnimationState){
 
-  if (_activeAnimationType != newAnimationState) {
-    _activeAnimationType = newAnimationState;
+  const AnimationDefinition *definition = GetAnimationDefinition(newAnimationState);
+
+  _activeAnimationType = newAnimationState;
+  _renderAnimation = definition->render;
+  _renderEveryTick = definition->renderEveryTick;
+  _updateInterval = definition->updateInterval;
+  _renderSharing = definition->sharing;
+  _stateVersion++;
+
+  // layers the last animation brought with it go with it
+  for( uint8_t slot = 0; slot < MAX_LAYERS; slot++ ){
+    if( _animationLayerMask & (1 << slot) ){
+      _layers[slot].type = LAYER_NONE;
+    }
   }
+  _animationLayerMask = 0;
+  _brightnessLayerMask = 0;
+
+  // restart the tick grid now, so segments triggered together tick together
+  _timeToUpdate = FrameClock::GetAnimationMillis();
 
   // SET THE INITIAL STATE OF THE ANIMATION
-  InitializeAnimation();
+  if( definition->init ){
+    definition->init(*this);
+  }
   
 }
 
+
 // IF THE ANIMATION IS TRIGGERED IT WILL INITIALIZE ITSELF BASED ON THESE SETTTINGS
-void LEDStripController::InitializeAnimation() {
-
-  switch(_activeAnimationType) {
-    case ALL_OFF:
-    case SOLID_COLOR:
-      _updateInterval = DEFAULT_UPDATE_INTERVAL;
-      break;
-    case FADE_OUT_BPM:
-    case FADE_LOW_BPM:
-      _showStrip = true;
-    case FADE_IN_OUT_BPM:
-      _bsTimebase = millis();
-      _updateInterval = FADE_UPDATE_INTERVAL;
-      break;
-    case PALETTE:
-    case PALETTE_W_GLITTER:
-      //_paletteHue = 0;
-      _updateInterval = PALETTE_UPDATE_INTERVAL;
-      break;
-    case DDT_EXPERIMENTAL:
-    case PALETTE_FADE_LOW_BPM:
-    case PALETTE_W_GLITTER_FADE_LOW_BPM:
-      _showStrip = true;
-      _bsTimebase = millis();
-      _updateInterval = PALETTE_UPDATE_INTERVAL;
-      break;
-    case CONFETTI:
-      //_paletteHue = 0;
-      _updateInterval = CONFETTI_UPDATE_INTERVAL;
-      break;
-    case SINELON:
-      //_paletteHue = 0;
-      _bsTimebase = millis();
-      _updateInterval = SINELON_UPDATE_INTERVAL;
-      break;
-    case SINEPULSE:  
-      _paletteHue = 0;      
-      _bsTimebase = millis();     
-      _lastPos = -1;
-      _updateInterval = SINEPULSE_UPDATE_INTERVAL;
-      break;
-    case NONE:
-      _updateInterval = DEFAULT_UPDATE_INTERVAL;
-      break;
-    default:
-      _updateInterval = DEFAULT_UPDATE_INTERVAL;
-      break;
+// one shot fades start visible and measure their fade from now
+void LEDStripController::InitOneShot() {
+  _showStrip = true;
+  _bsTimebase = TriggerTimebase();
+}
+
+// beat based animations start at phase 0 now
+void LEDStripController::InitTimebase() {
+  _bsTimebase = TriggerTimebase();
+}
+
+void LEDStripController::InitSinepulse() {
+  _paletteHue = 0;      
+  _bsTimebase = TriggerTimebase();     
+  _lastPos = -1;
+}
+
+
+// now, or the nearest beat if we follow a tempo and are close to one. a trigger that took a few ms to get
+// here still starts its fade on the beat it was sent on
+uint32_t LEDStripController::TriggerTimebase() {
+
+  uint32_t now = FrameClock::GetAnimationMillis();
+  return _beatTracker ? _beatTracker->SnapToBeat(now) : now;
+}
+
+// the palette plus some random sparkly white glitter
+void LEDStripController::InitGlitter() {
+  AddAnimationLayer( { LAYER_GLITTER, BLEND_ALPHA, 255, 80, CRGB( CHSV(0, 0, 255) ) } ); // MAGIC NUMBER ALERT!!!
+}
+
+// the fading palette, with glitter at the strip's brightness (SetStripParams() keeps it there)
+void LEDStripController::InitGlitterFadeLowBPM() {
+  InitOneShot();
+  AddAnimationLayer( { LAYER_GLITTER, BLEND_ALPHA, 255, 80, CRGB( CHSV(0, 0, _brightness) ) }, true ); // MAGIC NUMBER ALERT!!!
+}
+
+
+// ids past NONE come from RegisterAnimation(). anything unknown behaves like NONE
+const AnimationDefinition *LEDStripController::GetAnimationDefinition(AnimationType animationType) {
+
+  static_assert(sizeof(_builtinAnimations) / sizeof(AnimationDefinition) == FIRST_CUSTOM_ANIMATION,
+                "the built-in animation table must have one row per AnimationType");
+
+  if( animationType < FIRST_CUSTOM_ANIMATION ){
+    return &_builtinAnimations[animationType];
+  }
+
+  uint8_t customIndex = animationType - FIRST_CUSTOM_ANIMATION;
+  if( customIndex < MAX_CUSTOM_ANIMATIONS && _customAnimations[customIndex].render ){
+    return &_customAnimations[customIndex];
+  }
+
+  return &_builtinAnimations[NONE];
+}
+
+
+bool LEDStripController::RegisterAnimation(AnimationType animationType, const AnimationDefinition &definition) {
+
+  uint8_t customIndex = animationType - FIRST_CUSTOM_ANIMATION;
+  if( animationType < FIRST_CUSTOM_ANIMATION || customIndex >= MAX_CUSTOM_ANIMATIONS || !definition.render ){
+    return false;
   }
 
+  _customAnimations[customIndex] = definition;
+  return true;
+}
+
+
+// true if the id draws something (NONE and empty custom slots don't)
+bool LEDStripController::IsAnimationRegistered(AnimationType animationType) {
+  return GetAnimationDefinition(animationType)->render != nullptr;
 }
 
 
@@ -173,24 +384,155 @@ void LEDStripController::SetStripParams(uint8_t hue, uint8_t brightness, uint16_
   _brightnessHigh = brightnessHigh;
   _brightnessLow = brightnessLow;
   _bpm = bpm;
+  _stateVersion++;
+
+  // glitter the animation draws at our brightness changes with it, as it did when drawn fresh every tick
+  for( uint8_t slot = 0; slot < MAX_LAYERS; slot++ ){
+    if( _brightnessLayerMask & (1 << slot) ){
+      _layers[slot].color = CRGB( CHSV(0, 0, _brightness) );
+    }
+  }
+
+  // bpm is taken to be for the tempo we're at now, and scales from here as it changes
+  _paramBPM = bpm;
+  _paramTempo = _beatTracker ? _beatTracker->GetBPM() : GLOBAL_BPM;
+  if( _beatTracker ){
+    _beatTrackerVersion = _beatTracker->GetVersion();
+  }
 
 }
 
 
-void LEDStripController::SetColorPalette(CRGBPalette16 colorPalette){
+bool LEDStripController::SetColorPalette(const CRGBPalette16 &colorPalette){
+
+  PaletteRef palette(colorPalette);
+  return SetColorPalette(palette);
+}
+
+
+bool LEDStripController::SetColorPalette(const PaletteRef &colorPalette){
+
+  if(!colorPalette.IsValid()){
+    return false;
+  }
+
+  // a palette fill already on the strip no longer matches what we'd draw
+  if(_stripContents == CONTENTS_PALETTE && GetColorPalette() != colorPalette.GetPalette()){
+    _stripContents = CONTENTS_UNKNOWN;
+  }
+
   _colorPalette = colorPalette;
+  _sharedPalette = nullptr;
+  _stateVersion++;
+  return true;
+}
+
+
+// follow a palette shared with other segments (and any crossfade it does) until SetColorPalette()
+// is called. nullptr goes back to our own palette, holding whatever the shared one was showing
+// (or keeps following, if there's no room in the palette registry for it)
+void LEDStripController::FollowPalette(PaletteCrossfade *sharedPalette){
+
+  if(!sharedPalette){
+    SetColorPalette( GetColorPalette() );
+    return;
+  }
+
+  if(_stripContents == CONTENTS_PALETTE && sharedPalette->GetPalette() != GetColorPalette()){
+    _stripContents = CONTENTS_UNKNOWN;
+  }
+
+  _sharedPalette = sharedPalette;
+  _sharedPaletteVersion = sharedPalette->GetVersion();
+  _stateVersion++;
+}
+
+
+
+// follow a tempo shared with other segments until called with nullptr. our bpm is taken to be
+// for the tempo it's at now
+void LEDStripController::FollowTempo(const BeatTracker *beatTracker){
+
+  _beatTracker = beatTracker;
+  _paramBPM = _bpm;
+  _paramTempo = beatTracker ? beatTracker->GetBPM() : GLOBAL_BPM;
+  _beatTrackerVersion = beatTracker ? beatTracker->GetVersion() : 0;
+  _stateVersion++;
+}
+
+
+// scale our bpm to the new tempo. the timebase moves so the wave is at the same phase now as it
+// was at the old speed, so a fade that's running carries on from where it is instead of jumping
+void LEDStripController::ApplyTempo(uint16_t tempoBPM){
+
+  uint16_t bpm = ((uint32_t)_paramBPM * tempoBPM + _paramTempo / 2) / _paramTempo;
+  if( bpm == _bpm || bpm == 0 ){
+    return;
+  }
+
+  uint32_t now = FrameClock::GetAnimationMillis();
+  _bsTimebase = now - (uint32_t)((uint64_t)(now - _bsTimebase) * _bpm / bpm);
+  _bpm = bpm;
+}
+
+
+bool LEDStripController::SetLayer(uint8_t slot, const Layer &layer){
+
+  if( slot >= MAX_LAYERS || layer.type >= LAYER_TYPE_COUNT || layer.blendMode >= BLEND_MODE_COUNT ){
+    return false;
+  }
+
+  // set from outside, so it stays when the animation changes
+  _layers[slot] = layer;
+  _animationLayerMask &= ~(1 << slot);
+  _brightnessLayerMask &= ~(1 << slot);
+  _stateVersion++;
+
+  return true;
+}
+
+
+void LEDStripController::ClearLayers(){
+
+  for( uint8_t slot = 0; slot < MAX_LAYERS; slot++ ){
+    _layers[slot].type = LAYER_NONE;
+  }
+  _animationLayerMask = 0;
+  _brightnessLayerMask = 0;
+  _stateVersion++;
 }
 
 
 
 void LEDStripController::SetStripHueIndexBPM(uint16_t hueIndexBPM){
   _hueIndexBPM = hueIndexBPM;
+  _stateVersion++;
 }
 
 
 
 void LEDStripController::ReverseStripHueIndexDirection(){
   _reverseHueIndexDirection = !_reverseHueIndexDirection;
+  _stateVersion++;
+}
+
+
+// the pixels were drawn by someone else (a pixel stream), so nothing we knew about them holds
+void LEDStripController::ForgetStripContents(){
+  _stripContents = CONTENTS_UNKNOWN;
+  _litCount = LIT_PIXELS_UNCOUNTED;
+  _powerLoadStale = true;
+  _stateVersion++;
+}
+
+
+uint32_t LEDStripController::GetPowerLoad(){
+
+  if( _powerLoadStale ){
+    _powerLoad = PixelsPowerLoad( _leds, _stripLength );
+    _powerLoadStale = false;
+  }
+  return _powerLoad;
 }
 
 
@@ -203,14 +545,407 @@ void LEDStripController::ReverseStripHueIndexDirection(){
 // set strip to color based on CHSV input
 void LEDStripController::SetStripHSV(CHSV newCHSV) {
 
-  fill_solid( _leds, _stripLength, newCHSV ); 
+  SetStripHSV( CRGB(newCHSV) );
 
 }
 
 // set strip to color based on CRGB input
+// skipped if the strip is already that color, which is most ticks of a fade or a solid color
 void LEDStripController::SetStripHSV(CRGB newCRGB) {
 
-  fill_solid( _leds, _stripLength, newCRGB ); 
+  bool isBlack = !(newCRGB.r | newCRGB.g | newCRGB.b);
+
+  if( (_stripContents == CONTENTS_SOLID && _solidColor == newCRGB) || (_stripContents == CONTENTS_BLACK && isBlack) ){
+    return;
+  }
+
+  PixelKernels::Fill( _leds, _stripLength, newCRGB );
+
+  _powerLoad = PixelPowerLoad(newCRGB) * _stripLength;
+  _powerLoadStale = false;
+  _solidColor = newCRGB;
+  _stripContents = isBlack ? CONTENTS_BLACK : CONTENTS_SOLID;
+  _litCount = isBlack ? 0 : LIT_PIXELS_UNCOUNTED;
+  _stripChanged = true;
+
+}
+
+
+
+// *********************************************************************************
+//      PIXEL WRITE HELPERS
+//        Every write to _leds goes through here (or SetStripHSV above) so we always
+//        know whether the last Update() changed anything on the physical strip
+// *********************************************************************************
+
+// fill the strip from our palette. skipped if the same fill is already on the strip
+// (the hue index only moves every few ticks at slow palette speeds)
+void LEDStripController::FillPalette(uint8_t startIndex, uint8_t brightness) {
+
+  if( _stripContents == CONTENTS_PALETTE && _paletteStartIndex == startIndex && _paletteBrightness == brightness ){
+    return;
+  }
+
+  // same result as fill_palette(), but each pixel is a table lookup plus (at most) one scale. without
+  // a table (no palette cache, or the registry's are all being drawn from) it's fill_palette()
+#ifdef PALETTE_CACHE_ENABLED
+  const CRGB *paletteTable = GetPaletteTable();
+#else
+  const CRGB *paletteTable = nullptr;
+#endif
+
+  if( !paletteTable ){
+    fill_palette( _leds, _stripLength, startIndex, (256 / _stripLength), GetColorPalette(), brightness, LINEARBLEND);
+    _powerLoadStale = true;
+  }
+  else {
+    uint8_t colorIndex = startIndex;
+    uint8_t incIndex = 256 / _stripLength;
+    uint32_t powerLoad = 0;   // while the pixels are at hand, rather than another pass for PowerLimiter
+
+    if( brightness == 255 ){
+      for( uint16_t i = 0; i < _stripLength; i++ ){
+        _leds[i] = paletteTable[colorIndex];
+        powerLoad += PixelPowerLoad(_leds[i]);
+        colorIndex += incIndex;
+      }
+    }
+    else if( brightness == 0 ){
+      PixelKernels::Fill( _leds, _stripLength, CRGB(0, 0, 0) );
+    }
+    else {
+      // ColorFromPalette rounds brightness up by one before scaling
+      uint8_t scale = brightness + 1;
+      for( uint16_t i = 0; i < _stripLength; i++ ){
+        const CRGB &color = paletteTable[colorIndex];
+        _leds[i] = CRGB( scale8(color.r, scale), scale8(color.g, scale), scale8(color.b, scale) );
+        powerLoad += PixelPowerLoad(_leds[i]);
+        colorIndex += incIndex;
+      }
+    }
+    _powerLoad = powerLoad;
+    _powerLoadStale = false;
+  }
+
+  _paletteStartIndex = startIndex;
+  _paletteBrightness = brightness;
+  _stripContents = CONTENTS_PALETTE;
+  _litCount = brightness ? LIT_PIXELS_UNCOUNTED : 0;
+  _stripChanged = true;
+
+}
+
+
+// fade the whole strip towards black. once enough fades have been applied that every
+// pixel must be black we stop touching the strip at all
+void LEDStripController::FadeStrip(uint8_t fadeBy) {
+
+  if( _stripContents == CONTENTS_BLACK || fadeBy == 0 ){
+    return;
+  }
+
+  // nothing lit, so it's black already, however many fades were counted
+  if( _litCount == 0 ){
+    _stripContents = CONTENTS_BLACK;
+    _powerLoad = 0;
+    _powerLoadStale = false;
+    return;
+  }
+
+  // a gentler fade than the one we counted for takes longer to reach black, so count again
+  if( _stripContents != CONTENTS_FADING || fadeBy < _fadeAmount ){
+    if( fadeBy != _fadeAmount ){
+      _fadeAmount = fadeBy;
+      _fadeStepsForAmount = fadeStepsToBlack(fadeBy);
+    }
+    _fadeStepsToBlack = _fadeStepsForAmount;
+    _stripContents = CONTENTS_FADING;
+  }
+
+  uint8_t scale = 255 - fadeBy;
+  if( _litCount != LIT_PIXELS_UNCOUNTED ){
+    ScaleLitPixels( CRGB(scale, scale, scale) );
+  }
+  else {
+    // fadeToBlackBy(), then the load from the faded pixels (scaling the old load instead drifts high,
+    // every channel rounds down). two word-at-a-time passes beat one a channel at a time
+    PixelKernels::Scale( _leds, _stripLength, scale );
+    _powerLoad = PixelsPowerLoad( _leds, _stripLength );
+
+    // every so often, see whether few enough are still lit to go back to fading only those
+    if( --_litRecountIn == 0 ){
+      _litRecountIn = SPARSE_RECOUNT_FADES;
+      FindLitPixels();
+    }
+  }
+  _powerLoadStale = false;
+  _stripChanged = true;
+
+  if( --_fadeStepsToBlack == 0 || _litCount == 0 ){
+    _stripContents = CONTENTS_BLACK;
+    _litCount = 0;
+  }
+
+}
+
+
+// look a color up in our palette
+CRGB LEDStripController::PaletteColor(uint8_t index, uint8_t brightness) {
+
+#ifdef PALETTE_CACHE_ENABLED
+  const CRGB *paletteTable = GetPaletteTable();
+  if( !paletteTable ){
+    return ColorFromPalette( GetColorPalette(), index, brightness, LINEARBLEND);
+  }
+
+  const CRGB &color = paletteTable[index];
+  if( brightness == 255 ){
+    return color;
+  }
+  if( brightness == 0 ){
+    return CRGB(0, 0, 0);
+  }
+
+  // ColorFromPalette rounds brightness up by one before scaling
+  uint8_t scale = brightness + 1;
+  return CRGB( scale8(color.r, scale), scale8(color.g, scale), scale8(color.b, scale) );
+#else
+  return ColorFromPalette( GetColorPalette(), index, brightness, LINEARBLEND);
+#endif
+
+}
+
+
+// add a color onto a single pixel (saturating)
+void LEDStripController::AddPixelColor(uint16_t pos, CRGB color) {
+
+  bool wasLit = IsLit(_leds[pos]);
+  _powerLoad -= PixelPowerLoad(_leds[pos]);
+  _leds[pos] += color;
+  _powerLoad += PixelPowerLoad(_leds[pos]);
+  TrackLitPixel( pos, wasLit );
+
+  // a pixel on a fading strip restarts the count to black
+  _stripContents = CONTENTS_UNKNOWN;
+  _stripChanged = true;
+
+}
+
+
+// overwrite a single pixel
+void LEDStripController::SetPixelColor(uint16_t pos, CRGB color) {
+
+  bool wasLit = IsLit(_leds[pos]);
+  _powerLoad -= PixelPowerLoad(_leds[pos]);
+  _leds[pos] = color;
+  _powerLoad += PixelPowerLoad(_leds[pos]);
+  TrackLitPixel( pos, wasLit );
+
+  _stripContents = CONTENTS_UNKNOWN;
+  _stripChanged = true;
+
+}
+
+
+
+// blend a color onto a single pixel (see Compositing.h)
+void LEDStripController::BlendPixelColor(uint16_t pos, CRGB color, BlendMode blendMode, uint8_t amount) {
+
+  bool wasLit = IsLit(_leds[pos]);
+  _powerLoad -= PixelPowerLoad(_leds[pos]);
+  BlendPixel( _leds[pos], color, blendMode, amount );
+  _powerLoad += PixelPowerLoad(_leds[pos]);
+  TrackLitPixel( pos, wasLit );
+
+  _stripContents = CONTENTS_UNKNOWN;
+  _stripChanged = true;
+
+}
+
+
+// blend a color onto every pixel. skipped if it wouldn't change anything, and a solid
+// strip stays solid so that's a single blend
+void LEDStripController::BlendStripColor(CRGB color, BlendMode blendMode, uint8_t amount) {
+
+  if( BlendIsNoOp(color, blendMode, amount) ){
+    return;
+  }
+
+  if( _stripContents == CONTENTS_SOLID || _stripContents == CONTENTS_BLACK ){
+    CRGB blended = _stripContents == CONTENTS_SOLID ? _solidColor : CRGB(0, 0, 0);
+    BlendPixel( blended, color, blendMode, amount );
+    SetStripHSV( blended );
+    return;
+  }
+
+  // a multiply can't light a black pixel, so it only needs the lit ones
+  if( blendMode == BLEND_MULTIPLY && _litCount != LIT_PIXELS_UNCOUNTED ){
+    if( _litCount ){
+      ScaleLitPixels( BlendMultiplier(color, amount) );
+      _stripContents = CONTENTS_UNKNOWN;
+      _stripChanged = true;
+    }
+    return;
+  }
+
+  // a gray multiply (a white envelope) scales every channel alike, so the load we have scales with them,
+  // without another look at the pixels. it comes out a little high (each channel rounds down), never low
+  CRGB multiplier = BlendMultiplier(color, amount);
+  if( blendMode == BLEND_MULTIPLY && !_powerLoadStale && multiplier.r == multiplier.g && multiplier.g == multiplier.b ){
+    PixelKernels::Scale( _leds, _stripLength, multiplier.r );
+    uint16_t scale = multiplier.r + 1;    // scale8() multiplies by one more
+    _powerLoad = (_powerLoad >> 8) * scale + (((_powerLoad & 0xFF) * scale) >> 8);
+  }
+  else {
+    _powerLoad = ChannelsPowerLoad( BlendPixels( _leds, _stripLength, color, blendMode, amount ) );
+  }
+
+  _stripContents = CONTENTS_UNKNOWN;
+  _powerLoadStale = false;
+  _litCount = LIT_PIXELS_UNCOUNTED;
+  _stripChanged = true;
+
+}
+
+
+
+// *********************************************************************************
+//      LIT PIXELS
+//        While few of a segment's pixels are lit, _litPixels lists them so fades (and
+//        multiplies) only touch those. the write helpers keep it exact: a pixel is on the
+//        list if and only if it isn't black
+// *********************************************************************************
+
+// after a single pixel write. a pixel lighting up that would take the list past LitPixelLimit()
+// stops the counting until FadeStrip() finds few enough lit again
+void LEDStripController::TrackLitPixel(uint16_t pos, bool wasLit) {
+
+  bool isLit = IsLit(_leds[pos]);
+  if( _litCount == LIT_PIXELS_UNCOUNTED || isLit == wasLit ){
+    return;
+  }
+
+  if( isLit ){
+    if( _litCount < LitPixelLimit() ){
+      _litPixels[_litCount++] = pos;
+    }
+    else {
+      _litCount = LIT_PIXELS_UNCOUNTED;
+      _litRecountIn = SPARSE_RECOUNT_FADES;
+    }
+    return;
+  }
+
+  for( uint8_t i = 0; i < _litCount; i++ ){
+    if( _litPixels[i] == pos ){
+      _litPixels[i] = _litPixels[--_litCount];
+      return;
+    }
+  }
+}
+
+
+// a pass over every pixel for the lit ones. false, and still not counting, if there are too many
+bool LEDStripController::FindLitPixels() {
+
+  uint8_t limit = LitPixelLimit();
+  uint8_t count = 0;
+  for( uint16_t i = 0; i < _stripLength; i++ ){
+    if( IsLit(_leds[i]) ){
+      if( count == limit ){
+        return false;
+      }
+      _litPixels[count++] = i;
+    }
+  }
+
+  _litCount = count;
+  return true;
+}
+
+
+// scale8() every lit pixel's channels by scale's, adding up the load as it goes. pixels that go
+// black come off the list
+void LEDStripController::ScaleLitPixels(const CRGB &scale) {
+
+  uint32_t powerLoad = 0;
+  uint8_t i = 0;
+  while( i < _litCount ){
+    CRGB &pixel = _leds[_litPixels[i]];
+    pixel.r = scale8( pixel.r, scale.r );
+    pixel.g = scale8( pixel.g, scale.g );
+    pixel.b = scale8( pixel.b, scale.b );
+
+    if( IsLit(pixel) ){
+      powerLoad += PixelPowerLoad(pixel);
+      i++;
+    }
+    else {
+      _litPixels[i] = _litPixels[--_litCount];
+    }
+  }
+
+  _powerLoad = powerLoad;
+  _powerLoadStale = false;
+}
+
+
+
+// *********************************************************************************
+//      LAYERS
+//        Drawn in place over the animation after each render. Nothing is buffered, so an
+//        animation that builds on its last tick (fade trails) builds on its layers too
+// *********************************************************************************
+
+// layers a built-in animation brings along take the first free slot. if every slot
+// is taken the layers set from outside win. atStripBrightness: the color is white at
+// _brightness and follows it when SetStripParams() changes it
+void LEDStripController::AddAnimationLayer(const Layer &layer, bool atStripBrightness) {
+
+  for( uint8_t slot = 0; slot < MAX_LAYERS; slot++ ){
+    if( _layers[slot].type == LAYER_NONE ){
+      _layers[slot] = layer;
+      _animationLayerMask |= 1 << slot;
+      if( atStripBrightness ){
+        _brightnessLayerMask |= 1 << slot;
+      }
+      return;
+    }
+  }
+
+}
+
+
+void LEDStripController::RenderLayers() {
+
+  for( uint8_t slot = 0; slot < MAX_LAYERS; slot++ ){
+    const Layer &layer = _layers[slot];
+
+    switch( layer.type ){
+      case LAYER_GLITTER:
+        if( random8() < layer.param ){
+          BlendPixelColor( random16(_stripLength), layer.color, layer.blendMode, layer.amount );
+        }
+        break;
+
+      case LAYER_SPARKLE:
+        if( random8() < layer.param ){
+          uint16_t pos = random16(_stripLength);
+          BlendPixelColor( pos, PaletteColor( random8() ), layer.blendMode, layer.amount );
+        }
+        break;
+
+      case LAYER_ENVELOPE: {
+        CRGB color = layer.color;
+        color.nscale8( beatsin8( layer.param, 0, 255, _bsTimebase ) );
+        BlendStripColor( color, layer.blendMode, layer.amount );
+        break;
+      }
+
+      default:
+        break;
+    }
+  }
 
 }
 
@@ -224,7 +959,7 @@ void LEDStripController::SetStripHSV(CRGB newCRGB) {
 
 // quickly turn off the strip
 void LEDStripController::AllOff() {
-  fadeToBlackBy( _leds, _stripLength, 20);
+  FadeStrip(20);
 }
 
 void LEDStripController::SolidColor(){
@@ -330,23 +1065,7 @@ void LEDStripController::FadeInOutBPM() {
 void LEDStripController::Palette()
 {
   
-  fill_palette( _leds, _stripLength, getHueIndex( _hueIndexBPM ), (256 / _stripLength), _colorPalette, _brightness, LINEARBLEND);
-}
-
-
-// same as the above function except this also ads glitter
-void LEDStripController::PaletteWithGlitter() {
-  // reference our palette function, plus some random sparkly glitter
-  Palette();
-  AddGlitter(80); // MAGIC NUMBER ALERT!!!
-}
-
-// the glitter function, randomly selects a pixel and sets it to white
-void LEDStripController::AddGlitter( fract8 chanceOfGlitter, uint8_t brightness) {
-  if( random8() < chanceOfGlitter) {
-    //_leds[ random16(_stripLength) ] += CRGB::White;
-    _leds[ random16(_stripLength) ] = CHSV( 0, 0, brightness);
-  }
+  FillPalette( getHueIndex( _hueIndexBPM ), _brightness);
 }
 
 
@@ -364,23 +1083,16 @@ void LEDStripController::PaletteFadeLowBPM() {
   // we need to disable the animation once the brightnes drops below a certain threshold
   // as well as set the brightnes to 0 (or whatever value we want to stop it at)
   if(brightness > _brightnessLow && brightness > 5 && _showStrip){ // MAGIC NUMBER ALERT!!!
-    fill_palette( _leds, _stripLength, getHueIndex( _hueIndexBPM ), (256 / _stripLength), _colorPalette, brightness, LINEARBLEND);
+    FillPalette( getHueIndex( _hueIndexBPM ), brightness);
   }
   else {
-    fill_palette( _leds, _stripLength, getHueIndex( _hueIndexBPM ), (256 / _stripLength), _colorPalette, _brightnessLow, LINEARBLEND);
+    FillPalette( getHueIndex( _hueIndexBPM ), _brightnessLow);
     _showStrip = false;
   }
   
 
 }
 
-// same as the above function except this also ads glitter
-void LEDStripController::PaletteWithGlitterFadeLowBPM() {
-  // reference our palette function, plus some random sparkly glitter
-  PaletteFadeLowBPM();
-  AddGlitter(80, _brightness); // MAGIC NUMBER ALERT!!!
-}
-
 
 
 
@@ -390,7 +1102,7 @@ void LEDStripController::PaletteWithGlitterFadeLowBPM() {
 void LEDStripController::Confetti() {
   
   // random colored speckles that blink in and fade smoothly
-  fadeToBlackBy( _leds, _stripLength, 10); // MAGIC NUMBER ALERT!!! 20 is the speed of the brightness fade, smaller = longer fade
+  FadeStrip(10); // MAGIC NUMBER ALERT!!! 20 is the speed of the brightness fade, smaller = longer fade
   uint16_t pos = random16(_stripLength);
   //int pos = random16(_stripLength);
   
@@ -398,7 +1110,7 @@ void LEDStripController::Confetti() {
   // if you want to draw from a palette use this method
   //_leds[pos] += ColorFromPalette( _colorPalette, random8(), _brightness);
   if (random8()<_bpm){  // probability control for how many LED's pop simultaneously. Dependent on processor speed & LED count. Default = 180 out of 255
-    _leds[pos] += ColorFromPalette( _colorPalette, _paletteHue + random8(64), _brightness);
+    AddPixelColor( pos, PaletteColor( _paletteHue + random8(64), _brightness));
   }
   // here's an alternate method
   //_paletteHue++;
@@ -411,7 +1123,7 @@ void LEDStripController::Confetti() {
 void LEDStripController::Sinelon(){
 
   // fade the entire strip by 20. This is what causes the animation to have a tail
-  fadeToBlackBy( _leds, _stripLength, 20); // MAGIC NUMBER ALERT!!!
+  FadeStrip(20); // MAGIC NUMBER ALERT!!!
 
   // increment the _paletteHue position so the color moves through the palette
   _paletteHue++;
@@ -427,7 +1139,7 @@ void LEDStripController::Sinelon(){
   }
 
   // add the palette color to the led at pos
-  _leds[pos] += ColorFromPalette( _colorPalette, _paletteHue, _brightness);
+  AddPixelColor( pos, PaletteColor( _paletteHue, _brightness));
 
   //_leds[pos] += CHSV( _paletteHue, SATURATION_FULL, _brightness);
 
@@ -439,7 +1151,7 @@ void LEDStripController::Sinelon(){
 void LEDStripController::Sinepulse(){
 
   // fade the entire strip by 20. This is what causes the animation to have a tail
-  fadeToBlackBy( _leds, _stripLength, 20); // MAGIC NUMBER ALERT!!!
+  FadeStrip(20); // MAGIC NUMBER ALERT!!!
 
   // increment the _paletteHue position so the color moves through the palette
   _paletteHue++;
@@ -467,7 +1179,7 @@ void LEDStripController::Sinepulse(){
       }
     
       // add the palette color to the led at pos
-      _leds[pos] += ColorFromPalette( _colorPalette, _paletteHue, _brightness);    
+      AddPixelColor( pos, PaletteColor( _paletteHue, _brightness));
     }
   }
 
@@ -480,14 +1192,14 @@ void LEDStripController::Sinepulse(){
 // experiments with Waves animation (similar to Sinelon)
 void LEDStripController::DDT_Experimental(){
   // random colored speckles that blink in and fade smoothly
-  fadeToBlackBy( _leds, _stripLength, 20); // MAGIC NUMBER ALERT!!!
+  FadeStrip(20); // MAGIC NUMBER ALERT!!!
   uint16_t pos = random16(_stripLength);  
   //int pos = random16(_stripLength);
   
   _paletteHue++;
   // if you want to draw from a palette use this method
   //_leds[pos] += ColorFromPalette( _colorPalette, random8(), _brightness);
-  _leds[pos] += ColorFromPalette( _colorPalette, _paletteHue + random8(64), _brightness);
+  AddPixelColor( pos, PaletteColor( _paletteHue + random8(64), _brightness));
   
   // here's an alternate method
   //_paletteHue++;
@@ -513,3 +1225,33 @@ uint8_t LEDStripController::getHueIndex(uint8_t hueIndexBPM){
         return 255 - beat8(hueIndexBPM);  // leds appear to be moving forward
     }    
 }
+
+
+// the number of fadeToBlackBy(fadeBy) calls that take a full brightness pixel to black
+uint8_t LEDStripController::fadeStepsToBlack(uint8_t fadeBy){
+
+    uint8_t level = 255;
+    uint8_t steps = 0;
+
+    while(level){
+        level = scale8(level, 255 - fadeBy);
+        steps++;
+    }
+
+    return steps;
+}
+
+
+#ifdef PALETTE_CACHE_ENABLED
+// the 16 palette entries blended out to all 256 indexes, instead of once per pixel per frame. a shared
+// palette keeps its own table, and our own palette's is in the registry, so segments on the same
+// palette all read the one copy
+const CRGB *LEDStripController::GetPaletteTable(){
+
+    if(_sharedPalette){
+        return _sharedPalette->GetTable();
+    }
+
+    return _colorPalette.GetTable();
+}
+#endif
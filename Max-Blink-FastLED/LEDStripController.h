@@ -8,8 +8,14 @@
 // ******************************************************************
 //            Includes and Defines
 // ******************************************************************
+#include "FrameClock.h"    // before FastLED.h, so beat functions read the frame clock
 #include <FastLED.h>
 #include "GlobalVariables.h"
+#include "PaletteCrossfade.h"
+#include "PaletteRegistry.h"
+#include "BeatTracker.h"
+#include "Compositing.h"
+#include "PowerLimiter.h"
 
 // FASTLED_USING_NAMESPACE
 
@@ -21,16 +27,18 @@
 // ******************************************************************
 //    ANIMATION TYPES ENUM -- This makes it easy to change animations
 // ******************************************************************
-enum AnimationType { //add all new animation names here for human-readable format
+// the values index the built-in animation table in LEDStripController.cpp, so keep the two in the same order
+// ids after NONE are free for animations registered at runtime with LEDStripController::RegisterAnimation()
+enum AnimationType : uint8_t { //add all new animation names here for human-readable format
   ALL_OFF,
   SOLID_COLOR,
   FADE_OUT_BPM,
   FADE_LOW_BPM,
   FADE_IN_OUT_BPM,
   PALETTE,
-  PALETTE_W_GLITTER,
+  PALETTE_W_GLITTER,                 // PALETTE with a glitter layer (kept for the Max patch, see SetLayer())
   PALETTE_FADE_LOW_BPM,
-  PALETTE_W_GLITTER_FADE_LOW_BPM,
+  PALETTE_W_GLITTER_FADE_LOW_BPM,    // PALETTE_FADE_LOW_BPM with a glitter layer
   CONFETTI,
   SINELON,
   SINEPULSE,
@@ -49,6 +57,53 @@ enum AnimationType { //add all new animation names here for human-readable forma
 #define SINELON_UPDATE_INTERVAL 10
 #define SINEPULSE_UPDATE_INTERVAL 10
 
+// the most ticks an animation that renders every tick will catch up on in one frame
+#define MAX_CATCH_UP_TICKS 4
+
+
+// ******************************************************************
+//    ANIMATION REGISTRY -- every animation is an init/render pair plus its update interval
+// ******************************************************************
+class LEDStripController;
+typedef void (*AnimationFunction)(LEDStripController &strip);
+
+struct PixelCoordinate;   // see PixelMap.h
+
+// whether segments in the same state can share a single render (see RenderGroups.h)
+enum RenderSharing : uint8_t {
+  RENDER_UNIQUE,            // every segment renders itself. anything that draws random numbers, and the
+                            // default for registered animations
+  RENDER_SHARED,            // segments of the same length, state and orientation draw the same pixels
+  RENDER_SHARED_MIRRORED    // as above, and an inverted segment draws the exact reverse of a regular one
+};
+
+struct AnimationDefinition {
+  AnimationFunction init;      // called once when the animation is triggered (may be nullptr)
+  AnimationFunction render;    // called every _updateInterval ms while active (nullptr draws nothing)
+  uint16_t updateInterval;     // milliseconds between calls to render
+  bool renderEveryTick;        // true if each render builds on the last (fade trails), so ticks that
+                               // fall inside one frame are all rendered. otherwise only the latest is
+  RenderSharing sharing;       // see above
+};
+
+// room for animations registered at runtime, with ids FIRST_CUSTOM_ANIMATION and up
+#define MAX_CUSTOM_ANIMATIONS 8
+const uint8_t FIRST_CUSTOM_ANIMATION = NONE + 1;
+
+
+// the most lit pixels a segment keeps a list of, so a fade only touches those (CONFETTI, SINELON and
+// the like on a long strip). more than that, or more than one in SPARSE_MIN_SPREAD of the segment's
+// pixels, and it fades them all, looking for whether they fit the list again every SPARSE_RECOUNT_FADES fades.
+// the list is room the controller is handed, LitPixelLimit(stripLength) entries of it (Topology.h sizes
+// one pool for every segment). a controller without one fades every pixel
+#ifndef SPARSE_MAX_PIXELS
+  #define SPARSE_MAX_PIXELS 64
+#endif
+#define SPARSE_MIN_SPREAD 4
+#define SPARSE_RECOUNT_FADES 16
+
+static_assert(SPARSE_MAX_PIXELS < 255, "the lit pixel count is a byte, with 255 for not counting");
+
 
 // this will set whether or not the strip is inverted
 // meaning the beginning is the end and the end is the beginning
@@ -66,58 +121,193 @@ class LEDStripController
     //LEDStripController(CRGB *leds, uint16_t stripLength); // Constructor needs to be fully defined
     LEDStripController( CRGB *leds, 
                         uint16_t stripLength,
-                        CRGBPalette16 colorPalette = DEFAULT_PALETTE,                        
+                        const CRGBPalette16 &colorPalette = DEFAULT_PALETTE,
                         uint8_t invertStrip = 0,
-                        uint16_t stripStartIndex = 0 );
-    void Update(uint32_t currentTime);
+                        uint16_t stripStartIndex = 0,
+                        uint16_t *litPixels = nullptr );
+    bool Update(const FrameTime &frame);   // returns true if any pixel in the segment changed
 
     AnimationType GetActiveAnimationType();
     void SetActiveAnimationType(AnimationType newAnimationState);
     void SetStripParams(uint8_t hue, uint8_t brightness, uint16_t bpm, uint8_t brightnessHigh, uint8_t brightnessLow);
-    void SetColorPalette(CRGBPalette16 colorPalette);
+    // our own palette (stops following a shared one). false, and nothing changes, if the palette
+    // registry is full
+    bool SetColorPalette(const CRGBPalette16 &colorPalette);
+    bool SetColorPalette(const PaletteRef &colorPalette);  // one already acquired, for setting many segments at once
+    void FollowPalette(PaletteCrossfade *sharedPalette);   // draw with a palette shared by other segments
+    void FollowTempo(const BeatTracker *beatTracker);      // scale bpm with the music and start fades on its beats
     void SetStripHueIndexBPM(uint16_t hueIndexBPM);
     void ReverseStripHueIndexDirection();
+
+    // call after something other than the animations drew on the strip (see PixelStream.h),
+    // so the next render draws every pixel again
+    void ForgetStripContents();
+
+    // what the segment's pixels draw at full brightness (see PowerLimiter.h). kept up to date by the
+    // write helpers, so it's only a pass over the pixels after a write that can't work it out
+    uint32_t GetPowerLoad();
+
+    // LAYERS - drawn over the animation after every render (see Compositing.h). they stay through
+    // animation changes until cleared. LAYER_NONE empties a slot. false if slot, type or mode is out of range
+    bool SetLayer(uint8_t slot, const Layer &layer);
+    void ClearLayers();
+    const Layer &GetLayer(uint8_t slot) const { return _layers[slot < MAX_LAYERS ? slot : 0]; }
+
+    // register an animation under a custom id (FIRST_CUSTOM_ANIMATION and up) for every controller
+    static bool RegisterAnimation(AnimationType animationType, const AnimationDefinition &definition);
+    static bool IsAnimationRegistered(AnimationType animationType);
+
+
+    //********** ANIMATION API - what registered animations use to read state and draw **********
+    void SetStripHSV(CHSV newCHSV);
+    void SetStripHSV(CRGB newCRGB);
+
+    // PIXEL WRITE HELPERS - every write to _leds goes through these so Update() knows if the segment changed
+    void FillPalette(uint8_t startIndex, uint8_t brightness);
+    void FadeStrip(uint8_t fadeBy);
+    void AddPixelColor(uint16_t pos, CRGB color);
+    void SetPixelColor(uint16_t pos, CRGB color);
+    void BlendPixelColor(uint16_t pos, CRGB color, BlendMode blendMode, uint8_t amount);
+    void BlendStripColor(CRGB color, BlendMode blendMode, uint8_t amount);
+
+    // the same color ColorFromPalette( GetColorPalette(), index, brightness, LINEARBLEND ) returns
+    CRGB PaletteColor(uint8_t index, uint8_t brightness = 255);
+
+    // for a registered animation's init: beat based drawing starts at phase 0 now (see TriggerTimebase())
+    void InitTimebase();
+
+    const CRGB &GetPixel(uint16_t pos) const { return _leds[pos]; }
+
+    // where each of our pixels is on the sculpture, indexed like them (see PixelMap.h). nullptr until
+    // the pixel map is attached, and the spatial animations draw nothing without it
+    void SetPixelCoordinates(const PixelCoordinate *coordinates) { _coordinates = coordinates; }
+    const PixelCoordinate *GetPixelCoordinates() const { return _coordinates; }
+
+    uint16_t GetStripLength() const { return _stripLength; }
+
+    // how much of a lit pixel list a segment this long uses
+    static constexpr uint8_t LitPixelLimit(uint16_t stripLength) {
+      return stripLength / SPARSE_MIN_SPREAD < SPARSE_MAX_PIXELS ? stripLength / SPARSE_MIN_SPREAD : SPARSE_MAX_PIXELS;
+    }
+    bool IsInverted() const { return _invertStrip; }
+    const CRGBPalette16 &GetColorPalette() const { return _sharedPalette ? _sharedPalette->GetPalette() : _colorPalette.GetPalette(); }
+    uint8_t GetHue() const { return _hue; }
+    uint8_t GetBrightness() const { return _brightness; }
+    uint8_t GetBrightnessHigh() const { return _brightnessHigh; }
+    uint8_t GetBrightnessLow() const { return _brightnessLow; }
+    uint16_t GetBPM() const { return _bpm; }
+    uint16_t GetHueIndexBPM() const { return _hueIndexBPM; }
+    uint32_t GetTimebase() const { return _bsTimebase; }   // frame clock millis when the animation was triggered
+
+
+    //********** RENDER GROUPS - see RenderGroups.h **********
+    // bumped by every setter above, so a group can tell when one of its segments may have diverged
+    uint16_t GetStateVersion() const { return _stateVersion; }
+
+    // true if this segment's next renders would be leader's (reversed when mirrored is set). that needs
+    // both in the same state, and showing the same pixels (ShowsSamePixelsAs)
+    bool SharesRenderStateWith(const LEDStripController &leader, bool &mirrored) const;
+    bool ShowsSamePixelsAs(const LEDStripController &leader, bool mirrored) const;
+
+    // stands in for Update() on a segment in leader's group. call after leader.Update(), with its result
+    bool FollowRender(const LEDStripController &leader, bool leaderChanged, bool mirrored);
     
     
     
   //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
   private:
-    
+    // grouped widest first, so the compiler doesn't pad between them (host/bench/RamReport.cpp prints
+    // what a controller comes to). anything a render reads or moves along also needs adding to
+    // SharesRenderStateWith() and CopyRenderState()
+
     // our virtual strip representations
     CRGB *_leds;
+    PaletteCrossfade *_sharedPalette = nullptr;   // when set, used instead of _colorPalette
+    const BeatTracker *_beatTracker = nullptr;
+    const PixelCoordinate *_coordinates = nullptr;   // a fixed part of the segment, not render state
+    uint16_t *_litPixels;   // every pixel that isn't black, in no order, while _litCount counts them
+
+    // resolved from the animation table when the animation is set, so Update() is a single call
+    AnimationFunction _renderAnimation = nullptr;
+
+    //General timing variables used in our Update() method
+    uint32_t _timeToUpdate = 0; // deadline of the next tick. advanced by _updateInterval so it never drifts
+    uint32_t _bsTimebase = 0;
+    uint32_t _powerLoad = 0;
+
     uint16_t _stripLength;
-    CRGBPalette16 _colorPalette;    // the color palette to use in certain animations
-    uint8_t _invertStrip;          // whether the strip is regular orientation (0) or reversed (1)
+    uint16_t _updateInterval = DEFAULT_UPDATE_INTERVAL;   // milliseconds between updates. Likely needs to be 5
+    uint16_t _bpm = GLOBAL_BPM;         // _paramBPM scaled from _paramTempo to the tracked tempo
+    uint16_t _paramBPM = GLOBAL_BPM;    // the bpm SetStripParams() was given
+    uint16_t _paramTempo = GLOBAL_BPM;  // the tempo it was given at
+    uint16_t _hueIndexBPM = GLOBAL_BPM;
+    int16_t _lastPos = 0;
+    uint16_t _sharedPaletteVersion = 0;           // the version our last palette fill was drawn from
+    uint16_t _beatTrackerVersion = 0;             // the tempo version _bpm was last scaled to
+    uint16_t _stateVersion = 0;   // see GetStateVersion()
 
+    PaletteRef _colorPalette;       // the color palette to use in certain animations, held in the registry
+    uint8_t _invertStrip;          // whether the strip is regular orientation (0) or reversed (1)
 
     // a globally defined Enum that makes it easy to update animations with human readable names
     AnimationType _activeAnimationType;
-    
+    bool _renderEveryTick = false;
+    RenderSharing _renderSharing = RENDER_SHARED_MIRRORED;
+
     // mutable variables that save the state of the strip's _hue, _saturation and _brightness
     uint8_t _hue = 92;
     uint8_t _saturation = SATURATION_FULL;
     uint8_t _brightness = BRIGHTNESS_FULL;
     uint8_t _brightnessHigh = BRIGHTNESS_FULL;
     uint8_t _brightnessLow = 40;
-    uint16_t _bpm = GLOBAL_BPM;
-    uint16_t _hueIndexBPM = GLOBAL_BPM;
     uint8_t _reverseHueIndexDirection = false;
-  
+
     // mutable variables that help manage the state of parameters used in specific animations
-    uint32_t _bsTimebase = 0;
     bool _showStrip = true;
     uint8_t _paletteHue = 0;
-    int _lastPos = 0;
 
+    // what we know is currently on the strip, so writes that wouldn't change anything can be skipped
+    enum StripContents : uint8_t {
+      CONTENTS_UNKNOWN,     // individual pixels have been written
+      CONTENTS_SOLID,       // every pixel is _solidColor
+      CONTENTS_PALETTE,     // fill_palette() with _paletteStartIndex and _paletteBrightness
+      CONTENTS_FADING,      // fading out, black after _fadeStepsToBlack more fades of _fadeAmount
+      CONTENTS_BLACK        // every pixel is black
+    };
+    StripContents _stripContents = CONTENTS_UNKNOWN;
+    static const uint8_t LIT_PIXELS_UNCOUNTED = 255;   // _litCount when _litPixels isn't kept
+    CRGB _solidColor;
+    uint8_t _paletteStartIndex = 0;
+    uint8_t _paletteBrightness = 0;
+    uint8_t _fadeAmount = 0;            // the fade _fadeStepsForAmount was counted for
+    uint8_t _fadeStepsForAmount = 0;
+    uint8_t _fadeStepsToBlack = 0;
+    bool _stripChanged = false;   // set by any write during the current Update()
+    bool _powerLoadStale = true;  // a write that didn't keep _powerLoad (a blend, fill_palette())
+    uint8_t _litCount = LIT_PIXELS_UNCOUNTED;
+    uint8_t _litRecountIn = SPARSE_RECOUNT_FADES;   // fades of every pixel until FindLitPixels() tries again
 
-    //General timing variables used in our Update() method
-    unsigned long _timeToUpdate = 0; // time of last update of position
-    uint16_t _updateInterval = DEFAULT_UPDATE_INTERVAL;   // milliseconds between updates. Likely needs to be 5
+    // composited over every render, in slot order. random layers (glitter, sparkle) keep a segment
+    // out of render groups
+    uint8_t _animationLayerMask = 0;   // slots filled by the animation's init, emptied when it changes
+    uint8_t _brightnessLayerMask = 0;  // the ones of those that are white at _brightness, and follow it
+    Layer _layers[MAX_LAYERS];
 
-    //INITIALIZATION AND STATIC STRIP COLOR METHODS
-    void InitializeAnimation();
-    void SetStripHSV(CHSV newCHSV);
-    void SetStripHSV(CRGB newCRGB);
+    // ANIMATION TABLES
+    static const AnimationDefinition _builtinAnimations[];
+    static AnimationDefinition _customAnimations[MAX_CUSTOM_ANIMATIONS];
+    static const AnimationDefinition *GetAnimationDefinition(AnimationType animationType);
+
+    // turns a member function into an AnimationFunction at compile time so the
+    // built-in animations can sit in the same table as registered ones
+    template <void (LEDStripController::*METHOD)()>
+    static void Invoke(LEDStripController &strip) { (strip.*METHOD)(); }
+
+    //INITIALIZATION METHODS
+    void InitOneShot();
+    void InitSinepulse();
+    void InitGlitter();
+    void InitGlitterFadeLowBPM();
     
     //ANIMATION METHODS
     void AllOff();
@@ -126,10 +316,7 @@ class LEDStripController
     void FadeLowBPM();
     void FadeInOutBPM();
     void Palette();    
-    void PaletteWithGlitter();
     void PaletteFadeLowBPM();
-    void PaletteWithGlitterFadeLowBPM();
-    void AddGlitter( fract8 chanceOfGlitter, uint8_t brightness = 255);
     void Confetti();
     void Sinelon();
     void Sinepulse();
@@ -138,6 +325,20 @@ class LEDStripController
 
     // CLAS HELPER FUNCTIONS
     uint8_t getHueIndex(uint8_t hueIndexBPM);
+    static uint8_t fadeStepsToBlack(uint8_t fadeBy);
+    void CopyRenderState(const LEDStripController &leader);
+    static bool IsLit(const CRGB &color) { return color.r | color.g | color.b; }
+    void TrackLitPixel(uint16_t pos, bool wasLit);
+    uint8_t LitPixelLimit() const { return _litPixels ? LitPixelLimit(_stripLength) : 0; }
+    bool FindLitPixels();
+    void ScaleLitPixels(const CRGB &scale);
+    void ApplyTempo(uint16_t tempoBPM);
+    uint32_t TriggerTimebase();
+    void AddAnimationLayer(const Layer &layer, bool atStripBrightness = false);
+    void RenderLayers();
+#ifdef PALETTE_CACHE_ENABLED
+    const CRGB *GetPaletteTable();
+#endif
     // uint8_t getHueIndex(uint8_t hueIndexBPM, uint8_t reverseDirecton = false);
 
 
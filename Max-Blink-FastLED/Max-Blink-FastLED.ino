@@ -1,25 +1,71 @@
 /*  Simple example of Max->Teensy communication.   9/7/2020 ams
    The Teensy listens for incoming characters over the USB host serial port.
-   When any letter available in the switch statement is received...
+   When any letter with a preset (see Presets.h) is received...
    the Teensy will flash the onboard LED for 1/10 of a second.
 
    Also, the Teensy sends a "K" back to Max when it receives a command. This can be ignored, or used as a way for Max to verify that the Teensy is alive and connected.
 
    The accompanying Max patch is setup to send B on the downbeat and b on every quarter note.
 
+   Max can also send binary frames that carry every parameter explicitly (see SerialProtocol.h)
+   so a new look doesn't need a new character and a recompile.
+
 */
 
 /////// INCLUDES ///////
+#include "FrameClock.h"    // must come before FastLED.h so beat functions read the frame clock
 #include <FastLED.h>
 #include "LEDStripController.h"
 #include "GradientPalettes.h"
+#include "SerialProtocol.h"
+#include "PaletteCrossfade.h"
+#include "RenderGroups.h"
+#include "OutputBackend.h"
+#include "CommandQueue.h"
+#include "BeatTracker.h"
+#include "SessionCapture.h"
+#include "PixelStream.h"
+#include "PowerLimiter.h"
+#include "Telemetry.h"
+#include "Installation.h"
+#include "SerialLog.h"
+#include "EffectVM.h"
+#include "SpatialEffects.h"
+#include "Presets.h"
+#if defined(REPLAY_CAPTURE)
+  #include "ReplayCapture.h"    // const uint8_t replayCapture[], written by the host's replay_session tool
+#endif
 
 /////// GLOBAL CONSTANTS ///////
 #define baudRate 9600   //this is a safe and common rate. Feel free to change it as desired. Justmake sure that Max and the Teensy are at the same setting.
-char incomingByte;        // variable used for data from Max.
+#define SERIAL_MESSAGES_PER_LOOP 4   // how many commands we decode before going back to rendering
+#define SHOW_KEEP_ALIVE_INTERVAL 1000   // ms. strips are re-sent at least this often even if nothing changed
 
 /////// GLOBAL MUTABLES ///////
-uint32_t timeToCallFastLEDShow = 0; // time of last update of call to FastLED.show()
+SerialProtocol serialProtocol;      // decodes the bytes coming from Max (single characters and binary frames)
+CommandQueue commandQueue;          // holds commands until their frame when Max asks for a latency offset or quantizing
+BeatTracker beatTracker;            // the tempo and beat phase of the music, from the beats Max sends
+FrameClock frameClock;              // one clock for rendering and showing every strip
+uint32_t timeOfLastKeepAliveShow = 0; // time we last sent every strip regardless of changes
+PaletteCrossfade sharedPalette;     // the palette every segment draws with until a group command gives it its own
+uint16_t paletteCrossfadeFrames = DEFAULT_PALETTE_CROSSFADE_FRAMES; // how long a palette preset ('y', '0'-'9') takes to change palette
+
+// the show as Max sent it, for replaying later (see SessionCapture.h)
+SessionRecorder sessionRecorder;
+#if defined(SESSION_CAPTURE_BYTES)
+  uint8_t sessionCaptureBuffer[SESSION_CAPTURE_BYTES];
+#endif
+SessionReplay *sessionReplay = nullptr;   // set when we're playing a capture back instead of listening to Max
+
+// text for whoever is watching the serial monitor, sent between frames (see SerialLog.h)
+#if LOG_LEVEL > LOG_LEVEL_NONE
+  SerialLog serialLog;
+#endif
+
+// how long everything takes, for SERIAL_OP_TELEMETRY (see Telemetry.h)
+#if defined(TELEMETRY_ENABLED)
+  Telemetry telemetry;
+#endif
 
 // teensy LED timer variables
 uint32_t timeToTurnOffTeensyLED = 0;
@@ -27,71 +73,50 @@ bool teensyLEDIsOn = false;
 
 
 // THESE STEPS SETUP THE VIRTUAL REPRESENTATION OF OUR LED STRIPS
-// CRGB Array for each strip.
-CRGB aLEDs[ALEN];
-CRGB bLEDs[BLEN];
-CRGB cLEDs[CLEN];
-
-#if defined(__TURNERS_TESTING_UNO__) || defined(__TURNERS_TESTING_TEENSY__)
-  // Simple non-segmented version for testing
-  //LEDStripController ALedStripController_1(aLEDs, ALEN);
-  LEDStripController ALedStripController_1(aLEDs, ALEN,DEFAULT_PALETTE, !INVERT_STRIP);
+// the strips and segments are described in Installation.h. installation holds every strip's pixels, back
+// to back, and a controller for each segment in table order
+InstallationTopology installation;
 
-  // Array of all controllers (to make it more efficient to update all of them at once)
-  LEDStripController *LedStripControllerArray[] = {  
-                                                    &ALedStripController_1
-                                                  };  
-
-  const int sideTriangleStripIndexes[] = { 0 };
-  const int topTriangleStripIndexes[] = { 0 };
-
-#else
-// Segmented version for production
-LEDStripController ALedStripController_1(aLEDs, 24, DEFAULT_PALETTE, !INVERT_STRIP, 0); // right side triangle
-LEDStripController ALedStripController_2(aLEDs, 16, DEFAULT_PALETTE, !INVERT_STRIP, 24); // top big triangle
-LEDStripController ALedStripController_3(aLEDs, 16, DEFAULT_PALETTE, INVERT_STRIP, 24+16); // top big triangle (inverted)
-LEDStripController ALedStripController_4(aLEDs, 24, DEFAULT_PALETTE, INVERT_STRIP, 24+32);  // left side triangle (inverted)
-
-
-LEDStripController BLedStripController_1(bLEDs, 24, DEFAULT_PALETTE, !INVERT_STRIP, 0); // right side triangle
-LEDStripController BLedStripController_2(bLEDs, 16, DEFAULT_PALETTE, !INVERT_STRIP, 24); // top big triangle
-LEDStripController BLedStripController_3(bLEDs, 16, DEFAULT_PALETTE, INVERT_STRIP, 24+16); // top big triangle (inverted)
-LEDStripController BLedStripController_4(bLEDs, 24, DEFAULT_PALETTE, INVERT_STRIP, 24+32);  // left side triangle (inverted)
+#if defined(PARALLEL_OUTPUT)
+  // the parallel controller clocks every lane out of one buffer, lane n starting at pixel n * ALEN
+  static_assert(ALEN == BLEN && BLEN == CLEN, "parallel lanes must all be the same length");
+#endif
 
+// Array of all controllers (to make it more efficient to update all of them at once)
+LEDStripController * const *LedStripControllerArray = installation.GetControllers();
 
-LEDStripController CLedStripController_1(cLEDs, 24, DEFAULT_PALETTE, !INVERT_STRIP, 0); // right side triangle
-LEDStripController CLedStripController_2(cLEDs, 16, DEFAULT_PALETTE, !INVERT_STRIP, 24); // top big triangle
-LEDStripController CLedStripController_3(cLEDs, 16, DEFAULT_PALETTE, INVERT_STRIP, 24+16); // top big triangle (inverted)
-LEDStripController CLedStripController_4(cLEDs, 24, DEFAULT_PALETTE, INVERT_STRIP, 24+32);  // left side triangle (inverted)
+// *******  THE NUMBER OF SEGMENTS FROM OUR LedStripControllerArray  ******* 
+const int NUM_SEGMENTS = InstallationTopology::GetSegmentCount();
+#define NUM_PHYSICAL_STRIPS ARRAY_SIZE(INSTALLATION_STRIPS)
 
+// segments in the same state are rendered once and copied into the others
+RenderGroups renderGroups(LedStripControllerArray, NUM_SEGMENTS);
 
 
-// Array of all controllers (to make it more efficient to update all of them at once)
-LEDStripController *LedStripControllerArray[] = {  
-                                                  &ALedStripController_1,
-                                                  &ALedStripController_2, 
-                                                  &ALedStripController_3,
-                                                  &ALedStripController_4,
-                                                  &BLedStripController_1,
-                                                  &BLedStripController_2, 
-                                                  &BLedStripController_3,
-                                                  &BLedStripController_4,
-                                                  &CLedStripController_1,
-                                                  &CLedStripController_2, 
-                                                  &CLedStripController_3,
-                                                  &CLedStripController_4,
-                                                };
-
-const int sideTriangleStripIndexes[] = {0, 3, 4, 7, 8, 11};
-const int topTriangleStripIndexes[] = {1, 2, 5, 6, 9, 10};
-                                                
+// *******  THE PHYSICAL STRIPS - see OutputBackend.h  ******* 
+// setup() picks the backend. bit n of dirtyPhysicalStrips is set when a segment on strip n changed
+// since it was last sent, and only those strips are sent (if the backend can send them separately)
+#if !defined(PARALLEL_OUTPUT)
+  CLEDController *physicalStrips[NUM_PHYSICAL_STRIPS];   // filled in by setup() with what FastLED.addLeds returns
+  FastLEDSequentialBackend sequentialBackend(physicalStrips, NUM_PHYSICAL_STRIPS);
 #endif
+OutputBackend *outputBackend;
+uint8_t dirtyPhysicalStrips = 0;
 
 
+// *******  POWER - see PowerLimiter.h  ******* 
+// which supply each physical strip draws from is in Installation.h. each supply gets POWER_SUPPLY_MILLIAMPS
+// to start with, and the strips on one that would draw more are dimmed together until they fit
+PowerLimiter powerLimiter(installation.GetStripLengths(), installation.GetStripSupplies(), NUM_PHYSICAL_STRIPS);
+uint32_t physicalStripLoads[NUM_PHYSICAL_STRIPS];
 
 
-// *******  THE NUMBER OF SEGMENTS FROM OUR LedStripControllerArray  ******* 
-const int NUM_SEGMENTS = ARRAY_SIZE(LedStripControllerArray);
+// *******  PIXELS STREAMED FROM A PC - see PixelStream.h  ******* 
+// while frames keep arriving they go straight onto the strips and the animations wait
+#if defined(PIXEL_STREAM_ENABLED)
+  CRGB streamBackBuffer[InstallationTopology::GetPixelCount()];
+  PixelStream pixelStream(installation.GetStripPixelPointers(), installation.GetStripLengths(), NUM_PHYSICAL_STRIPS, streamBackBuffer);
+#endif
 
 
 
@@ -113,6 +138,30 @@ const TProgmemRGBGradientPalettePtr COLOR_PALETTES[] = {
 const uint8_t NUM_COLOR_PALETTES = ARRAY_SIZE(COLOR_PALETTES);
 
 
+// *******  FUNCTION PROTOTYPES - the Arduino IDE makes these itself, the host build needs them  ******* 
+void renderFrame(const FrameTime &frame);
+void replayNextFrame();
+void handleLegacyCommand(char incomingByte);
+void applyPreset(const Preset &preset);
+void queueLegacyCommand(uint8_t legacyByte, uint32_t arrivalMicros);
+void queueSerialCommand(const SerialCommand &command, uint32_t arrivalMicros);
+Preset presetFromCommand(const SerialCommand &command);
+void markBeat(uint32_t arrivalMicros, uint16_t bpm);
+void dumpSession();
+void sendTelemetry(bool reset);
+void stopPixelStream();
+void applySerialCommand(const SerialCommand &command);
+void triggerAnimationGroupStrips(uint16_t groupMask, AnimationType animationToSet);
+void setGroupStripParams(uint16_t groupMask, uint8_t aHue, uint8_t aBrightness, uint16_t aBPM, uint8_t aBrightnessHigh, uint8_t aBrightnessLow);
+void setGroupStripColorPalettes(uint16_t groupMask, const CRGBPalette16 &newColorPalette);
+void fadeGroupStripColorPalettes(uint16_t groupMask, const CRGBPalette16 &newColorPalette, uint16_t crossfadeFrames);
+void setGroupStripLayers(uint16_t groupMask, uint8_t slot, const Layer &layer);
+void setGroupStripHueIndexBPMs(uint16_t groupMask, uint16_t hueIndexBPM);
+void reverseGroupStripHueIndexDirections(uint16_t groupMask);
+void turnTeensyLEDOn();
+void updateTeensyLED(uint32_t currentTime);
+
+
 // *********************************************************************************
 //      SETUP
 // *********************************************************************************
@@ -122,7 +171,14 @@ void setup() {
   Serial.begin(baudRate);     //initialize the host USB port.
 
   // THIS STEP SETS UP THE PHYSICAL REPRESENTATION OF OUR LED STRIPS
-  FastLED.addLeds<NEOPIXEL, APIN>(aLEDs, ALEN);
+#if defined(PARALLEL_OUTPUT)
+  // all three strips on one port, sent at once (see PARALLEL_OUTPUT in GlobalVariables.h for the pins)
+  static FastLEDParallelBackend parallelBackend( &FastLED.addLeds<WS2811_PORTD, NUM_PHYSICAL_STRIPS, GRB>(installation.GetPixels(), ALEN), NUM_PHYSICAL_STRIPS );
+  outputBackend = &parallelBackend;
+#else
+  physicalStrips[0] = &FastLED.addLeds<NEOPIXEL, APIN>(installation.GetStripPixels(0), ALEN);
+  outputBackend = &sequentialBackend;
+#endif
 
 #if defined(__TURNERS_TESTING_UNO__)
   pinMode(PRIMARY_BUTTON_PIN, INPUT_PULLUP);
@@ -131,14 +187,60 @@ void setup() {
 
 #elif defined(__TURNERS_TESTING_TEENSY__)
   // don't add more strips if we're testing  
-#else
-  FastLED.addLeds<NEOPIXEL, CPIN>(cLEDs, CLEN);
-  FastLED.addLeds<NEOPIXEL, BPIN>(bLEDs, BLEN);
+#elif !defined(PARALLEL_OUTPUT)
+  physicalStrips[2] = &FastLED.addLeds<NEOPIXEL, CPIN>(installation.GetStripPixels(2), CLEN);
+  physicalStrips[1] = &FastLED.addLeds<NEOPIXEL, BPIN>(installation.GetStripPixels(1), BLEN);
 #endif
 
   // set master brightness control from our global variable
   FastLED.setBrightness(fastLEDGlobalBrightness);
 
+#if defined(PIXEL_STREAM_ENABLED)
+  serialProtocol.SetPixelStream(&pixelStream);
+#endif
+
+#if defined(TELEMETRY_ENABLED)
+  telemetry.Begin();
+  renderGroups.SetTelemetry(&telemetry);
+#endif
+
+  // every segment starts out drawing with (and crossfading along with) the shared palette
+  for(int i = 0; i < NUM_SEGMENTS; i++){
+    LedStripControllerArray[i]->FollowPalette( &sharedPalette );
+    LedStripControllerArray[i]->FollowTempo( &beatTracker );
+  }
+
+  // what each single character command does: the defaults, and whatever Max has saved over them (see Presets.h)
+  Presets::Begin();
+
+#if defined(SPATIAL_EFFECTS_ENABLED)
+  // where every pixel is on the sculpture (Installation.h), for the animations that draw across all of it
+  InstallationPixelMap::Attach( LedStripControllerArray );
+  SpatialEffects::Register();
+#endif
+
+  // start the frame grid now
+  uint32_t startMicros = micros();
+  uint32_t startMillis = millis();
+  frameClock.Start(startMicros, startMillis);
+
+  // make sure every strip goes out on the first frame
+  dirtyPhysicalStrips = ALL_OUTPUT_STRIPS;
+
+  // PLAY A CAPTURE BACK FROM THE SAME RANDOM SEED, OR START RECORDING THIS SHOW
+#if defined(REPLAY_CAPTURE)
+  static SessionReplay captureReplay(replayCapture, sizeof(replayCapture));
+  sessionReplay = &captureReplay;
+#endif
+  if(sessionReplay){
+    random16_set_seed(sessionReplay->GetSeed());
+  }
+#if defined(SESSION_CAPTURE_BYTES)
+  else {
+    sessionRecorder.Begin(sessionCaptureBuffer, SESSION_CAPTURE_BYTES, random16_get_seed(), FRAME_INTERVAL_MICROS, startMicros, startMillis);
+  }
+#endif
+
 }
 
 // *********************************************************************************
@@ -146,438 +248,583 @@ void setup() {
 // *********************************************************************************
 void loop() {
 
+  // a capture plays back instead of Max
+  if(sessionReplay){
+    replayNextFrame();
+    return;
+  }
+
+  static uint32_t currentTime;
+  currentTime = millis();
+  uint32_t arrivalMicros = micros();
+
+  // MOVE WHATEVER MAX HAS SENT INTO OUR RECEIVE RING WITHOUT WAITING FOR MORE
+#if defined(TELEMETRY_ENABLED)
+  uint16_t usbBacklog = Serial.available();
+#endif
+  uint16_t serialBytes = 0;
+  while(Serial.available() && serialProtocol.Room()) {
+    serialProtocol.Push(Serial.read());
+    serialBytes++;
+  }
+
+#if defined(TELEMETRY_ENABLED)
+  telemetry.RecordLoop(arrivalMicros, serialBytes, usbBacklog, SERIAL_RX_BUFFER_SIZE - serialProtocol.Room());
+#endif
+
   // SET THE STRIP'S ANIMATION BASED ON THE INPUT FROM MAX PATCH
-  while(Serial.available()) {         // check for incoming bytes
-    incomingByte = Serial.read();   // read incoming byte
-    
-    // you now have control over these parameters for each strip
-    uint8_t aHue = 176;              // the hue/color of the strip for all animations other than the palette controlled animations. 0 (red) - 255 (end spectrum red)
-    uint8_t aBrightness = 255;      // the brightness of the strip for all animations INCLUDING palette controlled animations
-    uint16_t aBPM = 85;             // the speed of the Brightness shifting animation in BPM for any of the "Fade" animations
-    uint16_t aPalSpeed = 85;        // the speed of the Palette movement animation in BPM for any of the "Fade" animations
-    uint8_t aBrightnessHigh = 255;  // the top level of brightness for any of the "Fade" animations
-    uint8_t aBrightnessLow = 80;    // the bottom level of brightness for any of the "Fade" animations; colors below ~30 are very inaccurate
-
-    // add this function into the switch statement below before triggering an animation
-    //setAllStripParams(aHue, aBrightness, aBPM, aBrightnessHigh, aBrightnessLow);
-
-    // for color palette animations, you can use this one as well
-    CRGBPalette16 aColorPalette = tk_Rainbow_gp; // the color palette that controls the colors for any of the palette controlled animations
-    //setAllStripColorPalettes(newColorPalette);
-
-    switch (incomingByte) {
-      case 'o':
-      {
-        triggerAnimationAllStrips(ALL_OFF);
-        break;
+  // only decode a few messages per pass so a burst of commands can't starve the render below
+  // (pixel chunks have already gone to the pixel stream by the time Poll() hands them back)
+  for(int i = 0; i < SERIAL_MESSAGES_PER_LOOP; i++){
+    SerialCommand command;
+    uint8_t legacyByte;
+
+    SerialMessageType messageType = serialProtocol.Poll(currentTime, command, legacyByte);
+    if(messageType == SERIAL_MESSAGE_NONE){
+      break;
+    }
+    else if(messageType == SERIAL_MESSAGE_LEGACY){
+      Serial.write('K');    // still alive
+      sessionRecorder.RecordLegacy(frameClock.GetFrameCount(), arrivalMicros, legacyByte);
+      queueLegacyCommand(legacyByte, arrivalMicros);
+    }
+    else if(messageType == SERIAL_MESSAGE_COMMAND){
+      Serial.write('K');
+      if(command.opcode != SERIAL_OP_DUMP_SESSION && command.opcode != SERIAL_OP_TELEMETRY){
+        sessionRecorder.RecordCommand(frameClock.GetFrameCount(), arrivalMicros, command);
       }
+      queueSerialCommand(command, arrivalMicros);
+    }
+  }
 
-      case 'O':
-      {
-        triggerAnimationAllStrips(FADE_OUT_BPM);
-        break;
-      }
+  // update the teensy led (this makes it so the teensy LED doesn't block the main thread)
+  updateTeensyLED(currentTime);
 
 
-      case 'A':
-      {
-        triggerAnimationAllStrips(SOLID_COLOR);
-        break;
+  // EVERYTHING BELOW HAPPENS ONCE PER FRAME, ON THE FRAME CLOCK'S FIXED GRID
+  FrameTime frame;
+  if( !frameClock.Poll(micros(), frame) ){
+#if LOG_LEVEL > LOG_LEVEL_NONE
+    // no frame due, so there's time to send a little of the log
+    serialLog.Drain(Serial, LOG_BYTES_PER_LOOP);
+#endif
+    return;
+  }
+
+  sessionRecorder.RecordFrame(frame);
+  renderFrame(frame);
+
+}
+
+
+// *********************************************************************************
+//      ONE FRAME
+// *********************************************************************************
+// everything that happens on the frame clock's grid, whether the frame is live or replayed
+void renderFrame(const FrameTime &frame){
+
+#if defined(TELEMETRY_ENABLED)
+  uint32_t frameStartCycles = Telemetry::Cycles();
+#endif
+
+  // BRING THE BEAT GRID UP TO THIS FRAME. the segments pick up a new tempo when they render
+  beatTracker.Update(frame);
+
+  // RUN THE COMMANDS THAT WERE WAITING FOR THIS FRAME
+  // anything they trigger starts on exactly this frame's time
+  FrameClock::SetAnimationMillis(frame.millis);
+  QueuedCommand queuedCommand;
+  while(commandQueue.PopDue(frame, queuedCommand)){
+    if(queuedCommand.legacy){
+      handleLegacyCommand(queuedCommand.legacyByte);
+    }
+    else {
+      applySerialCommand(queuedCommand.command);
+    }
+  }
+
+  // MOVE ANY PALETTE CROSSFADE ALONG ONE STEP. done once here for every segment that shares the palette
+  sharedPalette.Update();
+
+  // UPDATE THE VISUAL REPRESENTATION OF OUR STRIPS IN EACH STRIP CONTROLLER OBJECT
+  // every segment gets the same frame time, so they all render in phase with the show below
+  // and we remember which physical strips now hold something different from what they're showing.
+  // segments that share a render group only render once between them.
+  // while a PC is streaming pixels its frames are already on the strips, and the animations sit it out
+  uint16_t changedSegments = 0;
+  bool streaming = false;
+#if defined(PIXEL_STREAM_ENABLED)
+  bool wasStreaming = pixelStream.IsActive();
+  streaming = pixelStream.Update(frame);
+  if(streaming){
+    uint8_t streamedStrips = pixelStream.TakeChangedStrips();
+    dirtyPhysicalStrips |= streamedStrips;
+
+    // streamed pixels come with no idea of their load, so the strips that changed are added up
+    for(uint8_t i = 0; i < NUM_PHYSICAL_STRIPS; i++){
+      if(streamedStrips & (1 << i)){
+        physicalStripLoads[i] = PixelsPowerLoad(installation.GetStripPixels(i), installation.GetStripLengths()[i]);
       }
+    }
+  }
+  else {
+    if(wasStreaming){
+      stopPixelStream();
+    }
+    changedSegments = renderGroups.Update(frame);
+  }
+#else
+  changedSegments = renderGroups.Update(frame);
+#endif
+
+  for(int i = 0; i < NUM_SEGMENTS; i++){
+    if(changedSegments & (1 << i)){
+      dirtyPhysicalStrips |= (1 << InstallationTopology::GetSegmentStrip(i));
+    }
+  } 
+
+  // KEEP EVERY POWER SUPPLY UNDER ITS BUDGET
+  // the segments kept their loads as they drew, so this is a dozen additions rather than a pass
+  // over the pixels. a strip whose dimming changed has to go out again even if its pixels didn't
+  if(!streaming){
+    for(uint8_t i = 0; i < NUM_PHYSICAL_STRIPS; i++){
+      physicalStripLoads[i] = 0;
+    }
+    for(int i = 0; i < NUM_SEGMENTS; i++){
+      physicalStripLoads[ InstallationTopology::GetSegmentStrip(i) ] += LedStripControllerArray[i]->GetPowerLoad();
+    }
+  }
+  dirtyPhysicalStrips |= powerLimiter.Update( physicalStripLoads, FastLED.getBrightness(), *outputBackend );
+
+  // PUSH OUT LATEST FRAME TO THE ACTUAL PHYSICAL LEDS
+  // this physically displays the current state of leds in each strip controller object
+  // strips that haven't changed are skipped (sending one blocks serial for ~2.4 ms per 80 pixels)
+  // except for a periodic keep-alive so a glitched or re-plugged strip recovers
+  bool keepAlive = (uint32_t)(frame.millis - timeOfLastKeepAliveShow) >= SHOW_KEEP_ALIVE_INTERVAL;
+
+  if(dirtyPhysicalStrips || keepAlive){
+#if defined(TELEMETRY_ENABLED)
+    uint32_t showStartCycles = Telemetry::Cycles();
+    outputBackend->Show( keepAlive ? ALL_OUTPUT_STRIPS : dirtyPhysicalStrips, FastLED.getBrightness() );
+    telemetry.RecordShow( Telemetry::Cycles() - showStartCycles );
+#else
+    outputBackend->Show( keepAlive ? ALL_OUTPUT_STRIPS : dirtyPhysicalStrips, FastLED.getBrightness() );
+#endif
+    dirtyPhysicalStrips = 0;
+  }
+
+  if(keepAlive){
+    timeOfLastKeepAliveShow = frame.millis;
+  }
+
+#if defined(TELEMETRY_ENABLED)
+  telemetry.RecordFrame( frame, Telemetry::Cycles() - frameStartCycles, commandQueue.GetCount() );
+#endif
+
+}
+
+
+// the PC stopped sending pixels. the animations start again from black, so none of its frame is left behind
+void stopPixelStream(){
+
+  PixelKernels::Fill(installation.GetPixels(), InstallationTopology::GetPixelCount(), CRGB::Black);
+
+  for(int i = 0; i < NUM_SEGMENTS; i++){
+    LedStripControllerArray[i]->ForgetStripContents();
+  }
+
+  dirtyPhysicalStrips = ALL_OUTPUT_STRIPS;
+
+}
+
+
+// *********************************************************************************
+//      SESSION REPLAY
+// *********************************************************************************
+// the messages recorded before the next frame go through the same queueing as live ones, then the
+// frame renders at exactly its recorded time. every frame is hashed so two replays can be compared
+void replayNextFrame(){
+
+  static uint32_t replayStartMicros = 0;
+  static bool replayReported = false;
+
+#if !defined(REPLAY_UNPACED)
+  // keep to the frame rate. the frame clock moves the beat functions' time, which commands run
+  // between frames would see, so it goes back to where the last replayed frame left it
+  FrameTime pace;
+  uint32_t animationMillis = FrameClock::GetAnimationMillis();
+  if( !frameClock.Poll(micros(), pace) ){
+    return;
+  }
+  FrameClock::SetAnimationMillis(animationMillis);
+#endif
+
+  if(sessionReplay->GetFramesPlayed() == 0){
+    replayStartMicros = micros();
+  }
+
+  SessionMessage message;
+  while(sessionReplay->NextMessage(message)){
+    if(message.legacy){
+      queueLegacyCommand(message.legacyByte, message.arrivalMicros);
+    }
+    else {
+      queueSerialCommand(message.command, message.arrivalMicros);
+    }
+  }
+
+  FrameTime frame;
+  if(sessionReplay->NextFrame(frame)){
+    renderFrame(frame);
+    for(uint8_t i = 0; i < NUM_PHYSICAL_STRIPS; i++){
+      sessionReplay->HashFrame(installation.GetStripPixels(i), installation.GetStripLengths()[i]);
+    }
+    return;
+  }
+
+  // the capture ran out. say what it rendered, once
+  if(!replayReported){
+    uint32_t elapsedMicros = micros() - replayStartMicros;
+    Serial.print("replay frames: ");
+    Serial.println(sessionReplay->GetFramesPlayed());
+    Serial.print("replay hash: ");
+    Serial.println(sessionReplay->GetHash(), HEX);
+    Serial.print("replay frames/sec: ");
+    Serial.println(elapsedMicros ? (uint32_t)((uint64_t)sessionReplay->GetFramesPlayed() * 1000000UL / elapsedMicros) : 0);
+    replayReported = true;
+  }
+
+}
+
+
 
-      case 'b':
-      {
-        setAllStripParams(176, 255, aBPM, 150, 90);  //(aHue, aBrightness, aBPM, aBrightnessHigh, aBrightnessLow)
-        triggerAnimationAllStrips(FADE_LOW_BPM);
-        break;
+
+
+
+// *********************************************************************************
+//      COMMAND HANDLING
+// *********************************************************************************
+// the original single character commands from the Max patch, and any Max has added since (see Presets.h)
+void handleLegacyCommand(char incomingByte){
+
+  const Preset *preset = Presets::Find( (uint8_t)incomingByte );
+  if(preset){
+    applyPreset(*preset);
+  }
+
+}
+
+
+// a preset's actions, in the order the keys always did them
+void applyPreset(const Preset &preset){
+
+  uint16_t tempo = beatTracker.GetBPM();
+  uint16_t settingsMask = (preset.actions & PRESET_GROUP_SETTINGS) ? preset.groupMask : SERIAL_ALL_GROUPS;
+
+  if(preset.actions & PRESET_RANDOM_PARAMS){
+    uint8_t newHue = random8();
+    uint8_t newBrightness = random8(30, 220);
+    uint8_t newBrightnessHigh = random8(150, 255);
+    uint8_t newBrightnessLow = random8(30, 50); // min 30;  colors below ~30 are very inaccurate
+    uint16_t newBPM = random16(60, 160);
+
+    LOG_INFO("Hue: ", newHue, " Brightness: ", newBrightness, " bpm: ", newBPM, " High: ", newBrightnessHigh, " Low: ", newBrightnessLow);
+
+    setGroupStripParams(settingsMask, newHue, newBrightness, newBPM, newBrightnessHigh, newBrightnessLow);
+  }
+  else if(preset.actions & PRESET_PARAMS){
+    setGroupStripParams(settingsMask, preset.hue, preset.brightness, Presets::ResolveBPM(preset.bpm, tempo), preset.brightnessHigh, preset.brightnessLow);
+  }
+
+  if(preset.actions & PRESET_PALETTE){
+    // drawn for a fixed palette too, so replayed sessions get the random numbers they were recorded with
+    uint8_t paletteIndex = random8( NUM_COLOR_PALETTES );
+    if(preset.paletteIndex != PRESET_RANDOM_PALETTE){
+      paletteIndex = preset.paletteIndex;
+    }
+
+    if(paletteIndex < NUM_COLOR_PALETTES){
+      LOG_INFO("Palette: ", paletteIndex);
+      fadeGroupStripColorPalettes(settingsMask, COLOR_PALETTES[paletteIndex], paletteCrossfadeFrames);
+    }
+  }
+
+  if(preset.actions & PRESET_HUE_INDEX_BPM){
+    uint16_t hueIndexBPM = Presets::ResolveBPM(preset.hueIndexBPM, tempo);
+
+    LOG_INFO("BPM: ", hueIndexBPM);
+
+    setGroupStripHueIndexBPMs(settingsMask, hueIndexBPM); // this is the call to change the Palette scroll speed in BPM
+  }
+
+  if(preset.actions & PRESET_REVERSE_HUE){
+    LOG_INFO("reversing hue index direction");
+
+    // reverses the direction of the palette movement across the strip
+    reverseGroupStripHueIndexDirections(settingsMask);
+  }
+
+  // a saved preset can name a program that hasn't been uploaded since the last reset
+  if((preset.actions & PRESET_TRIGGER) && LEDStripController::IsAnimationRegistered(preset.animation)){
+    triggerAnimationGroupStrips(preset.groupMask, preset.animation);
+  }
+
+}
+
+
+// a single character command waits in the queue for its frame, when Max has asked for that
+void queueLegacyCommand(uint8_t legacyByte, uint32_t arrivalMicros){
+
+  // the Max patch sends B on the downbeat and b on every quarter note, so they're our beats as well
+  if(legacyByte == 'B' || legacyByte == 'b'){
+    markBeat(arrivalMicros, 0);
+  }
+
+  QueuedCommand queuedCommand;
+  queuedCommand.legacy = true;
+  queuedCommand.legacyByte = legacyByte;
+
+  if(!commandQueue.IsScheduling()){
+    handleLegacyCommand(legacyByte);
+  }
+  else if(!commandQueue.Schedule(arrivalMicros, queuedCommand)){
+    LOG_ERROR("command queue full, dropped ", (char)legacyByte);
+  }
+
+}
+
+
+// the timing frames set up the queue as they arrive. everything else waits in it for its frame
+void queueSerialCommand(const SerialCommand &command, uint32_t arrivalMicros){
+
+  switch (command.opcode) {
+    case SERIAL_OP_TIMING:
+      commandQueue.SetTiming(command.subdivision, (uint32_t)command.latencyMillis * 1000);
+      return;
+
+    case SERIAL_OP_BEAT:
+      markBeat(arrivalMicros, command.bpm);
+      return;
+
+    case SERIAL_OP_DUMP_SESSION:
+      dumpSession();
+      return;
+
+    case SERIAL_OP_POWER_BUDGET:
+      powerLimiter.SetBudget(command.powerSupply, command.powerBudgetMilliamps);
+      return;
+
+    case SERIAL_OP_TELEMETRY:
+      sendTelemetry(command.telemetryReset);
+      return;
+
+    // a program goes into its slot straight away, so a trigger for it right behind finds it there
+    case SERIAL_OP_PROGRAM_CODE:
+#if defined(EFFECT_PROGRAMS_ENABLED)
+      EffectVM::StageCode(command.programIndex, command.programCode, SERIAL_PROGRAM_CHUNK_INSTRUCTIONS);
+#endif
+      return;
+
+    case SERIAL_OP_PROGRAM_LOAD:
+#if defined(EFFECT_PROGRAMS_ENABLED)
+      if(!EffectVM::LoadStaged(command.programSlot, command.programLength, command.programFade, command.programUpdateInterval)){
+        LOG_ERROR("program ", command.programSlot, " didn't load");
       }
-      
-      case 'B':
-      {
-        setAllStripParams(176, 255, aBPM, 255, 90);  //(aHue, aBrightness, aBPM, aBrightnessHigh, aBrightnessLow)
-        triggerAnimationAllStrips(FADE_LOW_BPM);
-        break;
+#endif
+      return;
+
+    // a preset is in place straight away too, for a key right behind it
+    case SERIAL_OP_PRESET_STORE:
+      if(!Presets::Store(presetFromCommand(command))){
+        LOG_ERROR("no room for preset ", command.presetKey);
       }
-      
-      case 'E':
-      {      
-        setAllStripParams(176, 255, aBPM*2, 255, 90);  //(aHue, aBrightness, aBPM, aBrightnessHigh, aBrightnessLow)
-        triggerAnimationAllStrips(FADE_LOW_BPM);
-        break;
+      return;
+
+    case SERIAL_OP_PRESET_SAVE:
+      if(command.presetRevert){
+        Presets::Revert();
       }
-      
-      case 'N':
-      {
-        triggerAnimationAllStrips(FADE_IN_OUT_BPM);
-        break;
+      // a replay plays the edits it recorded, but mustn't change what the next power up starts with
+      if(!sessionReplay && !Presets::Save()){
+        LOG_ERROR("presets didn't fit in EEPROM");
       }
+      return;
+  }
 
-      case 'i':
-      {
-        triggerAnimationAllStrips(PALETTE);
-        break;
-      }
+  QueuedCommand queuedCommand;
+  queuedCommand.legacy = false;
+  queuedCommand.command = command;
 
-      case 'p':
-      {
-        // for this animation, (PALETTE_FADE_LOW_BPM) - DIMMER
-        // argument 1 does nothing so we set to 0 (normally hue)
-        // argument 1 does nothing so we set to 0 (normally brightness)
-        // argument 3 sets the speed of the fade in BPM
-        // argument 4 sets the brightness the fade starts at
-        // argument 5 sets the brightness the fade ends at  
-        setAllStripParams(0, 0, aBPM, 150, 20);  //(aHue, aBrightness, aBPM, aBrightnessHigh, aBrightnessLow)
-        //setAllStripParams(0, 0, aBPM, 140, 20);  // Lowered brightness version for non-1 beats
-        //setAllStripColorPalettes(tk_Fire_Red_gp); // Switch to an arbitraty new Palette
-        setAllStripHueIndexBPMs(10); // this is the call to change the Palette scroll speed in BPM
-        //reverseAllStripHueIndexDirections(); // reverses Palette scroll direction with every Pulse
-        triggerAnimationAllStrips(PALETTE_FADE_LOW_BPM); // Call the Animation using ENUM name
-        //triggerAnimationAllStrips(DDT_EXPERIMENTAL); // experiments with waves
-        break;
-      }      
-      
-      case 'P':
-      {
-        // for this animation, (PALETTE_FADE_LOW_BPM) - BRIGHTER
-        // argument 1 does nothing so we set to 0 (normally hue)
-        // argument 1 does nothing so we set to 0 (normally brightness)
-        // argument 3 sets the speed of the fade in BPM
-        // argument 4 sets the brightness the fade starts at
-        // argument 5 sets the brightness the fade ends at  
-        setAllStripParams(0, 0, aBPM, 255, 20);  //(aHue, aBrightness, aBPM, aBrightnessHigh, aBrightnessLow)
-        //setAllStripParams(0, 0, aBPM, 140, 20);  // Lowered brightness version for non-1 beats
-        //setAllStripColorPalettes(tk_Fire_Red_gp); // Switch to an arbitraty new Palette
-        setAllStripHueIndexBPMs(10); // this is the call to change the Palette scroll speed in BPM
-        //reverseAllStripHueIndexDirections(); // reverses Palette scroll direction with every Pulse
-        triggerAnimationAllStrips(PALETTE_FADE_LOW_BPM); // Call the Animation using ENUM name
-        //triggerAnimationAllStrips(DDT_EXPERIMENTAL); // experiments with waves
-        break;
-      }      
-
-      case 'g':
-      {
-        // for this animation, (PALETTE_W_GLITTER_FADE_LOW_BPM) - DIMMER
-        // argument 1 does nothing so we set to 0 (normally hue)
-        // argument 2 sets the brightness of the glitter pops
-        // argument 3 sets the speed of the fade in BPM
-        // argument 4 sets the brightness the fade starts at
-        // argument 5 sets the brightness the fade ends at
-        setAllStripParams(0, 125, aBPM*2, 150, 20);  //(aHue, aBrightness, aBPM, aBrightnessHigh, aBrightnessLow)
-        //setAllStripColorPalettes(Analogous_1_gp);
-        triggerAnimationAllStrips(PALETTE_W_GLITTER_FADE_LOW_BPM);
-        break;
-      }      
-      
-      case 'G':
-      {
-        // for this animation, (PALETTE_W_GLITTER_FADE_LOW_BPM) - BRIGHTER
-        // argument 1 does nothing so we set to 0 (normally hue)
-        // argument 2 sets the brightness of the glitter pops
-        // argument 3 sets the speed of the fade in BPM
-        // argument 4 sets the brightness the fade starts at
-        // argument 5 sets the brightness the fade ends at
-        setAllStripParams(0, 125, aBPM*2, 255, 20);  //(aHue, aBrightness, aBPM, aBrightnessHigh, aBrightnessLow)
-        //setAllStripColorPalettes(Analogous_1_gp);
-        triggerAnimationAllStrips(PALETTE_W_GLITTER_FADE_LOW_BPM);
-        break;
-      }      
-
-      case 'C':
-      {
-        setAllStripParams(0, 255, 60, 255, 20); // 3rd variable aBPM is closest thing to a Speed control; max is 255, default is 60
-        triggerAnimationAllStrips(CONFETTI);
-        break;
-      }
+  if(!commandQueue.IsScheduling()){
+    applySerialCommand(command);
+  }
+  else if(!commandQueue.Schedule(arrivalMicros, queuedCommand)){
+    LOG_ERROR("command queue full, dropped opcode ", command.opcode);
+  }
 
-      case 'S':
-      {
-        setAllStripParams(0, 255, aBPM, 255, 20);  // aBPM is speed of Sinelon animation
-        triggerAnimationAllStrips(SINELON);
-        break;
-      }
-      case 's':
-      {
-        setAllStripParams(0, 255, aBPM, 255, 20);  // aBPM is speed of Sinelon animation
+}
 
-        triggerAnimationSideTriangleStrips(SINEPULSE);
-       
-        break;
-      }
-      case 't':
-      {
-        setAllStripParams(0, 255, aBPM*2, 255, 20);  // aBPM is speed of Sinelon animation
-
-        triggerAnimationTopTriangleStrips(SINEPULSE);
-        
-        break;
-      }      
-      case 'x':
-      {
-        // for this animation, (PALETTE_FADE_LOW_BPM)
-        // argument 1 does nothing so we set to 0 (normally hue)
-        // argument 1 does nothing so we set to 0 (normally brightness)
-        // argument 3 sets the speed of the fade in BPM
-        // argument 4 sets the brightness the fade starts at
-        // argument 5 sets the brightness the fade ends at  
-        setAllStripParams(0, 255, aBPM, 255, 20);  //(aHue, aBrightness, aBPM, aBrightnessHigh, aBrightnessLow)
-        //setAllStripParams(0, 0, aBPM, 140, 20);  // Lowered brightness version for non-1 beats
-        //setAllStripColorPalettes(tk_Fire_Red_gp); // Switch to an arbitraty new Palette
-        setAllStripHueIndexBPMs(10); // this is the call to change the Palette scroll speed in BPM
-        //reverseAllStripHueIndexDirections(); // reverses Palette scroll direction with every Pulse
-        //triggerAnimationAllStrips(PALETTE_FADE_LOW_BPM); // Call the Animation using ENUM name
-        triggerAnimationAllStrips(DDT_EXPERIMENTAL); // experiments with waves
-        break;
-      }      
-      
-      case 'y':
-        {
-          uint8_t paletteIndex = random8( NUM_COLOR_PALETTES );
-          CRGBPalette16 newColorPalette = COLOR_PALETTES[paletteIndex];
-
-          Serial.println("************");
-          Serial.print("Palette: ");
-          Serial.println(paletteIndex);
-          Serial.println("************");
-
-          setAllStripColorPalettes(newColorPalette);
-          break;
-        }
-
-      case 'z':
-        {
-          uint8_t newHue = random8();
-          uint8_t newBrightness = random8(30, 220);
-          uint8_t newBrightnessHigh = random8(150, 255);
-          uint8_t newBrightnessLow = random8(30, 50); // min 30;  colors below ~30 are very inaccurate
-          uint16_t newBPM = random16(60, 160);
-
-          Serial.println("************");
-          Serial.print("Hue: ");
-          Serial.println(newHue);
-          Serial.print("Brightness: ");
-          Serial.println(newBrightness);
-          Serial.print("bpm: ");
-          Serial.println(newBPM);
-          Serial.print("High: ");
-          Serial.println(newBrightnessHigh);
-          Serial.print("Low: ");
-          Serial.println(newBrightnessLow);
-          Serial.println("************");
-          
-          setAllStripParams(newHue, newBrightness, newBPM, newBrightnessHigh, newBrightnessLow);
-          break;
-        }
-
- case '0':
-        {
-          uint8_t paletteIndex = random8( NUM_COLOR_PALETTES );
-          CRGBPalette16 newColorPalette = COLOR_PALETTES[0];
-
-          Serial.println("************");
-          Serial.print("Palette: ");
-          Serial.println(paletteIndex);
-          Serial.println("************");
-
-          setAllStripColorPalettes(newColorPalette);
-          break;
-        }
-
- case '1':
-        {
-          uint8_t paletteIndex = random8( NUM_COLOR_PALETTES );
-          CRGBPalette16 newColorPalette = COLOR_PALETTES[1];
-
-          Serial.println("************");
-          Serial.print("Palette: ");
-          Serial.println(paletteIndex);
-          Serial.println("************");
-
-          setAllStripColorPalettes(newColorPalette);
-          break;
-        }
-        
- case '2':
-        {
-          uint8_t paletteIndex = random8( NUM_COLOR_PALETTES );
-          CRGBPalette16 newColorPalette = COLOR_PALETTES[2];
-
-          Serial.println("************");
-          Serial.print("Palette: ");
-          Serial.println(paletteIndex);
-          Serial.println("************");
-
-          setAllStripColorPalettes(newColorPalette);
-          break;
-        }
-
- case '3':
-        {
-          uint8_t paletteIndex = random8( NUM_COLOR_PALETTES );
-          CRGBPalette16 newColorPalette = COLOR_PALETTES[3];
-
-          Serial.println("************");
-          Serial.print("Palette: ");
-          Serial.println(paletteIndex);
-          Serial.println("************");
-
-          setAllStripColorPalettes(newColorPalette);
-          break;
-        }
-
- case '4':
-        {
-          uint8_t paletteIndex = random8( NUM_COLOR_PALETTES );
-          CRGBPalette16 newColorPalette = COLOR_PALETTES[4];
-
-          Serial.println("************");
-          Serial.print("Palette: ");
-          Serial.println(paletteIndex);
-          Serial.println("************");
-
-          setAllStripColorPalettes(newColorPalette);
-          break;
-        }
-        
- case '5':
-        {
-          uint8_t paletteIndex = random8( NUM_COLOR_PALETTES );
-          CRGBPalette16 newColorPalette = COLOR_PALETTES[5];
-
-          Serial.println("************");
-          Serial.print("Palette: ");
-          Serial.println(paletteIndex);
-          Serial.println("************");
-
-          setAllStripColorPalettes(newColorPalette);
-          break;
-        }
-        
- case '6':
-        {
-          uint8_t paletteIndex = random8( NUM_COLOR_PALETTES );
-          CRGBPalette16 newColorPalette = COLOR_PALETTES[6];
-
-          Serial.println("************");
-          Serial.print("Palette: ");
-          Serial.println(paletteIndex);
-          Serial.println("************");
-
-          setAllStripColorPalettes(newColorPalette);
-          break;
-        }
-
- case '7':
-        {
-          uint8_t paletteIndex = random8( NUM_COLOR_PALETTES );
-          CRGBPalette16 newColorPalette = COLOR_PALETTES[7];
-
-          Serial.println("************");
-          Serial.print("Palette: ");
-          Serial.println(paletteIndex);
-          Serial.println("************");
-
-          setAllStripColorPalettes(newColorPalette);
-          break;
-        }        
-
- case '8':
-        {
-          uint8_t paletteIndex = random8( NUM_COLOR_PALETTES );
-          CRGBPalette16 newColorPalette = COLOR_PALETTES[8];
-
-          Serial.println("************");
-          Serial.print("Palette: ");
-          Serial.println(paletteIndex);
-          Serial.println("************");
-
-          setAllStripColorPalettes(newColorPalette);
-          break;
-        }       
-
- case '9':
-        {
-          uint8_t paletteIndex = random8( NUM_COLOR_PALETTES );
-          CRGBPalette16 newColorPalette = COLOR_PALETTES[9];
-
-          Serial.println("************");
-          Serial.print("Palette: ");
-          Serial.println(paletteIndex);
-          Serial.println("************");
-
-          setAllStripColorPalettes(newColorPalette);
-          break;
-        }       
-  
-        
- case 'R':
-        {
-
-          Serial.println("************");
-          Serial.println("reversing hue index direction");
-          Serial.println("************");
-
-          // reverses the direction of the palette movement across the strip
-          reverseAllStripHueIndexDirections();
-          break;
-        }
-        
- case 'D':
-        {
-          // sets the BPM of the color palette speed to aPalSpeed
-          uint16_t hueIndexBPM = aPalSpeed;
-
-          Serial.println("************");
-          Serial.print("BPM: ");
-          Serial.println(hueIndexBPM);
-          Serial.println("************");
-
-          setAllStripHueIndexBPMs(hueIndexBPM); // this is the call to change the Palette scroll speed in BPM
-          break;
-        }
- case 'd':
-        {
-          // sets the BPM of the color palette speed to half of aPalSpeed
-          uint16_t hueIndexBPM = aPalSpeed / 2;
-
-          Serial.println("************");
-          Serial.print("BPM: ");
-          Serial.println(hueIndexBPM);
-          Serial.println("************");
-
-          setAllStripHueIndexBPMs(hueIndexBPM);
-          break;
-        }
-
-
-        
-    }  // end of switch
-    
+
+// what a SERIAL_OP_PRESET_STORE frame asks a key to do. its group mask is where the animation is triggered
+Preset presetFromCommand(const SerialCommand &command){
+
+  Preset preset;
+  preset.key = command.presetKey;
+  preset.actions = command.presetActions;
+  preset.groupMask = command.groupMask;
+  preset.animation = command.animation;
+  preset.hue = command.hue;
+  preset.brightness = command.brightness;
+  preset.bpm = command.bpm;
+  preset.brightnessHigh = command.brightnessHigh;
+  preset.brightnessLow = command.brightnessLow;
+  preset.paletteIndex = command.paletteIndex;
+  preset.hueIndexBPM = command.hueIndexBPM;
+  return preset;
+
+}
+
+
+// a beat from Max (bpm 0 if it didn't say). quantized commands round to the tracked grid rather than
+// to the beat as it arrived, so serial jitter doesn't move the grid
+void markBeat(uint32_t arrivalMicros, uint16_t bpm){
+
+  if(beatTracker.OnBeat(arrivalMicros, bpm) && beatTracker.HasTempo()){
+    commandQueue.SetBeatGrid(beatTracker.GetBeatMicros() + commandQueue.GetLatencyMicros(), beatTracker.GetPeriodMicros());
   }
 
-  static uint32_t currentTime;
-  currentTime = millis();
+}
 
-  // update the teensy led (this makes it so the teensy LED doesn't block the main thread)
-  updateTeensyLED(currentTime);
 
+// send Max the show so far, as a capture the host's replay_session tool (or REPLAY_CAPTURE) can play back
+void dumpSession(){
 
-  // UPDATE THE VISUAL REPRESENTATION OF OUR STRIPS IN EACH STRIP CONTROLLER OBJECT
-  for(int i = 0; i < NUM_SEGMENTS; i++){
-    LedStripControllerArray[i]->Update(currentTime);
-  } 
+  sessionRecorder.Seal(frameClock.GetFrameCount());
+  Serial.write(sessionRecorder.GetData(), sessionRecorder.GetLength());
 
-  // PUSH OUT LATEST FRAME TO THE ACTUAL PHYSICAL LEDS
-  // this physically displays the current state of leds in each strip controller object
-  // we wrap it in a timer so that it only triggers at our chosen frame rate
-  if( currentTime > timeToCallFastLEDShow ){
-     FastLED.show();
-     timeToCallFastLEDShow = currentTime + (1000/FRAMES_PER_SECOND);
+}
+
+
+// tell Max how the show is running, as text lines between "telemetry" and "end" (see SERIAL_OP_TELEMETRY)
+void sendTelemetry(bool reset){
+
+  Serial.println("telemetry");
+
+#if defined(TELEMETRY_ENABLED)
+  telemetry.Report(Serial);
+#endif
+
+  // frames, late, missed, mean and worst lateness in us
+  Serial.print("clock "); Serial.print(frameClock.GetFrameCount());
+  Serial.print(' '); Serial.print(frameClock.GetLateFrameCount());
+  Serial.print(' '); Serial.print(frameClock.GetMissedFrameCount());
+  Serial.print(' '); Serial.print(frameClock.GetMeanLatenessMicros());
+  Serial.print(' '); Serial.println(frameClock.GetMaxLatenessMicros());
+
+  // bad frames, receive ring overflows, commands dropped with the command queue full
+  Serial.print("errors "); Serial.print(serialProtocol.GetBadFrameCount());
+  Serial.print(' '); Serial.print(serialProtocol.GetOverflowCount());
+  Serial.print(' '); Serial.println(commandQueue.GetOverflowCount());
+
+  // per supply: budget, demand and draw now, headroom now and at its least, in mA
+  for(uint8_t supply = 0; supply < POWER_MAX_SUPPLIES; supply++){
+    if(!powerLimiter.GetDemandMilliamps(supply)){
+      continue;
+    }
+    Serial.print("power "); Serial.print(supply);
+    Serial.print(' '); Serial.print(powerLimiter.GetBudget(supply));
+    Serial.print(' '); Serial.print(powerLimiter.GetDemandMilliamps(supply));
+    Serial.print(' '); Serial.print(powerLimiter.GetDrawMilliamps(supply));
+    Serial.print(' '); Serial.print(powerLimiter.GetHeadroomMilliamps(supply));
+    Serial.print(' '); Serial.println(powerLimiter.GetMinHeadroomMilliamps(supply));
   }
+  Serial.print("power_limited "); Serial.println(powerLimiter.GetLimitedFrameCount());
+
+  // palettes held, palettes that found the registry full, tables expanded, draws with every table taken
+  Serial.print("palettes "); Serial.print(PaletteRegistry::GetHeldCount());
+  Serial.print(' '); Serial.print(PaletteRegistry::GetFullCount());
+  Serial.print(' '); Serial.print(PaletteRegistry::GetExpandCount());
+  Serial.print(' '); Serial.println(PaletteRegistry::GetUncachedCount());
+
+#if defined(PIXEL_STREAM_ENABLED)
+  // frames shown, dropped waiting for a keyframe, senders that stopped
+  Serial.print("stream "); Serial.print(pixelStream.GetFrameCount());
+  Serial.print(' '); Serial.print(pixelStream.GetDroppedFrameCount());
+  Serial.print(' '); Serial.println(pixelStream.GetStallCount());
+#endif
 
+#if LOG_LEVEL > LOG_LEVEL_NONE
+  // log lines dropped for want of room, bytes waiting to go
+  Serial.print("log "); Serial.print(serialLog.GetDroppedCount());
+  Serial.print(' '); Serial.println(serialLog.GetPendingBytes());
+#endif
+
+  Serial.println("end");
+
+  if(reset){
+#if defined(TELEMETRY_ENABLED)
+    telemetry.Reset();
+#endif
+    frameClock.ResetStats();
+    powerLimiter.ResetStats();
+#if LOG_LEVEL > LOG_LEVEL_NONE
+    serialLog.ResetStats();
+#endif
+  }
 
 }
 
 
+// a binary frame from the Max patch. every field is explicit so no presets are needed here
+void applySerialCommand(const SerialCommand &command){
+
+  switch (command.opcode) {
+    case SERIAL_OP_TRIGGER:
+      triggerAnimationGroupStrips(command.groupMask, command.animation);
+      break;
+
+    case SERIAL_OP_PARAMS:
+      setGroupStripParams(command.groupMask, command.hue, command.brightness, command.bpm, command.brightnessHigh, command.brightnessLow);
+      break;
+
+    case SERIAL_OP_PALETTE:
+      if(command.paletteIndex < NUM_COLOR_PALETTES){
+        setGroupStripColorPalettes(command.groupMask, COLOR_PALETTES[command.paletteIndex]);
+      }
+      break;
+
+    case SERIAL_OP_PALETTE_FADE:
+      if(command.paletteIndex < NUM_COLOR_PALETTES){
+        fadeGroupStripColorPalettes(command.groupMask, COLOR_PALETTES[command.paletteIndex], command.crossfadeFrames);
+      }
+      break;
+
+    case SERIAL_OP_LAYER:
+      setGroupStripLayers(command.groupMask, command.layerSlot, command.layer);
+      break;
+
+    case SERIAL_OP_HUE_INDEX_BPM:
+      setGroupStripHueIndexBPMs(command.groupMask, command.hueIndexBPM);
+      break;
+
+    case SERIAL_OP_REVERSE_HUE:
+      reverseGroupStripHueIndexDirections(command.groupMask);
+      break;
+
+    case SERIAL_OP_PRESET:
+      // everything for one beat in a single frame: params, optional palette and scroll speed, then the trigger
+      setGroupStripParams(command.groupMask, command.hue, command.brightness, command.bpm, command.brightnessHigh, command.brightnessLow);
+      if(command.paletteIndex < NUM_COLOR_PALETTES){
+        setGroupStripColorPalettes(command.groupMask, COLOR_PALETTES[command.paletteIndex]);
+      }
+      if(command.hueIndexBPM){
+        setGroupStripHueIndexBPMs(command.groupMask, command.hueIndexBPM);
+      }
+      triggerAnimationGroupStrips(command.groupMask, command.animation);
+      break;
+  }
+
+}
 
 
 
@@ -585,91 +832,107 @@ void loop() {
 // *********************************************************************************
 //      HELPER FUNCTIONS
 // *********************************************************************************
+// bit n of groupMask selects LedStripControllerArray[n], and SERIAL_ALL_GROUPS every segment
 // blink the onboard LED
-// update the active animation for each LEDStripController object
-// based on the AnimationType Enum value sent into the function
-void triggerAnimationAllStrips(AnimationType animationToSet){
+void triggerAnimationGroupStrips(uint16_t groupMask, AnimationType animationToSet){
 
   turnTeensyLEDOn();
 
   for(int i = 0; i < NUM_SEGMENTS; i++){
-    LedStripControllerArray[i]->SetActiveAnimationType( animationToSet );
+    if(groupMask & (1 << i)){
+      LedStripControllerArray[i]->SetActiveAnimationType( animationToSet );
+    }
   }
 
 }
 
 
-void triggerAnimationSideTriangleStrips(AnimationType animationToSet){
+// blink the onboard LED
+void setGroupStripParams(uint16_t groupMask, uint8_t aHue, uint8_t aBrightness, uint16_t aBPM, uint8_t aBrightnessHigh, uint8_t aBrightnessLow){
 
   turnTeensyLEDOn();
-  
-  for(int i = 0; i < ARRAY_SIZE(sideTriangleStripIndexes); i++){
-    int sideTriangleIndex = sideTriangleStripIndexes[i];
-        
-    LedStripControllerArray[sideTriangleIndex]->SetActiveAnimationType( animationToSet );
+
+  for(int i = 0; i < NUM_SEGMENTS; i++){
+    if(groupMask & (1 << i)){
+      LedStripControllerArray[i]->SetStripParams( aHue, aBrightness, aBPM, aBrightnessHigh, aBrightnessLow);
+    }
   }
 
 }
 
 
-void triggerAnimationTopTriangleStrips(AnimationType animationToSet){
+// blink the onboard LED
+// the palette goes into the registry once, and every selected segment holds the same slot
+void setGroupStripColorPalettes(uint16_t groupMask, const CRGBPalette16 &newColorPalette){
 
   turnTeensyLEDOn();
 
-  for(int i = 0; i < ARRAY_SIZE(topTriangleStripIndexes); i++){
-    int topTriangleIndex = topTriangleStripIndexes[i];
-        
-    LedStripControllerArray[topTriangleIndex]->SetActiveAnimationType( animationToSet );
+  PaletteRef palette( newColorPalette );
+
+  for(int i = 0; i < NUM_SEGMENTS; i++){
+    if(groupMask & (1 << i)){
+      LedStripControllerArray[i]->SetColorPalette( palette );
+    }
   }
-}
 
+}
 
 
 // blink the onboard LED
-// update all the important parameters for the solid color and BPM based animations
-void setAllStripParams(uint8_t aHue, uint8_t aBrightness, uint16_t aBPM, uint8_t aBrightnessHigh, uint8_t aBrightnessLow){
+// the selected segments join the shared palette, which glides to the new one over crossfadeFrames
+void fadeGroupStripColorPalettes(uint16_t groupMask, const CRGBPalette16 &newColorPalette, uint16_t crossfadeFrames){
 
   turnTeensyLEDOn();
 
+  sharedPalette.SetTarget( newColorPalette, crossfadeFrames );
+
   for(int i = 0; i < NUM_SEGMENTS; i++){
-    LedStripControllerArray[i]->SetStripParams( aHue, aBrightness, aBPM, aBrightnessHigh, aBrightnessLow);
+    if(groupMask & (1 << i)){
+      LedStripControllerArray[i]->FollowPalette( &sharedPalette );
+    }
   }
 
 }
 
 
-
 // blink the onboard LED
-void setAllStripColorPalettes(CRGBPalette16 newColorPalette){
+// the layer is drawn over whatever animation the selected segments run, until it's replaced
+void setGroupStripLayers(uint16_t groupMask, uint8_t slot, const Layer &layer){
 
   turnTeensyLEDOn();
 
   for(int i = 0; i < NUM_SEGMENTS; i++){
-    LedStripControllerArray[i]->SetColorPalette( newColorPalette );
+    if(groupMask & (1 << i)){
+      LedStripControllerArray[i]->SetLayer( slot, layer );
+    }
   }
 
 }
 
 
 // blink the onboard LED
-void setAllStripHueIndexBPMs(uint16_t hueIndexBPM){
+void setGroupStripHueIndexBPMs(uint16_t groupMask, uint16_t hueIndexBPM){
 
   turnTeensyLEDOn();
 
   for(int i = 0; i < NUM_SEGMENTS; i++){
-    LedStripControllerArray[i]->SetStripHueIndexBPM( hueIndexBPM );
+    if(groupMask & (1 << i)){
+      LedStripControllerArray[i]->SetStripHueIndexBPM( hueIndexBPM );
+    }
   }
 
 }
 
 
 // reverse the hue directions and blink the onboard LED
-void reverseAllStripHueIndexDirections(){
+void reverseGroupStripHueIndexDirections(uint16_t groupMask){
 
   turnTeensyLEDOn();
 
   for(int i = 0; i < NUM_SEGMENTS; i++){
-    LedStripControllerArray[i]->ReverseStripHueIndexDirection();
+    if(groupMask & (1 << i)){
+      LedStripControllerArray[i]->ReverseStripHueIndexDirection();
+    }
   }
 
 }
@@ -693,7 +956,7 @@ void turnTeensyLEDOn(){
 // this function turns the LED off when it's time
 void updateTeensyLED(uint32_t currentTime) {
   
-  if(currentTime > timeToTurnOffTeensyLED && teensyLEDIsOn){
+  if((int32_t)(currentTime - timeToTurnOffTeensyLED) > 0 && teensyLEDIsOn){
     digitalWrite(led, LOW);
     teensyLEDIsOn = false;
   }
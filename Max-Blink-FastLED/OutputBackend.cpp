@@ -0,0 +1,81 @@
+/*
+  OutputBackend.cpp  - What sits between the strip controllers and the wire
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "OutputBackend.h"
+
+
+// *********************************************************************************
+//      EVERY BACKEND
+// *********************************************************************************
+
+OutputBackend::OutputBackend()
+{
+  for(uint8_t i = 0; i < MAX_OUTPUT_STRIPS; i++){
+    _stripScale[i] = 255;
+  }
+}
+
+
+// *********************************************************************************
+//      SEQUENTIAL - one FastLED controller per strip
+// *********************************************************************************
+
+FastLEDSequentialBackend::FastLEDSequentialBackend(CLEDController * const *strips, uint8_t stripCount)
+{
+  _strips = strips;
+  _stripCount = stripCount > MAX_OUTPUT_STRIPS ? MAX_OUTPUT_STRIPS : stripCount;
+}
+
+
+// each strip blocks for its whole length (~2.4 ms per 80 pixels), so only send the ones asked for
+uint8_t FastLEDSequentialBackend::Show(uint8_t stripMask, uint8_t brightness) {
+
+  uint8_t shown = 0;
+
+  for(uint8_t i = 0; i < _stripCount; i++){
+    if(stripMask & (1 << i)){
+      _strips[i]->showLeds( scale8(brightness, _stripScale[i]) );
+      shown |= (1 << i);
+    }
+  }
+
+  return shown;
+}
+
+
+// *********************************************************************************
+//      PARALLEL - one multi-lane FastLED controller for every strip
+// *********************************************************************************
+
+FastLEDParallelBackend::FastLEDParallelBackend(CLEDController *lanes, uint8_t laneCount)
+{
+  _lanes = lanes;
+  _laneCount = laneCount > MAX_OUTPUT_STRIPS ? MAX_OUTPUT_STRIPS : laneCount;
+}
+
+
+// the lanes can't be sent separately, but sending all of them costs the same as sending one.
+// they share one brightness too, so the most dimmed lane dims them all
+uint8_t FastLEDParallelBackend::Show(uint8_t stripMask, uint8_t brightness) {
+
+  uint8_t allLanes = (uint8_t)((1 << _laneCount) - 1);
+
+  if(!(stripMask & allLanes)){
+    return 0;
+  }
+
+  uint8_t scale = 255;
+  for(uint8_t i = 0; i < _laneCount; i++){
+    if(_stripScale[i] < scale){
+      scale = _stripScale[i];
+    }
+  }
+
+  _lanes->showLeds( scale8(brightness, scale) );
+  return allLanes;
+}
@@ -0,0 +1,100 @@
+/*
+  OutputBackend.h  - What sits between the strip controllers and the wire
+                   -- the sketch hands the backend a mask of physical strips that changed, and the
+                      backend decides how they get clocked out
+                   -- FastLEDSequentialBackend sends one strip after another (one FastLED controller
+                      per pin), so show time is the sum of the strips sent
+                   -- FastLEDParallelBackend sends every strip at once through one multi-lane FastLED
+                      controller, so show time is one strip's worth however many lanes there are
+                   -- host/sim has a backend that models WS2812 wire timing instead of sending anything
+                   -- each strip also has a scale (PowerLimiter's), applied on top of the brightness
+*/
+
+#ifndef OutputBackend_h
+#define OutputBackend_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include <FastLED.h>
+#include "GlobalVariables.h"
+
+// strips are passed around as a bit mask
+#define MAX_OUTPUT_STRIPS 8
+#define ALL_OUTPUT_STRIPS 0xFF
+
+
+// ******************************************************************
+//            OutputBackend interface
+// ******************************************************************
+class OutputBackend
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    OutputBackend();
+    virtual ~OutputBackend() {}
+
+    // send the strips whose bit is set in stripMask. returns the mask that actually went out,
+    // which can be more than was asked for (parallel lanes always go out together)
+    virtual uint8_t Show(uint8_t stripMask, uint8_t brightness) = 0;
+
+    virtual uint8_t GetStripCount() const = 0;
+
+    // 255 sends the strip at the brightness Show() is given, lower dims it by that much more
+    void SetStripScale(uint8_t strip, uint8_t scale) { if( strip < MAX_OUTPUT_STRIPS ) _stripScale[strip] = scale; }
+    uint8_t GetStripScale(uint8_t strip) const { return strip < MAX_OUTPUT_STRIPS ? _stripScale[strip] : 255; }
+
+
+  //********** PROTECTED MEMBER VARIABLES AND FUNCTIONS **********
+  protected:
+    uint8_t _stripScale[MAX_OUTPUT_STRIPS];
+};
+
+
+// ******************************************************************
+//            One FastLED controller per strip, sent one after another
+// ******************************************************************
+class FastLEDSequentialBackend : public OutputBackend
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    // strips is read on every Show(), so it can be filled in after construction (e.g. in setup())
+    FastLEDSequentialBackend(CLEDController * const *strips, uint8_t stripCount);
+
+    uint8_t Show(uint8_t stripMask, uint8_t brightness);
+    uint8_t GetStripCount() const { return _stripCount; }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    CLEDController * const *_strips;
+    uint8_t _stripCount;
+};
+
+
+// ******************************************************************
+//            One multi-lane FastLED controller, every strip sent at once
+// ******************************************************************
+class FastLEDParallelBackend : public OutputBackend
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    // lanes drives laneCount strips from one buffer (lane n starts at pixel n * lane length)
+    FastLEDParallelBackend(CLEDController *lanes, uint8_t laneCount);
+
+    uint8_t Show(uint8_t stripMask, uint8_t brightness);
+    uint8_t GetStripCount() const { return _laneCount; }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    CLEDController *_lanes;
+    uint8_t _laneCount;
+};
+
+
+
+#endif
@@ -0,0 +1,115 @@
+/*
+  PaletteCrossfade.cpp  - A palette that several strip controllers share, and that can glide to a new palette
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "PaletteCrossfade.h"
+
+
+// *********************************************************************************
+//      CONSTRUCTOR
+// *********************************************************************************
+
+PaletteCrossfade::PaletteCrossfade(const CRGBPalette16 &initialPalette)
+{
+  _palette = initialPalette;
+  _fromPalette = initialPalette;
+  _targetPalette = initialPalette;
+}
+
+
+// *********************************************************************************
+//      CROSSFADE
+// *********************************************************************************
+
+void PaletteCrossfade::SetTarget(const CRGBPalette16 &targetPalette, uint16_t durationFrames) {
+
+  // a new target mid-fade starts from whatever is on screen, so there's never a jump
+  _fromPalette = _palette;
+  _targetPalette = targetPalette;
+  _durationFrames = durationFrames;
+  _framesRemaining = durationFrames;
+  _nextEntry = 0;
+
+  if( durationFrames == 0 ){
+    for( uint8_t entry = 0; entry < 16; entry++ ){
+      if( _palette[entry] != _targetPalette[entry] ){
+        _palette[entry] = _targetPalette[entry];
+        EntryChanged(entry);
+      }
+    }
+  }
+}
+
+
+bool PaletteCrossfade::Update() {
+
+  if( _framesRemaining == 0 ){
+    return false;
+  }
+
+  uint16_t startVersion = _version;
+  _framesRemaining--;
+
+  // the last frame lands every entry exactly on the target
+  uint8_t firstEntry = 0;
+  uint8_t entryCount = 16;
+  fract8 amount = 255;
+
+  // before that, re-blend a few entries per frame round robin. an entry may lag the fade by a
+  // few frames, which can't be seen, and the work per frame stays small and constant
+  if( _framesRemaining > 0 ){
+    firstEntry = _nextEntry;
+    entryCount = PALETTE_CROSSFADE_ENTRIES_PER_FRAME;
+    amount = (uint32_t)(_durationFrames - _framesRemaining) * 255 / _durationFrames;
+    _nextEntry = (_nextEntry + PALETTE_CROSSFADE_ENTRIES_PER_FRAME) & 0x0F;
+  }
+
+  for( uint8_t i = 0; i < entryCount; i++ ){
+    uint8_t entry = (firstEntry + i) & 0x0F;
+    CRGB color = amount == 255 ? _targetPalette[entry] : blend( _fromPalette[entry], _targetPalette[entry], amount);
+
+    if( _palette[entry] != color ){
+      _palette[entry] = color;
+      EntryChanged(entry);
+    }
+  }
+
+  return _version != startVersion;
+}
+
+
+// bump the version once per change and mark the table indexes that blend from this entry
+void PaletteCrossfade::EntryChanged(uint8_t entry) {
+
+  _version++;
+
+#ifdef PALETTE_CACHE_ENABLED
+  // indexes 16n..16n+15 blend entry n into entry n+1, so an entry feeds its own section and the one before
+  _staleSections |= (1 << entry) | (1 << ((entry - 1) & 0x0F));
+#else
+  (void)entry;
+#endif
+}
+
+
+#ifdef PALETTE_CACHE_ENABLED
+const CRGB *PaletteCrossfade::GetTable() {
+
+  if( _staleSections ){
+    for( uint8_t section = 0; section < 16; section++ ){
+      if( _staleSections & (1 << section) ){
+        for( uint16_t i = section * 16; i < section * 16 + 16; i++ ){
+          _table[i] = ColorFromPalette( _palette, i, 255, LINEARBLEND);
+        }
+      }
+    }
+    _staleSections = 0;
+  }
+
+  return _table;
+}
+#endif
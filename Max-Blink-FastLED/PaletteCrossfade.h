@@ -0,0 +1,76 @@
+/*
+  PaletteCrossfade.h  - A palette that several strip controllers share, and that can glide to a new palette
+                      -- SetTarget() starts a crossfade; Update() is called once per frame and re-blends
+                         only a few of the 16 entries each time, so a fade costs about the same per frame
+                         however many segments follow it
+                      -- with the palette cache enabled it also keeps the 256 entry color table the
+                         controllers draw from, re-expanding only the parts next to entries that moved
+*/
+
+#ifndef PaletteCrossfade_h
+#define PaletteCrossfade_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include "FrameClock.h"    // before FastLED.h, so beat functions read the frame clock
+#include <FastLED.h>
+#include "GlobalVariables.h"
+
+// how long a palette change takes when the command doesn't say (one second at 60 fps)
+#define DEFAULT_PALETTE_CROSSFADE_FRAMES 60
+
+// palette entries re-blended per frame while fading. every entry is refreshed every 16 / this frames
+#define PALETTE_CROSSFADE_ENTRIES_PER_FRAME 4
+
+
+// ******************************************************************
+//            PaletteCrossfade class definitions
+// ******************************************************************
+class PaletteCrossfade
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    PaletteCrossfade(const CRGBPalette16 &initialPalette = DEFAULT_PALETTE);
+
+    // glide from whatever is showing now to targetPalette over durationFrames frames. 0 swaps immediately
+    void SetTarget(const CRGBPalette16 &targetPalette, uint16_t durationFrames = DEFAULT_PALETTE_CROSSFADE_FRAMES);
+
+    // call once per frame, before the controllers render. returns true if the palette changed
+    bool Update();
+
+    bool IsFading() const { return _framesRemaining > 0; }
+    const CRGBPalette16 &GetPalette() const { return _palette; }
+
+    // bumped every time the palette changes, so followers can tell their last palette fill is stale
+    uint16_t GetVersion() const { return _version; }
+
+#ifdef PALETTE_CACHE_ENABLED
+    // GetPalette() blended out to every index at full brightness, brought up to date on demand
+    const CRGB *GetTable();
+#endif
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    CRGBPalette16 _palette;          // what the controllers draw with right now
+    CRGBPalette16 _fromPalette;      // what was showing when the fade started
+    CRGBPalette16 _targetPalette;    // where the fade ends
+
+    uint16_t _durationFrames = 0;
+    uint16_t _framesRemaining = 0;
+    uint8_t _nextEntry = 0;          // the first entry to re-blend on the next frame
+    uint16_t _version = 0;
+
+#ifdef PALETTE_CACHE_ENABLED
+    CRGB _table[256];
+    uint16_t _staleSections = 0xFFFF;    // bit n set means table indexes 16n..16n+15 need rebuilding
+#endif
+
+    void EntryChanged(uint8_t entry);
+};
+
+
+
+#endif
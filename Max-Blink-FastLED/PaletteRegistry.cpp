@@ -0,0 +1,206 @@
+/*
+  PaletteRegistry.cpp  - Every palette the controllers draw with, held once however many segments use it
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "PaletteRegistry.h"
+
+
+// *********************************************************************************
+//      CONSTRUCTOR
+// *********************************************************************************
+
+PaletteRegistry::PaletteRegistry()
+{
+  for( uint8_t i = 0; i < PALETTE_REGISTRY_SLOTS; i++ ){
+    _slots[i].refCount = 0;
+    _slots[i].inUse = false;
+#ifdef PALETTE_CACHE_ENABLED
+    _slots[i].table = PALETTE_HANDLE_NONE;
+#endif
+  }
+
+#ifdef PALETTE_CACHE_ENABLED
+  for( uint8_t i = 0; i < PALETTE_REGISTRY_TABLES; i++ ){
+    _tableOwner[i] = PALETTE_HANDLE_NONE;
+    _tableLastUse[i] = 0;
+  }
+#endif
+}
+
+
+PaletteRegistry &PaletteRegistry::Instance() {
+  static PaletteRegistry registry;
+  return registry;
+}
+
+
+// *********************************************************************************
+//      REFERENCES
+// *********************************************************************************
+
+PaletteHandle PaletteRegistry::Acquire(const CRGBPalette16 &palette) {
+
+  PaletteRegistry &registry = Instance();
+
+  // already held, or still there from the last time it was
+  for( uint8_t i = 0; i < PALETTE_REGISTRY_SLOTS; i++ ){
+    if( registry._slots[i].inUse && registry._slots[i].palette == palette ){
+      registry._slots[i].refCount++;
+      return i;
+    }
+  }
+
+  uint8_t slot = registry.FindFreeSlot();
+  if( slot == PALETTE_HANDLE_NONE ){
+    registry._fullCount++;
+    return PALETTE_HANDLE_NONE;
+  }
+
+#ifdef PALETTE_CACHE_ENABLED
+  registry.DropTable(slot);
+#endif
+  registry._slots[slot].palette = palette;
+  registry._slots[slot].inUse = true;
+  registry._slots[slot].refCount = 1;
+  return slot;
+}
+
+
+void PaletteRegistry::Retain(PaletteHandle handle) {
+
+  if( handle < PALETTE_REGISTRY_SLOTS ){
+    Instance()._slots[handle].refCount++;
+  }
+}
+
+
+// the palette stays in the slot until the room is needed
+void PaletteRegistry::Release(PaletteHandle handle) {
+
+  if( handle < PALETTE_REGISTRY_SLOTS && Instance()._slots[handle].refCount > 0 ){
+    Instance()._slots[handle].refCount--;
+  }
+}
+
+
+// a never used slot first, then one nobody holds any more
+uint8_t PaletteRegistry::FindFreeSlot() const {
+
+  uint8_t unheld = PALETTE_HANDLE_NONE;
+  for( uint8_t i = 0; i < PALETTE_REGISTRY_SLOTS; i++ ){
+    if( !_slots[i].inUse ){
+      return i;
+    }
+    if( _slots[i].refCount == 0 && unheld == PALETTE_HANDLE_NONE ){
+      unheld = i;
+    }
+  }
+
+  return unheld;
+}
+
+
+// *********************************************************************************
+//      PALETTES AND TABLES
+// *********************************************************************************
+
+// a reference that didn't get a slot draws with slot 0's palette, rather than reading off the end
+const CRGBPalette16 &PaletteRegistry::GetPalette(PaletteHandle handle) {
+  return Instance()._slots[handle < PALETTE_REGISTRY_SLOTS ? handle : 0].palette;
+}
+
+
+#ifdef PALETTE_CACHE_ENABLED
+const CRGB *PaletteRegistry::GetTable(PaletteHandle handle) {
+
+  PaletteRegistry &registry = Instance();
+  Slot &slot = registry._slots[handle < PALETTE_REGISTRY_SLOTS ? handle : 0];
+  uint32_t now = FrameClock::GetAnimationMillis();
+
+  if( slot.table == PALETTE_HANDLE_NONE ){
+
+    // a table nobody has, or a palette nobody holds any more, or else the one drawn from longest ago,
+    // as long as that's longer ago than PALETTE_TABLE_KEEP_MILLIS
+    uint8_t table = PALETTE_HANDLE_NONE;
+    int32_t oldest = PALETTE_TABLE_KEEP_MILLIS;
+    for( uint8_t i = 0; i < PALETTE_REGISTRY_TABLES; i++ ){
+      uint8_t owner = registry._tableOwner[i];
+      if( owner == PALETTE_HANDLE_NONE || registry._slots[owner].refCount == 0 ){
+        table = i;
+        break;
+      }
+      int32_t age = now - registry._tableLastUse[i];    // a catch-up tick can be behind the frame
+      if( age >= oldest ){
+        oldest = age;
+        table = i;
+      }
+    }
+
+    if( table == PALETTE_HANDLE_NONE ){
+      registry._uncachedCount++;
+      return nullptr;
+    }
+
+    if( registry._tableOwner[table] != PALETTE_HANDLE_NONE ){
+      registry._slots[ registry._tableOwner[table] ].table = PALETTE_HANDLE_NONE;
+    }
+    registry._tableOwner[table] = &slot - registry._slots;
+    slot.table = table;
+
+    CRGB *colors = registry._tables[table];
+    for( uint16_t i = 0; i < 256; i++ ){
+      colors[i] = ColorFromPalette( slot.palette, i, 255, LINEARBLEND);
+    }
+    registry._expandCount++;
+  }
+
+  registry._tableLastUse[slot.table] = now;
+  return registry._tables[slot.table];
+}
+
+
+// the slot is taking a new palette, so whatever its table holds is no good to anyone
+void PaletteRegistry::DropTable(uint8_t slot) {
+
+  uint8_t table = _slots[slot].table;
+  if( table != PALETTE_HANDLE_NONE ){
+    _tableOwner[table] = PALETTE_HANDLE_NONE;
+    _slots[slot].table = PALETTE_HANDLE_NONE;
+  }
+}
+#endif
+
+
+// *********************************************************************************
+//      TELEMETRY
+// *********************************************************************************
+
+uint8_t PaletteRegistry::GetHeldCount() {
+
+  uint8_t held = 0;
+  for( uint8_t i = 0; i < PALETTE_REGISTRY_SLOTS; i++ ){
+    if( Instance()._slots[i].refCount > 0 ){
+      held++;
+    }
+  }
+  return held;
+}
+
+
+uint16_t PaletteRegistry::GetFullCount() {
+  return Instance()._fullCount;
+}
+
+
+uint16_t PaletteRegistry::GetExpandCount() {
+  return Instance()._expandCount;
+}
+
+
+uint16_t PaletteRegistry::GetUncachedCount() {
+  return Instance()._uncachedCount;
+}
@@ -0,0 +1,152 @@
+/*
+  PaletteRegistry.h  - Every palette the controllers draw with, held once however many segments use it
+                     -- a controller holds a one byte PaletteRef instead of its own 48 byte CRGBPalette16.
+                        acquiring a palette that's already in the registry hands out the same slot, so
+                        twelve segments on one palette share one copy (and compare by handle, not by bytes)
+                     -- slots are reference counted. a slot nobody holds keeps its palette (and table) until
+                        a new palette needs the room, so flipping back to a recent palette is free
+                     -- with the palette cache enabled, the 256 entry tables are a separate, smaller pool.
+                        a slot is only expanded when something draws from it, and the table drawn from
+                        longest ago is taken over when they're all in use. one drawn from in the last
+                        PALETTE_TABLE_KEEP_MILLIS isn't: with more palettes on the segments than tables,
+                        GetTable() returns nullptr for the rest and they blend from their 16 entries per
+                        pixel, rather than every table being expanded again every frame
+                     -- a palette a segment follows with FollowPalette() isn't in here: PaletteCrossfade
+                        keeps its own, since it changes every frame while it fades
+*/
+
+#ifndef PaletteRegistry_h
+#define PaletteRegistry_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include "FrameClock.h"    // before FastLED.h, like everything that reads the frame clock
+#include <FastLED.h>
+#include "GlobalVariables.h"
+
+// how many different palettes can be held at once (48 bytes each). 255 at most
+#ifndef PALETTE_REGISTRY_SLOTS
+  #if defined(__TURNERS_TESTING_UNO__)
+    #define PALETTE_REGISTRY_SLOTS 2
+  #else
+    #define PALETTE_REGISTRY_SLOTS 16
+  #endif
+#endif
+
+// how many of them can be expanded to a 256 entry table at once (768 bytes each)
+#ifndef PALETTE_REGISTRY_TABLES
+  #define PALETTE_REGISTRY_TABLES 4
+#endif
+
+// a table drawn from within this many ms (animation time) is kept for the palette it holds
+#ifndef PALETTE_TABLE_KEEP_MILLIS
+  #define PALETTE_TABLE_KEEP_MILLIS 1000
+#endif
+
+typedef uint8_t PaletteHandle;
+#define PALETTE_HANDLE_NONE 0xFF
+
+
+// ******************************************************************
+//            PaletteRegistry class definitions
+// ******************************************************************
+class PaletteRegistry
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    // a handle to palette with one reference taken, or PALETTE_HANDLE_NONE if every slot is held
+    static PaletteHandle Acquire(const CRGBPalette16 &palette);
+    static void Retain(PaletteHandle handle);
+    static void Release(PaletteHandle handle);
+
+    static const CRGBPalette16 &GetPalette(PaletteHandle handle);
+#ifdef PALETTE_CACHE_ENABLED
+    // the palette blended out to every index at full brightness, expanded on first use. nullptr if
+    // every table is being drawn from (see the top of this file)
+    static const CRGB *GetTable(PaletteHandle handle);
+#endif
+
+    // TELEMETRY
+    static uint8_t GetHeldCount();          // slots with at least one reference
+    static uint16_t GetFullCount();         // Acquire()s that found no room
+    static uint16_t GetExpandCount();       // tables expanded (more than the palettes in use means thrashing)
+    static uint16_t GetUncachedCount();     // GetTable()s that found every table being drawn from
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    struct Slot {
+      CRGBPalette16 palette;
+      uint8_t refCount;
+      bool inUse;            // holds a palette, referenced or not
+#ifdef PALETTE_CACHE_ENABLED
+      uint8_t table;         // index into _tables, or PALETTE_HANDLE_NONE
+#endif
+    };
+
+    Slot _slots[PALETTE_REGISTRY_SLOTS];
+#ifdef PALETTE_CACHE_ENABLED
+    CRGB _tables[PALETTE_REGISTRY_TABLES][256];
+    uint8_t _tableOwner[PALETTE_REGISTRY_TABLES];   // the slot each table belongs to
+    uint32_t _tableLastUse[PALETTE_REGISTRY_TABLES];   // animation millis it was last drawn from
+#endif
+    uint16_t _fullCount = 0;
+    uint16_t _expandCount = 0;
+    uint16_t _uncachedCount = 0;
+
+    PaletteRegistry();
+
+    // built on first use, so controllers constructed as globals in other files can acquire palettes
+    // before this file's globals would have been initialized
+    static PaletteRegistry &Instance();
+
+    uint8_t FindFreeSlot() const;
+#ifdef PALETTE_CACHE_ENABLED
+    void DropTable(uint8_t slot);
+#endif
+};
+
+
+// ******************************************************************
+//            PaletteRef - a counted reference to a registry slot
+// ******************************************************************
+class PaletteRef
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    explicit PaletteRef(const CRGBPalette16 &palette) : _handle(PaletteRegistry::Acquire(palette)) {}
+    PaletteRef(const PaletteRef &other) : _handle(other._handle) { PaletteRegistry::Retain(_handle); }
+    ~PaletteRef() { PaletteRegistry::Release(_handle); }
+
+    PaletteRef &operator=(const PaletteRef &other) {
+      PaletteRegistry::Retain(other._handle);
+      PaletteRegistry::Release(_handle);
+      _handle = other._handle;
+      return *this;
+    }
+
+    // false if the registry was full when it was acquired
+    bool IsValid() const { return _handle != PALETTE_HANDLE_NONE; }
+    PaletteHandle GetHandle() const { return _handle; }
+
+    const CRGBPalette16 &GetPalette() const { return PaletteRegistry::GetPalette(_handle); }
+#ifdef PALETTE_CACHE_ENABLED
+    const CRGB *GetTable() const { return PaletteRegistry::GetTable(_handle); }
+#endif
+
+    // equal palettes always share a slot, so this is the same as comparing the palettes
+    bool operator==(const PaletteRef &rhs) const { return _handle == rhs._handle; }
+    bool operator!=(const PaletteRef &rhs) const { return _handle != rhs._handle; }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    PaletteHandle _handle;
+};
+
+
+
+#endif
@@ -0,0 +1,422 @@
+/*
+  PixelKernels.cpp  - The loops that touch every pixel of a segment at once
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "PixelKernels.h"
+#include <string.h>
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+#if defined(__BYTE_ORDER__)
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "the channel sums read bytes out of words in little endian order");
+#endif
+
+
+// *********************************************************************************
+//      REFERENCE
+// *********************************************************************************
+
+void PixelKernelsReference::Fill(CRGB *pixels, uint16_t count, const CRGB &color) {
+  for( uint16_t i = 0; i < count; i++ ){
+    pixels[i] = color;
+  }
+}
+
+
+void PixelKernelsReference::Scale(CRGB *pixels, uint16_t count, uint8_t scale) {
+  for( uint16_t i = 0; i < count; i++ ){
+    pixels[i].nscale8(scale);
+  }
+}
+
+
+void PixelKernelsReference::ScaleByColor(CRGB *pixels, uint16_t count, const CRGB &scale) {
+  for( uint16_t i = 0; i < count; i++ ){
+    pixels[i].r = scale8( pixels[i].r, scale.r );
+    pixels[i].g = scale8( pixels[i].g, scale.g );
+    pixels[i].b = scale8( pixels[i].b, scale.b );
+  }
+}
+
+
+void PixelKernelsReference::Add(CRGB *pixels, uint16_t count, const CRGB &color) {
+  for( uint16_t i = 0; i < count; i++ ){
+    pixels[i].r = qadd8( pixels[i].r, color.r );
+    pixels[i].g = qadd8( pixels[i].g, color.g );
+    pixels[i].b = qadd8( pixels[i].b, color.b );
+  }
+}
+
+
+void PixelKernelsReference::Max(CRGB *pixels, uint16_t count, const CRGB &color) {
+  for( uint16_t i = 0; i < count; i++ ){
+    if( color.r > pixels[i].r ) pixels[i].r = color.r;
+    if( color.g > pixels[i].g ) pixels[i].g = color.g;
+    if( color.b > pixels[i].b ) pixels[i].b = color.b;
+  }
+}
+
+
+void PixelKernelsReference::Blend(CRGB *pixels, uint16_t count, const CRGB &color, uint8_t amountOfColor) {
+  for( uint16_t i = 0; i < count; i++ ){
+    pixels[i].r = blend8( pixels[i].r, color.r, amountOfColor );
+    pixels[i].g = blend8( pixels[i].g, color.g, amountOfColor );
+    pixels[i].b = blend8( pixels[i].b, color.b, amountOfColor );
+  }
+}
+
+
+ChannelSums PixelKernelsReference::SumChannels(const CRGB *pixels, uint16_t count) {
+
+  ChannelSums sums = { 0, 0, 0 };
+  for( uint16_t i = 0; i < count; i++ ){
+    sums.r += pixels[i].r;
+    sums.g += pixels[i].g;
+    sums.b += pixels[i].b;
+  }
+  return sums;
+}
+
+
+// *********************************************************************************
+//      SWAR
+//        the machine's word: 4 channels on the Teensy, 8 on a 64 bit host. a block is
+//        three words, a whole number of pixels, so a color repeats the same way in every
+//        block. blend8(a, b, n) is (a * (256 - n) + b * (1 + n)) >> 8, which never goes
+//        over 16 bits, so it spreads out like a scale with b's part added in
+// *********************************************************************************
+#if UINTPTR_MAX > 0xFFFFFFFFu
+  typedef uint64_t PixelWord;
+#else
+  typedef uint32_t PixelWord;
+#endif
+
+static const PixelWord ONES = (PixelWord)~(PixelWord)0 / 0xFF;              // 0x01 in every byte
+static const PixelWord LOW_BITS = ONES * 0x7F;
+static const PixelWord HIGH_BITS = ONES * 0x80;
+static const PixelWord EVEN_BYTES = (PixelWord)~(PixelWord)0 / 0xFFFF * 0xFF;   // the low byte of every 16 bits
+static const uint8_t BLOCK_PIXELS = sizeof(PixelWord);
+static const uint8_t BLOCK_BYTES = 3 * sizeof(PixelWord);
+
+// pixels can start anywhere, so words go through memcpy (a single load or store wherever unaligned ones are fine)
+static inline PixelWord LoadWord(const uint8_t *bytes) {
+  PixelWord word;
+  memcpy( &word, bytes, sizeof(word) );
+  return word;
+}
+
+static inline void StoreWord(uint8_t *bytes, PixelWord word) {
+  memcpy( bytes, &word, sizeof(word) );
+}
+
+// the block's three words with color repeated through them
+static void ColorPattern(const CRGB &color, PixelWord *pattern) {
+  CRGB pixels[BLOCK_PIXELS];
+  for( uint8_t i = 0; i < BLOCK_PIXELS; i++ ){
+    pixels[i] = color;
+  }
+  memcpy( pattern, pixels, sizeof(pixels) );
+}
+
+// every byte of word times multiplier (1 - 256) over 256, rounded down. with add (already in 16 bit lanes,
+// the even bytes' then the odd bytes') added to the products first
+static inline PixelWord ScaleWord(PixelWord word, uint16_t multiplier, PixelWord addEven, PixelWord addOdd) {
+  PixelWord even = (word & EVEN_BYTES) * multiplier + addEven;
+  PixelWord odd = ((word >> 8) & EVEN_BYTES) * multiplier + addOdd;
+  return ((even >> 8) & EVEN_BYTES) | (odd & ~EVEN_BYTES);
+}
+
+static inline PixelWord AddWord(PixelWord a, PixelWord b) {
+#if defined(__ARM_FEATURE_DSP) && UINTPTR_MAX == 0xFFFFFFFFu
+  PixelWord sum;
+  asm( "uqadd8 %0, %1, %2" : "=r" (sum) : "r" (a), "r" (b) );
+  return sum;
+#else
+  // add the low seven bits, put the top bit back, and fill every byte that carried out of it
+  PixelWord sum = ((a & LOW_BITS) + (b & LOW_BITS)) ^ ((a ^ b) & HIGH_BITS);
+  PixelWord carried = ((a & b) | ((a | b) & ~sum)) & HIGH_BITS;
+  return sum | ((carried >> 7) * 0xFF);
+#endif
+}
+
+static inline PixelWord MaxWord(PixelWord a, PixelWord b) {
+#if defined(__ARM_FEATURE_DSP) && UINTPTR_MAX == 0xFFFFFFFFu
+  // usub8 sets a flag per byte where a >= b, sel picks those bytes from a and the rest from b
+  PixelWord larger;
+  asm( "usub8 %0, %1, %2\n\t"
+       "sel %0, %1, %2" : "=&r" (larger) : "r" (a), "r" (b) : "cc" );
+  return larger;
+#else
+  // b plus how far a is over it (a - b, 0 in every byte that borrowed)
+  PixelWord difference = ((a | HIGH_BITS) - (b & LOW_BITS)) ^ ((a ^ ~b) & HIGH_BITS);
+  PixelWord borrowed = ((~a & b) | ((~a | b) & difference)) & HIGH_BITS;
+  return b + (difference & ~((borrowed >> 7) * 0xFF));
+#endif
+}
+
+
+void PixelKernelsSWAR::Fill(CRGB *pixels, uint16_t count, const CRGB &color) {
+
+  PixelWord pattern[3];
+  ColorPattern( color, pattern );
+
+  uint8_t *bytes = (uint8_t *)pixels;
+  uint16_t i = 0;
+  for( ; i + BLOCK_PIXELS <= count; i += BLOCK_PIXELS, bytes += BLOCK_BYTES ){
+    StoreWord( bytes, pattern[0] );
+    StoreWord( bytes + sizeof(PixelWord), pattern[1] );
+    StoreWord( bytes + 2 * sizeof(PixelWord), pattern[2] );
+  }
+  PixelKernelsReference::Fill( pixels + i, count - i, color );
+}
+
+
+void PixelKernelsSWAR::Scale(CRGB *pixels, uint16_t count, uint8_t scale) {
+
+  uint16_t multiplier = scale + 1;
+  uint8_t *bytes = (uint8_t *)pixels;
+  uint16_t i = 0;
+  for( ; i + BLOCK_PIXELS <= count; i += BLOCK_PIXELS, bytes += BLOCK_BYTES ){
+    for( uint8_t w = 0; w < 3; w++ ){
+      uint8_t *at = bytes + w * sizeof(PixelWord);
+      StoreWord( at, ScaleWord(LoadWord(at), multiplier, 0, 0) );
+    }
+  }
+  PixelKernelsReference::Scale( pixels + i, count - i, scale );
+}
+
+
+void PixelKernelsSWAR::ScaleByColor(CRGB *pixels, uint16_t count, const CRGB &scale) {
+
+  if( scale.r == scale.g && scale.g == scale.b ){
+    Scale( pixels, count, scale.r );
+  }
+  else {
+    PixelKernelsReference::ScaleByColor( pixels, count, scale );
+  }
+}
+
+
+void PixelKernelsSWAR::Add(CRGB *pixels, uint16_t count, const CRGB &color) {
+
+  PixelWord pattern[3];
+  ColorPattern( color, pattern );
+
+  uint8_t *bytes = (uint8_t *)pixels;
+  uint16_t i = 0;
+  for( ; i + BLOCK_PIXELS <= count; i += BLOCK_PIXELS, bytes += BLOCK_BYTES ){
+    for( uint8_t w = 0; w < 3; w++ ){
+      uint8_t *at = bytes + w * sizeof(PixelWord);
+      StoreWord( at, AddWord(LoadWord(at), pattern[w]) );
+    }
+  }
+  PixelKernelsReference::Add( pixels + i, count - i, color );
+}
+
+
+void PixelKernelsSWAR::Max(CRGB *pixels, uint16_t count, const CRGB &color) {
+
+  PixelWord pattern[3];
+  ColorPattern( color, pattern );
+
+  uint8_t *bytes = (uint8_t *)pixels;
+  uint16_t i = 0;
+  for( ; i + BLOCK_PIXELS <= count; i += BLOCK_PIXELS, bytes += BLOCK_BYTES ){
+    for( uint8_t w = 0; w < 3; w++ ){
+      uint8_t *at = bytes + w * sizeof(PixelWord);
+      StoreWord( at, MaxWord(LoadWord(at), pattern[w]) );
+    }
+  }
+  PixelKernelsReference::Max( pixels + i, count - i, color );
+}
+
+
+void PixelKernelsSWAR::Blend(CRGB *pixels, uint16_t count, const CRGB &color, uint8_t amountOfColor) {
+
+  PixelWord pattern[3];
+  ColorPattern( color, pattern );
+
+  // color's share of every channel, b * (1 + n), in the 16 bit lanes it's added in
+  uint16_t colorMultiplier = amountOfColor + 1;
+  PixelWord colorEven[3], colorOdd[3];
+  for( uint8_t w = 0; w < 3; w++ ){
+    colorEven[w] = (pattern[w] & EVEN_BYTES) * colorMultiplier;
+    colorOdd[w] = ((pattern[w] >> 8) & EVEN_BYTES) * colorMultiplier;
+  }
+
+  uint16_t pixelMultiplier = 256 - amountOfColor;
+  uint8_t *bytes = (uint8_t *)pixels;
+  uint16_t i = 0;
+  for( ; i + BLOCK_PIXELS <= count; i += BLOCK_PIXELS, bytes += BLOCK_BYTES ){
+    for( uint8_t w = 0; w < 3; w++ ){
+      uint8_t *at = bytes + w * sizeof(PixelWord);
+      StoreWord( at, ScaleWord(LoadWord(at), pixelMultiplier, colorEven[w], colorOdd[w]) );
+    }
+  }
+  PixelKernelsReference::Blend( pixels + i, count - i, color, amountOfColor );
+}
+
+
+// the even and odd bytes of each block word are summed in 16 bit lanes, which hold 256 blocks before
+// they could overflow. then each lane goes to the channel its byte is
+ChannelSums PixelKernelsSWAR::SumChannels(const CRGB *pixels, uint16_t count) {
+
+  uint32_t channels[3] = { 0, 0, 0 };
+  const uint8_t *bytes = (const uint8_t *)pixels;
+  uint16_t i = 0;
+
+  while( i + BLOCK_PIXELS <= count ){
+    PixelWord even[3] = { 0, 0, 0 }, odd[3] = { 0, 0, 0 };
+    for( uint16_t blocks = 0; blocks < 256 && i + BLOCK_PIXELS <= count; blocks++, i += BLOCK_PIXELS, bytes += BLOCK_BYTES ){
+      for( uint8_t w = 0; w < 3; w++ ){
+        PixelWord word = LoadWord( bytes + w * sizeof(PixelWord) );
+        even[w] += word & EVEN_BYTES;
+        odd[w] += (word >> 8) & EVEN_BYTES;
+      }
+    }
+
+    for( uint8_t w = 0; w < 3; w++ ){
+      for( uint8_t lane = 0; lane < sizeof(PixelWord) / 2; lane++ ){
+        uint8_t byte = w * sizeof(PixelWord) + lane * 2;
+        channels[byte % 3] += (uint32_t)(even[w] >> (lane * 16)) & 0xFFFF;
+        channels[(byte + 1) % 3] += (uint32_t)(odd[w] >> (lane * 16)) & 0xFFFF;
+      }
+    }
+  }
+
+  ChannelSums sums = PixelKernelsReference::SumChannels( pixels + i, count - i );
+  sums.r += channels[0];
+  sums.g += channels[1];
+  sums.b += channels[2];
+  return sums;
+}
+
+
+#if defined(__SSE2__)
+// *********************************************************************************
+//      SSE2
+//        a block is three 16 byte vectors (16 pixels). scales unpack each vector to
+//        16 bit lanes against zero, multiply, and pack the high bytes back with a
+//        saturating pack that never has anything to saturate. what's left over goes
+//        through the SWAR kernels, a segment is rarely a whole number of blocks
+// *********************************************************************************
+static const uint8_t SSE2_BLOCK_PIXELS = 16;
+
+static void ColorPattern(const CRGB &color, __m128i *pattern) {
+  CRGB pixels[SSE2_BLOCK_PIXELS];
+  for( uint8_t i = 0; i < SSE2_BLOCK_PIXELS; i++ ){
+    pixels[i] = color;
+  }
+  for( uint8_t v = 0; v < 3; v++ ){
+    pattern[v] = _mm_loadu_si128( (const __m128i *)pixels + v );
+  }
+}
+
+// (bytes * multiplier + add) >> 8, a vector of bytes with the multipliers and adds in its low and high halves
+static inline __m128i ScaleVector(__m128i bytes, __m128i multiplierLow, __m128i multiplierHigh, __m128i addLow, __m128i addHigh) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i low = _mm_add_epi16( _mm_mullo_epi16(_mm_unpacklo_epi8(bytes, zero), multiplierLow), addLow );
+  __m128i high = _mm_add_epi16( _mm_mullo_epi16(_mm_unpackhi_epi8(bytes, zero), multiplierHigh), addHigh );
+  return _mm_packus_epi16( _mm_srli_epi16(low, 8), _mm_srli_epi16(high, 8) );
+}
+
+
+void PixelKernelsSSE2::Scale(CRGB *pixels, uint16_t count, uint8_t scale) {
+
+  const __m128i multiplier = _mm_set1_epi16( scale + 1 );
+  const __m128i zero = _mm_setzero_si128();
+
+  __m128i *vectors = (__m128i *)pixels;
+  uint16_t i = 0;
+  for( ; i + SSE2_BLOCK_PIXELS <= count; i += SSE2_BLOCK_PIXELS, vectors += 3 ){
+    for( uint8_t v = 0; v < 3; v++ ){
+      _mm_storeu_si128( vectors + v, ScaleVector(_mm_loadu_si128(vectors + v), multiplier, multiplier, zero, zero) );
+    }
+  }
+  PixelKernelsSWAR::Scale( pixels + i, count - i, scale );
+}
+
+
+void PixelKernelsSSE2::ScaleByColor(CRGB *pixels, uint16_t count, const CRGB &scale) {
+
+  // scale8(x, s) multiplies by s + 1, and each lane's multiplier is its channel's
+  __m128i pattern[3], low[3], high[3];
+  ColorPattern( scale, pattern );
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16( 1 );
+  for( uint8_t v = 0; v < 3; v++ ){
+    low[v] = _mm_add_epi16( _mm_unpacklo_epi8(pattern[v], zero), one );
+    high[v] = _mm_add_epi16( _mm_unpackhi_epi8(pattern[v], zero), one );
+  }
+
+  __m128i *vectors = (__m128i *)pixels;
+  uint16_t i = 0;
+  for( ; i + SSE2_BLOCK_PIXELS <= count; i += SSE2_BLOCK_PIXELS, vectors += 3 ){
+    for( uint8_t v = 0; v < 3; v++ ){
+      _mm_storeu_si128( vectors + v, ScaleVector(_mm_loadu_si128(vectors + v), low[v], high[v], zero, zero) );
+    }
+  }
+  PixelKernelsSWAR::ScaleByColor( pixels + i, count - i, scale );
+}
+
+
+void PixelKernelsSSE2::Add(CRGB *pixels, uint16_t count, const CRGB &color) {
+
+  __m128i pattern[3];
+  ColorPattern( color, pattern );
+
+  __m128i *vectors = (__m128i *)pixels;
+  uint16_t i = 0;
+  for( ; i + SSE2_BLOCK_PIXELS <= count; i += SSE2_BLOCK_PIXELS, vectors += 3 ){
+    for( uint8_t v = 0; v < 3; v++ ){
+      _mm_storeu_si128( vectors + v, _mm_adds_epu8(_mm_loadu_si128(vectors + v), pattern[v]) );
+    }
+  }
+  PixelKernelsSWAR::Add( pixels + i, count - i, color );
+}
+
+
+void PixelKernelsSSE2::Max(CRGB *pixels, uint16_t count, const CRGB &color) {
+
+  __m128i pattern[3];
+  ColorPattern( color, pattern );
+
+  __m128i *vectors = (__m128i *)pixels;
+  uint16_t i = 0;
+  for( ; i + SSE2_BLOCK_PIXELS <= count; i += SSE2_BLOCK_PIXELS, vectors += 3 ){
+    for( uint8_t v = 0; v < 3; v++ ){
+      _mm_storeu_si128( vectors + v, _mm_max_epu8(_mm_loadu_si128(vectors + v), pattern[v]) );
+    }
+  }
+  PixelKernelsSWAR::Max( pixels + i, count - i, color );
+}
+
+
+void PixelKernelsSSE2::Blend(CRGB *pixels, uint16_t count, const CRGB &color, uint8_t amountOfColor) {
+
+  __m128i pattern[3], colorLow[3], colorHigh[3];
+  ColorPattern( color, pattern );
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i colorMultiplier = _mm_set1_epi16( amountOfColor + 1 );
+  for( uint8_t v = 0; v < 3; v++ ){
+    colorLow[v] = _mm_mullo_epi16( _mm_unpacklo_epi8(pattern[v], zero), colorMultiplier );
+    colorHigh[v] = _mm_mullo_epi16( _mm_unpackhi_epi8(pattern[v], zero), colorMultiplier );
+  }
+
+  const __m128i pixelMultiplier = _mm_set1_epi16( 256 - amountOfColor );
+  __m128i *vectors = (__m128i *)pixels;
+  uint16_t i = 0;
+  for( ; i + SSE2_BLOCK_PIXELS <= count; i += SSE2_BLOCK_PIXELS, vectors += 3 ){
+    for( uint8_t v = 0; v < 3; v++ ){
+      _mm_storeu_si128( vectors + v, ScaleVector(_mm_loadu_si128(vectors + v), pixelMultiplier, pixelMultiplier, colorLow[v], colorHigh[v]) );
+    }
+  }
+  PixelKernelsSWAR::Blend( pixels + i, count - i, color, amountOfColor );
+}
+#endif
@@ -0,0 +1,106 @@
+/*
+  PixelKernels.h  - The loops that touch every pixel of a segment at once: fill, fade, add, max, blend, multiply,
+                    and the channel sums the power load is worked out from
+                  -- PixelKernels is the fastest set the build has. LEDStripController, the compositing layers
+                     and the power limiter go through it for every whole-strip operation
+                  -- PixelKernelsReference is the plain loop, one channel at a time with FastLED's own 8 bit
+                     functions. every other set gives exactly the same bytes, rounding included
+                  -- PixelKernelsSWAR works on a machine word of channels at once (SIMD within a register).
+                     three words hold a whole number of pixels, so a color is three pattern words made once
+                     per call. scale8 is two multiplies a word, the even and the odd bytes spread out to 16
+                     bits so the products can't run into each other. on the Teensy (Cortex-M4, 32 bit words)
+                     the saturating add and the max are single DSP instructions, elsewhere a few logic ops
+                  -- PixelKernelsSSE2 (x86 hosts) does 16 channels per instruction the same way
+                  -- what's left at the end that doesn't make a whole block goes through the next smaller set
+                  -- host/bench/KernelBench.cpp checks every set against the reference over random pixels,
+                     lengths and alignments, and times them
+*/
+
+#ifndef PixelKernels_h
+#define PixelKernels_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include <FastLED.h>
+
+// red, green and blue summed over a span, for the power load
+struct ChannelSums {
+  uint32_t r;
+  uint32_t g;
+  uint32_t b;
+};
+
+
+// ******************************************************************
+//            PixelKernelsReference class definitions
+// ******************************************************************
+class PixelKernelsReference
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    static void Fill(CRGB *pixels, uint16_t count, const CRGB &color);
+
+    // nscale8() on every pixel (fadeToBlackBy(n) is a scale of 255 - n)
+    static void Scale(CRGB *pixels, uint16_t count, uint8_t scale);
+    // scale8() of each channel by that channel of scale
+    static void ScaleByColor(CRGB *pixels, uint16_t count, const CRGB &scale);
+    // qadd8() of color
+    static void Add(CRGB *pixels, uint16_t count, const CRGB &color);
+    // the larger of the pixel and color, per channel
+    static void Max(CRGB *pixels, uint16_t count, const CRGB &color);
+    // blend8() towards color
+    static void Blend(CRGB *pixels, uint16_t count, const CRGB &color, uint8_t amountOfColor);
+
+    static ChannelSums SumChannels(const CRGB *pixels, uint16_t count);
+};
+
+
+// ******************************************************************
+//            PixelKernelsSWAR class definitions
+// ******************************************************************
+class PixelKernelsSWAR
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    static void Fill(CRGB *pixels, uint16_t count, const CRGB &color);
+    static void Scale(CRGB *pixels, uint16_t count, uint8_t scale);
+    // only a gray scale (every channel the same, like a white envelope) is a word at a time. a colored
+    // one needs a multiply per channel either way, so it's the reference loop
+    static void ScaleByColor(CRGB *pixels, uint16_t count, const CRGB &scale);
+    static void Add(CRGB *pixels, uint16_t count, const CRGB &color);
+    static void Max(CRGB *pixels, uint16_t count, const CRGB &color);
+    static void Blend(CRGB *pixels, uint16_t count, const CRGB &color, uint8_t amountOfColor);
+    static ChannelSums SumChannels(const CRGB *pixels, uint16_t count);
+};
+
+
+#if defined(__SSE2__)
+// ******************************************************************
+//            PixelKernelsSSE2 class definitions
+// ******************************************************************
+class PixelKernelsSSE2
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    // a fill is only stores, and the sums add up fine in 16 bit lanes, so those two are the SWAR ones
+    static void Fill(CRGB *pixels, uint16_t count, const CRGB &color) { PixelKernelsSWAR::Fill(pixels, count, color); }
+    static void Scale(CRGB *pixels, uint16_t count, uint8_t scale);
+    static void ScaleByColor(CRGB *pixels, uint16_t count, const CRGB &scale);
+    static void Add(CRGB *pixels, uint16_t count, const CRGB &color);
+    static void Max(CRGB *pixels, uint16_t count, const CRGB &color);
+    static void Blend(CRGB *pixels, uint16_t count, const CRGB &color, uint8_t amountOfColor);
+    static ChannelSums SumChannels(const CRGB *pixels, uint16_t count) { return PixelKernelsSWAR::SumChannels(pixels, count); }
+};
+
+typedef PixelKernelsSSE2 PixelKernels;
+#else
+typedef PixelKernelsSWAR PixelKernels;
+#endif
+
+
+
+#endif
@@ -0,0 +1,220 @@
+/*
+  PixelMap.h  - Where every pixel of the sculpture is, as a table worked out when the sketch compiles
+              -- SegmentGeometry says where a segment's first and last pixels are (in strip order, so an
+                 inverted segment's first pixel is still its lowest index), in cm. the pixels in between
+                 are evenly spaced on the straight line joining them (see Installation.h for the show's)
+              -- PixelMap<> turns that into a PixelCoordinate for every pixel, segments back to back in
+                 table order: x, y and z across the sculpture's bounding box, the angle and radius around
+                 the vertical axis through the apex, and the distance from the apex. all of them are one
+                 byte, 0 - 255, so an effect is a few adds and table reads a pixel, with no trig at runtime
+              -- the table is constant, so it lives in flash with the code, not in RAM
+              -- Attach() hands each controller its segment's coordinates (GetPixelCoordinates()), indexed
+                 the same as its pixels. the spatial effects draw from them (see SpatialEffects.h)
+*/
+
+#ifndef PixelMap_h
+#define PixelMap_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include "Topology.h"
+
+struct PixelPoint {
+  int16_t x;
+  int16_t y;
+  int16_t z;             // up
+};
+
+struct SegmentGeometry {
+  PixelPoint first;      // the segment's pixel 0
+  PixelPoint last;       // its pixel length - 1
+};
+
+struct PixelCoordinate {
+  uint8_t x;
+  uint8_t y;
+  uint8_t z;
+  uint8_t angle;         // around the vertical axis through the apex, counterclockwise from +x. 256 is a turn
+  uint8_t radius;        // out from that axis. 255 is the pixel farthest from it
+  uint8_t apexDistance;  // 255 is the pixel farthest from the apex
+};
+
+
+// ******************************************************************
+//            Compile time helpers - single return statements, like Topology.h's
+// ******************************************************************
+#define PIXEL_MAP_PI 3.14159265358979
+
+constexpr double PixelMapAbs(double v) { return v < 0 ? -v : v; }
+constexpr double PixelMapLarger(double a, double b) { return a > b ? a : b; }
+constexpr double PixelMapSmaller(double a, double b) { return a < b ? a : b; }
+
+// newton's method. from above, so a fixed number of steps does for anything the size of a room
+constexpr double PixelMapSqrtStep(double v, double guess, uint8_t steps) {
+  return steps == 0 ? guess : PixelMapSqrtStep(v, (guess + v / guess) / 2, steps - 1);
+}
+
+constexpr double PixelMapSqrt(double v) {
+  return v <= 0 ? 0 : PixelMapSqrtStep(v, v > 1 ? v : 1, 40);
+}
+
+// atan(t) for -1 <= t <= 1, within 0.004 radians (a sixth of an angle step)
+constexpr double PixelMapAtan(double t) {
+  return t * (PIXEL_MAP_PI / 4 + 0.273 * (1 - PixelMapAbs(t)));
+}
+
+constexpr double PixelMapAtan2(double y, double x) {
+  return PixelMapAbs(x) >= PixelMapAbs(y)
+           ? ( x == 0 ? 0 :
+               x > 0 ? PixelMapAtan(y / x) :
+               y >= 0 ? PIXEL_MAP_PI + PixelMapAtan(y / x) : -PIXEL_MAP_PI + PixelMapAtan(y / x) )
+           : ( y > 0 ? PIXEL_MAP_PI / 2 - PixelMapAtan(x / y) : -PIXEL_MAP_PI / 2 - PixelMapAtan(x / y) );
+}
+
+// 0 - extent onto 0 - 255, rounded
+constexpr uint8_t PixelMapByte(double v, double extent) {
+  return (uint8_t)( PixelMapSmaller( PixelMapLarger(v, 0) * 255 / PixelMapLarger(extent, 1) + 0.5, 255 ) );
+}
+
+constexpr uint8_t PixelMapAngle(double radians) {
+  return (uint8_t)( ( (int)( radians * 256 / (2 * PIXEL_MAP_PI) + 256.5 ) ) & 0xFF );
+}
+
+// where pixel i of n is on the line from a to b
+constexpr double PixelMapLerp(int16_t a, int16_t b, uint16_t i, uint16_t n) {
+  return n < 2 ? a : a + (double)(b - a) * i / (n - 1);
+}
+
+// the least and most of one axis over every segment's ends (the pixels are between them)
+constexpr double PixelMapMin(const SegmentGeometry *geometry, uint8_t count, int16_t PixelPoint::*axis) {
+  return count == 0 ? 32767 :
+         PixelMapSmaller( PixelMapSmaller(geometry[0].first.*axis, geometry[0].last.*axis), PixelMapMin(geometry + 1, count - 1, axis) );
+}
+
+constexpr double PixelMapMax(const SegmentGeometry *geometry, uint8_t count, int16_t PixelPoint::*axis) {
+  return count == 0 ? -32768 :
+         PixelMapLarger( PixelMapLarger(geometry[0].first.*axis, geometry[0].last.*axis), PixelMapMax(geometry + 1, count - 1, axis) );
+}
+
+constexpr double PixelMapRadius(const PixelPoint &p, const PixelPoint &apex) {
+  return PixelMapSqrt( (double)(p.x - apex.x) * (p.x - apex.x) + (double)(p.y - apex.y) * (p.y - apex.y) );
+}
+
+constexpr double PixelMapDistance(const PixelPoint &p, const PixelPoint &apex) {
+  return PixelMapSqrt( (double)(p.x - apex.x) * (p.x - apex.x) + (double)(p.y - apex.y) * (p.y - apex.y) +
+                       (double)(p.z - apex.z) * (p.z - apex.z) );
+}
+
+// the farthest any pixel is. both distances only grow towards a line's ends, so the ends will do
+constexpr double PixelMapMaxRadius(const SegmentGeometry *geometry, uint8_t count, const PixelPoint &apex) {
+  return count == 0 ? 0 :
+         PixelMapLarger( PixelMapLarger( PixelMapRadius(geometry[0].first, apex), PixelMapRadius(geometry[0].last, apex) ),
+                         PixelMapMaxRadius(geometry + 1, count - 1, apex) );
+}
+
+constexpr double PixelMapMaxDistance(const SegmentGeometry *geometry, uint8_t count, const PixelPoint &apex) {
+  return count == 0 ? 0 :
+         PixelMapLarger( PixelMapLarger( PixelMapDistance(geometry[0].first, apex), PixelMapDistance(geometry[0].last, apex) ),
+                         PixelMapMaxDistance(geometry + 1, count - 1, apex) );
+}
+
+// the segments' pixels back to back, in table order
+constexpr uint16_t PixelMapSegmentOffset(const SegmentLayout *segments, uint8_t segment) {
+  return segment == 0 ? 0 : PixelMapSegmentOffset(segments, segment - 1) + segments[segment - 1].length;
+}
+
+constexpr uint8_t PixelMapSegmentOf(const SegmentLayout *segments, uint16_t pixel, uint8_t segment = 0) {
+  return pixel < segments[segment].length ? segment : PixelMapSegmentOf(segments, pixel - segments[segment].length, segment + 1);
+}
+
+
+// 0, 1 ... N - 1 as a parameter pack, built by halves so a few thousand pixels don't nest templates too deep
+template <uint16_t... I> struct PixelIndexes {};
+template <typename A, typename B> struct JoinPixelIndexes;
+template <uint16_t... A, uint16_t... B> struct JoinPixelIndexes< PixelIndexes<A...>, PixelIndexes<B...> > {
+  typedef PixelIndexes<A..., (uint16_t)(sizeof...(A) + B)...> Type;
+};
+template <uint16_t N> struct MakePixelIndexes
+  : JoinPixelIndexes< typename MakePixelIndexes<N / 2>::Type, typename MakePixelIndexes<N - N / 2>::Type > {};
+template <> struct MakePixelIndexes<0> { typedef PixelIndexes<> Type; };
+template <> struct MakePixelIndexes<1> { typedef PixelIndexes<0> Type; };
+
+
+// ******************************************************************
+//            PixelMap class definitions
+// ******************************************************************
+template <const SegmentLayout *SEGMENTS, uint8_t SEGMENT_COUNT, const SegmentGeometry *GEOMETRY, const PixelPoint *APEX>
+class PixelMap
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    static constexpr uint16_t GetPixelCount() { return PixelMapSegmentOffset(SEGMENTS, SEGMENT_COUNT); }
+
+    // segment's coordinates, one per pixel, in the order of its pixels
+    static const PixelCoordinate *GetSegmentCoordinates(uint8_t segment) {
+      return &_table.pixels[ PixelMapSegmentOffset(SEGMENTS, segment) ];
+    }
+
+    // every controller in table order gets its segment's coordinates
+    static void Attach(LEDStripController * const *controllers) {
+      for( uint8_t i = 0; i < SEGMENT_COUNT; i++ ){
+        controllers[i]->SetPixelCoordinates( GetSegmentCoordinates(i) );
+      }
+    }
+
+    // the same as the table's entry for pixel, worked out again (host/bench/SpatialBench.cpp checks the
+    // table against floating point)
+    static constexpr PixelCoordinate Coordinate(uint16_t pixel) {
+      return SegmentCoordinate( PixelMapSegmentOf(SEGMENTS, pixel), pixel );
+    }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    static constexpr PixelCoordinate SegmentCoordinate(uint8_t segment, uint16_t pixel) {
+      return PointCoordinate(
+        PixelMapLerp( GEOMETRY[segment].first.x, GEOMETRY[segment].last.x, pixel - PixelMapSegmentOffset(SEGMENTS, segment), SEGMENTS[segment].length ),
+        PixelMapLerp( GEOMETRY[segment].first.y, GEOMETRY[segment].last.y, pixel - PixelMapSegmentOffset(SEGMENTS, segment), SEGMENTS[segment].length ),
+        PixelMapLerp( GEOMETRY[segment].first.z, GEOMETRY[segment].last.z, pixel - PixelMapSegmentOffset(SEGMENTS, segment), SEGMENTS[segment].length ) );
+    }
+
+    // the bounding box and the farthest distances, worked out once for the whole table
+    static constexpr double _minX = PixelMapMin(GEOMETRY, SEGMENT_COUNT, &PixelPoint::x);
+    static constexpr double _minY = PixelMapMin(GEOMETRY, SEGMENT_COUNT, &PixelPoint::y);
+    static constexpr double _minZ = PixelMapMin(GEOMETRY, SEGMENT_COUNT, &PixelPoint::z);
+    static constexpr double _extentX = PixelMapMax(GEOMETRY, SEGMENT_COUNT, &PixelPoint::x) - _minX;
+    static constexpr double _extentY = PixelMapMax(GEOMETRY, SEGMENT_COUNT, &PixelPoint::y) - _minY;
+    static constexpr double _extentZ = PixelMapMax(GEOMETRY, SEGMENT_COUNT, &PixelPoint::z) - _minZ;
+    static constexpr double _maxRadius = PixelMapMaxRadius(GEOMETRY, SEGMENT_COUNT, *APEX);
+    static constexpr double _maxDistance = PixelMapMaxDistance(GEOMETRY, SEGMENT_COUNT, *APEX);
+
+    static constexpr PixelCoordinate PointCoordinate(double x, double y, double z) {
+      return PixelCoordinate{
+        PixelMapByte( x - _minX, _extentX ),
+        PixelMapByte( y - _minY, _extentY ),
+        PixelMapByte( z - _minZ, _extentZ ),
+        PixelMapAngle( PixelMapAtan2( y - APEX->y, x - APEX->x ) ),
+        PixelMapByte( PixelMapSqrt( (x - APEX->x) * (x - APEX->x) + (y - APEX->y) * (y - APEX->y) ), _maxRadius ),
+        PixelMapByte( PixelMapSqrt( (x - APEX->x) * (x - APEX->x) + (y - APEX->y) * (y - APEX->y) + (z - APEX->z) * (z - APEX->z) ),
+                      _maxDistance ) };
+    }
+
+    struct Table {
+      PixelCoordinate pixels[ PixelMapSegmentOffset(SEGMENTS, SEGMENT_COUNT) ];
+    };
+
+    template <uint16_t... I>
+    static constexpr Table BuildTable(PixelIndexes<I...>) { return Table{ { Coordinate(I)... } }; }
+
+    static constexpr Table _table = BuildTable( typename MakePixelIndexes< PixelMapSegmentOffset(SEGMENTS, SEGMENT_COUNT) >::Type() );
+};
+
+// the table's definition, which C++11 and 14 need for its address to be taken
+template <const SegmentLayout *SEGMENTS, uint8_t SEGMENT_COUNT, const SegmentGeometry *GEOMETRY, const PixelPoint *APEX>
+constexpr typename PixelMap<SEGMENTS, SEGMENT_COUNT, GEOMETRY, APEX>::Table PixelMap<SEGMENTS, SEGMENT_COUNT, GEOMETRY, APEX>::_table;
+
+
+
+#endif
@@ -0,0 +1,174 @@
+/*
+  PixelStream.cpp   - Pixels sent straight from a PC, shown instead of the animations while they keep coming
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "PixelStream.h"
+
+
+// *********************************************************************************
+//      CONSTRUCTOR
+// *********************************************************************************
+
+PixelStream::PixelStream(CRGB * const *strips, const uint16_t *stripLengths, uint8_t stripCount, CRGB *backBuffer)
+{
+  _strips = strips;
+  _stripLengths = stripLengths;
+  _stripCount = stripCount < MAX_OUTPUT_STRIPS ? stripCount : MAX_OUTPUT_STRIPS;
+  _backBuffer = backBuffer;
+
+  uint16_t offset = 0;
+  for( uint8_t i = 0; i < _stripCount; i++ ){
+    _stripOffsets[i] = offset;
+    offset += _stripLengths[i];
+    _dirtyStart[i] = _stripLengths[i];
+    _dirtyEnd[i] = 0;
+  }
+}
+
+
+// *********************************************************************************
+//      RECEIVING - called by SerialProtocol as each chunk arrives
+// *********************************************************************************
+
+void PixelStream::BeginChunk(uint8_t sequence, uint8_t strip, uint8_t flags, uint16_t start) {
+
+  // a gap in the sequence is a chunk that never made it (or failed its CRC before we saw its header)
+  if( _haveSequence && sequence != (uint8_t)(_lastSequence + 1) ){
+    _needKeyframe = true;
+  }
+  _lastSequence = sequence;
+  _haveSequence = true;
+
+  // a keyframe rewrites every pixel, so whatever the back buffer held doesn't matter anymore
+  if( flags & PIXEL_CHUNK_KEYFRAME ){
+    _needKeyframe = false;
+  }
+
+  _chunkFlags = flags;
+  _strip = strip;
+  _position = start;
+  _byteCount = 0;
+
+  // chunks for strips we don't have are skipped, so a sender set up for a bigger rig still works
+  _writing = !_needKeyframe && strip < _stripCount && start < _stripLengths[strip];
+}
+
+
+void PixelStream::Push(uint8_t dataByte) {
+
+  if( !_writing ){
+    return;
+  }
+
+  _bytes[_byteCount++] = dataByte;
+
+  if( _chunkFlags & PIXEL_CHUNK_RLE ){
+    if( _byteCount == 4 ){
+      Write( CRGB(_bytes[1], _bytes[2], _bytes[3]), _bytes[0] );
+      _byteCount = 0;
+    }
+  }
+  else if( _byteCount == 3 ){
+    Write( CRGB(_bytes[0], _bytes[1], _bytes[2]), 1 );
+    _byteCount = 0;
+  }
+}
+
+
+void PixelStream::EndChunk(bool intact) {
+
+  // a chunk that failed its CRC or stopped part way through a pixel has left the back buffer half written
+  if( !intact || _byteCount != 0 ){
+    _needKeyframe = true;
+  }
+  _writing = false;
+
+  if( !(_chunkFlags & PIXEL_CHUNK_COMMIT) ){
+    return;
+  }
+
+  if( _needKeyframe ){
+    _droppedFrameCount++;
+    return;
+  }
+
+  Commit();
+}
+
+
+// straight into the back buffer, noting the span written. a run past the end of the strip is a bad chunk
+void PixelStream::Write(CRGB color, uint16_t count) {
+
+  uint16_t length = _stripLengths[_strip];
+  if( count == 0 || _position + count > length ){
+    _needKeyframe = true;
+    _writing = false;
+    return;
+  }
+
+  CRGB *pixel = &_backBuffer[ _stripOffsets[_strip] + _position ];
+  for( uint16_t i = 0; i < count; i++ ){
+    pixel[i] = color;
+  }
+
+  if( _position < _dirtyStart[_strip] ){
+    _dirtyStart[_strip] = _position;
+  }
+  _position += count;
+  if( _position > _dirtyEnd[_strip] ){
+    _dirtyEnd[_strip] = _position;
+  }
+}
+
+
+// the whole frame is here. copy what it wrote onto the strips
+void PixelStream::Commit() {
+
+  for( uint8_t i = 0; i < _stripCount; i++ ){
+    if( _dirtyEnd[i] <= _dirtyStart[i] ){
+      continue;
+    }
+
+    memcpy( &_strips[i][_dirtyStart[i]], &_backBuffer[ _stripOffsets[i] + _dirtyStart[i] ], (_dirtyEnd[i] - _dirtyStart[i]) * sizeof(CRGB) );
+    _changedStrips |= 1 << i;
+    _dirtyStart[i] = _stripLengths[i];
+    _dirtyEnd[i] = 0;
+  }
+
+  _committed = true;
+  _frameCount++;
+}
+
+
+// *********************************************************************************
+//      ONCE PER FRAME
+// *********************************************************************************
+
+bool PixelStream::Update(const FrameTime &frame) {
+
+  if( _committed ){
+    _committed = false;
+    _active = true;
+    _lastFrameMillis = frame.millis;
+  }
+  // the sender stopped. the animations draw over what we showed, so only a keyframe can start us again
+  else if( _active && (uint32_t)(frame.millis - _lastFrameMillis) > PIXEL_STREAM_TIMEOUT_MILLIS ){
+    _active = false;
+    _needKeyframe = true;
+    _stallCount++;
+  }
+
+  return _active;
+}
+
+
+uint8_t PixelStream::TakeChangedStrips() {
+
+  uint8_t changedStrips = _changedStrips;
+  _changedStrips = 0;
+  return changedStrips;
+}
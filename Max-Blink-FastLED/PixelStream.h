@@ -0,0 +1,113 @@
+/*
+  PixelStream.h  - Pixels sent straight from a PC, shown instead of the animations while they keep coming
+                 -- frames arrive as SERIAL_OP_PIXELS chunks (see SerialProtocol.h). the decoder hands each
+                    chunk's pixel bytes over as they arrive and they're decoded straight into a back buffer,
+                    so nothing the size of a frame is ever staged
+                 -- the frame only reaches the strips when its last chunk (PIXEL_CHUNK_COMMIT) arrives and
+                    every chunk since the last frame got here intact. then just the spans that were written
+                    are copied over, so a frame that's cut off or corrupted is never shown
+                 -- a chunk only has to cover what changed since the last frame, as raw pixels or runs
+                    (PIXEL_CHUNK_RLE), so a mostly still scene costs a few bytes a frame
+                 -- a lost or bad chunk means the back buffer no longer matches what's on the strips, so
+                    nothing is shown until a frame marked PIXEL_CHUNK_KEYFRAME (one that writes every pixel).
+                    senders should send one every second or so
+                 -- when no frame has arrived for PIXEL_STREAM_TIMEOUT_MILLIS the stream lets go and the
+                    animations take over again
+
+  CHUNK DATA
+    raw     r, g, b for each pixel from start on
+    RLE     count (1-255), r, g, b for each run of identical pixels from start on
+*/
+
+#ifndef PixelStream_h
+#define PixelStream_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include "FrameClock.h"
+#include "OutputBackend.h"
+
+// SERIAL_OP_PIXELS, sequence, strip, flags, start (2)
+#define PIXEL_CHUNK_HEADER_SIZE 6
+
+// a frame length byte allows 255 payload bytes
+#define PIXEL_CHUNK_MAX_DATA (255 - PIXEL_CHUNK_HEADER_SIZE)
+
+// chunk flags
+#define PIXEL_CHUNK_RLE 0x01        // the data is runs rather than raw pixels
+#define PIXEL_CHUNK_KEYFRAME 0x02   // the frame starting with this chunk writes every pixel
+#define PIXEL_CHUNK_COMMIT 0x04     // the last chunk of a frame: show it
+
+// animations take back over once no frame has arrived for this long
+#define PIXEL_STREAM_TIMEOUT_MILLIS 500
+
+
+// ******************************************************************
+//            PixelStream class definitions
+// ******************************************************************
+class PixelStream
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    // strips are the arrays the output backend sends. backBuffer holds every strip's pixels, one after another
+    PixelStream(CRGB * const *strips, const uint16_t *stripLengths, uint8_t stripCount, CRGB *backBuffer);
+
+    // called by SerialProtocol as a chunk arrives: the header, each data byte, and whether it all
+    // arrived intact (its CRC passed)
+    void BeginChunk(uint8_t sequence, uint8_t strip, uint8_t flags, uint16_t start);
+    void Push(uint8_t dataByte);
+    void EndChunk(bool intact);
+
+    // once per frame. true while frames are arriving, when the animations should leave the strips alone
+    bool Update(const FrameTime &frame);
+    bool IsActive() const { return _active; }
+
+    // the strips a frame changed since the last call (bit n is strip n)
+    uint8_t TakeChangedStrips();
+
+    uint32_t GetFrameCount() const { return _frameCount; }
+    uint16_t GetDroppedFrameCount() const { return _droppedFrameCount; }   // lost, corrupted or waiting on a keyframe
+    uint16_t GetStallCount() const { return _stallCount; }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    CRGB * const *_strips;
+    const uint16_t *_stripLengths;
+    uint8_t _stripCount;
+    CRGB *_backBuffer;
+    uint16_t _stripOffsets[MAX_OUTPUT_STRIPS];
+
+    // what of the back buffer differs from the strips, per strip
+    uint16_t _dirtyStart[MAX_OUTPUT_STRIPS];
+    uint16_t _dirtyEnd[MAX_OUTPUT_STRIPS];
+    uint8_t _changedStrips = 0;
+
+    // the chunk arriving
+    uint8_t _lastSequence = 0;
+    bool _haveSequence = false;
+    bool _needKeyframe = true;
+    bool _writing = false;
+    uint8_t _chunkFlags = 0;
+    uint8_t _strip = 0;
+    uint16_t _position = 0;
+    uint8_t _bytes[4];
+    uint8_t _byteCount = 0;
+
+    bool _committed = false;        // a frame went to the strips since the last Update()
+    bool _active = false;
+    uint32_t _lastFrameMillis = 0;
+
+    uint32_t _frameCount = 0;
+    uint16_t _droppedFrameCount = 0;
+    uint16_t _stallCount = 0;
+
+    void Write(CRGB color, uint16_t count);
+    void Commit();
+};
+
+
+
+#endif
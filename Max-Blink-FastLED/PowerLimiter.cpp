@@ -0,0 +1,148 @@
+/*
+  PowerLimiter.cpp  - Keeps the strips under what their power supplies can deliver
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "PowerLimiter.h"
+
+
+uint32_t PixelsPowerLoad(const CRGB *leds, uint16_t count) {
+
+  return ChannelsPowerLoad( PixelKernels::SumChannels( leds, count ) );
+}
+
+
+// *********************************************************************************
+//      CONSTRUCTOR
+// *********************************************************************************
+
+PowerLimiter::PowerLimiter(const uint16_t *stripLengths, const uint8_t *stripSupply, uint8_t stripCount)
+{
+  _stripLengths = stripLengths;
+  _stripSupply = stripSupply;
+  _stripCount = stripCount < MAX_OUTPUT_STRIPS ? stripCount : MAX_OUTPUT_STRIPS;
+
+  for( uint8_t i = 0; i < POWER_MAX_SUPPLIES; i++ ){
+    _budgetMilliamps[i] = POWER_SUPPLY_MILLIAMPS;
+    _scale[i] = 255;
+    _demandMilliamps[i] = 0;
+    _drawMilliamps[i] = 0;
+  }
+  ResetStats();
+}
+
+
+void PowerLimiter::SetBudget(uint8_t supply, uint16_t milliamps) {
+
+  if( supply < POWER_MAX_SUPPLIES ){
+    _budgetMilliamps[supply] = milliamps;
+  }
+}
+
+
+// *********************************************************************************
+//      ONCE PER FRAME
+// *********************************************************************************
+
+uint8_t PowerLimiter::Update(const uint32_t *stripLoads, uint8_t brightness, OutputBackend &backend) {
+
+  uint32_t idle[POWER_MAX_SUPPLIES] = {0};
+  uint64_t load[POWER_MAX_SUPPLIES] = {0};
+  uint8_t supplyStrips[POWER_MAX_SUPPLIES] = {0};
+
+  for( uint8_t i = 0; i < _stripCount; i++ ){
+    uint8_t supply = _stripSupply[i] < POWER_MAX_SUPPLIES ? _stripSupply[i] : 0;
+    idle[supply] += (uint32_t)_stripLengths[i] * POWER_IDLE_MILLIAMPS;
+    load[supply] += stripLoads[i];
+    supplyStrips[supply] |= 1 << i;
+  }
+
+  uint8_t changedStrips = 0;
+  bool limited = false;
+
+  for( uint8_t supply = 0; supply < POWER_MAX_SUPPLIES; supply++ ){
+    if( !supplyStrips[supply] ){
+      continue;
+    }
+
+    _demandMilliamps[supply] = Milliamps(idle[supply], load[supply], brightness);
+
+    // the scale that would just fit: the most the loaded channels can have after the idle current,
+    // as a brightness, then as a fraction of the brightness we were given. if it's the idle current
+    // alone that's over, dimming can't help
+    uint8_t target = 255;
+    uint16_t budget = _budgetMilliamps[supply];
+    if( budget != 0 && _demandMilliamps[supply] > budget && load[supply] != 0 && brightness != 0 ){
+      uint64_t available = budget > idle[supply] ? budget - idle[supply] : 0;
+      uint64_t maxBrightness = available * 65025 / load[supply];
+      uint64_t scale = maxBrightness * 256 / brightness;
+      target = scale > 0 ? (uint8_t)(scale - 1) : 0;
+    }
+
+    uint8_t scale = _scale[supply];
+    if( target < scale ){
+      scale = target;
+    }
+    else {
+      scale = (target - scale) > POWER_RELEASE_STEP ? scale + POWER_RELEASE_STEP : target;
+    }
+
+    if( scale != _scale[supply] ){
+      _scale[supply] = scale;
+      changedStrips |= supplyStrips[supply];
+    }
+    if( scale != 255 ){
+      limited = true;
+    }
+
+    _drawMilliamps[supply] = Milliamps( idle[supply], load[supply], scale8(brightness, scale) );
+
+    int32_t headroom = GetHeadroomMilliamps(supply);
+    if( budget != 0 && headroom < _minHeadroomMilliamps[supply] ){
+      _minHeadroomMilliamps[supply] = headroom;
+    }
+  }
+
+  for( uint8_t i = 0; i < _stripCount; i++ ){
+    backend.SetStripScale( i, GetScale(_stripSupply[i] < POWER_MAX_SUPPLIES ? _stripSupply[i] : 0) );
+  }
+
+  if( limited ){
+    _limitedFrameCount++;
+  }
+
+  return changedStrips;
+}
+
+
+// *********************************************************************************
+//      TELEMETRY
+// *********************************************************************************
+
+int32_t PowerLimiter::GetHeadroomMilliamps(uint8_t supply) const {
+
+  if( supply >= POWER_MAX_SUPPLIES || _budgetMilliamps[supply] == 0 ){
+    return 0;
+  }
+  return (int32_t)_budgetMilliamps[supply] - (int32_t)_drawMilliamps[supply];
+}
+
+
+void PowerLimiter::ResetStats() {
+
+  for( uint8_t i = 0; i < POWER_MAX_SUPPLIES; i++ ){
+    _minHeadroomMilliamps[i] = _budgetMilliamps[i];
+  }
+  _limitedFrameCount = 0;
+}
+
+
+// the load is at full brightness, times 255, so scale it by brightness / 255 and take the 255 back off
+uint16_t PowerLimiter::Milliamps(uint32_t idleMilliamps, uint64_t load, uint8_t brightness) {
+
+  uint64_t milliamps = idleMilliamps + (load * brightness + 65024) / 65025;
+  return milliamps > 0xFFFF ? 0xFFFF : (uint16_t)milliamps;
+}
@@ -0,0 +1,102 @@
+/*
+  PowerLimiter.h  - Keeps the strips under what their power supplies can deliver
+                  -- a WS2812 draws about POWER_*_MILLIAMPS per channel at full, in proportion to the
+                     channel's value, plus POWER_IDLE_MILLIAMPS just for being on. a strip's "load" is the
+                     sum of its channels weighted by those, what it would draw at full brightness
+                  -- the load isn't a pass over the pixels at the end of a frame: each segment keeps its own
+                     up to date as it writes them (LEDStripController::GetPowerLoad()), mostly for free
+                     since solid fills, fades, single pixels and a white envelope have it without looking
+                     at every pixel
+                  -- once a frame the loads of each supply's strips are added up, and if they'd draw more
+                     than its budget, those strips are scaled down to just fit. the scale drops at once but
+                     only comes back up POWER_RELEASE_STEP a frame, so it doesn't pump with the beat
+                  -- the scale goes to the output backend (OutputBackend::SetStripScale()), on top of the
+                     global brightness, so no pixel is touched
+*/
+
+#ifndef PowerLimiter_h
+#define PowerLimiter_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include <FastLED.h>
+#include "GlobalVariables.h"
+#include "OutputBackend.h"
+#include "PixelKernels.h"
+
+// what one pixel draws: each channel at 255, and the chip with every channel off (FastLED's figures)
+#define POWER_RED_MILLIAMPS 16
+#define POWER_GREEN_MILLIAMPS 11
+#define POWER_BLUE_MILLIAMPS 15
+#define POWER_IDLE_MILLIAMPS 1
+
+#define POWER_MAX_SUPPLIES 4
+
+// how much (out of 255) a supply's scale can come back up per frame. 4 takes about a second
+#define POWER_RELEASE_STEP 4
+
+
+// a pixel's load: the milliamps it draws at full brightness, times 255
+inline uint32_t PixelPowerLoad(const CRGB &color) {
+  return (uint32_t)color.r * POWER_RED_MILLIAMPS + (uint32_t)color.g * POWER_GREEN_MILLIAMPS + (uint32_t)color.b * POWER_BLUE_MILLIAMPS;
+}
+
+// the load of pixels whose channels add up to sums
+inline uint32_t ChannelsPowerLoad(const ChannelSums &sums) {
+  return sums.r * POWER_RED_MILLIAMPS + sums.g * POWER_GREEN_MILLIAMPS + sums.b * POWER_BLUE_MILLIAMPS;
+}
+
+uint32_t PixelsPowerLoad(const CRGB *leds, uint16_t count);
+
+
+// ******************************************************************
+//            PowerLimiter class definitions
+// ******************************************************************
+class PowerLimiter
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    // stripSupply[n] is the supply strip n draws from. every supply starts with POWER_SUPPLY_MILLIAMPS
+    PowerLimiter(const uint16_t *stripLengths, const uint8_t *stripSupply, uint8_t stripCount);
+
+    // 0 doesn't limit the supply at all
+    void SetBudget(uint8_t supply, uint16_t milliamps);
+    uint16_t GetBudget(uint8_t supply) const { return supply < POWER_MAX_SUPPLIES ? _budgetMilliamps[supply] : 0; }
+
+    // once per frame, with each strip's load and the global brightness. sets each strip's scale on the
+    // backend, and returns the strips whose scale changed (they need sending even if no pixel did)
+    uint8_t Update(const uint32_t *stripLoads, uint8_t brightness, OutputBackend &backend);
+
+    uint8_t GetScale(uint8_t supply) const { return supply < POWER_MAX_SUPPLIES ? _scale[supply] : 255; }
+
+    // TELEMETRY - from the last Update(). demand is what the frame would draw unlimited, draw what it
+    // draws scaled. headroom is the budget less the draw (negative if even the idle current is over)
+    uint16_t GetDemandMilliamps(uint8_t supply) const { return supply < POWER_MAX_SUPPLIES ? _demandMilliamps[supply] : 0; }
+    uint16_t GetDrawMilliamps(uint8_t supply) const { return supply < POWER_MAX_SUPPLIES ? _drawMilliamps[supply] : 0; }
+    int32_t GetHeadroomMilliamps(uint8_t supply) const;
+    int32_t GetMinHeadroomMilliamps(uint8_t supply) const { return supply < POWER_MAX_SUPPLIES ? _minHeadroomMilliamps[supply] : 0; }
+    uint32_t GetLimitedFrameCount() const { return _limitedFrameCount; }
+    void ResetStats();
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    const uint16_t *_stripLengths;
+    const uint8_t *_stripSupply;
+    uint8_t _stripCount;
+
+    uint16_t _budgetMilliamps[POWER_MAX_SUPPLIES];
+    uint8_t _scale[POWER_MAX_SUPPLIES];
+    uint16_t _demandMilliamps[POWER_MAX_SUPPLIES];
+    uint16_t _drawMilliamps[POWER_MAX_SUPPLIES];
+    int32_t _minHeadroomMilliamps[POWER_MAX_SUPPLIES];
+    uint32_t _limitedFrameCount = 0;
+
+    static uint16_t Milliamps(uint32_t idleMilliamps, uint64_t load, uint8_t brightness);
+};
+
+
+
+#endif
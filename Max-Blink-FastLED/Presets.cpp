@@ -0,0 +1,231 @@
+/*
+  Presets.cpp  - What each single character command from the Max patch does, as a table instead of a switch
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include <EEPROM.h>
+#include "Presets.h"
+#include "Installation.h"
+#include "SerialProtocol.h"
+
+
+// *********************************************************************************
+//      THE DEFAULTS - the keys the Max patch has always sent
+// *********************************************************************************
+// for the palette animations the hue does nothing, and for PALETTE_W_GLITTER_FADE_LOW_BPM the brightness is
+// the glitter's. brightnessHigh is where a fade starts and brightnessLow where it ends (colors below ~30 are
+// very inaccurate). CONFETTI's bpm is the closest thing it has to a speed, 255 at most
+const Preset Presets::_defaults[] = {
+  // key  actions                                                 trigger on                                         animation                        hue   bri   bpm                   high  low  palette                 hue index bpm
+  { 'o',  PRESET_TRIGGER,                                         PRESET_ALL_SEGMENTS,                               ALL_OFF,                         0,    0,    0,                    0,    0,   0,                      0 },
+  { 'O',  PRESET_TRIGGER,                                         PRESET_ALL_SEGMENTS,                               FADE_OUT_BPM,                    0,    0,    0,                    0,    0,   0,                      0 },
+  { 'A',  PRESET_TRIGGER,                                         PRESET_ALL_SEGMENTS,                               SOLID_COLOR,                     0,    0,    0,                    0,    0,   0,                      0 },
+  { 'b',  PRESET_PARAMS | PRESET_TRIGGER,                         PRESET_ALL_SEGMENTS,                               FADE_LOW_BPM,                    176,  255,  PRESET_TEMPO,         150,  90,  0,                      0 },
+  { 'B',  PRESET_PARAMS | PRESET_TRIGGER,                         PRESET_ALL_SEGMENTS,                               FADE_LOW_BPM,                    176,  255,  PRESET_TEMPO,         255,  90,  0,                      0 },
+  { 'E',  PRESET_PARAMS | PRESET_TRIGGER,                         PRESET_ALL_SEGMENTS,                               FADE_LOW_BPM,                    176,  255,  PRESET_TEMPO_DOUBLE,  255,  90,  0,                      0 },
+  { 'N',  PRESET_TRIGGER,                                         PRESET_ALL_SEGMENTS,                               FADE_IN_OUT_BPM,                 0,    0,    0,                    0,    0,   0,                      0 },
+  { 'i',  PRESET_TRIGGER,                                         PRESET_ALL_SEGMENTS,                               PALETTE,                         0,    0,    0,                    0,    0,   0,                      0 },
+  { 'p',  PRESET_PARAMS | PRESET_HUE_INDEX_BPM | PRESET_TRIGGER,  PRESET_ALL_SEGMENTS,                               PALETTE_FADE_LOW_BPM,            0,    0,    PRESET_TEMPO,         150,  20,  0,                      10 },
+  { 'P',  PRESET_PARAMS | PRESET_HUE_INDEX_BPM | PRESET_TRIGGER,  PRESET_ALL_SEGMENTS,                               PALETTE_FADE_LOW_BPM,            0,    0,    PRESET_TEMPO,         255,  20,  0,                      10 },
+  { 'g',  PRESET_PARAMS | PRESET_TRIGGER,                         PRESET_ALL_SEGMENTS,                               PALETTE_W_GLITTER_FADE_LOW_BPM,  0,    125,  PRESET_TEMPO_DOUBLE,  150,  20,  0,                      0 },
+  { 'G',  PRESET_PARAMS | PRESET_TRIGGER,                         PRESET_ALL_SEGMENTS,                               PALETTE_W_GLITTER_FADE_LOW_BPM,  0,    125,  PRESET_TEMPO_DOUBLE,  255,  20,  0,                      0 },
+  { 'C',  PRESET_PARAMS | PRESET_TRIGGER,                         PRESET_ALL_SEGMENTS,                               CONFETTI,                        0,    255,  60,                   255,  20,  0,                      0 },
+  { 'S',  PRESET_PARAMS | PRESET_TRIGGER,                         PRESET_ALL_SEGMENTS,                               SINELON,                         0,    255,  PRESET_TEMPO,         255,  20,  0,                      0 },
+  { 's',  PRESET_PARAMS | PRESET_TRIGGER,                         InstallationTopology::TagMask(TAG_SIDE_TRIANGLE),  SINEPULSE,                       0,    255,  PRESET_TEMPO,         255,  20,  0,                      0 },
+  { 't',  PRESET_PARAMS | PRESET_TRIGGER,                         InstallationTopology::TagMask(TAG_TOP_TRIANGLE),   SINEPULSE,                       0,    255,  PRESET_TEMPO_DOUBLE,  255,  20,  0,                      0 },
+  { 'x',  PRESET_PARAMS | PRESET_HUE_INDEX_BPM | PRESET_TRIGGER,  PRESET_ALL_SEGMENTS,                               DDT_EXPERIMENTAL,                0,    255,  PRESET_TEMPO,         255,  20,  0,                      10 },
+  { 'y',  PRESET_PALETTE,                                         PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   PRESET_RANDOM_PALETTE,  0 },
+  { 'z',  PRESET_RANDOM_PARAMS,                                   PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   0,                      0 },
+  { '0',  PRESET_PALETTE,                                         PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   0,                      0 },
+  { '1',  PRESET_PALETTE,                                         PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   1,                      0 },
+  { '2',  PRESET_PALETTE,                                         PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   2,                      0 },
+  { '3',  PRESET_PALETTE,                                         PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   3,                      0 },
+  { '4',  PRESET_PALETTE,                                         PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   4,                      0 },
+  { '5',  PRESET_PALETTE,                                         PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   5,                      0 },
+  { '6',  PRESET_PALETTE,                                         PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   6,                      0 },
+  { '7',  PRESET_PALETTE,                                         PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   7,                      0 },
+  { '8',  PRESET_PALETTE,                                         PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   8,                      0 },
+  { '9',  PRESET_PALETTE,                                         PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   9,                      0 },
+  { 'R',  PRESET_REVERSE_HUE,                                     PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   0,                      0 },
+  { 'D',  PRESET_HUE_INDEX_BPM,                                   PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   0,                      PRESET_TEMPO },
+  { 'd',  PRESET_HUE_INDEX_BPM,                                   PRESET_ALL_SEGMENTS,                               NONE,                            0,    0,    0,                    0,    0,   0,                      PRESET_TEMPO_HALF },
+};
+
+const uint8_t Presets::DEFAULT_COUNT = ARRAY_SIZE(_defaults);
+
+Preset Presets::_edits[PRESET_EDIT_SLOTS];
+uint8_t Presets::_editCount = 0;
+uint8_t Presets::_index[PRESET_LAST_KEY - PRESET_FIRST_KEY + 1];
+
+
+// *********************************************************************************
+//      EEPROM LAYOUT - magic, version, edit count, the edits, then a CRC8 over everything before it
+// *********************************************************************************
+static const uint8_t PRESET_MAGIC[2] = { 'O', 'P' };
+#define PRESET_EEPROM_VERSION 1
+#define PRESET_EEPROM_HEADER_SIZE 4
+#define PRESET_EEPROM_RECORD_SIZE 14
+
+// a preset as it's saved, independent of how the compiler lays out the struct
+static void packPreset(const Preset &preset, uint8_t *out) {
+  out[0] = preset.key;
+  out[1] = preset.actions;
+  out[2] = preset.groupMask & 0xFF;
+  out[3] = preset.groupMask >> 8;
+  out[4] = preset.animation;
+  out[5] = preset.hue;
+  out[6] = preset.brightness;
+  out[7] = preset.bpm & 0xFF;
+  out[8] = preset.bpm >> 8;
+  out[9] = preset.brightnessHigh;
+  out[10] = preset.brightnessLow;
+  out[11] = preset.paletteIndex;
+  out[12] = preset.hueIndexBPM & 0xFF;
+  out[13] = preset.hueIndexBPM >> 8;
+}
+
+static void unpackPreset(const uint8_t *in, Preset &preset) {
+  preset.key = in[0];
+  preset.actions = in[1];
+  preset.groupMask = in[2] | (in[3] << 8);
+  preset.animation = (AnimationType)in[4];
+  preset.hue = in[5];
+  preset.brightness = in[6];
+  preset.bpm = in[7] | (in[8] << 8);
+  preset.brightnessHigh = in[9];
+  preset.brightnessLow = in[10];
+  preset.paletteIndex = in[11];
+  preset.hueIndexBPM = in[12] | (in[13] << 8);
+}
+
+
+// *********************************************************************************
+//      EDITING
+// *********************************************************************************
+
+void Presets::Begin() {
+
+  Revert();
+  Load();
+}
+
+
+void Presets::IndexDefaults() {
+
+  static_assert( ARRAY_SIZE(_defaults) + PRESET_EDIT_SLOTS < 256, "the index holds a byte per key" );
+  memset( _index, 0, sizeof(_index) );
+
+  // a key listed twice plays its first entry, as the switch did
+  for( uint8_t i = DEFAULT_COUNT; i > 0; i-- ){
+    _index[_defaults[i - 1].key - PRESET_FIRST_KEY] = i;
+  }
+}
+
+
+bool Presets::Store(const Preset &preset) {
+
+  if( !IsKey(preset.key) ){
+    return false;
+  }
+
+  uint8_t entry = _index[preset.key - PRESET_FIRST_KEY];
+  uint8_t slot;
+
+  if( entry > DEFAULT_COUNT ){
+    slot = entry - DEFAULT_COUNT - 1;
+  } else if( _editCount < PRESET_EDIT_SLOTS ){
+    slot = _editCount++;
+  } else {
+    return false;
+  }
+
+  _edits[slot] = preset;
+  _index[preset.key - PRESET_FIRST_KEY] = DEFAULT_COUNT + 1 + slot;
+  return true;
+}
+
+
+void Presets::Revert() {
+
+  _editCount = 0;
+  IndexDefaults();
+}
+
+
+// *********************************************************************************
+//      EEPROM
+// *********************************************************************************
+
+bool Presets::Save() {
+
+  int address = PRESET_EEPROM_ADDRESS;
+  if( address + PRESET_EEPROM_HEADER_SIZE + _editCount * PRESET_EEPROM_RECORD_SIZE + 1 > (int)EEPROM.length() ){
+    return false;
+  }
+
+  uint8_t header[PRESET_EEPROM_HEADER_SIZE] = { PRESET_MAGIC[0], PRESET_MAGIC[1], PRESET_EEPROM_VERSION, _editCount };
+  uint8_t crc = 0;
+
+  for( uint8_t i = 0; i < PRESET_EEPROM_HEADER_SIZE; i++ ){
+    crc = SerialProtocol::Crc8( crc, header[i] );
+    EEPROM.update( address++, header[i] );
+  }
+
+  for( uint8_t s = 0; s < _editCount; s++ ){
+    uint8_t record[PRESET_EEPROM_RECORD_SIZE];
+    packPreset( _edits[s], record );
+    for( uint8_t i = 0; i < PRESET_EEPROM_RECORD_SIZE; i++ ){
+      crc = SerialProtocol::Crc8( crc, record[i] );
+      EEPROM.update( address++, record[i] );
+    }
+  }
+
+  EEPROM.update( address, crc );
+  return true;
+}
+
+
+// anything that isn't a whole, current save (a new board's EEPROM is all 0xFF) leaves the defaults alone
+bool Presets::Load() {
+
+  int address = PRESET_EEPROM_ADDRESS;
+  if( address + PRESET_EEPROM_HEADER_SIZE + 1 > (int)EEPROM.length() ){
+    return false;
+  }
+
+  uint8_t header[PRESET_EEPROM_HEADER_SIZE];
+  uint8_t crc = 0;
+  for( uint8_t i = 0; i < PRESET_EEPROM_HEADER_SIZE; i++ ){
+    header[i] = EEPROM.read( address++ );
+    crc = SerialProtocol::Crc8( crc, header[i] );
+  }
+
+  uint8_t count = header[3];
+  if( header[0] != PRESET_MAGIC[0] || header[1] != PRESET_MAGIC[1] || header[2] != PRESET_EEPROM_VERSION ||
+      count > PRESET_EDIT_SLOTS || address + count * PRESET_EEPROM_RECORD_SIZE + 1 > (int)EEPROM.length() ){
+    return false;
+  }
+
+  // check it all before any of it replaces a default
+  for( int i = 0; i < count * PRESET_EEPROM_RECORD_SIZE; i++ ){
+    crc = SerialProtocol::Crc8( crc, EEPROM.read( address + i ) );
+  }
+  if( crc != EEPROM.read( address + count * PRESET_EEPROM_RECORD_SIZE ) ){
+    return false;
+  }
+
+  for( uint8_t s = 0; s < count; s++ ){
+    uint8_t record[PRESET_EEPROM_RECORD_SIZE];
+    for( uint8_t i = 0; i < PRESET_EEPROM_RECORD_SIZE; i++ ){
+      record[i] = EEPROM.read( address++ );
+    }
+
+    Preset preset;
+    unpackPreset( record, preset );
+    Store( preset );
+  }
+  return true;
+}
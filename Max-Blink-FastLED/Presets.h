@@ -0,0 +1,134 @@
+/*
+  Presets.h  - What each single character command from the Max patch does, as a table instead of a switch
+             -- a preset is a key and a handful of actions, done in this order: params (fixed, or random
+                like 'z'), a palette (fixed, or random like 'y'), the palette scroll speed, reversing the
+                scroll, and last triggering an animation
+             -- a bpm or scroll speed can be the tempo Max is playing at, twice it or half it
+                (PRESET_TEMPO and the rest) rather than a number
+             -- groupMask is where the animation is triggered. the settings go to every segment, as the
+                keys always did, unless PRESET_GROUP_SETTINGS keeps them to the group as well
+             -- the defaults (Presets.cpp) are const, so they stay in flash. SERIAL_OP_PRESET_STORE
+                replaces or adds a key in one of PRESET_EDIT_SLOTS slots in RAM, and SERIAL_OP_PRESET_SAVE
+                writes those to EEPROM, where Begin() finds them next time. the show can be retuned from
+                Max without reflashing (see SerialProtocol.h)
+             -- Find() is a lookup in an index with a byte for every printable key, however many presets
+                there are. PRESET_EDIT_SLOTS is in GlobalVariables.h
+             -- a session captured on the device (SessionCapture.h) replays its own preset edits, but
+                not what was saved before it started
+*/
+
+#ifndef Presets_h
+#define Presets_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include "LEDStripController.h"
+
+// the keys a preset can be on: printable characters, so the sync byte and the rest never are
+#define PRESET_FIRST_KEY ' '
+#define PRESET_LAST_KEY '~'
+
+// where the saved edits start in EEPROM
+#ifndef PRESET_EEPROM_ADDRESS
+  #define PRESET_EEPROM_ADDRESS 0
+#endif
+
+// what a preset does (Preset::actions)
+#define PRESET_PARAMS           0x01    // hue, brightness, bpm, brightnessHigh, brightnessLow
+#define PRESET_RANDOM_PARAMS    0x02    // all five made up, in the ranges 'z' always used
+#define PRESET_PALETTE          0x04    // paletteIndex, crossfaded over paletteCrossfadeFrames
+#define PRESET_HUE_INDEX_BPM    0x08    // hueIndexBPM
+#define PRESET_REVERSE_HUE      0x10
+#define PRESET_TRIGGER          0x20    // animation, on groupMask
+#define PRESET_GROUP_SETTINGS   0x40    // the settings above go to groupMask too, not every segment
+
+#define PRESET_ALL_SEGMENTS 0xFFFF
+
+// a bpm or hueIndexBPM that follows the music
+#define PRESET_TEMPO        0xFFFF
+#define PRESET_TEMPO_DOUBLE 0xFFFE
+#define PRESET_TEMPO_HALF   0xFFFD
+
+// paletteIndex for any of them. a random number is drawn for every palette preset either way, so
+// sessions replay with the numbers they were recorded with
+#define PRESET_RANDOM_PALETTE 0xFF
+
+
+struct Preset {
+  uint8_t key;
+  uint8_t actions;
+  uint16_t groupMask;
+  AnimationType animation;
+  uint8_t hue;
+  uint8_t brightness;
+  uint16_t bpm;
+  uint8_t brightnessHigh;
+  uint8_t brightnessLow;
+  uint8_t paletteIndex;
+  uint16_t hueIndexBPM;
+};
+
+
+// ******************************************************************
+//            Presets class definitions
+// ******************************************************************
+class Presets
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    // index the defaults, then load any saved edits over them
+    static void Begin();
+
+    static bool IsKey(uint8_t key) { return key >= PRESET_FIRST_KEY && key <= PRESET_LAST_KEY; }
+
+    // the preset for a key, or nullptr if the key does nothing
+    static const Preset *Find(uint8_t key) {
+      if( !IsKey(key) ){
+        return nullptr;
+      }
+      uint8_t entry = _index[key - PRESET_FIRST_KEY];
+      return entry == 0 ? nullptr : entry <= DEFAULT_COUNT ? &_defaults[entry - 1] : &_edits[entry - DEFAULT_COUNT - 1];
+    }
+
+    // a bpm from the table at the given tempo
+    static uint16_t ResolveBPM(uint16_t bpm, uint16_t tempo) {
+      switch( bpm ){
+        case PRESET_TEMPO:        return tempo;
+        case PRESET_TEMPO_DOUBLE: return tempo * 2;
+        case PRESET_TEMPO_HALF:   return tempo / 2;
+        default:                  return bpm;
+      }
+    }
+
+    // replaces the key's preset until Revert(). returns false if it's a new key and every edit slot is
+    // taken, or it isn't a key (IsKey())
+    static bool Store(const Preset &preset);
+    // back to the defaults (what's saved isn't touched until the next Save())
+    static void Revert();
+
+    // the edits to EEPROM, writing only the bytes that changed. false if they don't fit
+    static bool Save();
+
+    static uint8_t GetEditCount() { return _editCount; }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    static const Preset _defaults[];
+    static const uint8_t DEFAULT_COUNT;
+
+    static Preset _edits[PRESET_EDIT_SLOTS];
+    static uint8_t _editCount;
+
+    // by key, from PRESET_FIRST_KEY: 0 for nothing, 1 - DEFAULT_COUNT a default, then the edit slots
+    static uint8_t _index[PRESET_LAST_KEY - PRESET_FIRST_KEY + 1];
+
+    static void IndexDefaults();
+    static bool Load();
+};
+
+
+
+#endif
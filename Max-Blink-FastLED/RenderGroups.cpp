@@ -0,0 +1,116 @@
+/*
+  RenderGroups.cpp  - Renders segments that are in the same state once, and copies the result into the rest
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "RenderGroups.h"
+
+
+// *********************************************************************************
+//      CONSTRUCTOR
+// *********************************************************************************
+
+RenderGroups::RenderGroups(LEDStripController * const *segments, uint8_t numSegments)
+{
+  _segments = segments;
+  _numSegments = numSegments > MAX_RENDER_SEGMENTS ? MAX_RENDER_SEGMENTS : numSegments;
+
+  for(uint8_t i = 0; i < MAX_RENDER_SEGMENTS; i++){
+    _leader[i] = NO_RENDER_LEADER;
+    _mirrored[i] = false;
+    _stateVersion[i] = 0;
+  }
+}
+
+
+// *********************************************************************************
+//      UPDATE
+// *********************************************************************************
+
+uint16_t RenderGroups::Update(const FrameTime &frame) {
+
+  // a setter on any segment may have split (or merged) a group
+  for(uint8_t i = 0; i < _numSegments && !_regroup; i++){
+    if(_segments[i]->GetStateVersion() != _stateVersion[i]){
+      _regroup = true;
+      _retryFrames = RENDER_GROUP_RETRY_FRAMES;
+    }
+  }
+
+  if(_regroup){
+    Regroup();
+  }
+
+  // a leader always comes before the segments that copy it, so it has already rendered this frame
+  uint16_t changedSegments = 0;
+  bool changed[MAX_RENDER_SEGMENTS];
+  _renderCount = 0;
+
+  for(uint8_t i = 0; i < _numSegments; i++){
+    int8_t leader = _leader[i];
+    uint32_t startCycles = _telemetry ? Telemetry::Cycles() : 0;
+
+    if(leader == NO_RENDER_LEADER){
+      changed[i] = _segments[i]->Update(frame);
+      _renderCount++;
+    }
+    else {
+      changed[i] = _segments[i]->FollowRender(*_segments[leader], changed[leader], _mirrored[i]);
+    }
+
+    if(_telemetry){
+      _telemetry->RecordSegment(i, _segments[i]->GetActiveAnimationType(), Telemetry::Cycles() - startCycles, leader == NO_RENDER_LEADER);
+    }
+
+    if(changed[i]){
+      changedSegments |= (1 << i);
+    }
+  }
+
+  return changedSegments;
+}
+
+
+// *********************************************************************************
+//      GROUPING
+// *********************************************************************************
+
+// each segment joins the first earlier segment that renders for itself and is in the same state
+void RenderGroups::Regroup() {
+
+  bool waitingForPixels = false;
+
+  for(uint8_t i = 0; i < _numSegments; i++){
+    _stateVersion[i] = _segments[i]->GetStateVersion();
+    _leader[i] = NO_RENDER_LEADER;
+  }
+
+  for(uint8_t i = 0; i < _numSegments; i++){
+    for(uint8_t j = 0; j < i; j++){
+      bool mirrored;
+      if(_leader[j] != NO_RENDER_LEADER || !_segments[i]->SharesRenderStateWith(*_segments[j], mirrored)){
+        continue;
+      }
+
+      if(_segments[i]->ShowsSamePixelsAs(*_segments[j], mirrored)){
+        _leader[i] = j;
+        _mirrored[i] = mirrored;
+        break;
+      }
+
+      waitingForPixels = true;
+    }
+  }
+
+  // triggered together but still showing different pixels. look again next frame, once the new animation has drawn
+  if(waitingForPixels && _retryFrames){
+    _retryFrames--;
+    _regroup = true;
+  }
+  else {
+    _regroup = false;
+  }
+}
@@ -0,0 +1,67 @@
+/*
+  RenderGroups.h  - Renders segments that are in the same state once, and copies the result into the rest
+                  -- most of the show runs one animation with one set of params on every segment, so
+                     instead of 12 renders a frame we do one per segment length (and orientation)
+                  -- inverted segments take a reversed copy when the animation allows it (see RenderSharing)
+                  -- groups are rebuilt whenever a segment's settings change, so a command that only
+                     reaches some segments (e.g. triggerAnimationSideTriangleStrips) splits them off
+*/
+
+#ifndef RenderGroups_h
+#define RenderGroups_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include "LEDStripController.h"
+#include "Telemetry.h"
+
+// segments are reported back in a 16 bit mask, same as the serial group mask
+#define MAX_RENDER_SEGMENTS 16
+
+#define NO_RENDER_LEADER -1
+
+// segments in the same state whose pixels still differ (the tail of the last animation) are
+// checked again every frame for this long after a change, so they can join once they match
+#define RENDER_GROUP_RETRY_FRAMES 120
+
+
+// ******************************************************************
+//            RenderGroups class definitions
+// ******************************************************************
+class RenderGroups
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    RenderGroups(LEDStripController * const *segments, uint8_t numSegments);
+
+    // stands in for calling Update() on every segment. bit n of the result is set if segment n changed
+    uint16_t Update(const FrameTime &frame);
+
+    // how many segments actually rendered themselves on the last frame
+    uint8_t GetRenderCount() const { return _renderCount; }
+
+    // time every segment's render (or copy) into telemetry. nullptr stops
+    void SetTelemetry(Telemetry *telemetry) { _telemetry = telemetry; }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    LEDStripController * const *_segments;
+    uint8_t _numSegments;
+
+    int8_t _leader[MAX_RENDER_SEGMENTS];             // the segment we copy from, or NO_RENDER_LEADER if we render
+    bool _mirrored[MAX_RENDER_SEGMENTS];             // copy the leader's pixels in reverse
+    uint16_t _stateVersion[MAX_RENDER_SEGMENTS];     // each segment's GetStateVersion() when we grouped
+    bool _regroup = true;            // some segment changed settings
+    uint8_t _retryFrames = RENDER_GROUP_RETRY_FRAMES;   // see RENDER_GROUP_RETRY_FRAMES
+    uint8_t _renderCount = 0;
+    Telemetry *_telemetry = nullptr;
+
+    void Regroup();
+};
+
+
+
+#endif
@@ -0,0 +1,67 @@
+/*
+  RingBuffer.h  - Fixed size single-producer / single-consumer ring buffer
+                -- CAPACITY must be a power of two so wrapping is a mask instead of a divide
+                -- nothing is allocated at runtime; the storage lives inside the object
+*/
+
+#ifndef RingBuffer_h
+#define RingBuffer_h
+
+#include <stdint.h>
+
+
+template <typename T, uint16_t CAPACITY>
+class RingBuffer
+{
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0, "RingBuffer CAPACITY must be a power of two");
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    RingBuffer() : _head(0), _tail(0) {}
+
+    // add an item to the end of the buffer. returns false (and drops the item) when full
+    bool Push(const T &item) {
+      if (IsFull()) {
+        return false;
+      }
+      _items[_head & (CAPACITY - 1)] = item;
+      _head++;
+      return true;
+    }
+
+    // take the oldest item out of the buffer. returns false when empty
+    bool Pop(T &item) {
+      if (IsEmpty()) {
+        return false;
+      }
+      item = _items[_tail & (CAPACITY - 1)];
+      _tail++;
+      return true;
+    }
+
+    // look at the oldest item without removing it
+    const T &Peek() const { return _items[_tail & (CAPACITY - 1)]; }
+
+    // the index'th oldest item (index must be below Count())
+    const T &At(uint16_t index) const { return _items[(uint16_t)(_tail + index) & (CAPACITY - 1)]; }
+
+    void Clear() { _tail = _head; }
+
+    uint16_t Count() const { return (uint16_t)(_head - _tail); }
+    uint16_t Room() const { return CAPACITY - Count(); }
+    bool IsEmpty() const { return _head == _tail; }
+    bool IsFull() const { return Count() == CAPACITY; }
+    static uint16_t Capacity() { return CAPACITY; }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    T _items[CAPACITY];
+
+    // free running indexes, only masked on access, so full and empty are distinguishable
+    volatile uint16_t _head;
+    volatile uint16_t _tail;
+};
+
+
+#endif
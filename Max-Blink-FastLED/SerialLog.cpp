@@ -0,0 +1,78 @@
+/*
+  SerialLog.cpp  - Log lines that never hold up a frame
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "SerialLog.h"
+
+
+// *********************************************************************************
+//      FORMATTING - into _line, cut short at LOG_MAX_LINE (less the line ending)
+// *********************************************************************************
+
+void SerialLog::AppendPart(const char *text) {
+
+  while( *text && _lineLength < LOG_MAX_LINE - 2 ){
+    _line[_lineLength++] = *text++;
+  }
+}
+
+
+void SerialLog::AppendPart(char c) {
+
+  if( _lineLength < LOG_MAX_LINE - 2 ){
+    _line[_lineLength++] = c;
+  }
+}
+
+
+void SerialLog::AppendPart(long value) {
+
+  if( value < 0 ){
+    AppendPart('-');
+    AppendNumber( (uint32_t)0 - (uint32_t)value, 10 );
+    return;
+  }
+  AppendNumber( (uint32_t)value, 10 );
+}
+
+
+void SerialLog::AppendNumber(uint32_t value, uint8_t base) {
+
+  // backwards into a scratch buffer, then forwards onto the line
+  char digits[10];
+  uint8_t count = 0;
+  do {
+    uint8_t digit = value % base;
+    digits[count++] = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    value /= base;
+  } while( value );
+
+  while( count ){
+    AppendPart( digits[--count] );
+  }
+}
+
+
+// *********************************************************************************
+//      INTO THE RING
+// *********************************************************************************
+
+void SerialLog::Commit() {
+
+  // the same line ending println() sends
+  _line[_lineLength++] = '\r';
+  _line[_lineLength++] = '\n';
+
+  if( _buffer.Room() < _lineLength ){
+    _droppedCount++;
+    return;
+  }
+
+  for( uint8_t i = 0; i < _lineLength; i++ ){
+    _buffer.Push(_line[i]);
+  }
+}
@@ -0,0 +1,158 @@
+/*
+  SerialLog.h  - Log lines that never hold up a frame
+               -- LOG_ERROR/LOG_INFO/LOG_DEBUG(parts...) format one line (strings and numbers, one after
+                  another) into a fixed ring buffer and return. nothing touches Serial until Drain()
+               -- Drain() is called from loop() while there's no frame due, and sends at most a byte budget
+                  of whole lines, and no more than Serial will take without blocking. a line that won't
+                  fit in the ring is dropped and counted, never waited for
+               -- LOG_LEVEL (GlobalVariables.h) picks what's compiled in. the levels above it compile to
+                  nothing, arguments and all, so a release build sends no text at all
+               -- the "K" acks and the replies to SERIAL_OP_TELEMETRY and SERIAL_OP_DUMP_SESSION aren't
+                  logging: they go straight out, since Max is waiting for them
+*/
+
+#ifndef SerialLog_h
+#define SerialLog_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include <FastLED.h>
+#include "GlobalVariables.h"
+#include "RingBuffer.h"
+
+// must be a power of two (it's a RingBuffer)
+#ifndef LOG_BUFFER_BYTES
+  #define LOG_BUFFER_BYTES 256
+#endif
+
+// the longest line, its \r\n included. longer ones are cut short
+#define LOG_MAX_LINE 64
+
+// the most Drain() sends per pass of loop()
+#define LOG_BYTES_PER_LOOP 64
+
+static_assert(LOG_MAX_LINE <= LOG_BYTES_PER_LOOP, "a whole line has to fit in one Drain()");
+
+
+// a number printed in hex, for LOG_*(..., LogHex(value))
+struct LogHex {
+  explicit LogHex(uint32_t value) : value(value) {}
+  uint32_t value;
+};
+
+
+// ******************************************************************
+//            SerialLog class definitions
+// ******************************************************************
+class SerialLog
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    // one line: every part one after the other, then a newline. use the LOG_* macros rather than this,
+    // so the line compiles out when its level is off
+    template <typename... Parts>
+    void Write(const Parts &...parts) {
+      _lineLength = 0;
+      Append(parts...);
+      Commit();
+    }
+
+    // send whole lines, up to maxBytes and what out can take without blocking. returns the bytes sent
+    template <typename Output>
+    uint16_t Drain(Output &out, uint16_t maxBytes);
+
+    uint16_t GetPendingBytes() const { return _buffer.Count(); }
+    uint32_t GetDroppedCount() const { return _droppedCount; }
+    void ResetStats() { _droppedCount = 0; }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    RingBuffer<char, LOG_BUFFER_BYTES> _buffer;
+    char _line[LOG_MAX_LINE];       // the line being formatted
+    uint8_t _lineLength = 0;
+    uint32_t _droppedCount = 0;
+
+    void Append() {}
+    template <typename Part, typename... Rest>
+    void Append(const Part &part, const Rest &...rest) {
+      AppendPart(part);
+      Append(rest...);
+    }
+
+    void AppendPart(const char *text);
+    void AppendPart(char c);
+    void AppendPart(unsigned char value) { AppendNumber(value, 10); }
+    void AppendPart(unsigned short value) { AppendNumber(value, 10); }
+    void AppendPart(unsigned int value) { AppendNumber(value, 10); }
+    void AppendPart(unsigned long value) { AppendNumber(value, 10); }
+    void AppendPart(short value) { AppendPart((long)value); }
+    void AppendPart(int value) { AppendPart((long)value); }
+    void AppendPart(long value);
+    void AppendPart(const LogHex &hex) { AppendNumber(hex.value, 16); }
+    void AppendNumber(uint32_t value, uint8_t base);
+
+    // the line goes into the ring whole, or not at all
+    void Commit();
+};
+
+
+// *********************************************************************************
+//      DRAIN - a template so it can write to whatever Serial is on the board (or the host)
+// *********************************************************************************
+template <typename Output>
+uint16_t SerialLog::Drain(Output &out, uint16_t maxBytes) {
+
+  uint16_t room = out.availableForWrite();
+  if( room < maxBytes ){
+    maxBytes = room;
+  }
+
+  // up to the last newline that fits, so Max never sees half a line with something else after it
+  uint16_t count = 0;
+  uint16_t pending = _buffer.Count();
+  for( uint16_t i = 0; i < pending && i < maxBytes; i++ ){
+    if( _buffer.At(i) == '\n' ){
+      count = i + 1;
+    }
+  }
+
+  char c;
+  for( uint16_t i = 0; i < count && _buffer.Pop(c); i++ ){
+    out.write((uint8_t)c);
+  }
+
+  return count;
+}
+
+
+// ******************************************************************
+//            Log levels - LOG_LEVEL and the LOG_LEVEL_* values are in GlobalVariables.h
+// ******************************************************************
+// what a line compiles to when its level is off: nothing, but its arguments still count as used
+template <typename... Parts>
+inline void LogDiscard(const Parts &...) {}
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+  #define LOG_ERROR(...) serialLog.Write(__VA_ARGS__)
+#else
+  #define LOG_ERROR(...) LogDiscard(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  #define LOG_INFO(...) serialLog.Write(__VA_ARGS__)
+#else
+  #define LOG_INFO(...) LogDiscard(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+  #define LOG_DEBUG(...) serialLog.Write(__VA_ARGS__)
+#else
+  #define LOG_DEBUG(...) LogDiscard(__VA_ARGS__)
+#endif
+
+
+
+#endif
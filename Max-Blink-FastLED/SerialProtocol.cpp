@@ -0,0 +1,437 @@
+/*
+  SerialProtocol.cpp   - Incremental decoder for the binary framed commands sent by Max
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "SerialProtocol.h"
+
+
+// *********************************************************************************
+//      CONSTRUCTOR
+// *********************************************************************************
+
+SerialProtocol::SerialProtocol()
+{
+}
+
+
+// *********************************************************************************
+//      RECEIVING
+// *********************************************************************************
+
+bool SerialProtocol::Push(uint8_t incomingByte) {
+
+  if (!_rxBuffer.Push(incomingByte)) {
+    _overflowCount++;
+    return false;
+  }
+
+  return true;
+}
+
+
+// walk the decoder state machine over whatever is staged
+// this never waits for bytes that haven't arrived yet, a partial frame simply
+// picks up where it left off on the next call
+SerialMessageType SerialProtocol::Poll(uint32_t currentTime, SerialCommand &command, uint8_t &legacyByte) {
+
+  uint8_t incomingByte;
+  while (_rxBuffer.Pop(incomingByte)) {
+
+    switch (_state) {
+      case WAIT_SYNC:
+        if (incomingByte == SERIAL_FRAME_SYNC) {
+          _state = WAIT_LENGTH;
+          _frameStartTime = currentTime;
+        }
+        else {
+          legacyByte = incomingByte;
+          return SERIAL_MESSAGE_LEGACY;
+        }
+        break;
+
+      case WAIT_LENGTH:
+        // only a pixel chunk can be longer than SERIAL_MAX_PAYLOAD. that's checked once its opcode is in
+        if (incomingByte < 3 || (incomingByte > SERIAL_MAX_PAYLOAD && !_pixelStream)) {
+          Discard(incomingByte + 1, currentTime);
+          _badFrameCount++;
+          return SERIAL_MESSAGE_BAD_FRAME;
+        }
+        _payloadLength = incomingByte;
+        _payloadIndex = 0;
+        _crc = Crc8(0, incomingByte);
+        _state = WAIT_PAYLOAD;
+        break;
+
+      case WAIT_PAYLOAD:
+        _crc = Crc8(_crc, incomingByte);
+
+        if (_payloadIndex == 0) {
+          _pixelChunk = incomingByte == SERIAL_OP_PIXELS && _pixelStream && _payloadLength >= PIXEL_CHUNK_HEADER_SIZE;
+          if (!_pixelChunk && _payloadLength > SERIAL_MAX_PAYLOAD) {
+            Discard(_payloadLength, currentTime);
+            _badFrameCount++;
+            return SERIAL_MESSAGE_BAD_FRAME;
+          }
+        }
+
+        // a pixel chunk's header is kept like any payload, its pixels go straight to the stream
+        if (_pixelChunk && _payloadIndex >= PIXEL_CHUNK_HEADER_SIZE) {
+          _pixelStream->Push(incomingByte);
+          _payloadIndex++;
+        }
+        else {
+          _payload[_payloadIndex++] = incomingByte;
+          if (_pixelChunk && _payloadIndex == PIXEL_CHUNK_HEADER_SIZE) {
+            _pixelStream->BeginChunk(_payload[1], _payload[2], _payload[3], _payload[4] | (_payload[5] << 8));
+          }
+        }
+
+        if (_payloadIndex == _payloadLength) {
+          _state = WAIT_CRC;
+        }
+        break;
+
+      case WAIT_CRC:
+        _state = WAIT_SYNC;
+        if (_pixelChunk) {
+          _pixelChunk = false;
+          _pixelStream->EndChunk(incomingByte == _crc);
+          if (incomingByte != _crc) {
+            _badFrameCount++;
+            return SERIAL_MESSAGE_BAD_FRAME;
+          }
+          return SERIAL_MESSAGE_PIXELS;
+        }
+        if (incomingByte != _crc || !DecodePayload(command)) {
+          _badFrameCount++;
+          return SERIAL_MESSAGE_BAD_FRAME;
+        }
+        return SERIAL_MESSAGE_COMMAND;
+
+      case WAIT_DISCARD:
+        _frameStartTime = currentTime;
+        if (--_discardCount == 0) {
+          _state = WAIT_SYNC;
+        }
+        break;
+    }
+  }
+
+  // the rest of a thrown away frame that never came. whatever arrives now is new
+  if (_state == WAIT_DISCARD) {
+    if ((uint32_t)(currentTime - _frameStartTime) > SERIAL_FRAME_TIMEOUT) {
+      _state = WAIT_SYNC;
+    }
+    return SERIAL_MESSAGE_NONE;
+  }
+
+  // everything staged has been consumed. a frame that stalled part way through will
+  // never complete, drop it so the bytes that follow are not swallowed as payload. if
+  // the rest of it is only late, it's skipped when it comes instead of run as keys
+  if (_state != WAIT_SYNC && (uint32_t)(currentTime - _frameStartTime) > SERIAL_FRAME_TIMEOUT) {
+    if (_pixelChunk && _payloadIndex >= PIXEL_CHUNK_HEADER_SIZE) {
+      _pixelStream->EndChunk(false);
+    }
+    _pixelChunk = false;
+    Discard(_state == WAIT_PAYLOAD ? _payloadLength - _payloadIndex + 1 : _state == WAIT_CRC ? 1 : 0, currentTime);
+    _badFrameCount++;
+    return SERIAL_MESSAGE_BAD_FRAME;
+  }
+
+  return SERIAL_MESSAGE_NONE;
+}
+
+
+void SerialProtocol::Discard(uint16_t count, uint32_t currentTime) {
+
+  _discardCount = count;
+  _frameStartTime = currentTime;
+  _state = count ? WAIT_DISCARD : WAIT_SYNC;
+}
+
+
+// *********************************************************************************
+//      DECODING AND ENCODING
+// *********************************************************************************
+
+// number of payload bytes each opcode carries, or 0 if the opcode is unknown
+uint8_t SerialProtocol::PayloadLength(uint8_t opcode) {
+
+  switch (opcode) {
+    case SERIAL_OP_TRIGGER:       return 4;
+    case SERIAL_OP_PARAMS:        return 9;
+    case SERIAL_OP_PALETTE:       return 4;
+    case SERIAL_OP_HUE_INDEX_BPM: return 5;
+    case SERIAL_OP_REVERSE_HUE:   return 3;
+    case SERIAL_OP_PRESET:        return 13;
+    case SERIAL_OP_PALETTE_FADE:  return 6;
+    case SERIAL_OP_LAYER:         return 11;
+    case SERIAL_OP_TIMING:        return 6;
+    case SERIAL_OP_BEAT:          return 5;
+    case SERIAL_OP_DUMP_SESSION:  return 3;
+    case SERIAL_OP_POWER_BUDGET:  return 6;
+    case SERIAL_OP_TELEMETRY:     return 4;
+    case SERIAL_OP_PROGRAM_CODE:  return 4 + SERIAL_PROGRAM_CHUNK_INSTRUCTIONS * 4;
+    case SERIAL_OP_PROGRAM_LOAD:  return 8;
+    case SERIAL_OP_PRESET_STORE:  return 15;
+    case SERIAL_OP_PRESET_SAVE:   return 4;
+    default:                      return 0;
+  }
+}
+
+
+bool SerialProtocol::DecodePayload(SerialCommand &command) {
+
+  const uint8_t *p = _payload;
+
+  if (PayloadLength(p[0]) != _payloadLength) {
+    return false;
+  }
+
+  command = SerialCommand();
+  command.opcode = p[0];
+  command.groupMask = p[1] | (p[2] << 8);
+  p += 3;
+
+  switch (command.opcode) {
+    case SERIAL_OP_TRIGGER:
+      command.animation = (AnimationType)p[0];
+      break;
+    case SERIAL_OP_PARAMS:
+      command.hue = p[0];
+      command.brightness = p[1];
+      command.bpm = p[2] | (p[3] << 8);
+      command.brightnessHigh = p[4];
+      command.brightnessLow = p[5];
+      break;
+    case SERIAL_OP_PALETTE:
+      command.paletteIndex = p[0];
+      break;
+    case SERIAL_OP_HUE_INDEX_BPM:
+      command.hueIndexBPM = p[0] | (p[1] << 8);
+      break;
+    case SERIAL_OP_REVERSE_HUE:
+      break;
+    case SERIAL_OP_PRESET:
+      command.animation = (AnimationType)p[0];
+      command.hue = p[1];
+      command.brightness = p[2];
+      command.bpm = p[3] | (p[4] << 8);
+      command.brightnessHigh = p[5];
+      command.brightnessLow = p[6];
+      command.paletteIndex = p[7];
+      command.hueIndexBPM = p[8] | (p[9] << 8);
+      break;
+    case SERIAL_OP_PALETTE_FADE:
+      command.paletteIndex = p[0];
+      command.crossfadeFrames = p[1] | (p[2] << 8);
+      break;
+    case SERIAL_OP_LAYER:
+      command.layerSlot = p[0];
+      command.layer.type = (LayerType)p[1];
+      command.layer.blendMode = (BlendMode)p[2];
+      command.layer.amount = p[3];
+      command.layer.param = p[4];
+      command.layer.color = CRGB(p[5], p[6], p[7]);
+      break;
+    case SERIAL_OP_TIMING:
+      command.subdivision = p[0];
+      command.latencyMillis = p[1] | (p[2] << 8);
+      break;
+    case SERIAL_OP_BEAT:
+      command.bpm = p[0] | (p[1] << 8);
+      break;
+    case SERIAL_OP_POWER_BUDGET:
+      command.powerSupply = p[0];
+      command.powerBudgetMilliamps = p[1] | (p[2] << 8);
+      break;
+    case SERIAL_OP_TELEMETRY:
+      command.telemetryReset = p[0];
+      break;
+    case SERIAL_OP_PROGRAM_CODE:
+      command.programIndex = p[0];
+      memcpy(command.programCode, &p[1], sizeof(command.programCode));
+      break;
+    case SERIAL_OP_PROGRAM_LOAD:
+      command.programSlot = p[0];
+      command.programLength = p[1];
+      command.programFade = p[2];
+      command.programUpdateInterval = p[3] | (p[4] << 8);
+      break;
+    case SERIAL_OP_PRESET_STORE:
+      command.presetKey = p[0];
+      command.presetActions = p[1];
+      command.animation = (AnimationType)p[2];
+      command.hue = p[3];
+      command.brightness = p[4];
+      command.bpm = p[5] | (p[6] << 8);
+      command.brightnessHigh = p[7];
+      command.brightnessLow = p[8];
+      command.paletteIndex = p[9];
+      command.hueIndexBPM = p[10] | (p[11] << 8);
+      break;
+    case SERIAL_OP_PRESET_SAVE:
+      command.presetRevert = p[0];
+      break;
+  }
+
+  // never hand an animation the controllers don't know about to them
+  if ((command.opcode == SERIAL_OP_TRIGGER || command.opcode == SERIAL_OP_PRESET) && !LEDStripController::IsAnimationRegistered(command.animation)) {
+    return false;
+  }
+
+  // the same goes for a preset that triggers one. and only a printable character can be a key
+  if (command.opcode == SERIAL_OP_PRESET_STORE &&
+      (!Presets::IsKey(command.presetKey) ||
+       ((command.presetActions & PRESET_TRIGGER) && !LEDStripController::IsAnimationRegistered(command.animation)))) {
+    return false;
+  }
+
+  // or a layer they can't hold
+  if (command.opcode == SERIAL_OP_LAYER &&
+      (command.layerSlot >= MAX_LAYERS || command.layer.type >= LAYER_TYPE_COUNT || command.layer.blendMode >= BLEND_MODE_COUNT)) {
+    return false;
+  }
+
+  // or program code that wouldn't fit. the program itself is checked when it's loaded
+  if ((command.opcode == SERIAL_OP_PROGRAM_CODE && command.programIndex + SERIAL_PROGRAM_CHUNK_INSTRUCTIONS > EFFECT_MAX_INSTRUCTIONS) ||
+      (command.opcode == SERIAL_OP_PROGRAM_LOAD && command.programSlot >= EFFECT_PROGRAM_SLOTS)) {
+    return false;
+  }
+
+  return true;
+}
+
+
+uint8_t SerialProtocol::EncodeFrame(const SerialCommand &command, uint8_t *out) {
+
+  uint8_t length = PayloadLength(command.opcode);
+  if (length == 0) {
+    return 0;
+  }
+
+  uint8_t *p = out + 2;
+  p[0] = command.opcode;
+  p[1] = command.groupMask & 0xFF;
+  p[2] = command.groupMask >> 8;
+  p += 3;
+
+  switch (command.opcode) {
+    case SERIAL_OP_TRIGGER:
+      p[0] = command.animation;
+      break;
+    case SERIAL_OP_PARAMS:
+      p[0] = command.hue;
+      p[1] = command.brightness;
+      p[2] = command.bpm & 0xFF;
+      p[3] = command.bpm >> 8;
+      p[4] = command.brightnessHigh;
+      p[5] = command.brightnessLow;
+      break;
+    case SERIAL_OP_PALETTE:
+      p[0] = command.paletteIndex;
+      break;
+    case SERIAL_OP_HUE_INDEX_BPM:
+      p[0] = command.hueIndexBPM & 0xFF;
+      p[1] = command.hueIndexBPM >> 8;
+      break;
+    case SERIAL_OP_PRESET:
+      p[0] = command.animation;
+      p[1] = command.hue;
+      p[2] = command.brightness;
+      p[3] = command.bpm & 0xFF;
+      p[4] = command.bpm >> 8;
+      p[5] = command.brightnessHigh;
+      p[6] = command.brightnessLow;
+      p[7] = command.paletteIndex;
+      p[8] = command.hueIndexBPM & 0xFF;
+      p[9] = command.hueIndexBPM >> 8;
+      break;
+    case SERIAL_OP_PALETTE_FADE:
+      p[0] = command.paletteIndex;
+      p[1] = command.crossfadeFrames & 0xFF;
+      p[2] = command.crossfadeFrames >> 8;
+      break;
+    case SERIAL_OP_LAYER:
+      p[0] = command.layerSlot;
+      p[1] = command.layer.type;
+      p[2] = command.layer.blendMode;
+      p[3] = command.layer.amount;
+      p[4] = command.layer.param;
+      p[5] = command.layer.color.r;
+      p[6] = command.layer.color.g;
+      p[7] = command.layer.color.b;
+      break;
+    case SERIAL_OP_TIMING:
+      p[0] = command.subdivision;
+      p[1] = command.latencyMillis & 0xFF;
+      p[2] = command.latencyMillis >> 8;
+      break;
+    case SERIAL_OP_BEAT:
+      p[0] = command.bpm & 0xFF;
+      p[1] = command.bpm >> 8;
+      break;
+    case SERIAL_OP_POWER_BUDGET:
+      p[0] = command.powerSupply;
+      p[1] = command.powerBudgetMilliamps & 0xFF;
+      p[2] = command.powerBudgetMilliamps >> 8;
+      break;
+    case SERIAL_OP_TELEMETRY:
+      p[0] = command.telemetryReset;
+      break;
+    case SERIAL_OP_PROGRAM_CODE:
+      p[0] = command.programIndex;
+      memcpy(&p[1], command.programCode, sizeof(command.programCode));
+      break;
+    case SERIAL_OP_PROGRAM_LOAD:
+      p[0] = command.programSlot;
+      p[1] = command.programLength;
+      p[2] = command.programFade;
+      p[3] = command.programUpdateInterval & 0xFF;
+      p[4] = command.programUpdateInterval >> 8;
+      break;
+    case SERIAL_OP_PRESET_STORE:
+      p[0] = command.presetKey;
+      p[1] = command.presetActions;
+      p[2] = command.animation;
+      p[3] = command.hue;
+      p[4] = command.brightness;
+      p[5] = command.bpm & 0xFF;
+      p[6] = command.bpm >> 8;
+      p[7] = command.brightnessHigh;
+      p[8] = command.brightnessLow;
+      p[9] = command.paletteIndex;
+      p[10] = command.hueIndexBPM & 0xFF;
+      p[11] = command.hueIndexBPM >> 8;
+      break;
+    case SERIAL_OP_PRESET_SAVE:
+      p[0] = command.presetRevert;
+      break;
+  }
+
+  out[0] = SERIAL_FRAME_SYNC;
+  out[1] = length;
+
+  uint8_t crc = 0;
+  for (uint8_t i = 1; i < length + 2; i++) {
+    crc = Crc8(crc, out[i]);
+  }
+  out[length + 2] = crc;
+
+  return length + 3;
+}
+
+
+// CRC-8, polynomial 0x07. frames are short so the bitwise form is cheaper than a 256 byte table
+uint8_t SerialProtocol::Crc8(uint8_t crc, uint8_t data) {
+
+  crc ^= data;
+  for (uint8_t i = 0; i < 8; i++) {
+    crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
@@ -0,0 +1,238 @@
+/*
+  SerialProtocol.h - Incremental decoder for the binary framed commands sent by Max
+                   -- the single character commands still work; any byte outside of a frame
+                      is handed back to the sketch as a legacy command
+
+  FRAME LAYOUT (all multi-byte values are little endian)
+
+    | SYNC 0xA5 | LEN | OPCODE | GROUP MASK lo | GROUP MASK hi | ...opcode fields... | CRC8 |
+                      |<------------------------ LEN bytes ------------------------>|
+
+    LEN counts the payload only (OPCODE through the last field)
+    CRC8 is polynomial 0x07, initial value 0, computed over LEN and the payload
+    GROUP MASK bit n selects LedStripControllerArray[n], the nth segment in Installation.h; 0xFFFF addresses every segment
+
+  OPCODE FIELDS
+    SERIAL_OP_TRIGGER         animation
+    SERIAL_OP_PARAMS          hue, brightness, bpm (2), brightnessHigh, brightnessLow
+    SERIAL_OP_PALETTE         paletteIndex
+    SERIAL_OP_HUE_INDEX_BPM   hueIndexBPM (2)
+    SERIAL_OP_REVERSE_HUE     (none)
+    SERIAL_OP_PRESET          animation, hue, brightness, bpm (2), brightnessHigh, brightnessLow,
+                              paletteIndex (SERIAL_KEEP_PALETTE to keep), hueIndexBPM (2, 0 to keep)
+    SERIAL_OP_PALETTE_FADE    paletteIndex, crossfadeFrames (2, 0 swaps immediately)
+                              the selected segments join the shared palette, which glides to the new one.
+                              segments outside the mask that already share it glide along with them
+    SERIAL_OP_LAYER           slot, layerType, blendMode, amount, param, red, green, blue
+                              sets one layer over the selected segments' animations (see Compositing.h).
+                              LAYER_NONE empties the slot
+    SERIAL_OP_TIMING          subdivision, latencyMillis (2)
+                              when the commands that follow fire (see CommandQueue.h): latencyMillis after
+                              they arrive, rounded to the nearest 1/subdivision beat (0 doesn't round).
+                              0, 0 runs them as they arrive. the group mask is ignored
+    SERIAL_OP_BEAT            bpm (2)
+                              a beat is happening now, at bpm (0 if Max doesn't know). goes to the beat tracker
+                              (see BeatTracker.h), whose grid SERIAL_OP_TIMING rounds to. the group mask is ignored
+    SERIAL_OP_DUMP_SESSION    (none)
+                              writes the session captured so far back over serial (see SessionCapture.h), raw
+                              bytes rather than a frame. runs as it arrives and isn't itself recorded. the
+                              group mask is ignored
+    SERIAL_OP_PIXELS          sequence, strip, flags, start (2), pixel data
+                              a chunk of a frame of pixels (see PixelStream.h). no group mask: the bytes after
+                              the opcode are as listed. the only frame that can be longer than SERIAL_MAX_PAYLOAD
+                              (up to 255), and the pixel data goes straight to the pixel stream as it arrives
+    SERIAL_OP_POWER_BUDGET    supply, milliamps (2)
+                              how much current the strips on one power supply may draw (see PowerLimiter.h),
+                              0 for no limit. runs as it arrives. the group mask is ignored
+    SERIAL_OP_TELEMETRY       reset
+                              prints the profiling counters (see Telemetry.h), the frame clock's, the power
+                              limiter's and the serial decoder's as text lines between "telemetry" and "end".
+                              reset 1 clears the counters afterwards. runs as it arrives and isn't recorded.
+                              the group mask is ignored
+    SERIAL_OP_PROGRAM_CODE    index, 2 instructions (8)
+                              copies two instructions of a program (see EffectVM.h) into the upload buffer, at
+                              instruction index on. runs as it arrives. the group mask is ignored
+    SERIAL_OP_PROGRAM_LOAD    slot, length, fade, updateInterval (2)
+                              checks the first length uploaded instructions and puts them in a program slot, to
+                              be started with SERIAL_OP_TRIGGER or SERIAL_OP_PRESET as EffectVM::GetAnimation(slot).
+                              a program that doesn't check out leaves the slot as it was. runs as it arrives.
+                              the group mask is ignored
+    SERIAL_OP_PRESET_STORE    key, actions, animation, hue, brightness, bpm (2), brightnessHigh, brightnessLow,
+                              paletteIndex, hueIndexBPM (2)
+                              what the single character command key does from now on (see Presets.h): the
+                              actions, then the animation triggered on the group mask. bpm and hueIndexBPM can
+                              be PRESET_TEMPO, PRESET_TEMPO_DOUBLE or PRESET_TEMPO_HALF, paletteIndex
+                              PRESET_RANDOM_PALETTE. the key has to be a printable character. lasts until the next
+                              reset unless it's saved. runs as it arrives
+    SERIAL_OP_PRESET_SAVE     revert
+                              writes the stored presets to EEPROM, where they're loaded from at startup. revert 1
+                              forgets them first, so the keys go back to the defaults for good. runs as it
+                              arrives (a replayed session never writes). the group mask is ignored
+
+  every single character command and every frame other than SERIAL_OP_PIXELS is answered with a "K",
+  so Max can tell the Teensy is alive
+*/
+
+#ifndef SerialProtocol_h
+#define SerialProtocol_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include "LEDStripController.h"
+#include "RingBuffer.h"
+#include "PixelStream.h"
+#include "EffectVM.h"
+#include "Presets.h"
+
+#define SERIAL_FRAME_SYNC 0xA5
+
+// the largest payload we accept, other than SERIAL_OP_PIXELS. SERIAL_OP_PRESET_STORE is the longest at 15 bytes
+#define SERIAL_MAX_PAYLOAD 16
+
+// a frame that has not finished arriving within this many ms is thrown away. so is the rest of it, if
+// that turns up with no gap this long, rather than being taken for single character commands
+#define SERIAL_FRAME_TIMEOUT 50
+
+// receive ring size in bytes (must be a power of two)
+#define SERIAL_RX_BUFFER_SIZE 128
+
+#define SERIAL_ALL_GROUPS 0xFFFF
+#define SERIAL_KEEP_PALETTE 0xFF
+
+// instructions a SERIAL_OP_PROGRAM_CODE frame carries
+#define SERIAL_PROGRAM_CHUNK_INSTRUCTIONS 2
+
+
+// ******************************************************************
+//    OPCODES
+// ******************************************************************
+enum SerialOpcode {
+  SERIAL_OP_TRIGGER = 0x01,
+  SERIAL_OP_PARAMS = 0x02,
+  SERIAL_OP_PALETTE = 0x03,
+  SERIAL_OP_HUE_INDEX_BPM = 0x04,
+  SERIAL_OP_REVERSE_HUE = 0x05,
+  SERIAL_OP_PRESET = 0x06,
+  SERIAL_OP_PALETTE_FADE = 0x07,
+  SERIAL_OP_LAYER = 0x08,
+  SERIAL_OP_TIMING = 0x09,
+  SERIAL_OP_BEAT = 0x0A,
+  SERIAL_OP_DUMP_SESSION = 0x0B,
+  SERIAL_OP_PIXELS = 0x0C,
+  SERIAL_OP_POWER_BUDGET = 0x0D,
+  SERIAL_OP_TELEMETRY = 0x0E,
+  SERIAL_OP_PROGRAM_CODE = 0x0F,
+  SERIAL_OP_PROGRAM_LOAD = 0x10,
+  SERIAL_OP_PRESET_STORE = 0x11,
+  SERIAL_OP_PRESET_SAVE = 0x12
+};
+
+
+// what a call to SerialProtocol::Poll() produced
+enum SerialMessageType {
+  SERIAL_MESSAGE_NONE,        // nothing complete yet
+  SERIAL_MESSAGE_LEGACY,      // a single character command outside of a frame
+  SERIAL_MESSAGE_COMMAND,     // a complete frame that passed its CRC
+  SERIAL_MESSAGE_PIXELS,      // a SERIAL_OP_PIXELS chunk that passed its CRC, already handed to the pixel stream
+  SERIAL_MESSAGE_BAD_FRAME    // a frame that failed its CRC, length or field checks
+};
+
+
+// a decoded frame. fields not carried by the opcode keep their defaults
+struct SerialCommand {
+  uint8_t opcode = 0;
+  uint16_t groupMask = SERIAL_ALL_GROUPS;
+  AnimationType animation = NONE;
+  uint8_t hue = 0;
+  uint8_t brightness = BRIGHTNESS_FULL;
+  uint16_t bpm = GLOBAL_BPM;
+  uint8_t brightnessHigh = BRIGHTNESS_FULL;
+  uint8_t brightnessLow = 0;
+  uint8_t paletteIndex = SERIAL_KEEP_PALETTE;
+  uint16_t hueIndexBPM = 0;
+  uint16_t crossfadeFrames = 0;
+  uint8_t layerSlot = 0;
+  Layer layer = { LAYER_NONE, BLEND_ALPHA, 255, 0, CRGB(0, 0, 0) };
+  uint8_t subdivision = 0;
+  uint16_t latencyMillis = 0;
+  uint8_t powerSupply = 0;
+  uint16_t powerBudgetMilliamps = 0;
+  uint8_t telemetryReset = 0;
+  uint8_t programSlot = 0;
+  uint8_t programIndex = 0;          // the first instruction a SERIAL_OP_PROGRAM_CODE chunk fills
+  uint8_t programLength = 0;
+  uint8_t programFade = 0;
+  uint16_t programUpdateInterval = 0;
+  uint8_t programCode[SERIAL_PROGRAM_CHUNK_INSTRUCTIONS * 4] = {};
+  uint8_t presetKey = 0;
+  uint8_t presetActions = 0;
+  uint8_t presetRevert = 0;
+};
+
+
+// ******************************************************************
+//            SerialProtocol class definitions
+// ******************************************************************
+class SerialProtocol
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    SerialProtocol();
+
+    // stage a received byte. returns false (and counts an overflow) if the ring is full
+    bool Push(uint8_t incomingByte);
+    uint16_t Room() const { return _rxBuffer.Room(); }
+
+    // where SERIAL_OP_PIXELS chunks go. without one they're bad frames
+    void SetPixelStream(PixelStream *pixelStream) { _pixelStream = pixelStream; }
+
+    // decode staged bytes until one message is complete or the ring is empty
+    SerialMessageType Poll(uint32_t currentTime, SerialCommand &command, uint8_t &legacyByte);
+
+    uint16_t GetBadFrameCount() const { return _badFrameCount; }
+    uint16_t GetOverflowCount() const { return _overflowCount; }
+
+    // build a complete frame (sync through CRC) for a command. returns the number of bytes written
+    // out must hold at least SERIAL_MAX_PAYLOAD + 3 bytes
+    static uint8_t EncodeFrame(const SerialCommand &command, uint8_t *out);
+    static uint8_t Crc8(uint8_t crc, uint8_t data);
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+
+    enum DecoderState {
+      WAIT_SYNC,
+      WAIT_LENGTH,
+      WAIT_PAYLOAD,
+      WAIT_CRC,
+      WAIT_DISCARD      // the rest of a frame that was thrown away
+    };
+
+    RingBuffer<uint8_t, SERIAL_RX_BUFFER_SIZE> _rxBuffer;
+
+    DecoderState _state = WAIT_SYNC;
+    uint8_t _payload[SERIAL_MAX_PAYLOAD];
+    uint8_t _payloadLength = 0;
+    uint8_t _payloadIndex = 0;
+    uint8_t _crc = 0;
+    uint32_t _frameStartTime = 0;   // and while discarding, when the last byte was
+    uint16_t _discardCount = 0;
+
+    PixelStream *_pixelStream = nullptr;
+    bool _pixelChunk = false;       // the frame arriving is SERIAL_OP_PIXELS
+
+    uint16_t _badFrameCount = 0;
+    uint16_t _overflowCount = 0;
+
+    // skip the next count bytes (the rest of a bad frame, CRC included)
+    void Discard(uint16_t count, uint32_t currentTime);
+    bool DecodePayload(SerialCommand &command);
+    static uint8_t PayloadLength(uint8_t opcode);
+};
+
+
+
+#endif
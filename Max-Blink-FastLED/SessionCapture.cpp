@@ -0,0 +1,336 @@
+/*
+  SessionCapture.cpp   - Records what Max sends during a show, so the show can be replayed frame for frame
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "SessionCapture.h"
+
+
+static const uint8_t SESSION_MAGIC[4] = { 'O', 'C', 'L', 'S' };
+
+// where the header fields sit
+#define SESSION_HEADER_VERSION 4
+#define SESSION_HEADER_SEED 5
+#define SESSION_HEADER_FRAME_INTERVAL 7
+#define SESSION_HEADER_START_MICROS 11
+#define SESSION_HEADER_START_MILLIS 15
+#define SESSION_HEADER_FRAME_COUNT 19
+#define SESSION_HEADER_RECORD_BYTES 23
+
+
+static void putLong(uint8_t *out, uint32_t value) {
+  out[0] = value & 0xFF;
+  out[1] = (value >> 8) & 0xFF;
+  out[2] = (value >> 16) & 0xFF;
+  out[3] = value >> 24;
+}
+
+
+uint32_t HashPixels(uint32_t hash, const CRGB *leds, uint16_t count) {
+
+  for (uint16_t i = 0; i < count; i++) {
+    hash = (hash ^ leds[i].r) * 16777619UL;
+    hash = (hash ^ leds[i].g) * 16777619UL;
+    hash = (hash ^ leds[i].b) * 16777619UL;
+  }
+  return hash;
+}
+
+
+// *********************************************************************************
+//      RECORDING
+// *********************************************************************************
+
+SessionRecorder::SessionRecorder()
+{
+}
+
+
+void SessionRecorder::Begin(uint8_t *buffer, uint32_t size, uint16_t seed, uint32_t frameIntervalMicros,
+                            uint32_t startMicros, uint32_t startMillis) {
+
+  if (size < SESSION_HEADER_SIZE + SESSION_MAX_RECORD_SIZE) {
+    _buffer = nullptr;
+    return;
+  }
+
+  _buffer = buffer;
+  _size = size;
+
+  memcpy(_buffer, SESSION_MAGIC, sizeof(SESSION_MAGIC));
+  _buffer[SESSION_HEADER_VERSION] = SESSION_CAPTURE_VERSION;
+  _buffer[SESSION_HEADER_SEED] = seed & 0xFF;
+  _buffer[SESSION_HEADER_SEED + 1] = seed >> 8;
+  putLong(&_buffer[SESSION_HEADER_FRAME_INTERVAL], frameIntervalMicros);
+  putLong(&_buffer[SESSION_HEADER_START_MICROS], startMicros);
+  putLong(&_buffer[SESSION_HEADER_START_MILLIS], startMillis);
+  putLong(&_buffer[SESSION_HEADER_FRAME_COUNT], 0);
+  putLong(&_buffer[SESSION_HEADER_RECORD_BYTES], 0);
+
+  _length = SESSION_HEADER_SIZE;
+  _lastFrame = 0;
+  _lastArrivalMicros = startMicros;
+  _full = false;
+  _fullAtFrame = 0;
+  _droppedCount = 0;
+}
+
+
+void SessionRecorder::RecordLegacy(uint32_t frameNumber, uint32_t arrivalMicros, uint8_t legacyByte) {
+
+  if (!Room(frameNumber)) {
+    return;
+  }
+
+  PutRecordStart(SESSION_LEGACY, frameNumber);
+  PutVarint(arrivalMicros - _lastArrivalMicros);
+  _buffer[_length++] = legacyByte;
+
+  _lastArrivalMicros = arrivalMicros;
+}
+
+
+void SessionRecorder::RecordCommand(uint32_t frameNumber, uint32_t arrivalMicros, const SerialCommand &command) {
+
+  uint8_t frame[SERIAL_MAX_PAYLOAD + 3];
+  if (SerialProtocol::EncodeFrame(command, frame) == 0 || !Room(frameNumber)) {
+    return;
+  }
+
+  PutRecordStart(SESSION_COMMAND, frameNumber);
+  PutVarint(arrivalMicros - _lastArrivalMicros);
+
+  // the length and payload. the sync byte and CRC are put back when it's replayed
+  uint8_t payloadLength = frame[1];
+  memcpy(&_buffer[_length], &frame[1], payloadLength + 1);
+  _length += payloadLength + 1;
+
+  _lastArrivalMicros = arrivalMicros;
+}
+
+
+void SessionRecorder::RecordFrame(const FrameTime &frame) {
+
+  if (frame.missedFrames == 0 || !Room(frame.frameNumber)) {
+    return;
+  }
+
+  PutRecordStart(SESSION_MISSED, frame.frameNumber);
+  PutVarint(frame.missedFrames);
+}
+
+
+void SessionRecorder::Seal(uint32_t frameCount) {
+
+  if (!_buffer) {
+    return;
+  }
+
+  putLong(&_buffer[SESSION_HEADER_FRAME_COUNT], _full ? _fullAtFrame : frameCount);
+  putLong(&_buffer[SESSION_HEADER_RECORD_BYTES], _length - SESSION_HEADER_SIZE);
+}
+
+
+// once a record doesn't fit nothing more is recorded, and the capture ends at the frame it was for
+bool SessionRecorder::Room(uint32_t frameNumber) {
+
+  if (!_buffer) {
+    return false;
+  }
+
+  if (!_full && _length + SESSION_MAX_RECORD_SIZE > _size) {
+    _full = true;
+    _fullAtFrame = frameNumber;
+  }
+
+  if (_full) {
+    _droppedCount++;
+    return false;
+  }
+
+  return true;
+}
+
+
+void SessionRecorder::PutRecordStart(SessionRecordType type, uint32_t frameNumber) {
+
+  _buffer[_length++] = type;
+  PutVarint(frameNumber - _lastFrame);
+  _lastFrame = frameNumber;
+}
+
+
+void SessionRecorder::PutVarint(uint32_t value) {
+
+  while (value >= 0x80) {
+    _buffer[_length++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  _buffer[_length++] = value;
+}
+
+
+// *********************************************************************************
+//      REPLAYING
+// *********************************************************************************
+
+SessionReplay::SessionReplay(const uint8_t *data, uint32_t length)
+{
+  _data = data;
+
+  if (!data || length < SESSION_HEADER_SIZE || memcmp(data, SESSION_MAGIC, sizeof(SESSION_MAGIC)) != 0 ||
+      data[SESSION_HEADER_VERSION] != SESSION_CAPTURE_VERSION) {
+    return;
+  }
+
+  uint32_t recordBytes = GetLong(SESSION_HEADER_RECORD_BYTES);
+  _frameIntervalMicros = GetLong(SESSION_HEADER_FRAME_INTERVAL);
+  if (recordBytes > length - SESSION_HEADER_SIZE || _frameIntervalMicros == 0) {
+    return;
+  }
+
+  _seed = data[SESSION_HEADER_SEED] | (data[SESSION_HEADER_SEED + 1] << 8);
+  _startMicros = GetLong(SESSION_HEADER_START_MICROS);
+  _startMillis = GetLong(SESSION_HEADER_START_MILLIS);
+  _frameCount = GetLong(SESSION_HEADER_FRAME_COUNT);
+  _end = SESSION_HEADER_SIZE + recordBytes;
+
+  // frames come from a clock of our own, stepped through the recorded grid. like the sketch's, it
+  // hands each frame's time to the beat functions
+  _clock = FrameClock(_frameIntervalMicros);
+  _clock.Start(_startMicros, _startMillis);
+  _nextFrameMicros = _startMicros;
+  _lastArrivalMicros = _startMicros;
+
+  _valid = true;
+}
+
+
+bool SessionReplay::NextMessage(SessionMessage &message) {
+
+  if (!PeekRecord() || _pendingFrame != _frameIndex || _pendingType == SESSION_MISSED) {
+    return false;
+  }
+
+  uint32_t position = _bodyPosition;
+  uint32_t arrivalDelta;
+  if (!GetVarint(position, arrivalDelta) || position >= _end) {
+    _end = _position;
+    return false;
+  }
+
+  message.arrivalMicros = _lastArrivalMicros + arrivalDelta;
+
+  if (_pendingType == SESSION_LEGACY) {
+    message.legacy = true;
+    message.legacyByte = _data[position++];
+  }
+  else {
+    // put the sync byte and CRC back, and decode it the way it was decoded live
+    uint8_t payloadLength = _data[position];
+    if (payloadLength > SERIAL_MAX_PAYLOAD || position + payloadLength + 1 > _end) {
+      _end = _position;
+      return false;
+    }
+
+    SerialProtocol decoder;
+    uint8_t crc = 0;
+    decoder.Push(SERIAL_FRAME_SYNC);
+    for (uint8_t i = 0; i <= payloadLength; i++) {
+      decoder.Push(_data[position + i]);
+      crc = SerialProtocol::Crc8(crc, _data[position + i]);
+    }
+    decoder.Push(crc);
+    position += payloadLength + 1;
+
+    uint8_t legacyByte;
+    if (decoder.Poll(0, message.command, legacyByte) != SERIAL_MESSAGE_COMMAND) {
+      _end = _position;
+      return false;
+    }
+    message.legacy = false;
+  }
+
+  _lastArrivalMicros = message.arrivalMicros;
+  _recordFrame = _pendingFrame;
+  _position = position;
+  _havePending = false;
+  return true;
+}
+
+
+bool SessionReplay::NextFrame(FrameTime &frame) {
+
+  if (!_valid || _frameIndex >= _frameCount) {
+    return false;
+  }
+
+  // frames the clock skipped when recording are skipped here too
+  uint32_t missed = 0;
+  if (PeekRecord() && _pendingFrame == _frameIndex && _pendingType == SESSION_MISSED) {
+    uint32_t position = _bodyPosition;
+    if (GetVarint(position, missed)) {
+      _recordFrame = _pendingFrame;
+      _position = position;
+      _havePending = false;
+    }
+  }
+
+  _clock.Poll(_nextFrameMicros + missed * _frameIntervalMicros, frame);
+  _nextFrameMicros = frame.micros + _frameIntervalMicros;
+  _frameIndex++;
+
+  return true;
+}
+
+
+// read the type and frame of the next record, if we haven't already
+bool SessionReplay::PeekRecord() {
+
+  if (_havePending) {
+    return true;
+  }
+
+  uint32_t position = _position;
+  uint32_t frameDelta;
+  if (position >= _end) {
+    return false;
+  }
+
+  uint8_t type = _data[position++];
+  if (type < SESSION_LEGACY || type > SESSION_MISSED || !GetVarint(position, frameDelta)) {
+    _end = _position;
+    return false;
+  }
+
+  _pendingType = (SessionRecordType)type;
+  _pendingFrame = _recordFrame + frameDelta;
+  _bodyPosition = position;
+  _havePending = true;
+  return true;
+}
+
+
+bool SessionReplay::GetVarint(uint32_t &position, uint32_t &value) const {
+
+  value = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+    if (position >= _end) {
+      return false;
+    }
+    uint8_t b = _data[position++];
+    value |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+uint32_t SessionReplay::GetLong(uint32_t position) const {
+  return _data[position] | (_data[position + 1] << 8) | ((uint32_t)_data[position + 2] << 16) | ((uint32_t)_data[position + 3] << 24);
+}
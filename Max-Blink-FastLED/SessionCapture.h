@@ -0,0 +1,175 @@
+/*
+  SessionCapture.h  - Records what Max sends during a show, so the show can be replayed frame for frame
+                    -- everything a frame's pixels depend on is either in the sketch or in the capture: the
+                       random seed, every message with the frame it arrived before and the micros it arrived
+                       at (the command queue and beat tracker read those), and every frame the clock skipped
+                    -- so a replay from the same build regenerates the exact same frames, on the Teensy or
+                       on the host, paced or as fast as it can render
+                    -- pixels streamed from a PC (PixelStream.h) aren't recorded, there'd be no room. a
+                       capture of a streamed scene replays the animations that were paused underneath it
+                    -- the format is a header then variable length records. numbers are little endian in the
+                       header and LEB128 varints in the records; frames and arrival times are deltas from the
+                       record before, so a beat trigger costs about 6 bytes
+
+  header            'O' 'C' 'L' 'S', version, seed (2), frameIntervalMicros (4), startMicros (4),
+                    startMillis (4), frameCount (4), recordBytes (4)
+                    startMicros/startMillis are when the frame clock started. frameCount is how many frames
+                    the records cover
+  records           type, frames since the last record (varint), then
+    SESSION_LEGACY    arrival micros since the last message (varint), the character
+    SESSION_COMMAND   arrival micros since the last message (varint), length, payload (as framed by
+                      SerialProtocol, without the sync byte and CRC)
+    SESSION_MISSED    frames the clock skipped before this one (varint)
+*/
+
+#ifndef SessionCapture_h
+#define SessionCapture_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include "FrameClock.h"
+#include "SerialProtocol.h"
+
+#define SESSION_CAPTURE_VERSION 1
+#define SESSION_HEADER_SIZE 27
+
+// the longest record: type, two 5 byte varints, length and the longest payload
+#define SESSION_MAX_RECORD_SIZE (1 + 5 + 5 + 1 + SERIAL_MAX_PAYLOAD)
+
+enum SessionRecordType : uint8_t {
+  SESSION_LEGACY = 1,
+  SESSION_COMMAND = 2,
+  SESSION_MISSED = 3
+};
+
+
+// a message from Max, as it's handed back during a replay
+struct SessionMessage {
+  uint32_t arrivalMicros;
+  bool legacy;               // a single character command (legacyByte) rather than a frame (command)
+  uint8_t legacyByte;
+  SerialCommand command;
+};
+
+
+// the running hash of a replay or a recording. FNV-1a over every pixel of every frame
+#define SESSION_HASH_SEED 2166136261UL
+uint32_t HashPixels(uint32_t hash, const CRGB *leds, uint16_t count);
+
+
+// ******************************************************************
+//            SessionRecorder class definitions
+// ******************************************************************
+class SessionRecorder
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    SessionRecorder();
+
+    // start recording into buffer (the header included), from a frame clock started at startMicros/startMillis
+    // with the random seed as it is now. a full buffer stops recording, but what was captured still replays
+    void Begin(uint8_t *buffer, uint32_t size, uint16_t seed, uint32_t frameIntervalMicros,
+               uint32_t startMicros, uint32_t startMillis);
+
+    // frameNumber is the frame the message arrived before (the frame clock's GetFrameCount())
+    void RecordLegacy(uint32_t frameNumber, uint32_t arrivalMicros, uint8_t legacyByte);
+    void RecordCommand(uint32_t frameNumber, uint32_t arrivalMicros, const SerialCommand &command);
+
+    // call for every frame the clock hands out, so skipped frames are replayed as skipped
+    void RecordFrame(const FrameTime &frame);
+
+    // bring the header up to date, covering frameCount frames (or up to where the buffer filled).
+    // the capture is then GetData()/GetLength(), and recording carries on
+    void Seal(uint32_t frameCount);
+    const uint8_t *GetData() const { return _buffer; }
+    uint32_t GetLength() const { return _length; }
+
+    bool IsRecording() const { return _buffer != nullptr; }
+    bool IsFull() const { return _full; }
+    uint16_t GetDroppedCount() const { return _droppedCount; }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    uint8_t *_buffer = nullptr;
+    uint32_t _size = 0;
+    uint32_t _length = 0;
+
+    uint32_t _lastFrame = 0;
+    uint32_t _lastArrivalMicros = 0;
+    bool _full = false;
+    uint32_t _fullAtFrame = 0;     // the first frame the records no longer cover
+    uint16_t _droppedCount = 0;
+
+    bool Room(uint32_t frameNumber);
+    void PutRecordStart(SessionRecordType type, uint32_t frameNumber);
+    void PutVarint(uint32_t value);
+};
+
+
+// ******************************************************************
+//            SessionReplay class definitions
+// ******************************************************************
+class SessionReplay
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    // data must stay valid for as long as the replay runs. IsValid() says whether it's a capture we can play
+    SessionReplay(const uint8_t *data, uint32_t length);
+
+    bool IsValid() const { return _valid; }
+    uint16_t GetSeed() const { return _seed; }
+    uint32_t GetStartMicros() const { return _startMicros; }
+    uint32_t GetStartMillis() const { return _startMillis; }
+    uint32_t GetFrameCount() const { return _frameCount; }
+
+    // the messages that arrived before the next frame, one per call
+    bool NextMessage(SessionMessage &message);
+
+    // the next frame, exactly as the frame clock handed it out when recording. false once the
+    // capture has run out
+    bool NextFrame(FrameTime &frame);
+    uint32_t GetFramesPlayed() const { return _frameIndex; }
+
+    // kept by whoever renders the frames, for reporting at the end
+    uint32_t GetHash() const { return _hash; }
+    void HashFrame(const CRGB *leds, uint16_t count) { _hash = HashPixels(_hash, leds, count); }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    const uint8_t *_data;
+    uint32_t _end = 0;
+    uint32_t _position = SESSION_HEADER_SIZE;
+    bool _valid = false;
+
+    uint16_t _seed = 0;
+    uint32_t _frameIntervalMicros = 0;
+    uint32_t _startMicros = 0;
+    uint32_t _startMillis = 0;
+    uint32_t _frameCount = 0;
+
+    // the record at _position, once its type and frame are read
+    bool _havePending = false;
+    SessionRecordType _pendingType = SESSION_LEGACY;
+    uint32_t _pendingFrame = 0;
+    uint32_t _bodyPosition = 0;
+    uint32_t _recordFrame = 0;         // the frame of the last record read
+
+    FrameClock _clock;
+    uint32_t _nextFrameMicros = 0;
+    uint32_t _lastArrivalMicros = 0;
+    uint32_t _frameIndex = 0;
+    uint32_t _hash = SESSION_HASH_SEED;
+
+    bool PeekRecord();
+    bool GetVarint(uint32_t &position, uint32_t &value) const;
+    uint32_t GetLong(uint32_t position) const;
+};
+
+
+
+#endif
@@ -0,0 +1,152 @@
+/*
+  SpatialEffects.cpp  - Animations drawn across the whole sculpture, from where each pixel is
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "SpatialEffects.h"
+
+
+// the width of SPATIAL_WIPE's band and SPATIAL_SWEEP's tail, in coordinate steps (a power of two)
+#define SPATIAL_BAND_WIDTH 64
+
+
+const AnimationDefinition SpatialEffects::_definitions[SPATIAL_EFFECT_COUNT] = {
+  //  init     render                      interval                  every tick  sharing
+  { &Init,     &SpatialEffects::Wipe,          SPATIAL_UPDATE_INTERVAL,  false,  RENDER_UNIQUE },   // SPATIAL_WIPE
+  { &Init,     &SpatialEffects::RadialPulse,   SPATIAL_UPDATE_INTERVAL,  false,  RENDER_UNIQUE },   // SPATIAL_RADIAL_PULSE
+  { &Init,     &SpatialEffects::Sweep,         SPATIAL_UPDATE_INTERVAL,  false,  RENDER_UNIQUE },   // SPATIAL_SWEEP
+  { &Init,     &SpatialEffects::Noise,         SPATIAL_UPDATE_INTERVAL,  false,  RENDER_UNIQUE },   // SPATIAL_NOISE
+};
+
+
+bool SpatialEffects::Register() {
+
+  bool registered = true;
+  for( uint8_t i = 0; i < SPATIAL_EFFECT_COUNT; i++ ){
+    registered = LEDStripController::RegisterAnimation( GetAnimation((SpatialEffect)i), _definitions[i] ) && registered;
+  }
+  return registered;
+}
+
+
+void SpatialEffects::Init(LEDStripController &strip) {
+  strip.InitTimebase();
+}
+
+
+// *********************************************************************************
+//      EFFECTS
+// *********************************************************************************
+
+void SpatialEffects::Wipe(LEDStripController &strip) {
+
+  const PixelCoordinate *coordinates = strip.GetPixelCoordinates();
+  if( !coordinates || strip.GetBPM() == 0 ){
+    return;
+  }
+
+  // which sweep this is and how far through it, from the time rather than a beat function so the
+  // count of sweeps picks the direction
+  uint32_t sweepMillis = 120000UL / strip.GetBPM();
+  uint32_t elapsed = FrameClock::GetAnimationMillis() - strip.GetTimebase();
+  uint16_t sweep = elapsed / sweepMillis;
+
+  // the band's leading edge runs from the near side until its tail has left the far one
+  int16_t front = (int32_t)(elapsed % sweepMillis) * (256 + SPATIAL_BAND_WIDTH) / sweepMillis;
+
+  // a bit over a sixth of a turn between sweeps, so the directions don't repeat for a while
+  uint8_t direction = sweep * 48;
+  int16_t dx = (int16_t)cos8(direction) - 128;
+  int16_t dy = (int16_t)sin8(direction) - 128;
+
+  uint8_t hue = strip.GetHue();
+  uint8_t brightness = strip.GetBrightness();
+
+  for( uint16_t i = 0; i < strip.GetStripLength(); i++ ){
+    const PixelCoordinate &p = coordinates[i];
+
+    // how far along the sweep the pixel is, 0 - 255 (the corners of the box can come out past either end)
+    int16_t along = 128 + ( ((int16_t)p.x - 128) * dx + ((int16_t)p.y - 128) * dy ) / 256;
+    int16_t behind = front - along;
+
+    CRGB color = CRGB(0, 0, 0);
+    if( behind >= 0 && behind < SPATIAL_BAND_WIDTH ){
+      color = strip.PaletteColor( hue + along, scale8(brightness, 255 - behind * (256 / SPATIAL_BAND_WIDTH)) );
+    }
+    DrawPixel( strip, i, color );
+  }
+}
+
+
+void SpatialEffects::RadialPulse(LEDStripController &strip) {
+
+  const PixelCoordinate *coordinates = strip.GetPixelCoordinates();
+  if( !coordinates ){
+    return;
+  }
+
+  uint8_t phase = beat8( strip.GetBPM(), strip.GetTimebase() );
+  uint8_t hue = strip.GetHue();
+  uint8_t brightness = strip.GetBrightness();
+
+  for( uint16_t i = 0; i < strip.GetStripLength(); i++ ){
+    uint8_t distance = coordinates[i].apexDistance;
+
+    // the rings are where twice the distance catches up with the phase, so they move outwards
+    uint8_t ring = quadwave8( distance * 2 - phase );
+    DrawPixel( strip, i, strip.PaletteColor( hue + distance / 2, scale8(brightness, ring) ) );
+  }
+}
+
+
+void SpatialEffects::Sweep(LEDStripController &strip) {
+
+  const PixelCoordinate *coordinates = strip.GetPixelCoordinates();
+  if( !coordinates ){
+    return;
+  }
+
+  uint8_t heading = beat8( strip.GetBPM() / 2, strip.GetTimebase() );
+  uint8_t hue = strip.GetHue();
+  uint8_t brightness = strip.GetBrightness();
+
+  for( uint16_t i = 0; i < strip.GetStripLength(); i++ ){
+    const PixelCoordinate &p = coordinates[i];
+
+    // how far the beam has gone past the pixel, wrapping once a turn
+    uint8_t behind = heading - p.angle;
+
+    CRGB color = CRGB(0, 0, 0);
+    if( behind < SPATIAL_BAND_WIDTH ){
+      color = strip.PaletteColor( hue + p.z, scale8(brightness, 255 - behind * (256 / SPATIAL_BAND_WIDTH)) );
+    }
+    DrawPixel( strip, i, color );
+  }
+}
+
+
+void SpatialEffects::Noise(LEDStripController &strip) {
+
+  const PixelCoordinate *coordinates = strip.GetPixelCoordinates();
+  if( !coordinates ){
+    return;
+  }
+
+  // a quarter of a noise cell (256) a beat. the noise repeats every 256 cells, so drift wrapping is seamless
+  uint32_t elapsed = FrameClock::GetAnimationMillis() - strip.GetTimebase();
+  uint16_t drift = (uint64_t)elapsed * strip.GetBPM() * 64 / 60000UL;
+
+  uint8_t hue = strip.GetHue();
+  uint8_t brightness = strip.GetBrightness();
+
+  for( uint16_t i = 0; i < strip.GetStripLength(); i++ ){
+    const PixelCoordinate &p = coordinates[i];
+
+    // about three noise cells across the sculpture each way
+    uint8_t field = inoise8( p.x * 3, p.y * 3, p.z * 3 - drift );
+    DrawPixel( strip, i, strip.PaletteColor( hue + field, scale8(brightness, qadd8(field, field / 2)) ) );
+  }
+}
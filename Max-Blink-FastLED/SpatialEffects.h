@@ -0,0 +1,85 @@
+/*
+  SpatialEffects.h  - Animations drawn across the whole sculpture, from where each pixel is (see PixelMap.h)
+                    -- every segment draws its own pixels from its coordinates, so segments triggered together
+                       make one picture: a wipe crosses from one station to the next, rings run out from the
+                       apex and down every triangle
+                    -- a pixel is a few adds and multiplies on its table entry and a palette lookup. nothing
+                       is worked out per pixel that the table already has
+                    -- they're timed from the trigger, so a group triggered on the same frame stays in step.
+                       no two segments are in the same place, so they don't share renders (RENDER_UNIQUE)
+                    -- the hue parameter moves the colors along the palette, brightness scales them and bpm
+                       (following the tracked tempo) sets the speed
+                    -- Register() puts them on the first custom animation ids, so SERIAL_OP_TRIGGER and
+                       SERIAL_OP_PRESET start them: SpatialEffects::GetAnimation(SPATIAL_WIPE) and so on
+                    -- host/bench/SpatialBench.cpp times them on the show's layout against the frame budget
+
+  EFFECTS
+
+    SPATIAL_WIPE           a band sweeps across the room once every two beats, colored by how far along the
+                           sweep each pixel is. every sweep comes from a different direction
+    SPATIAL_RADIAL_PULSE   rings run out from the apex, two of them across the sculpture, one a beat
+    SPATIAL_SWEEP          a beam turns around the apex once every two beats with a fading tail, colored by
+                           height
+    SPATIAL_NOISE          a noise field drifting up through the sculpture, faster at a higher bpm
+*/
+
+#ifndef SpatialEffects_h
+#define SpatialEffects_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include "LEDStripController.h"
+#include "PixelMap.h"
+#include "EffectVM.h"
+
+#define SPATIAL_UPDATE_INTERVAL 10
+
+enum SpatialEffect : uint8_t {
+  SPATIAL_WIPE,
+  SPATIAL_RADIAL_PULSE,
+  SPATIAL_SWEEP,
+  SPATIAL_NOISE,
+  SPATIAL_EFFECT_COUNT
+};
+
+static_assert(FIRST_CUSTOM_ANIMATION + SPATIAL_EFFECT_COUNT <= EffectVM::FIRST_PROGRAM_ANIMATION,
+              "the spatial effects' ids run into the effect program slots'");
+
+
+// ******************************************************************
+//            SpatialEffects class definitions
+// ******************************************************************
+class SpatialEffects
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    // register every effect for every controller. the controllers need their coordinates as well
+    // (PixelMap<>::Attach()), or the effects draw nothing on them
+    static bool Register();
+
+    static constexpr AnimationType GetAnimation(SpatialEffect effect) { return (AnimationType)(FIRST_CUSTOM_ANIMATION + effect); }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    static const AnimationDefinition _definitions[SPATIAL_EFFECT_COUNT];
+
+    static void Init(LEDStripController &strip);
+    static void Wipe(LEDStripController &strip);
+    static void RadialPulse(LEDStripController &strip);
+    static void Sweep(LEDStripController &strip);
+    static void Noise(LEDStripController &strip);
+
+    // only pixels that change are written, so a still part of the picture isn't a change
+    static void DrawPixel(LEDStripController &strip, uint16_t pos, CRGB color) {
+      if( strip.GetPixel(pos) != color ){
+        strip.SetPixelColor( pos, color );
+      }
+    }
+};
+
+
+
+#endif
@@ -0,0 +1,143 @@
+/*
+  Telemetry.cpp  - Profiling counters that are always on, for asking a running show how it's doing
+*/
+
+
+// ******************************************************************
+//      INCLUDES
+// ******************************************************************
+#include "Telemetry.h"
+
+
+// *********************************************************************************
+//      CONSTRUCTOR
+// *********************************************************************************
+
+Telemetry::Telemetry()
+{
+  Reset();
+}
+
+
+void Telemetry::Begin() {
+
+#if defined(ARM_DWT_CTRL_CYCCNTENA)
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+#endif
+}
+
+
+void Telemetry::Reset() {
+
+  memset(_animations, 0, sizeof(_animations));
+  memset(_segments, 0, sizeof(_segments));
+  memset(_segmentCopies, 0, sizeof(_segmentCopies));
+  memset(&_show, 0, sizeof(_show));
+  memset(&_frame, 0, sizeof(_frame));
+  memset(&_loopGap, 0, sizeof(_loopGap));
+  memset(&_lateness, 0, sizeof(_lateness));
+  memset(&_second, 0, sizeof(_second));
+
+  _haveLoop = false;
+  _serialBytes = 0;
+  _usbHighWater = 0;
+  _rxHighWater = 0;
+  _queueHighWater = 0;
+  _history.Clear();
+  _haveSecond = false;
+}
+
+
+// *********************************************************************************
+//      RECORDING
+// *********************************************************************************
+
+void Telemetry::RecordLoop(uint32_t nowMicros, uint16_t serialBytes, uint16_t usbBacklog, uint16_t rxDepth) {
+
+  if( _haveLoop ){
+    _loopGap.Add(nowMicros - _lastLoopMicros);
+  }
+  _lastLoopMicros = nowMicros;
+  _haveLoop = true;
+
+  _serialBytes += serialBytes;
+  _second.serialBytes += serialBytes;
+
+  if( usbBacklog > _usbHighWater ){
+    _usbHighWater = usbBacklog;
+  }
+  uint8_t usbBacklogByte = usbBacklog > 255 ? 255 : (uint8_t)usbBacklog;
+  if( usbBacklogByte > _second.usbHighWater ){
+    _second.usbHighWater = usbBacklogByte;
+  }
+
+  if( rxDepth > _rxHighWater ){
+    _rxHighWater = rxDepth;
+  }
+  uint8_t rxDepthByte = rxDepth > 255 ? 255 : (uint8_t)rxDepth;
+  if( rxDepthByte > _second.rxHighWater ){
+    _second.rxHighWater = rxDepthByte;
+  }
+}
+
+
+void Telemetry::RecordSegment(uint8_t segment, uint8_t animationType, uint32_t cycles, bool rendered) {
+
+  if( segment >= TELEMETRY_MAX_SEGMENTS ){
+    return;
+  }
+
+  if( !rendered ){
+    _segmentCopies[segment].Add(cycles);
+    return;
+  }
+
+  _segments[segment].Add(cycles);
+  if( animationType < TELEMETRY_MAX_ANIMATIONS ){
+    _animations[animationType].Add(cycles);
+  }
+}
+
+
+void Telemetry::RecordShow(uint32_t cycles) {
+  _show.Add(cycles);
+}
+
+
+void Telemetry::RecordFrame(const FrameTime &frame, uint32_t cycles, uint8_t queueDepth) {
+
+  // a new second. the one that ended goes into the history, pushing the oldest out if it's full
+  if( !_haveSecond ){
+    _secondStartMillis = frame.millis;
+    _haveSecond = true;
+  }
+  else if( (uint32_t)(frame.millis - _secondStartMillis) >= 1000 ){
+    if( _history.IsFull() ){
+      TelemetrySecond oldest;
+      _history.Pop(oldest);
+    }
+    _history.Push(_second);
+    memset(&_second, 0, sizeof(_second));
+    _secondStartMillis += 1000 * ((frame.millis - _secondStartMillis) / 1000);
+  }
+
+  _frame.Add(cycles);
+  _lateness.Add(frame.latenessMicros);
+
+  uint32_t frameMicros = cycles / TELEMETRY_CYCLES_PER_MICRO;
+  _second.frames++;
+  if( frame.latenessMicros > LATE_FRAME_THRESHOLD_MICROS ){
+    _second.lateFrames++;
+  }
+  if( frameMicros > _second.maxFrameMicros ){
+    _second.maxFrameMicros = frameMicros > 0xFFFF ? 0xFFFF : (uint16_t)frameMicros;
+  }
+
+  if( queueDepth > _queueHighWater ){
+    _queueHighWater = queueDepth;
+  }
+  if( queueDepth > _second.queueHighWater ){
+    _second.queueHighWater = queueDepth;
+  }
+}
@@ -0,0 +1,219 @@
+/*
+  Telemetry.h  - Profiling counters that are always on, for asking a running show how it's doing
+               -- times are taken with the cycle counter (ARM_DWT_CYCCNT on the Teensy, a cycle a tick
+                  at F_CPU), so a measurement is two register reads and nothing is ever printed until asked
+               -- per animation and per segment: how many renders, their mean and worst time. per frame:
+                  the whole frame and the show() on the end of it
+               -- histograms of the gap between passes of loop() (how long serial waits to be read) and
+                  of how late frames start, in power of two microsecond buckets
+               -- serial bytes in, and how far the USB buffer, our receive ring and the command queue
+                  backed up, as high-water marks overall and for each of the last TELEMETRY_HISTORY_SECONDS
+               -- everything is fixed size. SERIAL_OP_TELEMETRY prints it as text (see Report())
+*/
+
+#ifndef Telemetry_h
+#define Telemetry_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include <FastLED.h>
+#include "GlobalVariables.h"
+#include "FrameClock.h"
+#include "LEDStripController.h"
+#include "RingBuffer.h"
+
+// the cycle counter where there is one, microseconds where there isn't
+#if defined(ARM_DWT_CYCCNT)
+  #define TELEMETRY_CYCLES() (ARM_DWT_CYCCNT)
+  #define TELEMETRY_CYCLES_PER_MICRO (F_CPU / 1000000)
+#else
+  #define TELEMETRY_CYCLES() (micros())
+  #define TELEMETRY_CYCLES_PER_MICRO 1
+#endif
+
+#define TELEMETRY_MAX_SEGMENTS 16
+#define TELEMETRY_MAX_ANIMATIONS (FIRST_CUSTOM_ANIMATION + MAX_CUSTOM_ANIMATIONS)
+
+// bucket n holds times of n significant bits in microseconds: 0, 1, 2-3, 4-7 ... the last holds 16 ms and up
+#define TELEMETRY_HISTOGRAM_BUCKETS 16
+
+// must be a power of two (it's a RingBuffer)
+#define TELEMETRY_HISTORY_SECONDS 8
+
+
+// how often something ran and how long it took, in cycles
+struct TelemetryTiming {
+  uint32_t count;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+
+  void Add(uint32_t cycles) {
+    count++;
+    totalCycles += cycles;
+    if( cycles > maxCycles ){
+      maxCycles = cycles;
+    }
+  }
+  uint32_t GetMeanMicros() const { return count ? (uint32_t)(totalCycles / count / TELEMETRY_CYCLES_PER_MICRO) : 0; }
+  uint32_t GetMaxMicros() const { return maxCycles / TELEMETRY_CYCLES_PER_MICRO; }
+};
+
+
+struct TelemetryHistogram {
+  uint16_t buckets[TELEMETRY_HISTOGRAM_BUCKETS];
+
+  void Add(uint32_t micros) {
+    uint8_t bucket = 0;
+    while( micros && bucket < TELEMETRY_HISTOGRAM_BUCKETS - 1 ){
+      micros >>= 1;
+      bucket++;
+    }
+    if( buckets[bucket] != 0xFFFF ){
+      buckets[bucket]++;
+    }
+  }
+};
+
+
+// one second of the show
+struct TelemetrySecond {
+  uint16_t serialBytes;
+  uint16_t frames;
+  uint16_t lateFrames;
+  uint16_t maxFrameMicros;
+  uint8_t usbHighWater;       // capped at 255
+  uint8_t rxHighWater;
+  uint8_t queueHighWater;
+};
+
+
+// ******************************************************************
+//            Telemetry class definitions
+// ******************************************************************
+class Telemetry
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    Telemetry();
+
+    // starts the cycle counter, on chips where it has to be
+    void Begin();
+
+    static uint32_t Cycles() { return TELEMETRY_CYCLES(); }
+
+    // at the top of every loop(): the serial bytes just read, what the USB buffer held before they were,
+    // and what our receive ring holds after
+    void RecordLoop(uint32_t nowMicros, uint16_t serialBytes, uint16_t usbBacklog, uint16_t rxDepth);
+
+    // a segment's Update() (rendered) or FollowRender() (copied from its render group's leader)
+    void RecordSegment(uint8_t segment, uint8_t animationType, uint32_t cycles, bool rendered);
+
+    void RecordShow(uint32_t cycles);
+
+    // at the end of every frame, with what it cost and how many commands are waiting for later frames
+    void RecordFrame(const FrameTime &frame, uint32_t cycles, uint8_t queueDepth);
+
+    void Reset();
+
+    // one line per counter, "name value value...". times are microseconds
+    template <typename Output>
+    void Report(Output &out) const;
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    TelemetryTiming _animations[TELEMETRY_MAX_ANIMATIONS];
+    TelemetryTiming _segments[TELEMETRY_MAX_SEGMENTS];
+    TelemetryTiming _segmentCopies[TELEMETRY_MAX_SEGMENTS];
+    TelemetryTiming _show;
+    TelemetryTiming _frame;
+
+    TelemetryHistogram _loopGap;
+    TelemetryHistogram _lateness;
+    uint32_t _lastLoopMicros = 0;
+    bool _haveLoop = false;
+
+    uint32_t _serialBytes = 0;
+    uint16_t _usbHighWater = 0;
+    uint16_t _rxHighWater = 0;
+    uint8_t _queueHighWater = 0;
+
+    RingBuffer<TelemetrySecond, TELEMETRY_HISTORY_SECONDS> _history;
+    TelemetrySecond _second;
+    uint32_t _secondStartMillis = 0;
+    bool _haveSecond = false;
+};
+
+
+// *********************************************************************************
+//      REPORT - a template so it can print to whatever Serial is on the board (or the host)
+// *********************************************************************************
+template <typename Output>
+void Telemetry::Report(Output &out) const {
+
+  for( uint8_t i = 0; i < TELEMETRY_MAX_ANIMATIONS; i++ ){
+    if( !_animations[i].count ){
+      continue;
+    }
+    out.print("animation "); out.print(i);
+    out.print(' '); out.print(_animations[i].count);
+    out.print(' '); out.print(_animations[i].GetMeanMicros());
+    out.print(' '); out.println(_animations[i].GetMaxMicros());
+  }
+
+  for( uint8_t i = 0; i < TELEMETRY_MAX_SEGMENTS; i++ ){
+    if( !_segments[i].count && !_segmentCopies[i].count ){
+      continue;
+    }
+    out.print("segment "); out.print(i);
+    out.print(' '); out.print(_segments[i].count);
+    out.print(' '); out.print(_segments[i].GetMeanMicros());
+    out.print(' '); out.print(_segments[i].GetMaxMicros());
+    out.print(' '); out.print(_segmentCopies[i].count);
+    out.print(' '); out.print(_segmentCopies[i].GetMeanMicros());
+    out.print(' '); out.println(_segmentCopies[i].GetMaxMicros());
+  }
+
+  out.print("frame "); out.print(_frame.count);
+  out.print(' '); out.print(_frame.GetMeanMicros());
+  out.print(' '); out.println(_frame.GetMaxMicros());
+
+  out.print("show "); out.print(_show.count);
+  out.print(' '); out.print(_show.GetMeanMicros());
+  out.print(' '); out.println(_show.GetMaxMicros());
+
+  out.print("loop_gap");
+  for( uint8_t i = 0; i < TELEMETRY_HISTOGRAM_BUCKETS; i++ ){
+    out.print(' '); out.print(_loopGap.buckets[i]);
+  }
+  out.println();
+
+  out.print("lateness");
+  for( uint8_t i = 0; i < TELEMETRY_HISTOGRAM_BUCKETS; i++ ){
+    out.print(' '); out.print(_lateness.buckets[i]);
+  }
+  out.println();
+
+  out.print("serial "); out.print(_serialBytes);
+  out.print(' '); out.print(_usbHighWater);
+  out.print(' '); out.print(_rxHighWater);
+  out.print(' '); out.println(_queueHighWater);
+
+  // oldest first
+  for( uint16_t i = 0; i < _history.Count(); i++ ){
+    const TelemetrySecond &second = _history.At(i);
+    out.print("second "); out.print(second.serialBytes);
+    out.print(' '); out.print(second.frames);
+    out.print(' '); out.print(second.lateFrames);
+    out.print(' '); out.print(second.maxFrameMicros);
+    out.print(' '); out.print(second.usbHighWater);
+    out.print(' '); out.print(second.rxHighWater);
+    out.print(' '); out.println(second.queueHighWater);
+  }
+}
+
+
+
+#endif
@@ -0,0 +1,151 @@
+/*
+  Topology.h  - A sculpture's strips and segments as two constant tables, and everything built from them
+              -- StripLayout is a physical strip (its length and the power supply it's on). SegmentLayout is
+                 one LEDStripController's stretch of a strip: where it starts, how long it is, whether it
+                 runs backwards, and the tags it answers to (see Installation.h for the show's tables)
+              -- Topology<> lays the strips' pixels out back to back in one buffer, strip 0 first (what the
+                 parallel output needs), and constructs a controller for every segment in table order, so
+                 segment n is LedStripControllerArray[n] and bit n of a group mask
+              -- the segments' lit pixel lists are one pool, each as long as its segment uses
+              -- the tables are checked when the sketch compiles: a segment off the end of its strip, two
+                 segments sharing a pixel, or more segments than a group mask has bits won't build
+              -- TagMask() is worked out at compile time too, so a tag group is just a group mask
+*/
+
+#ifndef Topology_h
+#define Topology_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include <FastLED.h>
+#include "GlobalVariables.h"
+#include "LEDStripController.h"
+#include "RenderGroups.h"
+
+struct StripLayout {
+  uint16_t length;
+  uint8_t supply;        // which power supply it draws from (see PowerLimiter.h)
+};
+
+struct SegmentLayout {
+  uint8_t strip;         // index into the strip table
+  uint16_t start;        // first pixel on the strip
+  uint16_t length;
+  bool invert;           // INVERT_STRIP runs the segment from its last pixel to its first
+  uint8_t tags;          // any of the sculpture's tags, or'd together
+};
+
+
+// ******************************************************************
+//            Compile time helpers - single return statements, so they're constexpr in C++11 as well
+// ******************************************************************
+constexpr uint16_t TopologyStripOffset(const StripLayout *strips, uint8_t strip) {
+  return strip == 0 ? 0 : TopologyStripOffset(strips, strip - 1) + strips[strip - 1].length;
+}
+
+constexpr uint16_t TopologyPixelCount(const StripLayout *strips, uint8_t stripCount) {
+  return TopologyStripOffset(strips, stripCount);
+}
+
+// where segment n's lit pixel list starts in the pool every segment's comes from (see LEDStripController.h)
+constexpr uint16_t TopologyLitPixelOffset(const SegmentLayout *segments, uint8_t segment) {
+  return segment == 0 ? 0 : TopologyLitPixelOffset(segments, segment - 1) + LEDStripController::LitPixelLimit(segments[segment - 1].length);
+}
+
+// bit n set for every segment n that carries any of tags
+constexpr uint16_t TopologyTagMask(const SegmentLayout *segments, uint8_t segmentCount, uint8_t tags, uint8_t i = 0) {
+  return i >= segmentCount ? 0 :
+         ((segments[i].tags & tags) ? (uint16_t)(1 << i) : 0) | TopologyTagMask(segments, segmentCount, tags, i + 1);
+}
+
+constexpr bool TopologySegmentsFit(const StripLayout *strips, uint8_t stripCount, const SegmentLayout *segments, uint8_t segmentCount, uint8_t i = 0) {
+  return i >= segmentCount ||
+         ( segments[i].strip < stripCount &&
+           segments[i].length > 0 &&
+           segments[i].start + segments[i].length <= strips[segments[i].strip].length &&
+           TopologySegmentsFit(strips, stripCount, segments, segmentCount, i + 1) );
+}
+
+constexpr bool TopologySegmentsOverlap(const SegmentLayout &a, const SegmentLayout &b) {
+  return a.strip == b.strip && a.start < b.start + b.length && b.start < a.start + a.length;
+}
+
+// every pair, i < j
+constexpr bool TopologyAnyOverlap(const SegmentLayout *segments, uint8_t segmentCount, uint8_t i = 0, uint8_t j = 1) {
+  return i + 1 >= segmentCount ? false :
+         j >= segmentCount ? TopologyAnyOverlap(segments, segmentCount, i + 1, i + 2) :
+         TopologySegmentsOverlap(segments[i], segments[j]) || TopologyAnyOverlap(segments, segmentCount, i, j + 1);
+}
+
+
+// 0, 1 ... N - 1 as a parameter pack, for constructing one controller per segment
+template <uint8_t... I> struct TopologyIndexes {};
+template <uint8_t N, uint8_t... I> struct MakeTopologyIndexes : MakeTopologyIndexes<N - 1, N - 1, I...> {};
+template <uint8_t... I> struct MakeTopologyIndexes<0, I...> { typedef TopologyIndexes<I...> Type; };
+
+
+// ******************************************************************
+//            Topology class definitions
+// ******************************************************************
+template <const StripLayout *STRIPS, uint8_t STRIP_COUNT, const SegmentLayout *SEGMENTS, uint8_t SEGMENT_COUNT>
+class Topology
+{
+  static_assert(STRIP_COUNT > 0 && STRIP_COUNT <= MAX_OUTPUT_STRIPS, "a topology needs 1 to MAX_OUTPUT_STRIPS strips");
+  static_assert(SEGMENT_COUNT > 0 && SEGMENT_COUNT <= MAX_RENDER_SEGMENTS, "a group mask has 16 bits, so 1 to MAX_RENDER_SEGMENTS segments");
+  static_assert(TopologySegmentsFit(STRIPS, STRIP_COUNT, SEGMENTS, SEGMENT_COUNT), "a segment is off the end of its strip, empty, or on a strip that isn't in the table");
+  static_assert(!TopologyAnyOverlap(SEGMENTS, SEGMENT_COUNT), "two segments share pixels");
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    Topology() : Topology(typename MakeTopologyIndexes<SEGMENT_COUNT>::Type()) {}
+
+    static constexpr uint8_t GetStripCount() { return STRIP_COUNT; }
+    static constexpr uint8_t GetSegmentCount() { return SEGMENT_COUNT; }
+    static constexpr uint16_t GetPixelCount() { return TopologyPixelCount(STRIPS, STRIP_COUNT); }
+    static constexpr uint8_t GetSegmentStrip(uint8_t segment) { return SEGMENTS[segment].strip; }
+
+    // the group mask of every segment carrying any of tags
+    static constexpr uint16_t TagMask(uint8_t tags) { return TopologyTagMask(SEGMENTS, SEGMENT_COUNT, tags); }
+    static constexpr uint16_t AllSegments() { return (uint16_t)((1UL << SEGMENT_COUNT) - 1); }
+
+    // every strip's pixels, back to back
+    CRGB *GetPixels() { return _pixels; }
+    CRGB *GetStripPixels(uint8_t strip) { return _stripPixels[strip]; }
+    CRGB * const *GetStripPixelPointers() const { return _stripPixels; }
+    const uint16_t *GetStripLengths() const { return _stripLengths; }
+    const uint8_t *GetStripSupplies() const { return _stripSupplies; }
+
+    LEDStripController * const *GetControllers() const { return _controllerPointers; }
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    CRGB _pixels[TopologyPixelCount(STRIPS, STRIP_COUNT)];
+    uint16_t _litPixels[TopologyLitPixelOffset(SEGMENTS, SEGMENT_COUNT) > 0 ? TopologyLitPixelOffset(SEGMENTS, SEGMENT_COUNT) : 1];
+    LEDStripController _controllers[SEGMENT_COUNT];
+    LEDStripController *_controllerPointers[SEGMENT_COUNT];
+    CRGB *_stripPixels[STRIP_COUNT];
+    uint16_t _stripLengths[STRIP_COUNT];
+    uint8_t _stripSupplies[STRIP_COUNT];
+
+    template <uint8_t... I>
+    Topology(TopologyIndexes<I...>)
+      : _controllers{ LEDStripController( &_pixels[ TopologyStripOffset(STRIPS, SEGMENTS[I].strip) ],
+                                          SEGMENTS[I].length, DEFAULT_PALETTE, SEGMENTS[I].invert, SEGMENTS[I].start,
+                                          &_litPixels[ TopologyLitPixelOffset(SEGMENTS, I) ] )... }
+    {
+      for( uint8_t i = 0; i < SEGMENT_COUNT; i++ ){
+        _controllerPointers[i] = &_controllers[i];
+      }
+      for( uint8_t i = 0; i < STRIP_COUNT; i++ ){
+        _stripPixels[i] = &_pixels[ TopologyStripOffset(STRIPS, i) ];
+        _stripLengths[i] = STRIPS[i].length;
+        _stripSupplies[i] = STRIPS[i].supply;
+      }
+    }
+};
+
+
+
+#endif
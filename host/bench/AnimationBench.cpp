@@ -0,0 +1,626 @@
+/*
+  AnimationBench.cpp  - Per-animation microbenchmark for LEDStripController on the host
+                      -- renders every AnimationType at strip lengths from 16 to 4096
+                      -- reports ns/pixel and frames/sec for the render path only, and the share
+                         of frames that changed a pixel (frames that need a show())
+                      -- *_CROSSFADE rows draw from a shared palette that is always mid-crossfade,
+                         and include the crossfade's per-frame step in the render cost
+                      -- rows with a layer name (*_ENVELOPE, *_SPARKLE, ...) set that layer on top
+                      -- before anything runs, checks PALETTE_W_GLITTER_FADE_LOW_BPM's glitter follows a
+                         brightness change while it runs (exits 1 if it doesn't)
+                      -- PROGRAM_* rows run effect programs (see EffectVM.h), uploaded through the serial
+                         framing first. PROGRAM_PALETTE draws exactly what PALETTE does on a regular strip
+                         (same checksum in --csv), PROGRAM_SINELON is SINELON with the color following the
+                         ticks since the trigger, so the two show what interpreting costs over native code
+
+                      -- --rig runs the show's layout (Installation.h) with and without render groups,
+                         checks every frame comes out the same both ways and reports the saving.
+                         then PALETTE again with a different palette on every segment (more than the
+                         registry has tables for, on the show's layout) and checks the tables aren't
+                         re-expanded every frame
+
+  usage: animation_bench [--quick] [--csv] [--rig]
+*/
+
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "Installation.h"
+#include "SerialProtocol.h"
+#include "EffectVM.h"
+
+
+// *********************************************************************************
+//      EFFECT PROGRAMS - the built-in PALETTE and SINELON, and a noise field, as bytecode
+// *********************************************************************************
+static const EffectInstruction PALETTE_PROGRAM[] = {
+  { EFFECT_PARAM,   0, EFFECT_PARAM_HUE_INDEX_BPM, 0 },
+  { EFFECT_BEAT8,   1, 0, 1 },          // free running, like PALETTE's scroll
+  { EFFECT_LOAD,    2, 255, 0 },
+  { EFFECT_SUB,     1, 2, 1 },          // 255 - beat, the way PALETTE runs on a regular strip
+  { EFFECT_LOAD,    3, 0, 1 },          // 256
+  { EFFECT_LENGTH,  2, 0, 0 },
+  { EFFECT_DIV,     3, 3, 2 },          // palette steps between pixels
+  { EFFECT_PARAM,   4, EFFECT_PARAM_BRIGHTNESS, 0 },
+  { EFFECT_INDEX,   5, 0, 0 },          // per pixel from here
+  { EFFECT_MUL,     5, 5, 3 },
+  { EFFECT_ADD,     5, 5, 1 },
+  { EFFECT_PALETTE, 5, 4, 0 },
+};
+
+static const EffectInstruction SINELON_PROGRAM[] = {
+  { EFFECT_PARAM,   0, EFFECT_PARAM_BPM, 0 },
+  { EFFECT_SHR,     0, 0, 1 },          // half the bpm, so a sweep one way takes a beat
+  { EFFECT_BEAT16,  1, 0, 0 },          // from the trigger
+  { EFFECT_LOAD,    2, 0, 64 },         // a quarter wave on
+  { EFFECT_ADD,     1, 1, 2 },
+  { EFFECT_SIN16,   1, 1, 0 },
+  { EFFECT_LENGTH,  2, 0, 0 },
+  { EFFECT_LOAD,    3, 1, 0 },
+  { EFFECT_SUB,     2, 2, 3 },
+  { EFFECT_SCALE16, 1, 1, 2 },          // where the dot is
+  { EFFECT_SUB,     1, 2, 1 },          // from the far end, the way SINELON runs on a regular strip
+  { EFFECT_TICKS,   4, 0, 0 },          // the color moves a step every render
+  { EFFECT_PARAM,   5, EFFECT_PARAM_BRIGHTNESS, 0 },
+  { EFFECT_INDEX,   6, 0, 0 },          // per pixel from here
+  { EFFECT_EQ,      6, 6, 1 },
+  { EFFECT_JZ,      6, 17, 0 },         // everywhere else keeps its fading trail
+  { EFFECT_PALETTE_ADD, 4, 5, 0 },
+};
+
+static const EffectInstruction NOISE_PROGRAM[] = {
+  { EFFECT_TIME,    0, 0, 0 },
+  { EFFECT_SHR,     0, 0, 2 },          // the field drifts a quarter noise step a ms
+  { EFFECT_PARAM,   1, EFFECT_PARAM_BRIGHTNESS, 0 },
+  { EFFECT_LOAD,    3, 60, 0 },
+  { EFFECT_INDEX,   2, 0, 0 },          // per pixel from here
+  { EFFECT_MUL,     2, 2, 3 },
+  { EFFECT_NOISE,   2, 2, 0 },
+  { EFFECT_PALETTE, 2, 1, 0 },
+};
+
+static const AnimationType PROGRAM_PALETTE = EffectVM::GetAnimation(0);
+static const AnimationType PROGRAM_SINELON = EffectVM::GetAnimation(1);
+static const AnimationType PROGRAM_NOISE = EffectVM::GetAnimation(2);
+
+
+// send a program the way Max would, a SERIAL_OP_PROGRAM_CODE frame for every two instructions and a
+// SERIAL_OP_PROGRAM_LOAD, through the decoder and on to the VM as the sketch does
+static bool uploadProgram(uint8_t slot, const EffectInstruction *code, uint8_t length, uint8_t fade, uint16_t updateInterval) {
+
+  SerialProtocol decoder;
+  uint8_t frame[SERIAL_MAX_PAYLOAD + 3];
+
+  for (uint8_t index = 0; index < length + SERIAL_PROGRAM_CHUNK_INSTRUCTIONS; index += SERIAL_PROGRAM_CHUNK_INSTRUCTIONS) {
+    SerialCommand command;
+    if (index < length) {
+      command.opcode = SERIAL_OP_PROGRAM_CODE;
+      command.programIndex = index;
+      uint8_t count = length - index < SERIAL_PROGRAM_CHUNK_INSTRUCTIONS ? length - index : SERIAL_PROGRAM_CHUNK_INSTRUCTIONS;
+      memcpy(command.programCode, &code[index], count * sizeof(EffectInstruction));
+    } else {
+      command.opcode = SERIAL_OP_PROGRAM_LOAD;
+      command.programSlot = slot;
+      command.programLength = length;
+      command.programFade = fade;
+      command.programUpdateInterval = updateInterval;
+    }
+
+    uint8_t frameLength = SerialProtocol::EncodeFrame(command, frame);
+    for (uint8_t i = 0; i < frameLength; i++) {
+      decoder.Push(frame[i]);
+    }
+
+    SerialCommand decoded;
+    uint8_t legacyByte;
+    if (decoder.Poll(0, decoded, legacyByte) != SERIAL_MESSAGE_COMMAND) {
+      return false;
+    }
+    if (decoded.opcode == SERIAL_OP_PROGRAM_CODE) {
+      EffectVM::StageCode(decoded.programIndex, decoded.programCode, SERIAL_PROGRAM_CHUNK_INSTRUCTIONS);
+    } else {
+      return EffectVM::LoadStaged(decoded.programSlot, decoded.programLength, decoded.programFade, decoded.programUpdateInterval);
+    }
+  }
+
+  return false;
+}
+
+
+static bool uploadPrograms() {
+  return uploadProgram(0, PALETTE_PROGRAM, ARRAY_SIZE(PALETTE_PROGRAM), 0, PALETTE_UPDATE_INTERVAL) &&
+         uploadProgram(1, SINELON_PROGRAM, ARRAY_SIZE(SINELON_PROGRAM), 20, SINELON_UPDATE_INTERVAL) &&
+         uploadProgram(2, NOISE_PROGRAM, ARRAY_SIZE(NOISE_PROGRAM), 0, DEFAULT_UPDATE_INTERVAL);
+}
+
+
+// *********************************************************************************
+//      ANIMATIONS UNDER TEST - keep in sync with the AnimationType enum
+// *********************************************************************************
+struct BenchAnimation {
+  AnimationType type;
+  const char *name;
+  bool crossfade;     // follow a shared palette that never stops crossfading
+  const Layer *layer; // set in slot 0, if any
+};
+
+static const Layer ENVELOPE_LAYER = { LAYER_ENVELOPE, BLEND_MULTIPLY, 200, GLOBAL_BPM, CRGB(255, 255, 255) };
+static const Layer SPARKLE_LAYER = { LAYER_SPARKLE, BLEND_ADD, 255, 160, CRGB(0, 0, 0) };
+static const Layer GLITTER_MAX_LAYER = { LAYER_GLITTER, BLEND_MAX, 255, 120, CRGB(255, 255, 255) };
+
+static const BenchAnimation BENCH_ANIMATIONS[] = {
+  { ALL_OFF,                         "ALL_OFF",                         false, nullptr },
+  { SOLID_COLOR,                     "SOLID_COLOR",                     false, nullptr },
+  { FADE_OUT_BPM,                    "FADE_OUT_BPM",                    false, nullptr },
+  { FADE_LOW_BPM,                    "FADE_LOW_BPM",                    false, nullptr },
+  { FADE_IN_OUT_BPM,                 "FADE_IN_OUT_BPM",                 false, nullptr },
+  { PALETTE,                         "PALETTE",                         false, nullptr },
+  { PALETTE_W_GLITTER,               "PALETTE_W_GLITTER",               false, nullptr },
+  { PALETTE_FADE_LOW_BPM,            "PALETTE_FADE_LOW_BPM",            false, nullptr },
+  { PALETTE_W_GLITTER_FADE_LOW_BPM,  "PALETTE_W_GLITTER_FADE_LOW_BPM",  false, nullptr },
+  { CONFETTI,                        "CONFETTI",                        false, nullptr },
+  { SINELON,                         "SINELON",                         false, nullptr },
+  { SINEPULSE,                       "SINEPULSE",                       false, nullptr },
+  { DDT_EXPERIMENTAL,                "DDT_EXPERIMENTAL",                false, nullptr },
+  { PALETTE,                         "PALETTE_CROSSFADE",               true,  nullptr },
+  { CONFETTI,                        "CONFETTI_CROSSFADE",              true,  nullptr },
+  { PALETTE,                         "PALETTE_ENVELOPE",                false, &ENVELOPE_LAYER },
+  { SOLID_COLOR,                     "SOLID_COLOR_ENVELOPE",            false, &ENVELOPE_LAYER },
+  { CONFETTI,                        "CONFETTI_SPARKLE",                false, &SPARKLE_LAYER },
+  { SINELON,                         "SINELON_GLITTER_MAX",             false, &GLITTER_MAX_LAYER },
+  { PROGRAM_PALETTE,                 "PROGRAM_PALETTE",                 false, nullptr },
+  { PROGRAM_SINELON,                 "PROGRAM_SINELON",                 false, nullptr },
+  { PROGRAM_NOISE,                   "PROGRAM_NOISE",                   false, nullptr },
+};
+
+static const uint16_t MIN_STRIP_LENGTH = 16;
+static const uint16_t MAX_STRIP_LENGTH = 4096;
+
+// the Max patch re-triggers one-shot animations on every quarter note
+static const uint32_t BEAT_MS = 60000UL / GLOBAL_BPM;
+
+
+struct BenchResult {
+  uint32_t frames;
+  uint32_t changedFrames;   // frames where Update() reported a pixel change (i.e. show() was needed)
+  double nsPerPixel;
+  double framesPerSecond;
+  uint32_t checksum;
+};
+
+
+// *********************************************************************************
+//      RUN ONE ANIMATION AT ONE STRIP LENGTH
+// *********************************************************************************
+static BenchResult runBench(AnimationType type, bool crossfade, const Layer *layer, uint16_t stripLength, uint32_t pixelBudget) {
+
+  // same starting point for every run so glitter/confetti draw the same randoms
+  random16_set_seed(RAND16_SEED);
+  hostSetMillis(1);
+
+  // frames land exactly on the grid, so every frame renders at least one tick
+  FrameClock frameClock;
+  frameClock.Start(micros(), millis());
+  FrameTime frame;
+
+  std::vector<CRGB> leds(stripLength, CRGB(0, 0, 0));
+  uint16_t litPixels[SPARSE_MAX_PIXELS];
+  LEDStripController controller(leds.data(), stripLength, DEFAULT_PALETTE, 0, 0, litPixels);
+
+  controller.SetStripParams(176, 255, GLOBAL_BPM, 255, 40);
+  controller.SetStripHueIndexBPM(GLOBAL_BPM);
+  if (layer) {
+    controller.SetLayer(0, *layer);
+  }
+  controller.SetActiveAnimationType(type);
+
+  // for the crossfade rows, swing between the default palette and its mirror image for as long as we run
+  CRGBPalette16 palettes[2] = { DEFAULT_PALETTE, DEFAULT_PALETTE };
+  for (uint8_t i = 0; i < 16; i++) {
+    palettes[1][i] = palettes[0][15 - i];
+  }
+  uint8_t targetPalette = 0;
+  PaletteCrossfade sharedPalette(palettes[0]);
+  if (crossfade) {
+    controller.FollowPalette(&sharedPalette);
+  }
+
+  uint32_t frames = pixelBudget / stripLength;
+  if (frames < 64) {
+    frames = 64;
+  }
+
+  // warm up caches and branch predictors
+  for (uint32_t i = 0; i < 16; i++) {
+    hostAdvanceMicros(FRAME_INTERVAL_MICROS);
+    frameClock.Poll(micros(), frame);
+    sharedPalette.Update();
+    controller.Update(frame);
+  }
+
+  uint32_t timeToRetrigger = frame.millis + BEAT_MS;
+  uint32_t changedFrames = 0;
+  std::chrono::nanoseconds elapsed(0);
+
+  for (uint32_t i = 0; i < frames; i++) {
+    hostAdvanceMicros(FRAME_INTERVAL_MICROS);
+    frameClock.Poll(micros(), frame);
+
+    // re-triggering is part of the show, but not part of the render cost
+    if ((int32_t)(frame.millis - timeToRetrigger) >= 0) {
+      controller.SetActiveAnimationType(type);
+      timeToRetrigger += BEAT_MS;
+    }
+
+    if (crossfade && !sharedPalette.IsFading()) {
+      targetPalette ^= 1;
+      sharedPalette.SetTarget(palettes[targetPalette]);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (crossfade) {
+      sharedPalette.Update();
+    }
+    bool changed = controller.Update(frame);
+    elapsed += std::chrono::steady_clock::now() - start;
+
+    if (changed) {
+      changedFrames++;
+    }
+  }
+
+  BenchResult result;
+  result.frames = frames;
+  result.changedFrames = changedFrames;
+  result.checksum = 0;
+  for (uint16_t i = 0; i < stripLength; i++) {
+    result.checksum = result.checksum * 31 + ((leds[i].r << 16) | (leds[i].g << 8) | leds[i].b);
+  }
+
+  double ns = (double)elapsed.count();
+  result.nsPerPixel = ns / ((double)frames * stripLength);
+  result.framesPerSecond = ns > 0 ? (double)frames * 1e9 / ns : 0;
+  return result;
+}
+
+
+// *********************************************************************************
+//      GLITTER AT THE STRIP'S BRIGHTNESS - PALETTE_W_GLITTER_FADE_LOW_BPM's glitter follows
+//      SetStripParams() while it runs, the way 'z' and SERIAL_OP_PARAMS change it
+// *********************************************************************************
+
+// on an all red palette, a pixel with any green in it is glitter. true if there was some and all of it
+// was white at brightness
+static bool glitterAt(LEDStripController &controller, FrameClock &frameClock, FrameTime &frame,
+                      const std::vector<CRGB> &leds, uint8_t brightness) {
+
+  CRGB expected = CRGB( CHSV(0, 0, brightness) );
+  uint32_t seen = 0;
+  for (uint32_t f = 0; f < 200; f++) {
+    hostAdvanceMicros(FRAME_INTERVAL_MICROS);
+    frameClock.Poll(micros(), frame);
+    controller.Update(frame);
+
+    for (size_t i = 0; i < leds.size(); i++) {
+      if (leds[i].g) {
+        if (leds[i] != expected) {
+          return false;
+        }
+        seen++;
+      }
+    }
+  }
+  return seen > 0;
+}
+
+
+static bool checkGlitterBrightness() {
+
+  random16_set_seed(RAND16_SEED);
+  hostSetMillis(1);
+
+  FrameClock frameClock;
+  frameClock.Start(micros(), millis());
+  FrameTime frame;
+
+  CRGBPalette16 red;
+  for (uint8_t i = 0; i < 16; i++) {
+    red[i] = CRGB(255, 0, 0);
+  }
+
+  std::vector<CRGB> leds(32, CRGB(0, 0, 0));
+  uint16_t litPixels[SPARSE_MAX_PIXELS];
+  LEDStripController controller(leds.data(), leds.size(), red, 0, 0, litPixels);
+  controller.SetStripParams(176, 255, GLOBAL_BPM, 255, 40);
+  controller.SetActiveAnimationType(PALETTE_W_GLITTER_FADE_LOW_BPM);
+
+  if (!glitterAt(controller, frameClock, frame, leds, 255)) {
+    return false;
+  }
+
+  // no re-trigger, just the params
+  controller.SetStripParams(176, 60, GLOBAL_BPM, 255, 40);
+  return glitterAt(controller, frameClock, frame, leds, 60);
+}
+
+
+// *********************************************************************************
+//      THE SHOW'S LAYOUT - Installation.h, a fresh InstallationTopology for every run
+// *********************************************************************************
+static const uint8_t RIG_NUM_SEGMENTS = InstallationTopology::GetSegmentCount();
+static const uint16_t RIG_PIXEL_COUNT = InstallationTopology::GetPixelCount();
+
+// every strip's pixels starting black, and a controller for every segment
+static std::unique_ptr<InstallationTopology> newRig() {
+  std::unique_ptr<InstallationTopology> rig(new InstallationTopology());
+  PixelKernels::Fill(rig->GetPixels(), RIG_PIXEL_COUNT, CRGB(0, 0, 0));
+  return rig;
+}
+
+
+struct RigResult {
+  double usPerFrame;
+  double rendersPerFrame;
+  std::vector<uint32_t> frameHashes;    // every pixel and the changed mask, per frame
+};
+
+
+static RigResult runRig(AnimationType type, bool crossfade, const Layer *layer, bool grouped, uint32_t frames) {
+
+  random16_set_seed(RAND16_SEED);
+  hostSetMillis(1);
+
+  FrameClock frameClock;
+  frameClock.Start(micros(), millis());
+  FrameTime frame;
+
+  std::unique_ptr<InstallationTopology> rig = newRig();
+  const CRGB *leds = rig->GetPixels();
+  LEDStripController * const *segments = rig->GetControllers();
+  RenderGroups renderGroups(segments, RIG_NUM_SEGMENTS);
+
+  CRGBPalette16 palettes[2] = { DEFAULT_PALETTE, DEFAULT_PALETTE };
+  for (uint8_t i = 0; i < 16; i++) {
+    palettes[1][i] = palettes[0][15 - i];
+  }
+  uint8_t targetPalette = 0;
+  PaletteCrossfade sharedPalette(palettes[0]);
+
+  for (uint8_t i = 0; i < RIG_NUM_SEGMENTS; i++) {
+    segments[i]->SetStripParams(176, 255, GLOBAL_BPM, 255, 40);
+    segments[i]->SetStripHueIndexBPM(GLOBAL_BPM);
+    if (crossfade) {
+      segments[i]->FollowPalette(&sharedPalette);
+    }
+    if (layer) {
+      segments[i]->SetLayer(0, *layer);
+    }
+    segments[i]->SetActiveAnimationType(type);
+  }
+
+  RigResult result;
+  result.frameHashes.reserve(frames);
+  uint32_t renders = 0;
+  uint32_t timeToRetrigger = millis() + BEAT_MS;
+  std::chrono::nanoseconds elapsed(0);
+
+  for (uint32_t f = 0; f < frames; f++) {
+    hostAdvanceMicros(FRAME_INTERVAL_MICROS);
+    frameClock.Poll(micros(), frame);
+
+    if ((int32_t)(frame.millis - timeToRetrigger) >= 0) {
+      for (uint8_t i = 0; i < RIG_NUM_SEGMENTS; i++) {
+        segments[i]->SetActiveAnimationType(type);
+      }
+      timeToRetrigger += BEAT_MS;
+    }
+
+    if (crossfade && !sharedPalette.IsFading()) {
+      targetPalette ^= 1;
+      sharedPalette.SetTarget(palettes[targetPalette]);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (crossfade) {
+      sharedPalette.Update();
+    }
+
+    uint16_t changedSegments = 0;
+    if (grouped) {
+      changedSegments = renderGroups.Update(frame);
+      renders += renderGroups.GetRenderCount();
+    } else {
+      for (uint8_t i = 0; i < RIG_NUM_SEGMENTS; i++) {
+        if (segments[i]->Update(frame)) {
+          changedSegments |= (1 << i);
+        }
+      }
+      renders += RIG_NUM_SEGMENTS;
+    }
+    elapsed += std::chrono::steady_clock::now() - start;
+
+    uint32_t hash = changedSegments;
+    for (uint16_t i = 0; i < RIG_PIXEL_COUNT; i++) {
+      hash = hash * 31 + ((leds[i].r << 16) | (leds[i].g << 8) | leds[i].b);
+    }
+    result.frameHashes.push_back(hash);
+  }
+
+  result.usPerFrame = (double)elapsed.count() / 1000.0 / frames;
+  result.rendersPerFrame = (double)renders / frames;
+  return result;
+}
+
+
+// run every animation on the show's layout both ways. returns false if render groups changed any frame
+static bool benchRig(bool quick, bool csv) {
+
+  uint32_t frames = quick ? 600 : 6000;
+  bool identical = true;
+
+  if (csv) {
+    printf("animation,frames,us_per_frame,grouped_us_per_frame,renders_per_frame,speedup,identical\n");
+  } else {
+    printf("%-32s %8s %12s %12s %10s %8s %10s\n", "animation", "frames", "us/frame", "grouped", "renders", "speedup", "identical");
+  }
+
+  for (size_t a = 0; a < ARRAY_SIZE(BENCH_ANIMATIONS); a++) {
+    RigResult single = runRig(BENCH_ANIMATIONS[a].type, BENCH_ANIMATIONS[a].crossfade, BENCH_ANIMATIONS[a].layer, false, frames);
+    RigResult grouped = runRig(BENCH_ANIMATIONS[a].type, BENCH_ANIMATIONS[a].crossfade, BENCH_ANIMATIONS[a].layer, true, frames);
+
+    bool same = single.frameHashes == grouped.frameHashes;
+    identical = identical && same;
+    double speedup = grouped.usPerFrame > 0 ? single.usPerFrame / grouped.usPerFrame : 0;
+
+    if (csv) {
+      printf("%s,%u,%.3f,%.3f,%.2f,%.2f,%s\n", BENCH_ANIMATIONS[a].name, (unsigned)frames, single.usPerFrame,
+             grouped.usPerFrame, grouped.rendersPerFrame, speedup, same ? "yes" : "NO");
+    } else {
+      printf("%-32s %8u %12.3f %12.3f %10.2f %7.2fx %10s\n", BENCH_ANIMATIONS[a].name, (unsigned)frames, single.usPerFrame,
+             grouped.usPerFrame, grouped.rendersPerFrame, speedup, same ? "yes" : "NO");
+    }
+  }
+
+  return identical;
+}
+
+
+// PALETTE on the show's layout with its own palette on every segment, so more palettes are drawn from than
+// the registry has tables. returns false if tables were expanded again after the first frame
+static bool benchPaletteTables(bool quick, bool csv) {
+
+  uint32_t frames = quick ? 600 : 6000;
+
+  random16_set_seed(RAND16_SEED);
+  hostSetMillis(1);
+
+  FrameClock frameClock;
+  frameClock.Start(micros(), millis());
+  FrameTime frame;
+
+  // the default palette turned a step further round for each segment
+  CRGBPalette16 defaultPalette = DEFAULT_PALETTE;
+  std::unique_ptr<InstallationTopology> rig = newRig();
+  LEDStripController * const *segments = rig->GetControllers();
+  for (uint8_t i = 0; i < RIG_NUM_SEGMENTS; i++) {
+    CRGBPalette16 palette;
+    for (uint8_t e = 0; e < 16; e++) {
+      palette[e] = defaultPalette[(e + i + 1) % 16];
+    }
+    segments[i]->SetColorPalette(palette);
+    segments[i]->SetStripParams(176, 255, GLOBAL_BPM, 255, 40);
+    segments[i]->SetStripHueIndexBPM(GLOBAL_BPM);
+    segments[i]->SetActiveAnimationType(PALETTE);
+  }
+
+  uint16_t expandsBefore = PaletteRegistry::GetExpandCount();
+  uint16_t uncachedBefore = PaletteRegistry::GetUncachedCount();
+  uint16_t firstFrameExpands = 0;
+  std::chrono::nanoseconds elapsed(0);
+
+  for (uint32_t f = 0; f < frames; f++) {
+    hostAdvanceMicros(FRAME_INTERVAL_MICROS);
+    frameClock.Poll(micros(), frame);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint8_t i = 0; i < RIG_NUM_SEGMENTS; i++) {
+      segments[i]->Update(frame);
+    }
+    elapsed += std::chrono::steady_clock::now() - start;
+
+    if (f == 0) {
+      firstFrameExpands = PaletteRegistry::GetExpandCount() - expandsBefore;
+    }
+  }
+
+  uint16_t expands = PaletteRegistry::GetExpandCount() - expandsBefore;
+  uint16_t uncached = PaletteRegistry::GetUncachedCount() - uncachedBefore;
+  double usPerFrame = (double)elapsed.count() / 1000.0 / frames;
+  bool steady = expands == firstFrameExpands;
+
+  if (csv) {
+    printf("\npalettes,tables,frames,us_per_frame,expands,uncached_draws,steady\n");
+    printf("%u,%u,%u,%.3f,%u,%u,%s\n", (unsigned)RIG_NUM_SEGMENTS, (unsigned)PALETTE_REGISTRY_TABLES, (unsigned)frames,
+           usPerFrame, (unsigned)expands, (unsigned)uncached, steady ? "yes" : "NO");
+  } else {
+    printf("\n%-10s %8s %8s %12s %10s %14s %8s\n", "palettes", "tables", "frames", "us/frame", "expands", "uncached draws", "steady");
+    printf("%-10u %8u %8u %12.3f %10u %14u %8s\n", (unsigned)RIG_NUM_SEGMENTS, (unsigned)PALETTE_REGISTRY_TABLES, (unsigned)frames,
+           usPerFrame, (unsigned)expands, (unsigned)uncached, steady ? "yes" : "NO");
+  }
+
+  return steady;
+}
+
+
+// *********************************************************************************
+//      MAIN
+// *********************************************************************************
+int main(int argc, char **argv) {
+
+  bool quick = false;
+  bool csv = false;
+  bool rig = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    } else if (strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else if (strcmp(argv[i], "--rig") == 0) {
+      rig = true;
+    } else {
+      fprintf(stderr, "usage: %s [--quick] [--csv] [--rig]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (!uploadPrograms()) {
+    fprintf(stderr, "an effect program didn't upload\n");
+    return 1;
+  }
+
+  if (!checkGlitterBrightness()) {
+    fprintf(stderr, "PALETTE_W_GLITTER_FADE_LOW_BPM's glitter didn't follow the strip's brightness\n");
+    return 1;
+  }
+
+  if (rig) {
+    if (!benchRig(quick, csv)) {
+      fprintf(stderr, "render groups changed the output of at least one animation\n");
+      return 1;
+    }
+    if (!benchPaletteTables(quick, csv)) {
+      fprintf(stderr, "palette tables were expanded again every frame\n");
+      return 1;
+    }
+    return 0;
+  }
+
+  // total pixels rendered per (animation, length) pair
+  uint32_t pixelBudget = quick ? (1UL << 16) : (1UL << 22);
+
+  if (csv) {
+    printf("animation,pixels,frames,changed_pct,ns_per_pixel,frames_per_sec,checksum\n");
+  } else {
+    printf("%-32s %6s %8s %9s %12s %14s\n", "animation", "pixels", "frames", "changed%", "ns/pixel", "frames/sec");
+  }
+
+  for (size_t a = 0; a < ARRAY_SIZE(BENCH_ANIMATIONS); a++) {
+    for (uint32_t length = MIN_STRIP_LENGTH; length <= MAX_STRIP_LENGTH; length *= 2) {
+      BenchResult r = runBench(BENCH_ANIMATIONS[a].type, BENCH_ANIMATIONS[a].crossfade, BENCH_ANIMATIONS[a].layer, (uint16_t)length, pixelBudget);
+      double changedPct = 100.0 * r.changedFrames / r.frames;
+
+      if (csv) {
+        printf("%s,%u,%u,%.1f,%.3f,%.1f,%08x\n", BENCH_ANIMATIONS[a].name, (unsigned)length, (unsigned)r.frames,
+               changedPct, r.nsPerPixel, r.framesPerSecond, (unsigned)r.checksum);
+      } else {
+        printf("%-32s %6u %8u %9.1f %12.3f %14.1f\n", BENCH_ANIMATIONS[a].name, (unsigned)length, (unsigned)r.frames,
+               changedPct, r.nsPerPixel, r.framesPerSecond);
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,222 @@
+/*
+  CommandTiming.cpp  - How evenly triggers sent on the beat land on the strips, on the host
+                     -- Max sends a trigger (and a beat marker) every beat. each reaches loop() after a
+                        serial delay that varies, and loop() only reads it between shows
+                     -- runs the loop in Max-Blink-FastLED.ino against the virtual clock, with a 3 x 80
+                        pixel show, and records the frame each trigger takes effect on
+                     -- delay_ms is from Max sending to that frame: the mean, the spread (max - min) and
+                        the standard deviation. spread is what you see as beats that wobble; one frame
+                        (16.7 ms at 60 fps) is the least any mode can do
+                     -- the first WARM_UP_BEATS aren't counted, while a tracker finds the tempo
+
+  usage: command_timing [--quick] [--csv]
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "BeatTracker.h"
+#include "CommandQueue.h"
+#include "WS2812TimingMock.h"
+
+
+static const uint16_t STRIP_LENGTHS[] = { 80, 80, 80 };
+
+// Max to loop(): USB polling, the Max scheduler and the serial buffer
+static const uint32_t SERIAL_DELAY_MICROS = 1000;
+static const uint32_t SERIAL_JITTER_MICROS = 8000;
+
+static const uint32_t IDLE_STEP_MICROS = 50;
+static const uint32_t WARM_UP_BEATS = 8;
+static const uint32_t BEAT_MICROS = 60000000UL / GLOBAL_BPM;
+
+
+// where the beat grid commands are rounded to comes from
+enum BeatGrid {
+  GRID_MARKERS,     // each beat marker as it arrives (CommandQueue::MarkBeat)
+  GRID_TRACKED,     // the beat markers through a BeatTracker, as the sketch does
+  GRID_STEADY       // known exactly
+};
+
+struct TimingMode {
+  const char *name;
+  uint8_t subdivision;
+  uint16_t latencyMillis;
+  BeatGrid grid;
+};
+
+static const TimingMode TIMING_MODES[] = {
+  { "immediate",                0, 0,  GRID_MARKERS },
+  { "latency 20ms",             0, 20, GRID_MARKERS },
+  { "1/4 beat, beat markers",   4, 20, GRID_MARKERS },
+  { "1/4 beat, tracked",        4, 20, GRID_TRACKED },
+  { "1/4 beat, steady grid",    4, 20, GRID_STEADY },
+};
+
+
+struct TimingResult {
+  double meanMillis;
+  double spreadMillis;
+  double stdDevMillis;
+  uint32_t overflows;
+};
+
+
+// something Max sent, on its way to the Teensy
+struct InFlight {
+  uint32_t arriveMicros;
+  bool beatMarker;
+};
+
+
+// *********************************************************************************
+//      RUN THE SKETCH'S LOOP FOR ONE MODE
+// *********************************************************************************
+static TimingResult runMode(const TimingMode &mode, uint32_t beats) {
+
+  random16_set_seed(RAND16_SEED);
+  hostSetMillis(1);
+  uint32_t startMicros = micros();
+
+  WS2812TimingMock wire(STRIP_LENGTHS, ARRAY_SIZE(STRIP_LENGTHS), false);
+  FrameClock frameClock;
+  frameClock.Start(micros(), millis());
+
+  CommandQueue commandQueue;
+  commandQueue.SetTiming(mode.subdivision, (uint32_t)mode.latencyMillis * 1000);
+  BeatTracker beatTracker;
+
+  // the first beat is a little way in, so the loop is already running
+  uint32_t firstBeatMicros = startMicros + 100000;
+  if (mode.grid == GRID_STEADY) {
+    commandQueue.SetBeatGrid(firstBeatMicros + commandQueue.GetLatencyMicros(), BEAT_MICROS);
+  }
+
+  // a marker then a trigger every beat, each with its own delay
+  std::vector<InFlight> inFlight;
+  std::vector<uint32_t> sendMicros;
+  for (uint32_t b = 0; b < beats; b++) {
+    uint32_t sent = firstBeatMicros + b * BEAT_MICROS;
+    if (mode.grid != GRID_STEADY) {
+      inFlight.push_back({ sent + SERIAL_DELAY_MICROS + random16(SERIAL_JITTER_MICROS), true });
+    }
+    inFlight.push_back({ sent + SERIAL_DELAY_MICROS + random16(SERIAL_JITTER_MICROS), false });
+    sendMicros.push_back(sent);
+  }
+
+  std::vector<uint32_t> fireMicros;
+  uint32_t appliedNow = 0;      // triggers that ran as they were read, so take effect on the next frame
+  uint32_t endMicros = firstBeatMicros + (beats + 1) * BEAT_MICROS;
+
+  while ((int32_t)(micros() - endMicros) < 0) {
+
+    // read whatever has arrived, in the order it arrived
+    uint32_t arrivalMicros = micros();
+    for (size_t i = 0; i < inFlight.size(); i++) {
+      if (inFlight[i].arriveMicros == 0 || (int32_t)(inFlight[i].arriveMicros - arrivalMicros) > 0) {
+        continue;
+      }
+      if (inFlight[i].beatMarker && mode.grid == GRID_TRACKED) {
+        // markers without a bpm, so the tracker has to find the tempo too
+        if (beatTracker.OnBeat(arrivalMicros) && beatTracker.HasTempo()) {
+          commandQueue.SetBeatGrid(beatTracker.GetBeatMicros() + commandQueue.GetLatencyMicros(),
+                                   beatTracker.GetPeriodMicros());
+        }
+      } else if (inFlight[i].beatMarker) {
+        commandQueue.MarkBeat(arrivalMicros, GLOBAL_BPM);
+      } else {
+        QueuedCommand queued;
+        queued.legacy = true;
+        queued.legacyByte = 'a';
+        if (!commandQueue.IsScheduling()) {
+          appliedNow++;
+        } else {
+          commandQueue.Schedule(arrivalMicros, queued);   // a full queue drops it, counted in overflows
+        }
+      }
+      inFlight[i].arriveMicros = 0;
+    }
+
+    FrameTime frame;
+    if (!frameClock.Poll(micros(), frame)) {
+      hostAdvanceMicros(IDLE_STEP_MICROS);
+      continue;
+    }
+
+    for (; appliedNow > 0; appliedNow--) {
+      fireMicros.push_back(frame.micros);
+    }
+    QueuedCommand queued;
+    while (commandQueue.PopDue(frame, queued)) {
+      fireMicros.push_back(frame.micros);
+    }
+
+    wire.Show(ALL_OUTPUT_STRIPS, 255);
+  }
+
+  // triggers fire in the order they were sent, a beat apart
+  TimingResult result = { 0, 0, 0, commandQueue.GetOverflowCount() };
+  size_t count = fireMicros.size() < sendMicros.size() ? fireMicros.size() : sendMicros.size();
+  if (count <= WARM_UP_BEATS) {
+    return result;
+  }
+
+  double sum = 0, sumSquares = 0, lowest = 1e18, highest = -1e18;
+  for (size_t i = WARM_UP_BEATS; i < count; i++) {
+    double delayMillis = (int32_t)(fireMicros[i] - sendMicros[i]) / 1000.0;
+    sum += delayMillis;
+    sumSquares += delayMillis * delayMillis;
+    if (delayMillis < lowest) lowest = delayMillis;
+    if (delayMillis > highest) highest = delayMillis;
+  }
+
+  count -= WARM_UP_BEATS;
+  result.meanMillis = sum / count;
+  result.spreadMillis = highest - lowest;
+  result.stdDevMillis = sqrt(sumSquares / count - result.meanMillis * result.meanMillis);
+  return result;
+}
+
+
+// *********************************************************************************
+//      MAIN
+// *********************************************************************************
+int main(int argc, char **argv) {
+
+  bool quick = false;
+  bool csv = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    } else if (strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else {
+      fprintf(stderr, "usage: %s [--quick] [--csv]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  uint32_t beats = quick ? 64 : 1024;
+
+  if (csv) {
+    printf("mode,beats,mean_ms,spread_ms,stddev_ms,overflows\n");
+  } else {
+    printf("%-26s %6s %9s %10s %10s %10s\n", "mode", "beats", "mean_ms", "spread_ms", "stddev_ms", "overflows");
+  }
+
+  for (size_t m = 0; m < ARRAY_SIZE(TIMING_MODES); m++) {
+    TimingResult r = runMode(TIMING_MODES[m], beats);
+
+    if (csv) {
+      printf("%s,%u,%.2f,%.2f,%.2f,%u\n", TIMING_MODES[m].name, (unsigned)beats, r.meanMillis, r.spreadMillis,
+             r.stdDevMillis, (unsigned)r.overflows);
+    } else {
+      printf("%-26s %6u %9.2f %10.2f %10.2f %10u\n", TIMING_MODES[m].name, (unsigned)beats, r.meanMillis,
+             r.spreadMillis, r.stdDevMillis, (unsigned)r.overflows);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,228 @@
+/*
+  KernelBench.cpp  - The whole-strip pixel kernels (PixelKernels.h) against their reference, on the host
+                   -- every kernel of every set runs on random pixels, lengths, start alignments and
+                      colors (0 and 255 a good share of the time) next to PixelKernelsReference, and has to
+                      give the same bytes without touching any either side of the span (exits 1 if not)
+                   -- then ns/pixel for each kernel and set at a few lengths, the shortest about a segment.
+                      the Teensy's SWAR set uses its DSP instructions for add and max, which this can't run:
+                      those two are checked here in their portable form only
+                   -- PixelKernels is the set the sketch is built with (SSE2 here on x86)
+
+  usage: kernel_bench [--quick] [--csv]
+*/
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PixelKernels.h"
+#include "GlobalVariables.h"
+
+
+// *********************************************************************************
+//      KERNEL SETS
+// *********************************************************************************
+enum Kernel : uint8_t {
+  KERNEL_FILL,
+  KERNEL_SCALE,
+  KERNEL_SCALE_GRAY,         // ScaleByColor with every channel the same, as a white envelope does
+  KERNEL_SCALE_BY_COLOR,
+  KERNEL_ADD,
+  KERNEL_MAX,
+  KERNEL_BLEND,
+  KERNEL_SUM_CHANNELS,
+  KERNEL_COUNT
+};
+
+static const char * const KERNEL_NAMES[KERNEL_COUNT] = {
+  "Fill", "Scale", "ScaleByColor gray", "ScaleByColor", "Add", "Max", "Blend", "SumChannels"
+};
+
+struct KernelSet {
+  const char *name;
+  void (*fill)(CRGB *, uint16_t, const CRGB &);
+  void (*scale)(CRGB *, uint16_t, uint8_t);
+  void (*scaleByColor)(CRGB *, uint16_t, const CRGB &);
+  void (*add)(CRGB *, uint16_t, const CRGB &);
+  void (*max)(CRGB *, uint16_t, const CRGB &);
+  void (*blend)(CRGB *, uint16_t, const CRGB &, uint8_t);
+  ChannelSums (*sumChannels)(const CRGB *, uint16_t);
+};
+
+#define KERNEL_SET(name, type) { name, &type::Fill, &type::Scale, &type::ScaleByColor, &type::Add, &type::Max, &type::Blend, &type::SumChannels }
+
+static const KernelSet REFERENCE = KERNEL_SET("reference", PixelKernelsReference);
+
+static const KernelSet KERNEL_SETS[] = {
+  KERNEL_SET("swar", PixelKernelsSWAR),
+#if defined(__SSE2__)
+  KERNEL_SET("sse2", PixelKernelsSSE2),
+#endif
+};
+
+// one kernel of a set on a span. the sums come back through sums, the rest change the pixels
+static void runKernel(const KernelSet &set, Kernel kernel, CRGB *pixels, uint16_t count, const CRGB &color, uint8_t amount,
+                      ChannelSums &sums) {
+
+  switch( kernel ){
+    case KERNEL_FILL:            set.fill( pixels, count, color ); break;
+    case KERNEL_SCALE:           set.scale( pixels, count, amount ); break;
+    case KERNEL_SCALE_GRAY:      set.scaleByColor( pixels, count, CRGB(amount, amount, amount) ); break;
+    case KERNEL_SCALE_BY_COLOR:  set.scaleByColor( pixels, count, color ); break;
+    case KERNEL_ADD:             set.add( pixels, count, color ); break;
+    case KERNEL_MAX:             set.max( pixels, count, color ); break;
+    case KERNEL_BLEND:           set.blend( pixels, count, color, amount ); break;
+    case KERNEL_SUM_CHANNELS:    sums = set.sumChannels( pixels, count ); break;
+    default: break;
+  }
+}
+
+
+// *********************************************************************************
+//      EQUIVALENCE
+// *********************************************************************************
+static const uint16_t MAX_TEST_PIXELS = 1200;     // past the 256 blocks the SWAR sums hold
+static const uint8_t GUARD_BYTES = 16;
+
+// mostly anything, but the ends of the range often, since that's where rounding and saturation go wrong
+static uint8_t randomChannel() {
+  switch( rand() % 8 ){
+    case 0:  return 0;
+    case 1:  return 255;
+    default: return rand() & 0xFF;
+  }
+}
+
+// returns the number of runs that differed from the reference
+static uint32_t checkSet(const KernelSet &set, uint32_t trials, bool csv) {
+
+  static uint8_t expected[MAX_TEST_PIXELS * 3 + 2 * GUARD_BYTES];
+  static uint8_t actual[sizeof(expected)];
+  uint32_t mismatches = 0;
+
+  for( uint32_t t = 0; t < trials; t++ ){
+    Kernel kernel = (Kernel)(t % KERNEL_COUNT);
+    uint16_t count = rand() % 4 == 0 ? rand() % 40 : rand() % MAX_TEST_PIXELS;
+    uint8_t offset = rand() % GUARD_BYTES;
+    CRGB color = CRGB( randomChannel(), randomChannel(), randomChannel() );
+    uint8_t amount = randomChannel();
+
+    for( size_t i = 0; i < sizeof(expected); i++ ){
+      expected[i] = actual[i] = randomChannel();
+    }
+
+    ChannelSums expectedSums = { 0, 0, 0 }, actualSums = { 0, 0, 0 };
+    runKernel( REFERENCE, kernel, (CRGB *)(expected + offset), count, color, amount, expectedSums );
+    runKernel( set, kernel, (CRGB *)(actual + offset), count, color, amount, actualSums );
+
+    if( memcmp(expected, actual, sizeof(expected)) != 0 || expectedSums.r != actualSums.r ||
+        expectedSums.g != actualSums.g || expectedSums.b != actualSums.b ){
+      if( !csv && mismatches < 10 ){
+        printf("%s %s differs: %u pixels at byte %u, color %u %u %u, amount %u\n", set.name, KERNEL_NAMES[kernel],
+               (unsigned)count, (unsigned)offset, color.r, color.g, color.b, (unsigned)amount);
+      }
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+
+// *********************************************************************************
+//      TIMING
+// *********************************************************************************
+static double timeKernel(const KernelSet &set, Kernel kernel, uint16_t count, uint32_t passes) {
+
+  static CRGB pixels[4096];
+  for( uint16_t i = 0; i < count; i++ ){
+    pixels[i] = CRGB( rand() & 0xFF, rand() & 0xFF, rand() & 0xFF );
+  }
+
+  // the amounts keep the pixels from going to black or white, so no pass is different from the next
+  ChannelSums sums = { 0, 0, 0 };
+  uint32_t checksum = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for( uint32_t p = 0; p < passes; p++ ){
+    runKernel( set, kernel, pixels, count, CRGB(40, 200, 90), p & 1 ? 254 : 128, sums );
+    checksum += sums.r + pixels[p % count].g;
+  }
+  std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+  // so the work can't be dropped
+  if( checksum == 0xFFFFFFFF ){
+    printf(" ");
+  }
+  return (double)elapsed.count() / passes / count;
+}
+
+
+// *********************************************************************************
+//      MAIN
+// *********************************************************************************
+int main(int argc, char **argv) {
+
+  bool quick = false;
+  bool csv = false;
+  for( int i = 1; i < argc; i++ ){
+    if( strcmp(argv[i], "--quick") == 0 ){
+      quick = true;
+    } else if( strcmp(argv[i], "--csv") == 0 ){
+      csv = true;
+    } else {
+      fprintf(stderr, "usage: %s [--quick] [--csv]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  srand(22);
+  uint32_t trials = quick ? 4000 : 40000;
+  uint32_t mismatches = 0;
+  for( size_t s = 0; s < ARRAY_SIZE(KERNEL_SETS); s++ ){
+    uint32_t off = checkSet( KERNEL_SETS[s], trials, csv );
+    if( !csv ){
+      printf("%s: %u runs, %u differ from the reference\n", KERNEL_SETS[s].name, (unsigned)trials, (unsigned)off);
+    }
+    mismatches += off;
+  }
+
+  static const uint16_t LENGTHS[] = { 30, 150, 1024 };
+  uint32_t pixelsPerLength = quick ? 200000 : 4000000;
+
+  if( csv ){
+    printf("kernel,pixels,set,ns_per_pixel\n");
+  } else {
+    printf("\n%-20s %8s", "kernel", "pixels");
+    printf(" %12s", REFERENCE.name);
+    for( size_t s = 0; s < ARRAY_SIZE(KERNEL_SETS); s++ ){
+      printf(" %12s", KERNEL_SETS[s].name);
+    }
+    printf("    (ns/pixel)\n");
+  }
+
+  for( uint8_t k = 0; k < KERNEL_COUNT; k++ ){
+    for( size_t l = 0; l < ARRAY_SIZE(LENGTHS); l++ ){
+      uint32_t passes = pixelsPerLength / LENGTHS[l];
+      double referenceNs = timeKernel( REFERENCE, (Kernel)k, LENGTHS[l], passes );
+
+      if( csv ){
+        printf("%s,%u,%s,%.3f\n", KERNEL_NAMES[k], (unsigned)LENGTHS[l], REFERENCE.name, referenceNs);
+      } else {
+        printf("%-20s %8u %12.3f", KERNEL_NAMES[k], (unsigned)LENGTHS[l], referenceNs);
+      }
+      for( size_t s = 0; s < ARRAY_SIZE(KERNEL_SETS); s++ ){
+        double ns = timeKernel( KERNEL_SETS[s], (Kernel)k, LENGTHS[l], passes );
+        if( csv ){
+          printf("%s,%u,%s,%.3f\n", KERNEL_NAMES[k], (unsigned)LENGTHS[l], KERNEL_SETS[s].name, ns);
+        } else {
+          printf(" %12.3f", ns);
+        }
+      }
+      if( !csv ){
+        printf("\n");
+      }
+    }
+  }
+
+  return mismatches == 0 ? 0 : 1;
+}
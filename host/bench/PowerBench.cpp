@@ -0,0 +1,262 @@
+/*
+  PowerBench.cpp  - The power limiter on the show's layout, on the host
+                  -- runs a few animations over the strips and segments of Installation.h, every strip on
+                     one supply with POWER_SUPPLY_MILLIAMPS (or --budget), through the same per-frame steps
+                     as the sketch
+                  -- demand is what the frame would draw unlimited, draw what it draws once limited (both
+                     from the pixels themselves, not the limiter's estimate). headroom is the least the
+                     budget was left with, limited the share of frames dimmed
+                  -- error is how far the segments' running loads were from the pixels, the worst frame.
+                     they're allowed to be high (fades round down) but never low: over is frames whose
+                     real draw went past the budget, which should never happen (exits 1 if any do)
+                  -- ns/frame is adding up the segments' loads vs a pass over every pixel
+
+  usage: power_bench [--quick] [--csv] [--budget mA]
+*/
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory>
+#include <string.h>
+
+#include "Installation.h"
+#include "PowerLimiter.h"
+
+
+// *********************************************************************************
+//      THE SHOW'S LAYOUT - Installation.h, with every strip on supply 0
+// *********************************************************************************
+static const uint8_t STRIP_COUNT = InstallationTopology::GetStripCount();
+static const uint8_t SEGMENT_COUNT = InstallationTopology::GetSegmentCount();
+static const uint16_t PIXEL_COUNT = InstallationTopology::GetPixelCount();
+
+static const uint8_t ONE_SUPPLY[STRIP_COUNT] = { 0 };
+
+// the Max patch re-triggers one-shot animations on every quarter note
+static const uint32_t BEAT_MS = 60000UL / GLOBAL_BPM;
+
+
+// *********************************************************************************
+//      SCENES
+// *********************************************************************************
+// every pixel full white, the most the strips can ask for
+static const AnimationType FULL_WHITE = (AnimationType)FIRST_CUSTOM_ANIMATION;
+
+static void renderFullWhite(LEDStripController &strip) {
+  strip.SetStripHSV(CRGB(255, 255, 255));
+}
+
+static const Layer SPARKLE_LAYER = { LAYER_SPARKLE, BLEND_ADD, 255, 160, CRGB(0, 0, 0) };
+static const Layer GLITTER_MAX_LAYER = { LAYER_GLITTER, BLEND_MAX, 255, 120, CRGB(255, 255, 255) };
+static const Layer ENVELOPE_LAYER = { LAYER_ENVELOPE, BLEND_MULTIPLY, 200, GLOBAL_BPM, CRGB(255, 255, 255) };
+
+struct Scene {
+  AnimationType type;
+  const char *name;
+  const Layer *layer;
+};
+
+static const Scene SCENES[] = {
+  { FULL_WHITE,       "FULL_WHITE",          nullptr },
+  { SOLID_COLOR,      "SOLID_COLOR",         nullptr },
+  { FADE_OUT_BPM,     "FADE_OUT_BPM",        nullptr },
+  { PALETTE,          "PALETTE",             nullptr },
+  { PALETTE,          "PALETTE_ENVELOPE",    &ENVELOPE_LAYER },
+  { CONFETTI,         "CONFETTI",            nullptr },
+  { CONFETTI,         "CONFETTI_SPARKLE",    &SPARKLE_LAYER },
+  { SINELON,          "SINELON_GLITTER_MAX", &GLITTER_MAX_LAYER },
+};
+
+
+struct SceneResult {
+  uint32_t frames;
+  uint32_t maxDemandMilliamps;
+  uint32_t maxDrawMilliamps;
+  int32_t minHeadroomMilliamps;
+  uint32_t limitedFrames;
+  uint32_t overFrames;
+  double maxErrorPercent;
+  double incrementalNsPerFrame;
+  double fullPassNsPerFrame;
+};
+
+
+// what the strips really draw, from their pixels
+static uint32_t exactMilliamps(const uint32_t *loads, uint8_t scale) {
+
+  uint64_t load = 0;
+  for (uint8_t i = 0; i < STRIP_COUNT; i++) {
+    load += loads[i];
+  }
+  uint8_t brightness = scale8(255, scale);
+  return PIXEL_COUNT * POWER_IDLE_MILLIAMPS + (uint32_t)((load * brightness + 65024) / 65025);
+}
+
+
+// a backend that only keeps the scales it's given
+class ScaleOnlyBackend : public OutputBackend
+{
+  public:
+    uint8_t Show(uint8_t stripMask, uint8_t brightness) { (void)brightness; return stripMask; }
+    uint8_t GetStripCount() const { return STRIP_COUNT; }
+};
+
+
+static SceneResult runScene(const Scene &scene, uint16_t budget, uint32_t frames) {
+
+  random16_set_seed(RAND16_SEED);
+  hostSetMillis(1);
+
+  FrameClock frameClock;
+  frameClock.Start(micros(), millis());
+  FrameTime frame;
+
+  // a fresh installation for every scene, starting black
+  std::unique_ptr<InstallationTopology> installation(new InstallationTopology());
+  PixelKernels::Fill(installation->GetPixels(), PIXEL_COUNT, CRGB(0, 0, 0));
+
+  LEDStripController * const *segments = installation->GetControllers();
+  for (uint8_t i = 0; i < SEGMENT_COUNT; i++) {
+    segments[i]->SetStripParams(176, 255, GLOBAL_BPM, 255, 40);
+    segments[i]->SetStripHueIndexBPM(GLOBAL_BPM);
+    if (scene.layer) {
+      segments[i]->SetLayer(0, *scene.layer);
+    }
+    segments[i]->SetActiveAnimationType(scene.type);
+  }
+  RenderGroups renderGroups(segments, SEGMENT_COUNT);
+
+  ScaleOnlyBackend backend;
+  PowerLimiter powerLimiter(installation->GetStripLengths(), ONE_SUPPLY, STRIP_COUNT);
+  powerLimiter.SetBudget(0, budget);
+
+  SceneResult result;
+  memset(&result, 0, sizeof(result));
+  result.frames = frames;
+  result.minHeadroomMilliamps = budget;
+
+  uint32_t timeToRetrigger = millis() + BEAT_MS;
+  std::chrono::nanoseconds incrementalElapsed(0);
+  std::chrono::nanoseconds fullPassElapsed(0);
+
+  for (uint32_t f = 0; f < frames; f++) {
+    hostAdvanceMicros(FRAME_INTERVAL_MICROS);
+    frameClock.Poll(micros(), frame);
+
+    if ((int32_t)(frame.millis - timeToRetrigger) >= 0) {
+      for (uint8_t i = 0; i < SEGMENT_COUNT; i++) {
+        segments[i]->SetActiveAnimationType(scene.type);
+      }
+      timeToRetrigger += BEAT_MS;
+    }
+
+    renderGroups.Update(frame);
+
+    // the sketch's way: add up what the segments kept as they drew
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint32_t loads[STRIP_COUNT] = { 0 };
+    for (uint8_t i = 0; i < SEGMENT_COUNT; i++) {
+      loads[InstallationTopology::GetSegmentStrip(i)] += segments[i]->GetPowerLoad();
+    }
+    powerLimiter.Update(loads, 255, backend);
+    incrementalElapsed += std::chrono::steady_clock::now() - start;
+
+    // a pass over every pixel, to compare against
+    start = std::chrono::steady_clock::now();
+    uint32_t exactLoads[STRIP_COUNT];
+    for (uint8_t i = 0; i < STRIP_COUNT; i++) {
+      exactLoads[i] = PixelsPowerLoad(installation->GetStripPixels(i), installation->GetStripLengths()[i]);
+    }
+    fullPassElapsed += std::chrono::steady_clock::now() - start;
+
+    uint64_t load = 0, exactLoad = 0;
+    for (uint8_t i = 0; i < STRIP_COUNT; i++) {
+      load += loads[i];
+      exactLoad += exactLoads[i];
+    }
+    if (exactLoad != 0 || load != 0) {
+      double error = exactLoad ? 100.0 * ((double)load - (double)exactLoad) / (double)exactLoad : 100.0;
+      if (fabs(error) > fabs(result.maxErrorPercent)) {
+        result.maxErrorPercent = error;
+      }
+    }
+
+    uint32_t demand = exactMilliamps(exactLoads, 255);
+    uint32_t draw = exactMilliamps(exactLoads, powerLimiter.GetScale(0));
+    if (demand > result.maxDemandMilliamps) {
+      result.maxDemandMilliamps = demand;
+    }
+    if (draw > result.maxDrawMilliamps) {
+      result.maxDrawMilliamps = draw;
+    }
+    if ((int32_t)budget - (int32_t)draw < result.minHeadroomMilliamps) {
+      result.minHeadroomMilliamps = (int32_t)budget - (int32_t)draw;
+    }
+    if (powerLimiter.GetScale(0) != 255) {
+      result.limitedFrames++;
+    }
+    if (draw > budget) {
+      result.overFrames++;
+    }
+  }
+
+  result.incrementalNsPerFrame = (double)incrementalElapsed.count() / frames;
+  result.fullPassNsPerFrame = (double)fullPassElapsed.count() / frames;
+  return result;
+}
+
+
+int main(int argc, char **argv) {
+
+  bool quick = false;
+  bool csv = false;
+  uint16_t budget = POWER_SUPPLY_MILLIAMPS;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    } else if (strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+      budget = (uint16_t)atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--quick] [--csv] [--budget mA]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  AnimationDefinition fullWhite = { nullptr, renderFullWhite, 20, false, RENDER_SHARED };
+  LEDStripController::RegisterAnimation(FULL_WHITE, fullWhite);
+
+  uint32_t frames = quick ? 600 : 6000;
+  uint32_t overFrames = 0;
+
+  if (csv) {
+    printf("scene,budget_ma,max_demand_ma,max_draw_ma,min_headroom_ma,limited_pct,over_frames,max_error_pct,incremental_ns,full_pass_ns\n");
+  } else {
+    printf("%u strips, %u pixels on one %u mA supply, %u frames per scene\n\n", (unsigned)STRIP_COUNT, (unsigned)PIXEL_COUNT,
+           budget, frames);
+    printf("%-20s %10s %10s %10s %8s %5s %8s %14s %13s\n",
+           "scene", "demand mA", "draw mA", "headroom", "limited", "over", "error", "incremental ns", "full pass ns");
+  }
+
+  for (size_t s = 0; s < ARRAY_SIZE(SCENES); s++) {
+    SceneResult result = runScene(SCENES[s], budget, frames);
+    overFrames += result.overFrames;
+    double limitedPercent = 100.0 * result.limitedFrames / result.frames;
+
+    if (csv) {
+      printf("%s,%u,%u,%u,%d,%.1f,%u,%.2f,%.0f,%.0f\n", SCENES[s].name, budget, result.maxDemandMilliamps,
+             result.maxDrawMilliamps, result.minHeadroomMilliamps, limitedPercent, result.overFrames,
+             result.maxErrorPercent, result.incrementalNsPerFrame, result.fullPassNsPerFrame);
+    } else {
+      printf("%-20s %10u %10u %10d %7.1f%% %5u %7.2f%% %14.0f %13.0f\n", SCENES[s].name, result.maxDemandMilliamps,
+             result.maxDrawMilliamps, result.minHeadroomMilliamps, limitedPercent, result.overFrames,
+             result.maxErrorPercent, result.incrementalNsPerFrame, result.fullPassNsPerFrame);
+    }
+  }
+
+  return overFrames ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+/*
+  RamReport.cpp  - What the sketch's globals take in RAM, per segment and shared, on the host
+                 -- runs after every build (see CMakeLists.txt), so a change that grows a controller shows
+                    up without flashing anything
+                 -- sizes are the host's, where pointers are 8 bytes. on the Teensy they're 4, so every
+                    figure here is an upper bound for it (the Arduino build's "Global variables use" line
+                    is the exact total)
+                 -- per segment is the controller plus its place in LedStripControllerArray and
+                    segmentPhysicalStrip. shared is everything there's one of however many segments there
+                    are, pixels included. the totals are for the show's 12 segments and for 50
+
+  usage: ram_report [--csv]
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "LEDStripController.h"
+#include "PaletteRegistry.h"
+#include "PaletteCrossfade.h"
+#include "RenderGroups.h"
+#include "CommandQueue.h"
+#include "SerialProtocol.h"
+#include "BeatTracker.h"
+#include "FrameClock.h"
+#include "PowerLimiter.h"
+#include "SessionCapture.h"
+#include "PixelStream.h"
+#include "Telemetry.h"
+#include "SerialLog.h"
+#include "EffectVM.h"
+#include "Presets.h"
+#include "Installation.h"
+
+
+static const int PLANNED_SEGMENTS[] = { 12, 50 };
+static const int RIG_PIXELS = ALEN + BLEN + CLEN;
+
+struct RamLine {
+  const char *name;
+  size_t bytes;
+};
+
+static const RamLine PER_SEGMENT[] = {
+  { "LEDStripController",                sizeof(LEDStripController) },
+  { "  of which its palette handle",     sizeof(PaletteRef) },
+  { "  of which its layers",             sizeof(Layer) * MAX_LAYERS },
+  { "  of which its lit pixel list",     sizeof(uint16_t *) },
+  { "controller array pointer",          sizeof(LEDStripController *) },
+  { "physical strip index",              sizeof(uint8_t) },
+};
+
+static const RamLine SHARED[] = {
+  { "PaletteRegistry",                   sizeof(PaletteRegistry) },
+  { "PaletteCrossfade",                  sizeof(PaletteCrossfade) },
+  { "RenderGroups",                      sizeof(RenderGroups) },
+  { "CommandQueue",                      sizeof(CommandQueue) },
+  { "SerialProtocol",                    sizeof(SerialProtocol) },
+  { "BeatTracker",                       sizeof(BeatTracker) },
+  { "FrameClock",                        sizeof(FrameClock) },
+  { "PowerLimiter",                      sizeof(PowerLimiter) },
+  { "SessionRecorder",                   sizeof(SessionRecorder) },
+#if defined(SESSION_CAPTURE_BYTES)
+  { "session capture buffer",            SESSION_CAPTURE_BYTES },
+#endif
+#if defined(PIXEL_STREAM_ENABLED)
+  { "PixelStream",                       sizeof(PixelStream) },
+  { "pixel stream back buffer",          sizeof(CRGB) * RIG_PIXELS },
+#endif
+#if defined(TELEMETRY_ENABLED)
+  { "Telemetry",                         sizeof(Telemetry) },
+#endif
+#if defined(EFFECT_PROGRAMS_ENABLED)
+  { "effect program slots",              sizeof(EffectProgram) * EFFECT_PROGRAM_SLOTS },
+  { "effect program upload buffer",      sizeof(EffectInstruction) * EFFECT_MAX_INSTRUCTIONS },
+#endif
+  { "preset edit slots",                 sizeof(Preset) * PRESET_EDIT_SLOTS },
+  { "preset key index",                  PRESET_LAST_KEY - PRESET_FIRST_KEY + 1 },
+#if LOG_LEVEL > LOG_LEVEL_NONE
+  { "SerialLog",                         sizeof(SerialLog) },
+#endif
+  { "pixels",                            sizeof(CRGB) * RIG_PIXELS },
+  { "lit pixel lists",                   sizeof(uint16_t) * TopologyLitPixelOffset(INSTALLATION_SEGMENTS, ARRAY_SIZE(INSTALLATION_SEGMENTS)) },
+};
+
+
+// the lines that start with "  of which" are already in the line above them
+static size_t Total(const RamLine *lines, size_t count) {
+
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (strncmp(lines[i].name, "  ", 2) != 0) {
+      total += lines[i].bytes;
+    }
+  }
+  return total;
+}
+
+
+int main(int argc, char **argv) {
+
+  bool csv = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else {
+      fprintf(stderr, "usage: %s [--csv]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  size_t perSegment = Total(PER_SEGMENT, ARRAY_SIZE(PER_SEGMENT));
+  size_t shared = Total(SHARED, ARRAY_SIZE(SHARED));
+
+  if (csv) {
+    printf("section,name,bytes\n");
+    for (size_t i = 0; i < ARRAY_SIZE(PER_SEGMENT); i++) {
+      printf("segment,%s,%zu\n", PER_SEGMENT[i].name, PER_SEGMENT[i].bytes);
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(SHARED); i++) {
+      printf("shared,%s,%zu\n", SHARED[i].name, SHARED[i].bytes);
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(PLANNED_SEGMENTS); i++) {
+      printf("total,%d segments,%zu\n", PLANNED_SEGMENTS[i], shared + perSegment * PLANNED_SEGMENTS[i]);
+    }
+    return 0;
+  }
+
+  printf("static RAM on the host (pointers are %zu bytes here, 4 on the Teensy)\n\n", sizeof(void *));
+
+  printf("per segment\n");
+  for (size_t i = 0; i < ARRAY_SIZE(PER_SEGMENT); i++) {
+    printf("  %-36s %7zu\n", PER_SEGMENT[i].name, PER_SEGMENT[i].bytes);
+  }
+  printf("  %-36s %7zu\n\n", "total", perSegment);
+
+  printf("shared (palette registry: %d slots, %d tables)\n", PALETTE_REGISTRY_SLOTS, PALETTE_REGISTRY_TABLES);
+  for (size_t i = 0; i < ARRAY_SIZE(SHARED); i++) {
+    printf("  %-36s %7zu\n", SHARED[i].name, SHARED[i].bytes);
+  }
+  printf("  %-36s %7zu\n\n", "total", shared);
+
+  for (size_t i = 0; i < ARRAY_SIZE(PLANNED_SEGMENTS); i++) {
+    printf("%3d segments %33zu%s\n", PLANNED_SEGMENTS[i], shared + perSegment * PLANNED_SEGMENTS[i],
+           PLANNED_SEGMENTS[i] > MAX_RENDER_SEGMENTS ? "   (more than MAX_RENDER_SEGMENTS and a 16 bit group mask can address)" : "");
+  }
+
+  return 0;
+}
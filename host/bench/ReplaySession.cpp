@@ -0,0 +1,362 @@
+/*
+  ReplaySession.cpp  - Records a scripted show through the real sketch, and replays captures of shows
+                     -- builds Max-Blink-FastLED.ino itself against the shim, so setup() and loop() are
+                        exactly what runs on the Teensy. the Teensy's strips are a WS2812TimingMock
+                     -- record: plays Max for a while (beats, single character commands and binary frames,
+                        each with its own serial delay, and the odd stall that makes the clock skip frames),
+                        then writes the capture SERIAL_OP_DUMP_SESSION would have sent
+                     -- play: replays a capture on the virtual clock, as fast as it renders, and prints the
+                        hash of every frame (the same FNV-1a the sketch prints with REPLAY_CAPTURE) and how
+                        many frames/sec the host managed. the hash matches record's for the same capture
+                     -- --trace prints each frame's running hash, so two runs can be diffed for the first
+                        frame that differs
+                     -- --telemetry prints what SERIAL_OP_TELEMETRY answers at the end (record sends it
+                        the query over serial, like Max would). the times in it are the host's own
+                     -- header: writes a capture out as ReplayCapture.h, for REPLAY_CAPTURE on the Teensy
+
+  usage: replay_session record out.bin [--seconds N] [--seed N] [--trace] [--telemetry]
+         replay_session play in.bin [--trace] [--telemetry]
+         replay_session header in.bin > Max-Blink-FastLED/ReplayCapture.h
+*/
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "WS2812TimingMock.h"
+#include "Max-Blink-FastLED.ino"
+
+
+// Max to loop(): USB polling, the Max scheduler and the serial buffer
+static const uint32_t SERIAL_DELAY_MICROS = 1000;
+static const uint32_t SERIAL_JITTER_MICROS = 8000;
+
+static const uint32_t IDLE_STEP_MICROS = 50;
+static const uint32_t BEAT_MICROS = 60000000UL / 120;
+
+// every so often loop() is held up long enough for the frame clock to skip frames
+static const uint32_t STALL_EVERY_BEATS = 20;
+static const uint32_t STALL_MICROS = 45000;
+
+// single character commands the script picks from (see handleLegacyCommand)
+static const char LEGACY_COMMANDS[] = "oAgGCSstxyzpP0123456789RDd";
+
+
+// the script's own random numbers, so it never moves the sketch's random16 seed
+static uint32_t scriptRandomState = 1;
+
+static uint32_t scriptRandom(uint32_t range) {
+  scriptRandomState ^= scriptRandomState << 13;
+  scriptRandomState ^= scriptRandomState >> 17;
+  scriptRandomState ^= scriptRandomState << 5;
+  return scriptRandomState % range;
+}
+
+
+// something Max sent, on its way to the Teensy
+struct InFlight {
+  uint32_t arriveMicros;
+  uint8_t bytes[SERIAL_MAX_PAYLOAD + 3];
+  uint8_t length;
+};
+
+static void sendLegacy(std::vector<InFlight> &inFlight, uint32_t sentMicros, char legacyByte) {
+  InFlight message;
+  message.arriveMicros = sentMicros + SERIAL_DELAY_MICROS + scriptRandom(SERIAL_JITTER_MICROS);
+  message.bytes[0] = legacyByte;
+  message.length = 1;
+  inFlight.push_back(message);
+}
+
+static void sendCommand(std::vector<InFlight> &inFlight, uint32_t sentMicros, const SerialCommand &command) {
+  InFlight message;
+  message.arriveMicros = sentMicros + SERIAL_DELAY_MICROS + scriptRandom(SERIAL_JITTER_MICROS);
+  message.length = SerialProtocol::EncodeFrame(command, message.bytes);
+  inFlight.push_back(message);
+}
+
+
+// what Max does on beat b: a beat marker every beat ('B' on the downbeat), and now and then a new look
+static void scriptBeat(std::vector<InFlight> &inFlight, uint32_t sentMicros, uint32_t b) {
+
+  sendLegacy(inFlight, sentMicros, b % 4 == 0 ? 'B' : 'b');
+
+  SerialCommand command;
+  switch (b % 16) {
+    case 3:
+    case 11:
+      sendLegacy(inFlight, sentMicros, LEGACY_COMMANDS[scriptRandom(sizeof(LEGACY_COMMANDS) - 1)]);
+      break;
+
+    case 6:
+      command.opcode = SERIAL_OP_PRESET;
+      command.groupMask = 1 + scriptRandom(0xFFFF);
+      command.animation = scriptRandom(2) ? CONFETTI : PALETTE_W_GLITTER_FADE_LOW_BPM;
+      command.hue = scriptRandom(256);
+      command.bpm = 60 + scriptRandom(100);
+      command.brightnessLow = 40;
+      command.paletteIndex = scriptRandom(10);
+      sendCommand(inFlight, sentMicros, command);
+      break;
+
+    case 9:
+      command.opcode = SERIAL_OP_LAYER;
+      command.groupMask = SERIAL_ALL_GROUPS;
+      command.layer = { scriptRandom(2) ? LAYER_GLITTER : LAYER_SPARKLE, BLEND_ADD, 255, 120, CRGB(255, 255, 255) };
+      sendCommand(inFlight, sentMicros, command);
+      break;
+
+    case 14:
+      command.opcode = SERIAL_OP_TIMING;
+      command.subdivision = b % 32 == 14 ? 4 : 0;
+      command.latencyMillis = 20;
+      sendCommand(inFlight, sentMicros, command);
+      break;
+  }
+}
+
+
+static void printHash(uint32_t frame, uint32_t hash) {
+  printf("%u,%08x\n", (unsigned)frame, (unsigned)hash);
+}
+
+
+// *********************************************************************************
+//      RECORD
+// *********************************************************************************
+static int record(const char *path, uint32_t seconds, uint16_t seed, bool trace, bool telemetry) {
+
+  hostSetMillis(1);
+  random16_set_seed(seed);
+  scriptRandomState = seed ? seed : 1;
+
+  setup();
+  WS2812TimingMock wire(installation.GetStripLengths(), NUM_PHYSICAL_STRIPS, false);
+  outputBackend = &wire;
+
+  uint32_t firstBeatMicros = micros() + 100000;
+  uint32_t beats = seconds * 1000000ULL / BEAT_MICROS;
+
+  std::vector<InFlight> inFlight;
+  for (uint32_t b = 0; b < beats; b++) {
+    scriptBeat(inFlight, firstBeatMicros + b * BEAT_MICROS, b);
+  }
+
+  std::vector<uint32_t> hashes;    // the running hash after each frame
+  uint32_t hash = SESSION_HASH_SEED;
+  uint32_t nextStallMicros = firstBeatMicros + STALL_EVERY_BEATS * BEAT_MICROS;
+  uint32_t endMicros = firstBeatMicros + (beats + 1) * BEAT_MICROS;
+
+  while ((int32_t)(micros() - endMicros) < 0) {
+
+    // whatever has arrived goes into the serial port, in the order it arrived
+    for (size_t i = 0; i < inFlight.size(); i++) {
+      if (inFlight[i].length == 0 || (int32_t)(inFlight[i].arriveMicros - micros()) > 0) {
+        continue;
+      }
+      if (hostSerialPush(inFlight[i].bytes, inFlight[i].length)) {
+        inFlight[i].length = 0;
+      }
+    }
+
+    uint32_t framesBefore = frameClock.GetFrameCount();
+    loop();
+
+    if (frameClock.GetFrameCount() == framesBefore) {
+      hostAdvanceMicros(IDLE_STEP_MICROS);
+      continue;
+    }
+
+    for (uint8_t i = 0; i < NUM_PHYSICAL_STRIPS; i++) {
+      hash = HashPixels(hash, installation.GetStripPixels(i), installation.GetStripLengths()[i]);
+    }
+    hashes.push_back(hash);
+    if (trace) {
+      printHash(hashes.size() - 1, hash);
+    }
+
+    if ((int32_t)(micros() - nextStallMicros) >= 0) {
+      hostAdvanceMicros(STALL_MICROS);
+      nextStallMicros += STALL_EVERY_BEATS * BEAT_MICROS;
+    }
+  }
+
+  // what Max would get back from SERIAL_OP_DUMP_SESSION
+  dumpSession();
+  SessionReplay capture(sessionRecorder.GetData(), sessionRecorder.GetLength());
+  if (!capture.IsValid() || capture.GetFrameCount() == 0) {
+    fprintf(stderr, "nothing was recorded\n");
+    return 1;
+  }
+
+  FILE *out = fopen(path, "wb");
+  if (!out || fwrite(sessionRecorder.GetData(), 1, sessionRecorder.GetLength(), out) != sessionRecorder.GetLength()) {
+    fprintf(stderr, "can't write %s\n", path);
+    return 1;
+  }
+  fclose(out);
+
+  if (sessionRecorder.IsFull()) {
+    fprintf(stderr, "capture filled up: %u messages after frame %u weren't recorded\n",
+            (unsigned)sessionRecorder.GetDroppedCount(), (unsigned)capture.GetFrameCount());
+  }
+
+  printf("recorded %u frames (%u skipped by the clock), %u bytes\n", (unsigned)capture.GetFrameCount(),
+         (unsigned)frameClock.GetMissedFrameCount(), (unsigned)sessionRecorder.GetLength());
+  printf("hash %08x\n", (unsigned)hashes[capture.GetFrameCount() - 1]);
+
+  // ask the way Max does, and let the answer (and its "K") through to stdout
+  if (telemetry) {
+    SerialCommand query;
+    query.opcode = SERIAL_OP_TELEMETRY;
+    uint8_t frame[SERIAL_MAX_PAYLOAD + 3];
+    hostSerialPush(frame, SerialProtocol::EncodeFrame(query, frame));
+    fflush(stdout);
+    hostSerialEcho(true);
+    loop();
+    hostSerialEcho(false);
+  }
+  return 0;
+}
+
+
+// *********************************************************************************
+//      PLAY
+// *********************************************************************************
+static bool readCapture(const char *path, std::vector<uint8_t> &data) {
+
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    fprintf(stderr, "can't read %s\n", path);
+    return false;
+  }
+
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+    data.insert(data.end(), buffer, buffer + n);
+  }
+  fclose(in);
+  return true;
+}
+
+
+static int play(const char *path, bool trace, bool telemetry) {
+
+  std::vector<uint8_t> data;
+  if (!readCapture(path, data)) {
+    return 1;
+  }
+
+  SessionReplay replay(data.data(), data.size());
+  if (!replay.IsValid()) {
+    fprintf(stderr, "%s isn't a capture this build can play\n", path);
+    return 1;
+  }
+
+  hostSetMillis(1);
+  sessionReplay = &replay;
+  setup();
+  WS2812TimingMock wire(installation.GetStripLengths(), NUM_PHYSICAL_STRIPS, false);
+  outputBackend = &wire;
+
+  // the pacing is on the virtual clock, so stepping it a frame each loop renders as fast as the host can
+  auto start = std::chrono::steady_clock::now();
+  while (replay.GetFramesPlayed() < replay.GetFrameCount()) {
+    hostAdvanceMicros(FRAME_INTERVAL_MICROS);
+    loop();
+    if (trace) {
+      printHash(replay.GetFramesPlayed() - 1, replay.GetHash());
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("played %u frames, %.0f frames/sec (%.1fx real time)\n", (unsigned)replay.GetFramesPlayed(),
+         replay.GetFramesPlayed() / seconds, replay.GetFramesPlayed() / seconds / FRAMES_PER_SECOND);
+  printf("hash %08x\n", (unsigned)replay.GetHash());
+
+  // loop() is replaying rather than listening, so ask directly
+  if (telemetry) {
+    fflush(stdout);
+    hostSerialEcho(true);
+    sendTelemetry(false);
+    hostSerialEcho(false);
+  }
+  return 0;
+}
+
+
+// *********************************************************************************
+//      HEADER
+// *********************************************************************************
+static int header(const char *path) {
+
+  std::vector<uint8_t> data;
+  if (!readCapture(path, data)) {
+    return 1;
+  }
+
+  SessionReplay replay(data.data(), data.size());
+  if (!replay.IsValid()) {
+    fprintf(stderr, "%s isn't a capture this build can play\n", path);
+    return 1;
+  }
+
+  printf("// written by replay_session from %s: %u frames. played back with REPLAY_CAPTURE\n", path,
+         (unsigned)replay.GetFrameCount());
+  printf("const uint8_t replayCapture[] = {");
+  for (size_t i = 0; i < data.size(); i++) {
+    printf("%s0x%02x,", i % 16 == 0 ? "\n  " : " ", data[i]);
+  }
+  printf("\n};\n");
+  return 0;
+}
+
+
+// *********************************************************************************
+//      MAIN
+// *********************************************************************************
+static int usage(const char *name) {
+  fprintf(stderr, "usage: %s record out.bin [--seconds N] [--seed N] [--trace] [--telemetry]\n"
+                  "       %s play in.bin [--trace] [--telemetry]\n"
+                  "       %s header in.bin\n", name, name, name);
+  return 1;
+}
+
+
+int main(int argc, char **argv) {
+
+  if (argc < 3) {
+    return usage(argv[0]);
+  }
+
+  uint32_t seconds = 60;
+  uint16_t seed = RAND16_SEED;
+  bool trace = false;
+  bool telemetry = false;
+  for (int i = 3; i < argc; i++) {
+    if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--trace") == 0) {
+      trace = true;
+    } else if (strcmp(argv[i], "--telemetry") == 0) {
+      telemetry = true;
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  if (strcmp(argv[1], "record") == 0) {
+    return record(argv[2], seconds, seed, trace, telemetry);
+  }
+  if (strcmp(argv[1], "play") == 0) {
+    return play(argv[2], trace, telemetry);
+  }
+  if (strcmp(argv[1], "header") == 0) {
+    return header(argv[2]);
+  }
+  return usage(argv[0]);
+}
@@ -0,0 +1,842 @@
+/*
+  ShowSim.cpp  - Plays a show script (or a made-up set) through the sketch on the virtual clock, as fast as the
+                 host renders, and draws it as a strip chart
+               -- builds Max-Blink-FastLED.ino itself against the shim, like replay_session, so setup(), loop()
+                  and the command handling are the Teensy's. nothing sleeps: the clock jumps straight to
+                  the next frame or the next message from the script, whichever is first
+               -- a script is one timed message to the Teensy a line (see SCRIPT below). --generate makes
+                  up a set instead: tempo changes, beats, and a new look or palette every few bars
+               -- --chart writes the pixels as PNG strip charts, one row a frame: every physical strip's
+                  pixels left to right in strip order, a gray column between strips, time going down.
+                  --chart-rows rows to an image (a minute's worth to start with), --every keeps every nth
+                  frame. these are the pixels as rendered, before the global brightness and the power limit
+               -- then checks it: frames the clock missed, frames Max sent that the sketch threw out,
+                  commands the queue dropped (any of those exits 1), how long the longest stretch of black
+                  was, how often the power limiter stepped in, the host's slowest frame, and the hash of
+                  every frame (the same as replay_session's). --expect exits 1 if the hash isn't the one given
+
+  usage: show_sim (script.txt | --generate MINUTES) [--seconds N] [--seed N] [--chart prefix]
+                  [--chart-rows N] [--every N] [--expect HASH]
+
+  SCRIPT - one message a line, from "#" to the end of a line is a comment
+
+    TIME tempo BPM [keys]       beats from here on (0 stops them). keys sends 'B' on the downbeat and 'b' on
+                                the others like the Max patch does, otherwise SERIAL_OP_BEAT frames
+    TIME key CHARACTERS         single character commands, one after another
+    TIME trigger MASK ANIMATION
+    TIME params MASK HUE BRIGHTNESS BPM HIGH LOW
+    TIME palette MASK INDEX [CROSSFADE_FRAMES]
+    TIME hue_index MASK BPM
+    TIME frame OPCODE MASK [BYTE ...]   any frame (see SerialProtocol.h), the fields after the group mask as bytes
+    TIME end                    the show stops here (otherwise a bar after the last message)
+
+    TIME is seconds, m:ss or h:mm:ss (fractions allowed), or +seconds after the line before.
+    MASK is a group mask or "all". ANIMATION is a number or a name (ALL_OFF ... DDT_EXPERIMENTAL,
+    SPATIAL_WIPE ... SPATIAL_NOISE). numbers can be hex (0x..)
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "WS2812TimingMock.h"
+#include "Max-Blink-FastLED.ino"
+
+
+// the gray between strips on the chart
+static const uint8_t CHART_DIVIDER = 64;
+
+
+// *********************************************************************************
+//      THE SCRIPT - everything the Teensy will be sent, and when
+// *********************************************************************************
+struct ScriptMessage {
+  uint64_t atMicros;
+  uint8_t bytes[SERIAL_MAX_PAYLOAD + 3];
+  uint8_t length;
+};
+
+struct TempoChange {
+  uint64_t atMicros;
+  uint16_t bpm;
+  bool keys;
+};
+
+struct Script {
+  std::vector<ScriptMessage> messages;
+  std::vector<TempoChange> tempos;
+  uint64_t endMicros = 0;
+  bool hasEnd = false;
+};
+
+struct AnimationName {
+  const char *name;
+  AnimationType type;
+};
+
+static const AnimationName ANIMATION_NAMES[] = {
+  { "ALL_OFF",                         ALL_OFF },
+  { "SOLID_COLOR",                     SOLID_COLOR },
+  { "FADE_OUT_BPM",                    FADE_OUT_BPM },
+  { "FADE_LOW_BPM",                    FADE_LOW_BPM },
+  { "FADE_IN_OUT_BPM",                 FADE_IN_OUT_BPM },
+  { "PALETTE",                         PALETTE },
+  { "PALETTE_W_GLITTER",               PALETTE_W_GLITTER },
+  { "PALETTE_FADE_LOW_BPM",            PALETTE_FADE_LOW_BPM },
+  { "PALETTE_W_GLITTER_FADE_LOW_BPM",  PALETTE_W_GLITTER_FADE_LOW_BPM },
+  { "CONFETTI",                        CONFETTI },
+  { "SINELON",                         SINELON },
+  { "SINEPULSE",                       SINEPULSE },
+  { "DDT_EXPERIMENTAL",                DDT_EXPERIMENTAL },
+  { "SPATIAL_WIPE",                    SpatialEffects::GetAnimation(SPATIAL_WIPE) },
+  { "SPATIAL_RADIAL_PULSE",            SpatialEffects::GetAnimation(SPATIAL_RADIAL_PULSE) },
+  { "SPATIAL_SWEEP",                   SpatialEffects::GetAnimation(SPATIAL_SWEEP) },
+  { "SPATIAL_NOISE",                   SpatialEffects::GetAnimation(SPATIAL_NOISE) },
+};
+
+
+static bool parseNumber(const std::string &word, uint32_t &value) {
+  char *end;
+  value = strtoul(word.c_str(), &end, 0);
+  return !word.empty() && *end == '\0';
+}
+
+static bool parseMask(const std::string &word, uint32_t &mask) {
+  if (word == "all") {
+    mask = SERIAL_ALL_GROUPS;
+    return true;
+  }
+  return parseNumber(word, mask) && mask <= 0xFFFF;
+}
+
+static bool parseAnimation(const std::string &word, uint32_t &animation) {
+  for (size_t i = 0; i < ARRAY_SIZE(ANIMATION_NAMES); i++) {
+    if (word == ANIMATION_NAMES[i].name) {
+      animation = ANIMATION_NAMES[i].type;
+      return true;
+    }
+  }
+  return parseNumber(word, animation) && animation < 256;
+}
+
+// seconds, m:ss or h:mm:ss
+static bool parseTime(const std::string &word, uint64_t &micros) {
+  double seconds = 0;
+  size_t start = 0;
+  while (true) {
+    size_t colon = word.find(':', start);
+    std::string part = word.substr(start, colon == std::string::npos ? std::string::npos : colon - start);
+    char *end;
+    double value = strtod(part.c_str(), &end);
+    if (part.empty() || *end != '\0' || value < 0) {
+      return false;
+    }
+    seconds = seconds * 60 + value;
+    if (colon == std::string::npos) {
+      break;
+    }
+    start = colon + 1;
+  }
+  micros = (uint64_t)(seconds * 1000000.0 + 0.5);
+  return true;
+}
+
+static void addCommand(Script &script, uint64_t atMicros, const SerialCommand &command) {
+  ScriptMessage message;
+  message.atMicros = atMicros;
+  message.length = SerialProtocol::EncodeFrame(command, message.bytes);
+  script.messages.push_back(message);
+}
+
+static void addLegacy(Script &script, uint64_t atMicros, uint8_t legacyByte) {
+  ScriptMessage message;
+  message.atMicros = atMicros;
+  message.bytes[0] = legacyByte;
+  message.length = 1;
+  script.messages.push_back(message);
+}
+
+
+// one line of the script. returns false (with why in error) if it doesn't make sense
+static bool parseLine(const std::string &line, uint64_t &lastMicros, Script &script, std::string &error) {
+
+  std::vector<std::string> words;
+  size_t i = 0;
+  while (i < line.size() && line[i] != '#') {
+    if (isspace((unsigned char)line[i])) {
+      i++;
+      continue;
+    }
+    size_t start = i;
+    while (i < line.size() && line[i] != '#' && !isspace((unsigned char)line[i])) {
+      i++;
+    }
+    words.push_back(line.substr(start, i - start));
+  }
+  if (words.empty()) {
+    return true;
+  }
+
+  uint64_t at;
+  if (words[0][0] == '+') {
+    if (!parseTime(words[0].substr(1), at)) {
+      error = "bad time";
+      return false;
+    }
+    at += lastMicros;
+  } else if (!parseTime(words[0], at)) {
+    error = "bad time";
+    return false;
+  }
+  if (at < lastMicros) {
+    error = "goes back in time";
+    return false;
+  }
+  lastMicros = at;
+
+  if (words.size() < 2) {
+    error = "no command";
+    return false;
+  }
+  const std::string &verb = words[1];
+  size_t argCount = words.size() - 2;
+  uint32_t a[10] = {};
+
+  SerialCommand command;
+  if (verb == "end" && argCount == 0) {
+    script.endMicros = at;
+    script.hasEnd = true;
+  }
+  else if (verb == "tempo" && (argCount == 1 || (argCount == 2 && words[3] == "keys")) && parseNumber(words[2], a[0]) && a[0] < 1000) {
+    script.tempos.push_back({ at, (uint16_t)a[0], argCount == 2 });
+  }
+  else if (verb == "key" && argCount == 1) {
+    for (char c : words[2]) {
+      addLegacy(script, at, c);
+    }
+  }
+  else if (verb == "trigger" && argCount == 2 && parseMask(words[2], a[0]) && parseAnimation(words[3], a[1])) {
+    command.opcode = SERIAL_OP_TRIGGER;
+    command.groupMask = a[0];
+    command.animation = (AnimationType)a[1];
+    addCommand(script, at, command);
+  }
+  else if (verb == "params" && argCount == 6 && parseMask(words[2], a[0]) && parseNumber(words[3], a[1]) &&
+           parseNumber(words[4], a[2]) && parseNumber(words[5], a[3]) && parseNumber(words[6], a[4]) && parseNumber(words[7], a[5])) {
+    command.opcode = SERIAL_OP_PARAMS;
+    command.groupMask = a[0];
+    command.hue = a[1];
+    command.brightness = a[2];
+    command.bpm = a[3];
+    command.brightnessHigh = a[4];
+    command.brightnessLow = a[5];
+    addCommand(script, at, command);
+  }
+  else if (verb == "palette" && (argCount == 2 || argCount == 3) && parseMask(words[2], a[0]) && parseNumber(words[3], a[1]) &&
+           (argCount == 2 || parseNumber(words[4], a[2]))) {
+    command.opcode = argCount == 3 ? SERIAL_OP_PALETTE_FADE : SERIAL_OP_PALETTE;
+    command.groupMask = a[0];
+    command.paletteIndex = a[1];
+    command.crossfadeFrames = a[2];
+    addCommand(script, at, command);
+  }
+  else if (verb == "hue_index" && argCount == 2 && parseMask(words[2], a[0]) && parseNumber(words[3], a[1])) {
+    command.opcode = SERIAL_OP_HUE_INDEX_BPM;
+    command.groupMask = a[0];
+    command.hueIndexBPM = a[1];
+    addCommand(script, at, command);
+  }
+  else if (verb == "frame" && argCount >= 2 && argCount - 2 <= SERIAL_MAX_PAYLOAD - 3 && parseNumber(words[2], a[0]) &&
+           parseMask(words[3], a[1])) {
+    // laid out by hand, so a frame the sketch doesn't know can be sent too
+    ScriptMessage message;
+    message.atMicros = at;
+    uint8_t *p = message.bytes;
+    p[0] = SERIAL_FRAME_SYNC;
+    p[1] = argCount + 1;
+    p[2] = a[0];
+    p[3] = a[1] & 0xFF;
+    p[4] = a[1] >> 8;
+    for (size_t w = 4; w < words.size(); w++) {
+      uint32_t value;
+      if (!parseNumber(words[w], value) || value > 255) {
+        error = "bad byte";
+        return false;
+      }
+      p[w + 1] = value;
+    }
+    uint8_t crc = 0;
+    for (uint8_t b = 1; b < p[1] + 2; b++) {
+      crc = SerialProtocol::Crc8(crc, p[b]);
+    }
+    p[p[1] + 2] = crc;
+    message.length = p[1] + 3;
+    script.messages.push_back(message);
+  }
+  else {
+    error = "don't understand \"" + verb + "\" with those arguments";
+    return false;
+  }
+  return true;
+}
+
+
+static bool readScript(const char *path, Script &script) {
+
+  FILE *in = fopen(path, "r");
+  if (!in) {
+    fprintf(stderr, "can't read %s\n", path);
+    return false;
+  }
+
+  char buffer[512];
+  uint32_t lineNumber = 0;
+  uint64_t lastMicros = 0;
+  bool ok = true;
+  while (fgets(buffer, sizeof(buffer), in)) {
+    lineNumber++;
+    std::string error;
+    if (!parseLine(buffer, lastMicros, script, error)) {
+      fprintf(stderr, "%s:%u: %s\n", path, (unsigned)lineNumber, error.c_str());
+      ok = false;
+    }
+  }
+  fclose(in);
+  return ok;
+}
+
+
+// the made-up set's own random numbers, so it never moves the sketch's random16 seed
+static uint32_t generateRandomState = 1;
+
+static uint32_t generateRandom(uint32_t range) {
+  generateRandomState ^= generateRandomState << 13;
+  generateRandomState ^= generateRandomState >> 17;
+  generateRandomState ^= generateRandomState << 5;
+  return generateRandomState % range;
+}
+
+// a set the way the Max patch plays one: a new tempo every few minutes, with the beats sent as 'B' and
+// 'b' (which pulse every segment) about half the time, a new look every other bar and a new palette
+// every eight. made as script lines, so it goes through the same parser a script does
+static void generateSet(uint32_t minutes, uint16_t seed, Script &script) {
+
+  static const char LOOKS[] = "pPgGCSstxiNAEO";
+  static const char PALETTE_KEYS[] = "y0123456789zRDd";
+
+  generateRandomState = seed ? seed : 1;
+  uint64_t endMicros = (uint64_t)minutes * 60000000ULL;
+  uint64_t lastMicros = 0;
+  std::string error;
+
+  uint64_t sectionMicros = 0;
+  while (sectionMicros < endMicros) {
+    uint16_t bpm = 100 + generateRandom(41);
+    uint64_t beatMicros = 60000000ULL / bpm;
+    uint64_t sectionEnd = std::min<uint64_t>(endMicros, sectionMicros + (3 + generateRandom(4)) * 60000000ULL);
+
+    char line[64];
+    snprintf(line, sizeof(line), "%.6f tempo %u%s", sectionMicros / 1e6, (unsigned)bpm, generateRandom(2) ? " keys" : "");
+    parseLine(line, lastMicros, script, error);
+
+    uint32_t beat = 0;
+    for (uint64_t at = sectionMicros + beatMicros / 2; at < sectionEnd; at += beatMicros, beat++) {
+      if (beat % 8 == 0) {
+        snprintf(line, sizeof(line), "%.6f key %c", at / 1e6, LOOKS[generateRandom(sizeof(LOOKS) - 1)]);
+        parseLine(line, lastMicros, script, error);
+      }
+      if (beat % 32 == 16) {
+        snprintf(line, sizeof(line), "%.6f key %c", at / 1e6, PALETTE_KEYS[generateRandom(sizeof(PALETTE_KEYS) - 1)]);
+        parseLine(line, lastMicros, script, error);
+      }
+    }
+    sectionMicros = sectionEnd;
+  }
+
+  script.endMicros = endMicros;
+  script.hasEnd = true;
+}
+
+
+// the beats each tempo line asks for, up to the end of the show, merged in with everything else
+static void addBeats(Script &script) {
+
+  for (size_t t = 0; t < script.tempos.size(); t++) {
+    const TempoChange &tempo = script.tempos[t];
+    uint64_t until = t + 1 < script.tempos.size() ? script.tempos[t + 1].atMicros : script.endMicros;
+    if (tempo.bpm == 0) {
+      continue;
+    }
+
+    uint64_t beatMicros = 60000000ULL / tempo.bpm;
+    uint32_t beat = 0;
+    for (uint64_t at = tempo.atMicros; at < until; at += beatMicros, beat++) {
+      if (tempo.keys) {
+        addLegacy(script, at, beat % 4 == 0 ? 'B' : 'b');
+      } else {
+        SerialCommand command;
+        command.opcode = SERIAL_OP_BEAT;
+        command.bpm = tempo.bpm;
+        addCommand(script, at, command);
+      }
+    }
+  }
+
+  // a beat and a key at the same moment go beat first, the way Max sends them
+  std::stable_sort(script.messages.begin(), script.messages.end(),
+                   [](const ScriptMessage &a, const ScriptMessage &b) { return a.atMicros < b.atMicros; });
+}
+
+
+// *********************************************************************************
+//      PNG - stored as fixed Huffman deflate. each row is filtered against the one above it, so the
+//            frames that look like the last one are mostly zeros, which the matcher turns into long runs
+// *********************************************************************************
+static uint32_t crc32Table[256];
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t length) {
+  if (!crc32Table[1]) {
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++) {
+        c = c & 1 ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+      }
+      crc32Table[n] = c;
+    }
+  }
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc = crc32Table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+class BitWriter {
+  public:
+    explicit BitWriter(std::vector<uint8_t> &out) : _out(out) {}
+
+    // value's low count bits, first bit first
+    void Put(uint32_t value, uint8_t count) {
+      _bits |= value << _count;
+      _count += count;
+      while (_count >= 8) {
+        _out.push_back(_bits & 0xFF);
+        _bits >>= 8;
+        _count -= 8;
+      }
+    }
+
+    // a Huffman code, which deflate sends from its top bit down
+    void PutCode(uint32_t code, uint8_t length) {
+      uint32_t reversed = 0;
+      for (uint8_t i = 0; i < length; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+      }
+      Put(reversed, length);
+    }
+
+    void Flush() {
+      if (_count) {
+        _out.push_back(_bits & 0xFF);
+      }
+      _bits = 0;
+      _count = 0;
+    }
+
+  private:
+    std::vector<uint8_t> &_out;
+    uint32_t _bits = 0;
+    uint8_t _count = 0;
+};
+
+static const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+                                            4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// the fixed code for a literal, a length symbol (257 - 285) or the end of the block (256)
+static void putSymbol(BitWriter &bits, uint16_t symbol) {
+  if (symbol < 144) {
+    bits.PutCode(0x30 + symbol, 8);
+  } else if (symbol < 256) {
+    bits.PutCode(0x190 + symbol - 144, 9);
+  } else if (symbol < 280) {
+    bits.PutCode(symbol - 256, 7);
+  } else {
+    bits.PutCode(0xC0 + symbol - 280, 8);
+  }
+}
+
+static void putMatch(BitWriter &bits, uint16_t length, uint16_t distance) {
+  uint8_t l = 28;
+  while (LENGTH_BASE[l] > length) {
+    l--;
+  }
+  putSymbol(bits, 257 + l);
+  bits.Put(length - LENGTH_BASE[l], LENGTH_EXTRA[l]);
+
+  uint8_t d = 29;
+  while (DISTANCE_BASE[d] > distance) {
+    d--;
+  }
+  bits.PutCode(d, 5);
+  bits.Put(distance - DISTANCE_BASE[d], DISTANCE_EXTRA[d]);
+}
+
+// a zlib stream of data: one fixed Huffman block, greedy matches found through a hash of the next three bytes
+static void deflate(const std::vector<uint8_t> &data, std::vector<uint8_t> &out) {
+
+  static const uint32_t WINDOW = 32768;
+  static const uint16_t MAX_MATCH = 258;
+  static const uint8_t HASH_BITS = 15;
+  std::vector<int32_t> head(1 << HASH_BITS, -1);
+
+  out.push_back(0x78);
+  out.push_back(0x01);
+
+  BitWriter bits(out);
+  bits.Put(1, 1);     // the last block
+  bits.Put(1, 2);     // fixed Huffman codes
+
+  size_t n = data.size();
+  auto hashAt = [&](size_t i) { return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << HASH_BITS) - 1); };
+
+  size_t i = 0;
+  while (i < n) {
+    uint16_t length = 0;
+    size_t distance = 0;
+    if (i + 2 < n) {
+      uint32_t h = hashAt(i);
+      int32_t candidate = head[h];
+      head[h] = i;
+      if (candidate >= 0 && i - candidate <= WINDOW) {
+        size_t most = std::min<size_t>(MAX_MATCH, n - i);
+        while (length < most && data[candidate + length] == data[i + length]) {
+          length++;
+        }
+        distance = i - candidate;
+      }
+    }
+
+    if (length >= 3) {
+      putMatch(bits, length, distance);
+      // short matches are worth indexing inside, long runs aren't
+      if (length < 32) {
+        for (size_t j = i + 1; j < i + length && j + 2 < n; j++) {
+          head[hashAt(j)] = j;
+        }
+      }
+      i += length;
+    } else {
+      putSymbol(bits, data[i]);
+      i++;
+    }
+  }
+  putSymbol(bits, 256);
+  bits.Flush();
+
+  uint32_t a = 1, b = 0;
+  for (size_t j = 0; j < n; j++) {
+    a = (a + data[j]) % 65521;
+    b = (b + a) % 65521;
+  }
+  uint32_t adler = (b << 16) | a;
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back((adler >> shift) & 0xFF);
+  }
+}
+
+static void putChunk(FILE *out, const char *type, const std::vector<uint8_t> &data) {
+  uint8_t header[8] = { (uint8_t)(data.size() >> 24), (uint8_t)(data.size() >> 16), (uint8_t)(data.size() >> 8), (uint8_t)data.size(),
+                        (uint8_t)type[0], (uint8_t)type[1], (uint8_t)type[2], (uint8_t)type[3] };
+  uint32_t crc = crc32(crc32(0, header + 4, 4), data.data(), data.size());
+  uint8_t trailer[4] = { (uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc };
+  fwrite(header, 1, 8, out);
+  fwrite(data.data(), 1, data.size(), out);
+  fwrite(trailer, 1, 4, out);
+}
+
+
+// rows of RGB pixels, written out as numbered PNGs
+class StripChart {
+  public:
+    StripChart(const char *prefix, uint32_t width, uint32_t rowsPerImage)
+      : _prefix(prefix), _width(width), _rowsPerImage(rowsPerImage), _previous(width * 3, 0), _row(width * 3) {}
+
+    uint32_t GetImageCount() const { return _images; }
+    uint64_t GetBytesWritten() const { return _bytes; }
+
+    // the row the caller fills in before AddRow()
+    uint8_t *Row() { return _row.data(); }
+
+    bool AddRow() {
+      _filtered.push_back(2);    // "up": each byte less the one above it
+      for (size_t i = 0; i < _row.size(); i++) {
+        _filtered.push_back(_row[i] - _previous[i]);
+      }
+      _previous.swap(_row);
+      return ++_rows < _rowsPerImage || Flush();
+    }
+
+    bool Flush() {
+      if (_rows == 0) {
+        return true;
+      }
+
+      char path[512];
+      snprintf(path, sizeof(path), "%s%04u.png", _prefix, (unsigned)_images);
+      FILE *out = fopen(path, "wb");
+      if (!out) {
+        fprintf(stderr, "can't write %s\n", path);
+        return false;
+      }
+
+      static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+      fwrite(SIGNATURE, 1, 8, out);
+
+      std::vector<uint8_t> chunk = { (uint8_t)(_width >> 24), (uint8_t)(_width >> 16), (uint8_t)(_width >> 8), (uint8_t)_width,
+                                     (uint8_t)(_rows >> 24), (uint8_t)(_rows >> 16), (uint8_t)(_rows >> 8), (uint8_t)_rows,
+                                     8, 2, 0, 0, 0 };     // 8 bit RGB, not interlaced
+      putChunk(out, "IHDR", chunk);
+
+      chunk.clear();
+      deflate(_filtered, chunk);
+      putChunk(out, "IDAT", chunk);
+      putChunk(out, "IEND", std::vector<uint8_t>());
+
+      _bytes += ftell(out);
+      fclose(out);
+
+      // every image stands on its own, so its first row is against black
+      std::fill(_previous.begin(), _previous.end(), 0);
+      _filtered.clear();
+      _rows = 0;
+      _images++;
+      return true;
+    }
+
+  private:
+    const char *_prefix;
+    uint32_t _width;
+    uint32_t _rowsPerImage;
+    std::vector<uint8_t> _previous;
+    std::vector<uint8_t> _row;
+    std::vector<uint8_t> _filtered;
+    uint32_t _rows = 0;
+    uint32_t _images = 0;
+    uint64_t _bytes = 0;
+};
+
+
+// *********************************************************************************
+//      RUN
+// *********************************************************************************
+struct SimOptions {
+  const char *scriptPath = nullptr;
+  uint32_t generateMinutes = 0;
+  uint32_t seconds = 0;
+  uint16_t seed = RAND16_SEED;
+  const char *chartPrefix = nullptr;
+  uint32_t chartRows = 60 * FRAMES_PER_SECOND;
+  uint32_t every = 1;
+  bool expectHash = false;
+  uint32_t expectedHash = 0;
+};
+
+static void printDuration(const char *label, uint64_t micros) {
+  uint64_t seconds = micros / 1000000;
+  printf("%-22s %u:%02u:%02u.%03u\n", label, (unsigned)(seconds / 3600), (unsigned)(seconds / 60 % 60), (unsigned)(seconds % 60),
+         (unsigned)(micros / 1000 % 1000));
+}
+
+static int run(const SimOptions &options) {
+
+  Script script;
+  if (options.scriptPath) {
+    if (!readScript(options.scriptPath, script)) {
+      return 1;
+    }
+  } else {
+    generateSet(options.generateMinutes, options.seed, script);
+  }
+
+  if (options.seconds) {
+    script.endMicros = (uint64_t)options.seconds * 1000000ULL;
+  } else if (!script.hasEnd) {
+    uint64_t last = script.messages.empty() ? 0 : script.messages.back().atMicros;
+    for (const TempoChange &tempo : script.tempos) {
+      last = std::max(last, tempo.atMicros);
+    }
+    script.endMicros = last + 4 * 60000000ULL / GLOBAL_BPM;
+  }
+  addBeats(script);
+
+  hostSetMillis(1);
+  random16_set_seed(options.seed);
+  setup();
+  WS2812TimingMock wire(installation.GetStripLengths(), NUM_PHYSICAL_STRIPS, false);
+  outputBackend = &wire;
+
+  // the chart is every strip side by side, a divider column between each
+  uint32_t chartWidth = NUM_PHYSICAL_STRIPS - 1;
+  for (uint8_t s = 0; s < NUM_PHYSICAL_STRIPS; s++) {
+    chartWidth += installation.GetStripLengths()[s];
+  }
+  StripChart *chart = options.chartPrefix ? new StripChart(options.chartPrefix, chartWidth, options.chartRows) : nullptr;
+
+  const uint16_t emptyRoom = serialProtocol.Room();
+  uint64_t now = 0;                      // since setup(), without micros()'s 71 minute rollover
+  uint32_t lastMicros = micros();
+  uint64_t nextFrameMicros = 0;          // unknown until the first frame
+  size_t nextMessage = 0;
+
+  uint32_t frames = 0;
+  uint32_t hash = SESSION_HASH_SEED;
+  uint32_t darkFrames = 0, darkRun = 0, longestDarkRun = 0;
+  std::chrono::nanoseconds slowestFrame(0), renderTime(0);
+
+  auto start = std::chrono::steady_clock::now();
+  while (now < script.endMicros) {
+
+    // what's due goes into the serial port. the shim holds 4 kB, anything past that waits a loop
+    while (nextMessage < script.messages.size() && script.messages[nextMessage].atMicros <= now &&
+           hostSerialPush(script.messages[nextMessage].bytes, script.messages[nextMessage].length)) {
+      nextMessage++;
+    }
+
+    uint64_t loopMicros = now;
+    uint32_t framesBefore = frameClock.GetFrameCount();
+    auto loopStart = std::chrono::steady_clock::now();
+    loop();
+    std::chrono::nanoseconds loopTime = std::chrono::steady_clock::now() - loopStart;
+
+    // the wire mock moves the clock on while a frame goes out
+    now += (uint32_t)(micros() - lastMicros);
+    lastMicros = micros();
+
+    if (frameClock.GetFrameCount() != framesBefore) {
+      nextFrameMicros = loopMicros + FRAME_INTERVAL_MICROS;
+      renderTime += loopTime;
+      slowestFrame = std::max(slowestFrame, loopTime);
+
+      bool dark = true;
+      uint8_t *row = chart && frames % options.every == 0 ? chart->Row() : nullptr;
+      for (size_t s = 0; s < NUM_PHYSICAL_STRIPS; s++) {
+        const CRGB *pixels = installation.GetStripPixels(s);
+        uint16_t length = installation.GetStripLengths()[s];
+        hash = HashPixels(hash, pixels, length);
+        for (uint16_t i = 0; i < length && dark; i++) {
+          dark = !pixels[i];
+        }
+        if (row) {
+          memcpy(row, pixels, length * sizeof(CRGB));
+          row += length * sizeof(CRGB);
+          if (s + 1 < NUM_PHYSICAL_STRIPS) {
+            memset(row, CHART_DIVIDER, sizeof(CRGB));
+            row += sizeof(CRGB);
+          }
+        }
+      }
+      if (row && !chart->AddRow()) {
+        return 1;
+      }
+
+      darkRun = dark ? darkRun + 1 : 0;
+      darkFrames += dark;
+      longestDarkRun = std::max(longestDarkRun, darkRun);
+      frames++;
+    }
+
+    // more of what arrived still to decode, so no time passes
+    if (Serial.available() || serialProtocol.Room() != emptyRoom) {
+      continue;
+    }
+
+    uint64_t wakeMicros = nextFrameMicros > now ? nextFrameMicros : now + 50;
+    if (nextMessage < script.messages.size()) {
+      wakeMicros = std::min(wakeMicros, std::max(script.messages[nextMessage].atMicros, now + 1));
+    }
+    hostAdvanceMicros(wakeMicros - now);
+    now = wakeMicros;
+    lastMicros = micros();
+  }
+  double hostSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  if (chart && !chart->Flush()) {
+    return 1;
+  }
+
+  uint32_t missed = frameClock.GetMissedFrameCount();
+  uint32_t badFrames = serialProtocol.GetBadFrameCount();
+  uint32_t overflows = serialProtocol.GetOverflowCount() + commandQueue.GetOverflowCount();
+
+  printDuration("show", script.endMicros);
+  printf("%-22s %u (%u missed by the clock)\n", "frames", (unsigned)frames, (unsigned)missed);
+  printf("%-22s %u\n", "messages sent", (unsigned)nextMessage);
+  printf("%-22s %.2f s, %.0f frames/sec (%.0fx real time)\n", "host time", hostSeconds, frames / hostSeconds,
+         script.endMicros / 1e6 / hostSeconds);
+  printf("%-22s %.1f us mean, %.1f us slowest\n", "host frame", frames ? renderTime.count() / 1000.0 / frames : 0.0,
+         slowestFrame.count() / 1000.0);
+  printf("%-22s %u frames (%.1f%%), longest %.2f s\n", "black", (unsigned)darkFrames, frames ? darkFrames * 100.0 / frames : 0.0,
+         longestDarkRun / (double)FRAMES_PER_SECOND);
+  printf("%-22s %u frames\n", "power limited", (unsigned)powerLimiter.GetLimitedFrameCount());
+  printf("%-22s %u bad frames, %u overflows\n", "serial", (unsigned)badFrames, (unsigned)overflows);
+  if (chart) {
+    printf("%-22s %u images, %llu bytes\n", "chart", (unsigned)chart->GetImageCount(), (unsigned long long)chart->GetBytesWritten());
+    delete chart;
+  }
+  printf("hash %08x\n", (unsigned)hash);
+
+  if (options.expectHash && hash != options.expectedHash) {
+    fprintf(stderr, "hash %08x, expected %08x\n", (unsigned)hash, (unsigned)options.expectedHash);
+    return 1;
+  }
+  return missed == 0 && badFrames == 0 && overflows == 0 ? 0 : 1;
+}
+
+
+// *********************************************************************************
+//      MAIN
+// *********************************************************************************
+static int usage(const char *name) {
+  fprintf(stderr, "usage: %s (script.txt | --generate MINUTES) [--seconds N] [--seed N] [--chart prefix]\n"
+                  "       %*s [--chart-rows N] [--every N] [--expect HASH]\n", name, (int)strlen(name), "");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+
+  SimOptions options;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--generate") == 0 && hasValue) {
+      options.generateMinutes = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--seconds") == 0 && hasValue) {
+      options.seconds = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+      options.seed = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--chart") == 0 && hasValue) {
+      options.chartPrefix = argv[++i];
+    } else if (strcmp(argv[i], "--chart-rows") == 0 && hasValue) {
+      options.chartRows = std::max(1UL, strtoul(argv[++i], nullptr, 10));
+    } else if (strcmp(argv[i], "--every") == 0 && hasValue) {
+      options.every = std::max(1UL, strtoul(argv[++i], nullptr, 10));
+    } else if (strcmp(argv[i], "--expect") == 0 && hasValue) {
+      options.expectHash = true;
+      options.expectedHash = strtoul(argv[++i], nullptr, 16);
+    } else if (argv[i][0] != '-' && !options.scriptPath) {
+      options.scriptPath = argv[i];
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  if (!options.scriptPath == !options.generateMinutes) {
+    return usage(argv[0]);
+  }
+  return run(options);
+}
@@ -0,0 +1,120 @@
+/*
+  ShowTiming.cpp  - Show latency and frame rate ceilings for different strip layouts, on the host
+                  -- sends every strip on every frame (the worst case) through WS2812TimingMock,
+                     sequentially and in parallel, for 1 to 8 strips of 16 to 600 pixels
+                  -- show_us is one frame's wire time and max_fps the most frames/sec that leaves;
+                     the frame clock then runs at FRAMES_PER_SECOND to show what actually happens:
+                     the frame rate reached, the share of late frames and the frames skipped
+
+  usage: show_timing [--quick] [--csv]
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FrameClock.h"
+#include "WS2812TimingMock.h"
+
+
+static const uint8_t STRIP_COUNTS[] = { 1, 2, 3, 4, 8 };
+static const uint16_t STRIP_LENGTHS[] = { 16, 80, 150, 300, 600 };
+
+// how far the virtual clock moves while the loop waits for the next frame
+static const uint32_t IDLE_STEP_MICROS = 50;
+
+
+struct TimingResult {
+  uint32_t showMicros;
+  double framesPerSecond;
+  double latePct;
+  uint32_t missedFrames;
+};
+
+
+// *********************************************************************************
+//      RUN THE FRAME CLOCK AGAINST ONE LAYOUT
+// *********************************************************************************
+static TimingResult runLayout(uint8_t stripCount, uint16_t stripLength, bool parallel, uint32_t frames) {
+
+  uint16_t lengths[MAX_OUTPUT_STRIPS];
+  for (uint8_t i = 0; i < MAX_OUTPUT_STRIPS; i++) {
+    lengths[i] = stripLength;
+  }
+  WS2812TimingMock wire(lengths, stripCount, parallel);
+
+  hostSetMillis(1);
+  FrameClock frameClock;
+  frameClock.Start(micros(), millis());
+  uint32_t startMicros = micros();
+
+  // the loop in Max-Blink-FastLED.ino with nothing to render: wait for a frame, send everything
+  for (uint32_t shown = 0; shown < frames;) {
+    FrameTime frame;
+    if (frameClock.Poll(micros(), frame)) {
+      wire.Show(ALL_OUTPUT_STRIPS, 255);
+      shown++;
+    } else {
+      hostAdvanceMicros(IDLE_STEP_MICROS);
+    }
+  }
+
+  uint32_t elapsedMicros = micros() - startMicros;
+
+  TimingResult result;
+  result.showMicros = wire.ShowMicros(ALL_OUTPUT_STRIPS);
+  result.framesPerSecond = elapsedMicros ? frames * 1e6 / elapsedMicros : 0;
+  result.latePct = 100.0 * frameClock.GetLateFrameCount() / frames;
+  result.missedFrames = frameClock.GetMissedFrameCount();
+  return result;
+}
+
+
+// *********************************************************************************
+//      MAIN
+// *********************************************************************************
+int main(int argc, char **argv) {
+
+  bool quick = false;
+  bool csv = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    } else if (strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else {
+      fprintf(stderr, "usage: %s [--quick] [--csv]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  uint32_t frames = quick ? 120 : 1200;
+
+  if (csv) {
+    printf("strips,pixels,mode,show_us,max_fps,target_fps,fps,late_pct,missed\n");
+  } else {
+    printf("%6s %6s %10s %9s %9s %7s %8s %9s %8s\n", "strips", "pixels", "mode", "show_us", "max_fps", "target", "fps",
+           "late%", "missed");
+  }
+
+  for (size_t c = 0; c < ARRAY_SIZE(STRIP_COUNTS); c++) {
+    for (size_t l = 0; l < ARRAY_SIZE(STRIP_LENGTHS); l++) {
+      for (int parallel = 0; parallel < 2; parallel++) {
+        TimingResult r = runLayout(STRIP_COUNTS[c], STRIP_LENGTHS[l], parallel, frames);
+        double maxFps = r.showMicros ? 1e6 / r.showMicros : 0;
+        const char *mode = parallel ? "parallel" : "sequential";
+
+        if (csv) {
+          printf("%u,%u,%s,%u,%.1f,%u,%.1f,%.1f,%u\n", (unsigned)STRIP_COUNTS[c], (unsigned)STRIP_LENGTHS[l], mode,
+                 (unsigned)r.showMicros, maxFps, (unsigned)FRAMES_PER_SECOND, r.framesPerSecond, r.latePct,
+                 (unsigned)r.missedFrames);
+        } else {
+          printf("%6u %6u %10s %9u %9.1f %7u %8.1f %9.1f %8u\n", (unsigned)STRIP_COUNTS[c], (unsigned)STRIP_LENGTHS[l], mode,
+                 (unsigned)r.showMicros, maxFps, (unsigned)FRAMES_PER_SECOND, r.framesPerSecond, r.latePct,
+                 (unsigned)r.missedFrames);
+        }
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,278 @@
+/*
+  SpatialBench.cpp  - The pixel map and the spatial effects on the show's layout, on the host
+                    -- checks every entry of the compile time pixel map (PixelMap.h) against the same
+                       coordinates worked out in floating point with the C library. each byte has to be
+                       within one step (exits 1 if one isn't)
+                    -- runs each spatial effect over every segment of Installation.h, triggered together
+                       and re-triggered every few bars, through the sketch's per-frame Update()
+                    -- us/frame is every segment's render, ns/pixel that over the pixels, budget the share
+                       of a frame at FRAMES_PER_SECOND it takes (exits 1 if an effect takes more than a
+                       frame). changed is the share of frames that changed a pixel
+                    -- SWEEP_ATAN2 is SPATIAL_SWEEP working its angles out per pixel with atan2f() from the
+                       pixel positions instead of reading them from the map, for what the table saves. on
+                       the Teensy 3.2, with no floating point unit, the difference is far bigger
+
+  usage: spatial_bench [--quick] [--csv]
+*/
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "Installation.h"
+#include "SpatialEffects.h"
+
+
+// the effects restart every four bars, the way the Max patch re-triggers a look
+static const uint32_t RETRIGGER_MS = 16 * 60000UL / GLOBAL_BPM;
+
+static InstallationTopology installation;
+static const uint8_t SEGMENT_COUNT = InstallationTopology::GetSegmentCount();
+
+
+// *********************************************************************************
+//      THE MAP IN FLOATING POINT
+// *********************************************************************************
+struct PointF {
+  double x, y, z;
+};
+
+static PointF pixelPosition(uint8_t segment, uint16_t i) {
+
+  const SegmentGeometry &geometry = INSTALLATION_GEOMETRY[segment];
+  uint16_t length = INSTALLATION_SEGMENTS[segment].length;
+  double t = length < 2 ? 0 : (double)i / (length - 1);
+
+  PointF p;
+  p.x = geometry.first.x + (geometry.last.x - geometry.first.x) * t;
+  p.y = geometry.first.y + (geometry.last.y - geometry.first.y) * t;
+  p.z = geometry.first.z + (geometry.last.z - geometry.first.z) * t;
+  return p;
+}
+
+static bool withinAStep(uint8_t table, double exact, bool wraps) {
+  double difference = fabs(table - exact);
+  if (wraps && difference > 128) {
+    difference = 256 - difference;
+  }
+  return difference <= 1.0;
+}
+
+// every entry against libm. returns the number that are off
+static uint32_t checkPixelMap(bool csv) {
+
+  PointF lowest = { 1e9, 1e9, 1e9 };
+  PointF highest = { -1e9, -1e9, -1e9 };
+  double farthestRadius = 0;
+  double farthestDistance = 0;
+  const PixelPoint &apex = INSTALLATION_APEX;
+
+  for (uint8_t s = 0; s < SEGMENT_COUNT; s++) {
+    for (uint16_t i = 0; i < INSTALLATION_SEGMENTS[s].length; i++) {
+      PointF p = pixelPosition(s, i);
+      lowest.x = fmin(lowest.x, p.x);  highest.x = fmax(highest.x, p.x);
+      lowest.y = fmin(lowest.y, p.y);  highest.y = fmax(highest.y, p.y);
+      lowest.z = fmin(lowest.z, p.z);  highest.z = fmax(highest.z, p.z);
+      farthestRadius = fmax(farthestRadius, hypot(p.x - apex.x, p.y - apex.y));
+      farthestDistance = fmax(farthestDistance, sqrt(pow(p.x - apex.x, 2) + pow(p.y - apex.y, 2) + pow(p.z - apex.z, 2)));
+    }
+  }
+
+  uint32_t off = 0;
+  for (uint8_t s = 0; s < SEGMENT_COUNT; s++) {
+    const PixelCoordinate *coordinates = InstallationPixelMap::GetSegmentCoordinates(s);
+    for (uint16_t i = 0; i < INSTALLATION_SEGMENTS[s].length; i++) {
+      PointF p = pixelPosition(s, i);
+      double angle = atan2(p.y - apex.y, p.x - apex.x) * 256 / (2 * M_PI);
+      if (angle < 0) {
+        angle += 256;
+      }
+
+      const PixelCoordinate &c = coordinates[i];
+      bool ok = withinAStep(c.x, (p.x - lowest.x) * 255 / fmax(highest.x - lowest.x, 1), false) &&
+                withinAStep(c.y, (p.y - lowest.y) * 255 / fmax(highest.y - lowest.y, 1), false) &&
+                withinAStep(c.z, (p.z - lowest.z) * 255 / fmax(highest.z - lowest.z, 1), false) &&
+                withinAStep(c.angle, angle, true) &&
+                withinAStep(c.radius, hypot(p.x - apex.x, p.y - apex.y) * 255 / fmax(farthestRadius, 1), false) &&
+                withinAStep(c.apexDistance, sqrt(pow(p.x - apex.x, 2) + pow(p.y - apex.y, 2) + pow(p.z - apex.z, 2)) * 255 / fmax(farthestDistance, 1), false);
+      if (!ok) {
+        if (!csv) {
+          printf("segment %u pixel %u: x %u y %u z %u angle %u radius %u apex %u, expected %.1f %.1f %.1f %.1f\n", s, i, c.x, c.y, c.z,
+                 c.angle, c.radius, c.apexDistance, p.x, p.y, p.z, angle);
+        }
+        off++;
+      }
+    }
+  }
+
+  if (!csv) {
+    printf("pixel map: %u pixels, %zu bytes of constants, %u off by more than a step\n\n",
+           (unsigned)InstallationPixelMap::GetPixelCount(), sizeof(PixelCoordinate) * InstallationPixelMap::GetPixelCount(), (unsigned)off);
+  }
+  return off;
+}
+
+
+// *********************************************************************************
+//      SWEEP_ATAN2 - SPATIAL_SWEEP without the map's angles
+// *********************************************************************************
+static const AnimationType SWEEP_ATAN2 = (AnimationType)(FIRST_CUSTOM_ANIMATION + SPATIAL_EFFECT_COUNT);
+static std::vector<PointF> segmentPositions[MAX_RENDER_SEGMENTS];
+
+static void initSweepAtan2(LEDStripController &strip) {
+  strip.InitTimebase();
+}
+
+static void sweepAtan2(LEDStripController &strip) {
+
+  uint8_t segment = &strip - installation.GetControllers()[0];
+  const std::vector<PointF> &positions = segmentPositions[segment];
+  const PixelCoordinate *coordinates = strip.GetPixelCoordinates();
+
+  uint8_t heading = beat8(strip.GetBPM() / 2, strip.GetTimebase());
+  for (uint16_t i = 0; i < strip.GetStripLength(); i++) {
+    float angle = atan2f(positions[i].y - INSTALLATION_APEX.y, positions[i].x - INSTALLATION_APEX.x);
+    uint8_t behind = heading - (uint8_t)(int)lrintf(angle * (256 / (2 * (float)M_PI)));
+
+    CRGB color = CRGB(0, 0, 0);
+    if (behind < 64) {
+      color = strip.PaletteColor(strip.GetHue() + coordinates[i].z, scale8(strip.GetBrightness(), 255 - behind * 4));
+    }
+    if (strip.GetPixel(i) != color) {
+      strip.SetPixelColor(i, color);
+    }
+  }
+}
+
+
+// *********************************************************************************
+//      TIMING
+// *********************************************************************************
+struct BenchEffect {
+  const char *name;
+  AnimationType type;
+};
+
+static const BenchEffect BENCH_EFFECTS[] = {
+  { "SPATIAL_WIPE",          SpatialEffects::GetAnimation(SPATIAL_WIPE) },
+  { "SPATIAL_RADIAL_PULSE",  SpatialEffects::GetAnimation(SPATIAL_RADIAL_PULSE) },
+  { "SPATIAL_SWEEP",         SpatialEffects::GetAnimation(SPATIAL_SWEEP) },
+  { "SPATIAL_NOISE",         SpatialEffects::GetAnimation(SPATIAL_NOISE) },
+  { "SWEEP_ATAN2",           SWEEP_ATAN2 },
+};
+
+struct BenchResult {
+  double usPerFrame;
+  double changedShare;
+};
+
+static BenchResult runEffect(AnimationType type, uint32_t frames) {
+
+  LEDStripController * const *segments = installation.GetControllers();
+
+  hostSetMillis(1);
+  FrameClock frameClock;
+  frameClock.Start(micros(), millis());
+  FrameTime frame;
+
+  for (uint8_t i = 0; i < SEGMENT_COUNT; i++) {
+    segments[i]->SetStripParams(0, 255, GLOBAL_BPM, 255, 40);
+    segments[i]->SetActiveAnimationType(type);
+  }
+
+  uint32_t changedFrames = 0;
+  uint32_t timeToRetrigger = millis() + RETRIGGER_MS;
+  std::chrono::nanoseconds elapsed(0);
+
+  for (uint32_t f = 0; f < frames; f++) {
+    hostAdvanceMicros(FRAME_INTERVAL_MICROS);
+    frameClock.Poll(micros(), frame);
+
+    if ((int32_t)(frame.millis - timeToRetrigger) >= 0) {
+      for (uint8_t i = 0; i < SEGMENT_COUNT; i++) {
+        segments[i]->SetActiveAnimationType(type);
+      }
+      timeToRetrigger += RETRIGGER_MS;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool changed = false;
+    for (uint8_t i = 0; i < SEGMENT_COUNT; i++) {
+      changed = segments[i]->Update(frame) || changed;
+    }
+    elapsed += std::chrono::steady_clock::now() - start;
+
+    if (changed) {
+      changedFrames++;
+    }
+  }
+
+  BenchResult result;
+  result.usPerFrame = (double)elapsed.count() / 1000.0 / frames;
+  result.changedShare = (double)changedFrames / frames;
+  return result;
+}
+
+
+// *********************************************************************************
+//      MAIN
+// *********************************************************************************
+int main(int argc, char **argv) {
+
+  bool quick = false;
+  bool csv = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    } else if (strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else {
+      fprintf(stderr, "usage: %s [--quick] [--csv]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  uint32_t off = checkPixelMap(csv);
+
+  InstallationPixelMap::Attach(installation.GetControllers());
+  if (!SpatialEffects::Register() ||
+      !LEDStripController::RegisterAnimation(SWEEP_ATAN2, { &initSweepAtan2, &sweepAtan2, SPATIAL_UPDATE_INTERVAL, false, RENDER_UNIQUE })) {
+    fprintf(stderr, "couldn't register the effects\n");
+    return 1;
+  }
+  for (uint8_t s = 0; s < SEGMENT_COUNT; s++) {
+    for (uint16_t i = 0; i < INSTALLATION_SEGMENTS[s].length; i++) {
+      segmentPositions[s].push_back(pixelPosition(s, i));
+    }
+  }
+
+  uint32_t frames = quick ? 600 : 6000;
+  uint16_t pixels = InstallationPixelMap::GetPixelCount();
+  bool inBudget = true;
+
+  if (csv) {
+    printf("effect,frames,us_per_frame,ns_per_pixel,budget_percent,changed_percent\n");
+  } else {
+    printf("%u segments, %u pixels, %u frames/sec\n", (unsigned)SEGMENT_COUNT, (unsigned)pixels, (unsigned)FRAMES_PER_SECOND);
+    printf("%-24s %8s %12s %12s %10s %10s\n", "effect", "frames", "us/frame", "ns/pixel", "budget", "changed");
+  }
+
+  for (size_t e = 0; e < ARRAY_SIZE(BENCH_EFFECTS); e++) {
+    BenchResult result = runEffect(BENCH_EFFECTS[e].type, frames);
+    double budget = result.usPerFrame * 100.0 / FRAME_INTERVAL_MICROS;
+    inBudget = inBudget && budget < 100.0;
+
+    if (csv) {
+      printf("%s,%u,%.3f,%.3f,%.3f,%.1f\n", BENCH_EFFECTS[e].name, (unsigned)frames, result.usPerFrame,
+             result.usPerFrame * 1000.0 / pixels, budget, result.changedShare * 100.0);
+    } else {
+      printf("%-24s %8u %12.3f %12.3f %9.3f%% %9.1f%%\n", BENCH_EFFECTS[e].name, (unsigned)frames, result.usPerFrame,
+             result.usPerFrame * 1000.0 / pixels, budget, result.changedShare * 100.0);
+    }
+  }
+
+  return off == 0 && inBudget ? 0 : 1;
+}
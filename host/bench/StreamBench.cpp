@@ -0,0 +1,449 @@
+/*
+  StreamBench.cpp  - What streaming pixels from a PC costs on the wire and on the Teensy, on the host
+                   -- encodes a few scenes the way a PC sender would (every frame raw, every frame as runs,
+                      or only the spans that changed), pushes the bytes through SerialProtocol into a
+                      PixelStream over a 3 x 80 pixel rig, and checks every frame shown is the one sent
+                   -- bytes/frame is on the wire, framing included. kB/s is that at 60 frames/sec (USB full
+                      speed serial moves about 1000 kB/s). ns/frame is decoding on the host
+                   -- each row is run again losing every LOSS_EVERY_CHUNKS'th chunk: dropped is frames not
+                      shown because of it (they wait for the next keyframe), torn is frames shown that
+                      weren't ones sent, which should never happen (exits 1 if any are)
+                   -- then frames the decoder has to throw away (pixel chunks with no stream, as on the UNO,
+                      a frame too long, one too short, and one that stalls and finishes late), each followed by
+                      a key. only the keys may come out as single character commands (exits 1 otherwise)
+
+  usage: stream_bench [--quick] [--csv]
+*/
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "SerialProtocol.h"
+
+
+#define RIG_STRIPS 3
+#define RIG_STRIP_LENGTH 80
+
+static const uint32_t KEYFRAME_EVERY_FRAMES = 30;
+static const uint32_t LOSS_EVERY_CHUNKS = 500;
+
+// unchanged pixels this short between two changed spans are sent anyway, it's cheaper than a new chunk
+static const uint16_t SPAN_MERGE_GAP = 3;
+
+
+// *********************************************************************************
+//      SCENES
+// *********************************************************************************
+typedef void (*SceneFunction)(uint32_t frame, CRGB *pixels);
+
+static void paletteScroll(uint32_t frame, CRGB *pixels) {
+  for (uint16_t i = 0; i < RIG_STRIPS * RIG_STRIP_LENGTH; i++) {
+    pixels[i] = ColorFromPalette(RainbowColors_p, i * 3 + frame * 2);
+  }
+}
+
+static void movingDot(uint32_t frame, CRGB *pixels) {
+  fill_solid(pixels, RIG_STRIPS * RIG_STRIP_LENGTH, CRGB::Black);
+  for (uint8_t s = 0; s < RIG_STRIPS; s++) {
+    uint16_t position = (frame + s * 20) % (RIG_STRIP_LENGTH - 2);
+    fill_solid(&pixels[s * RIG_STRIP_LENGTH + position], 3, CHSV(s * 80, 255, 255));
+  }
+}
+
+static void solidOnBeat(uint32_t frame, CRGB *pixels) {
+  fill_solid(pixels, RIG_STRIPS * RIG_STRIP_LENGTH, CHSV((frame / 30) * 40, 255, 255));
+}
+
+static void noise(uint32_t frame, CRGB *pixels) {
+  (void)frame;
+  for (uint16_t i = 0; i < RIG_STRIPS * RIG_STRIP_LENGTH; i++) {
+    pixels[i] = CRGB(random8(), random8(), random8());
+  }
+}
+
+struct Scene {
+  const char *name;
+  SceneFunction draw;
+};
+
+static const Scene SCENES[] = {
+  { "palette scroll", paletteScroll },
+  { "moving dot",     movingDot },
+  { "solid on beat",  solidOnBeat },
+  { "noise",          noise },
+};
+
+
+// *********************************************************************************
+//      THE SENDER
+// *********************************************************************************
+enum Encoding {
+  ENCODE_RAW,           // every frame, every pixel
+  ENCODE_RLE,           // every frame, every pixel as runs
+  ENCODE_SPANS,         // what changed, raw
+  ENCODE_SPANS_RLE      // what changed, each span as raw or runs, whichever is shorter
+};
+
+static const char *ENCODING_NAMES[] = { "raw", "rle", "spans", "spans+rle" };
+
+
+struct Sender {
+  std::vector<std::vector<uint8_t> > chunks;    // the frame being built, one serial frame per chunk
+  uint8_t sequence = 0;
+  bool keyframe = false;
+};
+
+static void addChunk(Sender &sender, uint8_t strip, uint8_t flags, uint16_t start, const uint8_t *data, uint8_t length) {
+
+  if (sender.chunks.empty() && sender.keyframe) {
+    flags |= PIXEL_CHUNK_KEYFRAME;
+  }
+
+  std::vector<uint8_t> frame;
+  frame.push_back(SERIAL_FRAME_SYNC);
+  frame.push_back(PIXEL_CHUNK_HEADER_SIZE + length);
+  frame.push_back(SERIAL_OP_PIXELS);
+  frame.push_back(sender.sequence++);
+  frame.push_back(strip);
+  frame.push_back(flags);
+  frame.push_back(start & 0xFF);
+  frame.push_back(start >> 8);
+  frame.insert(frame.end(), data, data + length);
+
+  uint8_t crc = 0;
+  for (size_t i = 1; i < frame.size(); i++) {
+    crc = SerialProtocol::Crc8(crc, frame[i]);
+  }
+  frame.push_back(crc);
+  sender.chunks.push_back(frame);
+}
+
+// one span of a strip, split into chunks
+static void addRaw(Sender &sender, uint8_t strip, uint16_t start, const CRGB *pixels, uint16_t count) {
+
+  const uint16_t perChunk = PIXEL_CHUNK_MAX_DATA / 3;
+  for (uint16_t done = 0; done < count; done += perChunk) {
+    uint16_t n = count - done < perChunk ? count - done : perChunk;
+    uint8_t data[PIXEL_CHUNK_MAX_DATA];
+    for (uint16_t i = 0; i < n; i++) {
+      data[i * 3] = pixels[done + i].r;
+      data[i * 3 + 1] = pixels[done + i].g;
+      data[i * 3 + 2] = pixels[done + i].b;
+    }
+    addChunk(sender, strip, 0, start + done, data, n * 3);
+  }
+}
+
+static std::vector<uint8_t> runsOf(const CRGB *pixels, uint16_t count) {
+
+  std::vector<uint8_t> runs;
+  for (uint16_t i = 0; i < count;) {
+    uint16_t run = 1;
+    while (i + run < count && run < 255 && pixels[i + run] == pixels[i]) {
+      run++;
+    }
+    runs.push_back(run);
+    runs.push_back(pixels[i].r);
+    runs.push_back(pixels[i].g);
+    runs.push_back(pixels[i].b);
+    i += run;
+  }
+  return runs;
+}
+
+static void addRuns(Sender &sender, uint8_t strip, uint16_t start, const std::vector<uint8_t> &runs) {
+
+  const uint16_t perChunk = (PIXEL_CHUNK_MAX_DATA / 4) * 4;
+  uint16_t position = start;
+  for (size_t done = 0; done < runs.size(); done += perChunk) {
+    uint16_t n = runs.size() - done < perChunk ? runs.size() - done : perChunk;
+    addChunk(sender, strip, PIXEL_CHUNK_RLE, position, &runs[done], n);
+    for (uint16_t i = 0; i < n; i += 4) {
+      position += runs[done + i];
+    }
+  }
+}
+
+static void addSpan(Sender &sender, Encoding encoding, uint8_t strip, uint16_t start, const CRGB *pixels, uint16_t count) {
+
+  if (encoding == ENCODE_RAW || encoding == ENCODE_SPANS) {
+    addRaw(sender, strip, start, pixels, count);
+    return;
+  }
+
+  std::vector<uint8_t> runs = runsOf(pixels, count);
+  if (encoding == ENCODE_SPANS_RLE && runs.size() >= count * 3u) {
+    addRaw(sender, strip, start, pixels, count);
+  } else {
+    addRuns(sender, strip, start, runs);
+  }
+}
+
+static void encodeFrame(Sender &sender, Encoding encoding, uint32_t frame, const CRGB *previous, const CRGB *current) {
+
+  sender.chunks.clear();
+  sender.keyframe = encoding == ENCODE_RAW || encoding == ENCODE_RLE || frame % KEYFRAME_EVERY_FRAMES == 0;
+
+  for (uint8_t s = 0; s < RIG_STRIPS; s++) {
+    const CRGB *was = &previous[s * RIG_STRIP_LENGTH];
+    const CRGB *now = &current[s * RIG_STRIP_LENGTH];
+
+    if (sender.keyframe) {
+      addSpan(sender, encoding, s, 0, now, RIG_STRIP_LENGTH);
+      continue;
+    }
+
+    for (uint16_t i = 0; i < RIG_STRIP_LENGTH;) {
+      if (was[i] == now[i]) {
+        i++;
+        continue;
+      }
+      uint16_t end = i + 1;
+      for (uint16_t j = end; j < RIG_STRIP_LENGTH && j - end <= SPAN_MERGE_GAP; j++) {
+        if (was[j] != now[j]) {
+          end = j + 1;
+        }
+      }
+      addSpan(sender, encoding, s, i, &now[i], end - i);
+      i = end;
+    }
+  }
+
+  // the last chunk shows the frame. one with nothing changed is a bare commit
+  if (sender.chunks.empty()) {
+    addChunk(sender, 0, PIXEL_CHUNK_COMMIT, 0, nullptr, 0);
+  } else {
+    std::vector<uint8_t> &last = sender.chunks.back();
+    last[5] |= PIXEL_CHUNK_COMMIT;
+    uint8_t crc = 0;
+    for (size_t i = 1; i < last.size() - 1; i++) {
+      crc = SerialProtocol::Crc8(crc, last[i]);
+    }
+    last.back() = crc;
+  }
+}
+
+
+// *********************************************************************************
+//      RUN ONE SCENE AND ENCODING
+// *********************************************************************************
+struct StreamResult {
+  double bytesPerFrame;
+  double nsPerFrame;
+  uint32_t dropped;
+  uint32_t torn;
+};
+
+static StreamResult runStream(const Scene &scene, Encoding encoding, uint32_t frames, bool lossy) {
+
+  static CRGB strips[RIG_STRIPS][RIG_STRIP_LENGTH];
+  static CRGB backBuffer[RIG_STRIPS * RIG_STRIP_LENGTH];
+  CRGB * const stripPointers[RIG_STRIPS] = { strips[0], strips[1], strips[2] };
+  const uint16_t stripLengths[RIG_STRIPS] = { RIG_STRIP_LENGTH, RIG_STRIP_LENGTH, RIG_STRIP_LENGTH };
+  memset(strips, 0, sizeof(strips));
+
+  PixelStream stream(stripPointers, stripLengths, RIG_STRIPS, backBuffer);
+  SerialProtocol protocol;
+  protocol.SetPixelStream(&stream);
+
+  // every frame sent, so a shown frame can be checked against them
+  std::vector<std::vector<CRGB> > sent;
+  std::vector<CRGB> previous(RIG_STRIPS * RIG_STRIP_LENGTH);
+  std::vector<CRGB> current(RIG_STRIPS * RIG_STRIP_LENGTH);
+
+  random16_set_seed(RAND16_SEED);
+  Sender sender;
+  uint64_t bytes = 0;
+  uint64_t decodeNanos = 0;
+  uint32_t chunkCount = 0;
+  StreamResult result = { 0, 0, 0, 0 };
+
+  for (uint32_t f = 0; f < frames; f++) {
+    scene.draw(f, current.data());
+    encodeFrame(sender, encoding, f, previous.data(), current.data());
+    previous = current;
+    sent.push_back(current);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < sender.chunks.size(); c++) {
+      std::vector<uint8_t> &chunk = sender.chunks[c];
+      bytes += chunk.size();
+
+      // a lost chunk is one the decoder never sees
+      if (lossy && ++chunkCount % LOSS_EVERY_CHUNKS == 0) {
+        continue;
+      }
+
+      for (size_t i = 0; i < chunk.size(); i++) {
+        protocol.Push(chunk[i]);
+        if (protocol.Room() == 0 || i + 1 == chunk.size()) {
+          SerialCommand command;
+          uint8_t legacyByte;
+          while (protocol.Poll(0, command, legacyByte) != SERIAL_MESSAGE_NONE) {
+          }
+        }
+      }
+    }
+    decodeNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    uint32_t frameMicros = f * (uint32_t)FRAME_INTERVAL_MICROS;
+    FrameTime frame = { f, frameMicros, frameMicros / 1000, (uint32_t)FRAME_INTERVAL_MICROS, 0, 0 };
+    stream.Update(frame);
+    if (!stream.TakeChangedStrips()) {
+      continue;
+    }
+
+    // what's on the strips has to be one of the frames sent, never a mix
+    bool found = false;
+    for (size_t i = sent.size(); i-- > 0 && !found;) {
+      found = memcmp(strips, sent[i].data(), sizeof(strips)) == 0;
+    }
+    if (!found) {
+      result.torn++;
+    }
+  }
+
+  result.bytesPerFrame = (double)bytes / frames;
+  result.nsPerFrame = (double)decodeNanos / frames;
+  result.dropped = stream.GetDroppedFrameCount();
+  return result;
+}
+
+
+// *********************************************************************************
+//      REJECTED FRAMES - none of a thrown away frame's bytes may be taken for keys
+// *********************************************************************************
+static const char REJECT_KEY = 'o';
+
+static uint32_t pushAndPoll(SerialProtocol &protocol, const uint8_t *bytes, size_t length, uint32_t currentTime,
+                            std::vector<uint8_t> &legacy) {
+
+  uint32_t badFrames = 0;
+  for (size_t i = 0; i < length; i++) {
+    protocol.Push(bytes[i]);
+    SerialCommand command;
+    uint8_t legacyByte;
+    SerialMessageType type;
+    while ((type = protocol.Poll(currentTime, command, legacyByte)) != SERIAL_MESSAGE_NONE) {
+      if (type == SERIAL_MESSAGE_LEGACY) {
+        legacy.push_back(legacyByte);
+      }
+      badFrames += type == SERIAL_MESSAGE_BAD_FRAME;
+    }
+  }
+  return badFrames;
+}
+
+// returns how many bytes came out as keys that weren't the keys sent
+static uint32_t runRejectedFrames(bool csv) {
+
+  // a frame whose payload is all 'b's, so any that leak fire a preset
+  std::vector<std::vector<uint8_t> > frames;
+  const uint8_t lengths[] = { PIXEL_CHUNK_HEADER_SIZE + PIXEL_CHUNK_MAX_DATA, SERIAL_MAX_PAYLOAD + 1, 2, 0 };
+  for (uint8_t length : lengths) {
+    std::vector<uint8_t> frame = { SERIAL_FRAME_SYNC, length, SERIAL_OP_PIXELS };
+    frame.resize(length + 2, 'b');
+    if (length < 1) {
+      frame.resize(2);
+    }
+    uint8_t crc = 0;
+    for (size_t i = 1; i < frame.size(); i++) {
+      crc = SerialProtocol::Crc8(crc, frame[i]);
+    }
+    frame.push_back(crc);
+    frames.push_back(frame);
+  }
+
+  SerialProtocol protocol;       // no pixel stream, like the UNO
+  std::vector<uint8_t> legacy;
+  uint32_t badFrames = 0;
+  uint32_t time = 0;
+  for (const std::vector<uint8_t> &frame : frames) {
+    badFrames += pushAndPoll(protocol, frame.data(), frame.size(), time, legacy);
+    uint8_t key = REJECT_KEY;
+    badFrames += pushAndPoll(protocol, &key, 1, time, legacy);
+  }
+
+  // a command frame that stops half way, times out, then has the rest turn up
+  SerialCommand command;
+  command.opcode = SERIAL_OP_PARAMS;
+  command.hue = command.brightness = command.brightnessHigh = command.brightnessLow = 'b';
+  command.bpm = 'b' | ('b' << 8);
+  uint8_t stalled[SERIAL_MAX_PAYLOAD + 3];
+  uint8_t length = SerialProtocol::EncodeFrame(command, stalled);
+  badFrames += pushAndPoll(protocol, stalled, length / 2, time, legacy);
+  time += SERIAL_FRAME_TIMEOUT + 1;
+  SerialCommand unused;
+  uint8_t unusedByte;
+  badFrames += protocol.Poll(time, unused, unusedByte) == SERIAL_MESSAGE_BAD_FRAME;
+  badFrames += pushAndPoll(protocol, stalled + length / 2, length - length / 2, time, legacy);
+  uint8_t key = REJECT_KEY;
+  badFrames += pushAndPoll(protocol, &key, 1, time, legacy);
+
+  uint32_t keysSent = frames.size() + 1;
+  uint32_t keys = 0;
+  for (uint8_t b : legacy) {
+    keys += b == REJECT_KEY;
+  }
+  // a key eaten is as wrong as a byte let through
+  uint32_t leaked = legacy.size() - keys + keysSent - keys;
+
+  if (!csv) {
+    printf("\nrejected frames: %u thrown away, %u of %u keys after them through, %u bytes taken for keys\n",
+           (unsigned)badFrames, (unsigned)keys, (unsigned)keysSent, (unsigned)(legacy.size() - keys));
+  }
+  return leaked;
+}
+
+
+// *********************************************************************************
+//      MAIN
+// *********************************************************************************
+int main(int argc, char **argv) {
+
+  bool quick = false;
+  bool csv = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    } else if (strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else {
+      fprintf(stderr, "usage: %s [--quick] [--csv]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  uint32_t frames = quick ? 240 : 3600;
+  uint32_t torn = 0;
+
+  if (csv) {
+    printf("scene,encoding,frames,bytes_per_frame,kB_per_sec,ns_per_frame,dropped,torn\n");
+  } else {
+    printf("%-16s %-10s %7s %12s %10s %12s %8s %6s\n", "scene", "encoding", "frames", "bytes/frame", "kB/s",
+           "ns/frame", "dropped", "torn");
+  }
+
+  for (size_t s = 0; s < ARRAY_SIZE(SCENES); s++) {
+    for (int e = ENCODE_RAW; e <= ENCODE_SPANS_RLE; e++) {
+      StreamResult r = runStream(SCENES[s], (Encoding)e, frames, false);
+      StreamResult lossy = runStream(SCENES[s], (Encoding)e, frames, true);
+      torn += r.torn + lossy.torn;
+
+      double kBPerSec = r.bytesPerFrame * FRAMES_PER_SECOND / 1000.0;
+      if (csv) {
+        printf("%s,%s,%u,%.1f,%.1f,%.0f,%u,%u\n", SCENES[s].name, ENCODING_NAMES[e], (unsigned)frames,
+               r.bytesPerFrame, kBPerSec, r.nsPerFrame, (unsigned)lossy.dropped, (unsigned)(r.torn + lossy.torn));
+      } else {
+        printf("%-16s %-10s %7u %12.1f %10.1f %12.0f %8u %6u\n", SCENES[s].name, ENCODING_NAMES[e], (unsigned)frames,
+               r.bytesPerFrame, kBPerSec, r.nsPerFrame, (unsigned)lossy.dropped, (unsigned)(r.torn + lossy.torn));
+      }
+    }
+  }
+
+  uint32_t leaked = runRejectedFrames(csv);
+
+  return torn || leaked ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+/*
+  Arduino.h  - Minimal host-side stand-in for the Arduino core
+             -- only what the sketch and LEDStripController actually use
+             -- the clock is virtual so benchmarks and simulators can drive time themselves
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// ******************************************************************
+//            Pin and constant definitions
+// ******************************************************************
+#define HIGH 0x1
+#define LOW  0x0
+
+#define DEC 10
+#define HEX 16
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define LED_BUILTIN 13
+
+typedef uint8_t byte;
+
+
+// ******************************************************************
+//            Timing
+//    millis() and micros() read a virtual clock that only moves
+//    when the host program moves it. Both roll over exactly like
+//    the hardware counters do (millis at 2^32 ms, micros at 2^32 us)
+// ******************************************************************
+uint32_t millis();
+uint32_t micros();
+
+void hostSetMillis(uint32_t ms);
+void hostSetMicros(uint64_t us);
+void hostAdvanceMicros(uint32_t us);
+
+// the Teensy's cycle counter. unlike the clock above it runs in real time (at F_CPU), so what the
+// sketch profiles with it is what the host took
+#ifndef F_CPU
+  #define F_CPU 96000000
+#endif
+uint32_t hostCycleCount();
+#define ARM_DWT_CYCCNT (hostCycleCount())
+
+
+// ******************************************************************
+//            Digital IO (no-ops on the host)
+// ******************************************************************
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+
+// ******************************************************************
+//            Serial - what Max sends comes from hostSerialPush(),
+//            and anything the sketch prints or writes goes nowhere
+//            unless hostSerialEcho() sends it to stdout
+// ******************************************************************
+class HostSerial {
+  public:
+    void begin(uint32_t baud) { (void)baud; }
+    int available();
+    int read();
+
+    size_t write(uint8_t b);
+    size_t write(const uint8_t *buffer, size_t size);
+
+    // never full on the host, so this is just a typical USB packet's worth
+    int availableForWrite() { return 64; }
+
+    // the same overloads as Arduino's Print
+    size_t print(const char *text);
+    size_t print(char c);
+    size_t print(unsigned char value, int base = DEC) { return print((unsigned long)value, base); }
+    size_t print(int value, int base = DEC) { return print((long)value, base); }
+    size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+
+    size_t println() { return print("\r\n"); }
+    template <typename T> size_t println(const T &value) { size_t n = print(value); return n + println(); }
+    template <typename T> size_t println(const T &value, int base) { size_t n = print(value, base); return n + println(); }
+};
+
+extern HostSerial Serial;
+
+// queue bytes for Serial.read(). returns false (and queues nothing) if there isn't room for all of them
+bool hostSerialPush(const uint8_t *data, size_t length);
+
+// send what the sketch prints and writes to stdout (off to start with)
+void hostSerialEcho(bool echo);
+
+
+#endif
@@ -0,0 +1,34 @@
+/*
+  EEPROM.h  - Host-side stand-in for the Teensy's EEPROM library
+            -- 2048 bytes (a Teensy 3.2's) in memory, erased (0xFF) when the program starts
+*/
+
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include "Arduino.h"
+
+#define HOST_EEPROM_BYTES 2048
+
+
+class EEPROMClass {
+  public:
+    uint8_t read(int address) { return address >= 0 && address < HOST_EEPROM_BYTES ? _bytes[address] : 0xFF; }
+    void write(int address, uint8_t value) { if (address >= 0 && address < HOST_EEPROM_BYTES) _bytes[address] = value; }
+    void update(int address, uint8_t value) { write(address, value); }
+    uint16_t length() { return HOST_EEPROM_BYTES; }
+
+    // the host can look at (or wipe) what the sketch saved
+    uint8_t *hostBytes() { return _bytes; }
+    void hostErase() { memset(_bytes, 0xFF, sizeof(_bytes)); }
+
+    EEPROMClass() { hostErase(); }
+
+  private:
+    uint8_t _bytes[HOST_EEPROM_BYTES];
+};
+
+extern EEPROMClass EEPROM;
+
+
+#endif
@@ -0,0 +1,607 @@
+/*
+  FastLED.cpp  - Host implementations for the FastLED shim and the virtual Arduino clock
+*/
+
+#include <chrono>
+#include <stdio.h>
+
+#include "FastLED.h"
+#include "EEPROM.h"
+
+
+// *********************************************************************************
+//      VIRTUAL CLOCK
+// *********************************************************************************
+static uint64_t hostMicros = 0;
+
+uint32_t millis() {
+  return (uint32_t)(hostMicros / 1000);
+}
+
+uint32_t micros() {
+  return (uint32_t)hostMicros;
+}
+
+void hostSetMillis(uint32_t ms) {
+  hostMicros = (uint64_t)ms * 1000;
+}
+
+void hostSetMicros(uint64_t us) {
+  hostMicros = us;
+}
+
+void hostAdvanceMicros(uint32_t us) {
+  hostMicros += us;
+}
+
+uint32_t hostCycleCount() {
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  return (uint32_t)(nanos * (F_CPU / 1000000) / 1000);
+}
+
+
+// *********************************************************************************
+//      DIGITAL IO
+// *********************************************************************************
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return HIGH; }
+
+
+// *********************************************************************************
+//      SERIAL
+// *********************************************************************************
+HostSerial Serial;
+
+static uint8_t hostSerialBuffer[4096];
+static size_t hostSerialHead = 0;
+static size_t hostSerialCount = 0;
+
+int HostSerial::available() {
+  return (int)hostSerialCount;
+}
+
+int HostSerial::read() {
+  if (hostSerialCount == 0) {
+    return -1;
+  }
+  uint8_t b = hostSerialBuffer[hostSerialHead];
+  hostSerialHead = (hostSerialHead + 1) % sizeof(hostSerialBuffer);
+  hostSerialCount--;
+  return b;
+}
+
+static bool hostSerialEchoing = false;
+
+void hostSerialEcho(bool echo) {
+  hostSerialEchoing = echo;
+}
+
+size_t HostSerial::write(uint8_t b) {
+  if (hostSerialEchoing) {
+    fputc(b, stdout);
+  }
+  return 1;
+}
+
+size_t HostSerial::write(const uint8_t *buffer, size_t size) {
+  if (hostSerialEchoing) {
+    fwrite(buffer, 1, size, stdout);
+  }
+  return size;
+}
+
+size_t HostSerial::print(const char *text) {
+  return write((const uint8_t *)text, strlen(text));
+}
+
+size_t HostSerial::print(char c) {
+  return write((uint8_t)c);
+}
+
+size_t HostSerial::print(long value, int base) {
+  if (value < 0 && base == DEC) {
+    return print('-') + print((unsigned long)-value, base);
+  }
+  return print((unsigned long)value, base);
+}
+
+size_t HostSerial::print(unsigned long value, int base) {
+  char text[8 * sizeof(long) + 1];
+  char *digit = &text[sizeof(text) - 1];
+  *digit = 0;
+  if (base < 2) {
+    base = DEC;
+  }
+  do {
+    uint8_t d = value % base;
+    *--digit = d < 10 ? '0' + d : 'A' + d - 10;
+    value /= base;
+  } while (value);
+  return print(digit);
+}
+
+size_t HostSerial::print(double value, int digits) {
+  char text[32];
+  snprintf(text, sizeof(text), "%.*f", digits, value);
+  return print(text);
+}
+
+bool hostSerialPush(const uint8_t *data, size_t length) {
+  if (length > sizeof(hostSerialBuffer) - hostSerialCount) {
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    hostSerialBuffer[(hostSerialHead + hostSerialCount) % sizeof(hostSerialBuffer)] = data[i];
+    hostSerialCount++;
+  }
+  return true;
+}
+
+
+// *********************************************************************************
+//      EEPROM
+// *********************************************************************************
+EEPROMClass EEPROM;
+
+
+// *********************************************************************************
+//      THE FASTLED OBJECT
+// *********************************************************************************
+CFastLED FastLED;
+
+// every controller past the last one shares the last one, so setup() never gets a dangling reference
+CLEDController& CFastLED::addController(CRGB* data, int nLeds) {
+  uint8_t i = m_nControllers < HOST_MAX_CONTROLLERS ? m_nControllers++ : HOST_MAX_CONTROLLERS - 1;
+  return m_Controllers[i].setLeds(data, nLeds);
+}
+
+
+// *********************************************************************************
+//      RANDOM
+// *********************************************************************************
+uint16_t rand16seed = RAND16_SEED;
+
+
+// *********************************************************************************
+//      HSV -> RGB (FastLED's "rainbow" color map)
+// *********************************************************************************
+void hsv2rgb_rainbow(const CHSV& hsv, CRGB& rgb) {
+  const uint8_t K255 = 255;
+  const uint8_t K171 = 171;
+  const uint8_t K170 = 170;
+  const uint8_t K85 = 85;
+
+  uint8_t hue = hsv.hue;
+  uint8_t sat = hsv.sat;
+  uint8_t val = hsv.val;
+
+  uint8_t offset8 = (hue & 0x1F) << 3; // 0..248
+  uint8_t third = scale8(offset8, (256 / 3)); // max = 85
+
+  uint8_t r, g, b;
+
+  if (!(hue & 0x80)) {
+    if (!(hue & 0x40)) {
+      if (!(hue & 0x20)) {
+        // R -> O
+        r = K255 - third;
+        g = third;
+        b = 0;
+      } else {
+        // O -> Y
+        r = K171;
+        g = K85 + third;
+        b = 0;
+      }
+    } else {
+      if (!(hue & 0x20)) {
+        // Y -> G
+        uint8_t twothirds = scale8(offset8, ((256 * 2) / 3)); // max = 170
+        r = K171 - twothirds;
+        g = K170 + third;
+        b = 0;
+      } else {
+        // G -> A
+        r = 0;
+        g = K255 - third;
+        b = third;
+      }
+    }
+  } else {
+    if (!(hue & 0x40)) {
+      if (!(hue & 0x20)) {
+        // A -> B
+        uint8_t twothirds = scale8(offset8, ((256 * 2) / 3)); // max = 170
+        r = 0;
+        g = K171 - twothirds;
+        b = K85 + twothirds;
+      } else {
+        // B -> P
+        r = third;
+        g = 0;
+        b = K255 - third;
+      }
+    } else {
+      if (!(hue & 0x20)) {
+        // P -> K
+        r = K85 + third;
+        g = 0;
+        b = K171 - third;
+      } else {
+        // K -> R
+        r = K170 + third;
+        g = 0;
+        b = K85 - third;
+      }
+    }
+  }
+
+  // scale down colors if we're desaturated at all
+  // and add the brightness_floor to r, g, and b
+  if (sat != 255) {
+    if (sat == 0) {
+      r = 255; g = 255; b = 255;
+    } else {
+      uint8_t desat = 255 - sat;
+      desat = scale8_video(desat, desat);
+      uint8_t satscale = 255 - desat;
+      r = scale8(r, satscale) + desat;
+      g = scale8(g, satscale) + desat;
+      b = scale8(b, satscale) + desat;
+    }
+  }
+
+  // now scale everything down if we're at value < 255
+  if (val != 255) {
+    val = scale8_video(val, val);
+    if (val == 0) {
+      r = 0; g = 0; b = 0;
+    } else {
+      r = scale8(r, val);
+      g = scale8(g, val);
+      b = scale8(b, val);
+    }
+  }
+
+  rgb.r = r;
+  rgb.g = g;
+  rgb.b = b;
+}
+
+
+// *********************************************************************************
+//      PALETTES
+// *********************************************************************************
+const TProgmemRGBPalette16 RainbowColors_p = {
+  0xFF0000, 0xD52A00, 0xAB5500, 0xAB7F00,
+  0xABAB00, 0x56D500, 0x00FF00, 0x00D52A,
+  0x00AB55, 0x0056AA, 0x0000FF, 0x2A00D5,
+  0x5500AB, 0x7F0081, 0xAB0055, 0xD5002B
+};
+
+CRGBPalette16& CRGBPalette16::operator=(const TProgmemRGBPalette16& rhs) {
+  for (uint8_t i = 0; i < 16; i++) {
+    entries[i] = CRGB(rhs[i]);
+  }
+  return *this;
+}
+
+// expand a gradient palette (index, r, g, b quads ending at index 255) into 16 entries
+CRGBPalette16& CRGBPalette16::operator=(TProgmemRGBGradientPalettePtr progpal) {
+  const uint8_t* progent = progpal;
+
+  // count entries
+  uint16_t count = 0;
+  while (progent[count * 4] != 255) {
+    ++count;
+  }
+  ++count;
+
+  int8_t lastSlotUsed = -1;
+
+  CRGB rgbstart(progent[1], progent[2], progent[3]);
+  int indexstart = 0;
+  while (indexstart < 255) {
+    progent += 4;
+    int indexend = progent[0];
+    CRGB rgbend(progent[1], progent[2], progent[3]);
+    uint8_t istart8 = indexstart / 16;
+    uint8_t iend8 = indexend / 16;
+    if (count < 16) {
+      if ((istart8 <= lastSlotUsed) && (lastSlotUsed < 15)) {
+        istart8 = lastSlotUsed + 1;
+        if (iend8 < istart8) {
+          iend8 = istart8;
+        }
+      }
+      lastSlotUsed = iend8;
+    }
+    fill_gradient_RGB(&(entries[0]), istart8, rgbstart, iend8, rgbend);
+    indexstart = indexend;
+    rgbstart = rgbend;
+  }
+  return *this;
+}
+
+CRGB blend(const CRGB& p1, const CRGB& p2, fract8 amountOfP2) {
+  return CRGB(blend8(p1.r, p2.r, amountOfP2),
+              blend8(p1.g, p2.g, amountOfP2),
+              blend8(p1.b, p2.b, amountOfP2));
+}
+
+CRGB ColorFromPalette(const CRGBPalette16& pal, uint8_t index, uint8_t brightness, TBlendType blendType) {
+  uint8_t hi4 = index >> 4;
+  uint8_t lo4 = index & 0x0F;
+
+  const CRGB* entry = &(pal[0]) + hi4;
+
+  uint8_t red1 = entry->red;
+  uint8_t green1 = entry->green;
+  uint8_t blue1 = entry->blue;
+
+  if (lo4 && (blendType != NOBLEND)) {
+    if (hi4 == 15) {
+      entry = &(pal[0]);
+    } else {
+      ++entry;
+    }
+
+    uint8_t f2 = lo4 << 4;
+    uint8_t f1 = 255 - f2;
+
+    red1 = scale8(red1, f1) + scale8(entry->red, f2);
+    green1 = scale8(green1, f1) + scale8(entry->green, f2);
+    blue1 = scale8(blue1, f1) + scale8(entry->blue, f2);
+  }
+
+  if (brightness != 255) {
+    if (brightness) {
+      ++brightness; // adjust for rounding
+      red1 = scale8(red1, brightness);
+      green1 = scale8(green1, brightness);
+      blue1 = scale8(blue1, brightness);
+    } else {
+      red1 = 0;
+      green1 = 0;
+      blue1 = 0;
+    }
+  }
+
+  return CRGB(red1, green1, blue1);
+}
+
+
+// *********************************************************************************
+//      FILL AND FADE
+// *********************************************************************************
+void fill_solid(CRGB* leds, int numToFill, const CRGB& color) {
+  for (int i = 0; i < numToFill; i++) {
+    leds[i] = color;
+  }
+}
+
+void fill_solid(CRGB* leds, int numToFill, const CHSV& hsvColor) {
+  CRGB rgb;
+  hsv2rgb_rainbow(hsvColor, rgb);
+  fill_solid(leds, numToFill, rgb);
+}
+
+void fill_gradient_RGB(CRGB* leds, uint16_t startpos, CRGB startcolor, uint16_t endpos, CRGB endcolor) {
+  // if the points are in the wrong order, straighten them
+  if (endpos < startpos) {
+    uint16_t t = endpos;
+    CRGB tc = endcolor;
+    endcolor = startcolor;
+    endpos = startpos;
+    startpos = t;
+    startcolor = tc;
+  }
+
+  saccum87 rdistance87 = (endcolor.r - startcolor.r) << 7;
+  saccum87 gdistance87 = (endcolor.g - startcolor.g) << 7;
+  saccum87 bdistance87 = (endcolor.b - startcolor.b) << 7;
+
+  uint16_t pixeldistance = endpos - startpos;
+  int16_t divisor = pixeldistance ? pixeldistance : 1;
+
+  saccum87 rdelta87 = rdistance87 / divisor;
+  saccum87 gdelta87 = gdistance87 / divisor;
+  saccum87 bdelta87 = bdistance87 / divisor;
+
+  rdelta87 *= 2;
+  gdelta87 *= 2;
+  bdelta87 *= 2;
+
+  accum88 r88 = startcolor.r << 8;
+  accum88 g88 = startcolor.g << 8;
+  accum88 b88 = startcolor.b << 8;
+  for (uint16_t i = startpos; i <= endpos; ++i) {
+    leds[i] = CRGB(r88 >> 8, g88 >> 8, b88 >> 8);
+    r88 += rdelta87;
+    g88 += gdelta87;
+    b88 += bdelta87;
+  }
+}
+
+void fill_palette(CRGB* L, uint16_t N, uint8_t startIndex, uint8_t incIndex,
+                  const CRGBPalette16& pal, uint8_t brightness, TBlendType blendType) {
+  uint8_t colorIndex = startIndex;
+  for (uint16_t i = 0; i < N; i++) {
+    L[i] = ColorFromPalette(pal, colorIndex, brightness, blendType);
+    colorIndex += incIndex;
+  }
+}
+
+void nscale8(CRGB* leds, uint16_t num_leds, uint8_t scale) {
+  for (uint16_t i = 0; i < num_leds; i++) {
+    leds[i].nscale8(scale);
+  }
+}
+
+void fadeToBlackBy(CRGB* leds, uint16_t num_leds, uint8_t fadeBy) {
+  nscale8(leds, num_leds, 255 - fadeBy);
+}
+
+
+// *********************************************************************************
+//      NOISE (FastLED's noise.cpp, 8 bit versions)
+// *********************************************************************************
+// Ken Perlin's permutation, with the first entry again on the end so P(A + 1) never reads past it
+static const uint8_t noisePermutation[257] = {
+  151,160,137,91,90,15,131,13,201,95,96,53,194,233,7,225,
+  140,36,103,30,69,142,8,99,37,240,21,10,23,190,6,148,
+  247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,
+  57,177,33,88,237,149,56,87,174,20,125,136,171,168,68,175,
+  74,165,71,134,139,48,27,166,77,146,158,231,83,111,229,122,
+  60,211,133,230,220,105,92,41,55,46,245,40,244,102,143,54,
+  65,25,63,161,1,216,80,73,209,76,132,187,208,89,18,169,
+  200,196,135,130,116,188,159,86,164,100,109,198,173,186,3,64,
+  52,217,226,250,124,123,5,202,38,147,118,126,255,82,85,212,
+  207,206,59,227,47,16,58,17,182,189,28,42,223,183,170,213,
+  119,248,152,2,44,154,163,70,221,153,101,155,167,43,172,9,
+  129,22,39,253,19,98,108,110,79,113,224,232,178,185,112,104,
+  218,246,97,228,251,34,242,193,238,210,144,12,191,179,162,241,
+  81,51,145,235,249,14,239,107,49,192,214,31,181,199,106,157,
+  184,84,204,176,115,121,50,45,127,4,150,254,138,236,205,93,
+  222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180,
+  151
+};
+#define P(x) noisePermutation[(x)]
+
+static inline int8_t avg7(int8_t i, int8_t j) {
+  return (int8_t)((i >> 1) + (j >> 1) + (i & 0x1));
+}
+
+static inline int8_t lerp7by8(int8_t a, int8_t b, fract8 frac) {
+  if (b > a) {
+    uint8_t delta = b - a;
+    return (int8_t)(a + scale8(delta, frac));
+  }
+  uint8_t delta = a - b;
+  return (int8_t)(a - scale8(delta, frac));
+}
+
+static inline int8_t grad8(uint8_t hash, int8_t x, int8_t y, int8_t z) {
+  hash &= 0xF;
+  int8_t u = (hash & 8) ? y : x;
+  int8_t v = hash < 4 ? y : (hash == 12 || hash == 14) ? x : z;
+  if (hash & 1) u = -u;
+  if (hash & 2) v = -v;
+  return avg7(u, v);
+}
+
+static inline int8_t grad8(uint8_t hash, int8_t x, int8_t y) {
+  int8_t u, v;
+  if (hash & 4) {
+    u = y; v = x;
+  } else {
+    u = x; v = y;
+  }
+  if (hash & 1) u = -u;
+  if (hash & 2) v = -v;
+  return avg7(u, v);
+}
+
+static inline int8_t grad8(uint8_t hash, int8_t x) {
+  int8_t u, v;
+  if (hash & 8) {
+    u = x; v = x;
+  } else if (hash & 4) {
+    u = 1; v = x;
+  } else {
+    u = x; v = 1;
+  }
+  if (hash & 1) u = -u;
+  if (hash & 2) v = -v;
+  return avg7(u, v);
+}
+
+static int8_t inoise8_raw(uint16_t x, uint16_t y, uint16_t z) {
+  uint8_t X = x >> 8;
+  uint8_t Y = y >> 8;
+  uint8_t Z = z >> 8;
+
+  uint8_t A = P(X) + Y;
+  uint8_t AA = P(A) + Z;
+  uint8_t AB = P(A + 1) + Z;
+  uint8_t B = P(X + 1) + Y;
+  uint8_t BA = P(B) + Z;
+  uint8_t BB = P(B + 1) + Z;
+
+  uint8_t u = ease8InOutQuad((uint8_t)x);
+  uint8_t v = ease8InOutQuad((uint8_t)y);
+  uint8_t w = ease8InOutQuad((uint8_t)z);
+
+  int8_t xx = ((uint8_t)x >> 1) & 0x7F;
+  int8_t yy = ((uint8_t)y >> 1) & 0x7F;
+  int8_t zz = ((uint8_t)z >> 1) & 0x7F;
+  uint8_t N = 0x80;
+
+  int8_t X1 = lerp7by8(grad8(P(AA), xx, yy, zz), grad8(P(BA), xx - N, yy, zz), u);
+  int8_t X2 = lerp7by8(grad8(P(AB), xx, yy - N, zz), grad8(P(BB), xx - N, yy - N, zz), u);
+  int8_t X3 = lerp7by8(grad8(P(AA + 1), xx, yy, zz - N), grad8(P(BA + 1), xx - N, yy, zz - N), u);
+  int8_t X4 = lerp7by8(grad8(P(AB + 1), xx, yy - N, zz - N), grad8(P(BB + 1), xx - N, yy - N, zz - N), u);
+  int8_t Y1 = lerp7by8(X1, X2, v);
+  int8_t Y2 = lerp7by8(X3, X4, v);
+  return lerp7by8(Y1, Y2, w);
+}
+
+static int8_t inoise8_raw(uint16_t x, uint16_t y) {
+  uint8_t X = x >> 8;
+  uint8_t Y = y >> 8;
+
+  uint8_t A = P(X) + Y;
+  uint8_t AA = P(A);
+  uint8_t AB = P(A + 1);
+  uint8_t B = P(X + 1) + Y;
+  uint8_t BA = P(B);
+  uint8_t BB = P(B + 1);
+
+  uint8_t u = ease8InOutQuad((uint8_t)x);
+  uint8_t v = ease8InOutQuad((uint8_t)y);
+
+  int8_t xx = ((uint8_t)x >> 1) & 0x7F;
+  int8_t yy = ((uint8_t)y >> 1) & 0x7F;
+  uint8_t N = 0x80;
+
+  int8_t X1 = lerp7by8(grad8(P(AA), xx, yy), grad8(P(BA), xx - N, yy), u);
+  int8_t X2 = lerp7by8(grad8(P(AB), xx, yy - N), grad8(P(BB), xx - N, yy - N), u);
+  return lerp7by8(X1, X2, v);
+}
+
+static int8_t inoise8_raw(uint16_t x) {
+  uint8_t X = x >> 8;
+
+  uint8_t A = P(X);
+  uint8_t AA = P(A);
+  uint8_t B = P(X + 1);
+  uint8_t BA = P(B);
+
+  uint8_t u = ease8InOutQuad((uint8_t)x);
+  int8_t xx = ((uint8_t)x >> 1) & 0x7F;
+  uint8_t N = 0x80;
+
+  return lerp7by8(grad8(P(AA), xx), grad8(P(BA), xx - N), u);
+}
+
+#undef P
+
+uint8_t inoise8(uint16_t x, uint16_t y, uint16_t z) {
+  int8_t n = inoise8_raw(x, y, z);
+  n += 64;
+  return qadd8(n, n);
+}
+
+uint8_t inoise8(uint16_t x, uint16_t y) {
+  int8_t n = inoise8_raw(x, y);   // -64..+64
+  n += 64;                        //   0..128
+  return qadd8(n, n);             //   0..255
+}
+
+uint8_t inoise8(uint16_t x) {
+  int8_t n = inoise8_raw(x);
+  n += 64;
+  return qadd8(n, n);
+}
@@ -0,0 +1,416 @@
+/*
+  FastLED.h  - Minimal FastLED-compatible shim for host builds
+             -- mirrors the FastLED 3.x API surface used by this sketch
+             -- math follows FastLED's portable C paths (FASTLED_SCALE8_FIXED == 1)
+                so colors and timing match what the Teensy renders
+*/
+
+#ifndef FastLED_h
+#define FastLED_h
+
+#include "Arduino.h"
+
+
+// ******************************************************************
+//            Fixed point types and helpers (lib8tion)
+// ******************************************************************
+typedef uint8_t  fract8;
+typedef uint16_t fract16;
+typedef uint16_t accum88;
+typedef int16_t  saccum87;
+
+#define LIB8STATIC static inline
+
+LIB8STATIC uint8_t scale8(uint8_t i, uint8_t scale) {
+  return (uint8_t)(((uint16_t)i * (1 + (uint16_t)scale)) >> 8);
+}
+
+LIB8STATIC uint8_t scale8_video(uint8_t i, uint8_t scale) {
+  return (uint8_t)((((uint16_t)i * (uint16_t)scale) >> 8) + ((i && scale) ? 1 : 0));
+}
+
+LIB8STATIC uint16_t scale16(uint16_t i, uint16_t scale) {
+  return (uint16_t)(((uint32_t)i * (1 + (uint32_t)scale)) >> 16);
+}
+
+LIB8STATIC uint8_t qadd8(uint8_t i, uint8_t j) {
+  unsigned int t = i + j;
+  return (uint8_t)(t > 255 ? 255 : t);
+}
+
+LIB8STATIC uint8_t qsub8(uint8_t i, uint8_t j) {
+  return (uint8_t)(i > j ? i - j : 0);
+}
+
+LIB8STATIC uint8_t blend8(uint8_t a, uint8_t b, uint8_t amountOfB) {
+  uint16_t partial = (uint16_t)((a << 8) | b);
+  partial += (uint16_t)(b * amountOfB);
+  partial -= (uint16_t)(a * amountOfB);
+  return (uint8_t)(partial >> 8);
+}
+
+LIB8STATIC int16_t sin16(uint16_t theta) {
+  static const uint16_t base[] = { 0, 6393, 12539, 18204, 23170, 27245, 30273, 32137 };
+  static const uint8_t slope[] = { 49, 48, 44, 38, 31, 23, 14, 4 };
+
+  uint16_t offset = (theta & 0x3FFF) >> 3; // 0..2047
+  if (theta & 0x4000) offset = 2047 - offset;
+
+  uint8_t section = offset / 256; // 0..7
+  uint16_t b = base[section];
+  uint8_t m = slope[section];
+
+  uint8_t secoffset8 = (uint8_t)(offset) / 2;
+
+  uint16_t mx = m * secoffset8;
+  int16_t y = mx + b;
+
+  if (theta & 0x8000) y = -y;
+
+  return y;
+}
+
+LIB8STATIC uint8_t sin8(uint8_t theta) {
+  static const uint8_t b_m16_interleave[] = { 0, 49, 49, 41, 90, 27, 117, 10 };
+
+  uint8_t offset = theta;
+  if (theta & 0x40) {
+    offset = (uint8_t)255 - offset;
+  }
+  offset &= 0x3F; // 0..63
+
+  uint8_t secoffset = offset & 0x0F; // 0..15
+  if (theta & 0x40) secoffset++;
+
+  uint8_t section = offset >> 4; // 0..3
+  uint8_t b = b_m16_interleave[section * 2];
+  uint8_t m16 = b_m16_interleave[section * 2 + 1];
+
+  uint8_t mx = (m16 * secoffset) >> 4;
+
+  int8_t y = mx + b;
+  if (theta & 0x80) y = -y;
+
+  y += 128;
+
+  return (uint8_t)y;
+}
+
+LIB8STATIC uint8_t cos8(uint8_t theta) {
+  return sin8(theta + 64);
+}
+
+LIB8STATIC uint8_t triwave8(uint8_t in) {
+  if (in & 0x80) {
+    in = 255 - in;
+  }
+  return in << 1;
+}
+
+LIB8STATIC uint8_t ease8InOutQuad(uint8_t i) {
+  uint8_t j = i;
+  if (j & 0x80) {
+    j = 255 - j;
+  }
+  uint8_t jj = scale8(j, j);
+  uint8_t jj2 = jj << 1;
+  if (i & 0x80) {
+    jj2 = 255 - jj2;
+  }
+  return jj2;
+}
+
+LIB8STATIC uint8_t quadwave8(uint8_t in) {
+  return ease8InOutQuad(triwave8(in));
+}
+
+
+// ******************************************************************
+//            Random numbers (same LCG as FastLED's lib8tion)
+// ******************************************************************
+#define RAND16_SEED 1337
+extern uint16_t rand16seed;
+
+LIB8STATIC uint8_t random8() {
+  rand16seed = (rand16seed * 2053) + 13849;
+  return (uint8_t)(((uint8_t)(rand16seed & 0xFF)) + ((uint8_t)(rand16seed >> 8)));
+}
+
+LIB8STATIC uint8_t random8(uint8_t lim) {
+  uint8_t r = random8();
+  r = (r * lim) >> 8;
+  return r;
+}
+
+LIB8STATIC uint8_t random8(uint8_t min, uint8_t lim) {
+  uint8_t delta = lim - min;
+  return random8(delta) + min;
+}
+
+LIB8STATIC uint16_t random16() {
+  rand16seed = (rand16seed * 2053) + 13849;
+  return rand16seed;
+}
+
+LIB8STATIC uint16_t random16(uint16_t lim) {
+  uint16_t r = random16();
+  uint32_t p = (uint32_t)lim * (uint32_t)r;
+  return (uint16_t)(p >> 16);
+}
+
+LIB8STATIC uint16_t random16(uint16_t min, uint16_t lim) {
+  uint16_t delta = lim - min;
+  return random16(delta) + min;
+}
+
+LIB8STATIC void random16_set_seed(uint16_t seed) {
+  rand16seed = seed;
+}
+
+LIB8STATIC uint16_t random16_get_seed() {
+  return rand16seed;
+}
+
+LIB8STATIC void random16_add_entropy(uint16_t entropy) {
+  rand16seed += entropy;
+}
+
+
+// ******************************************************************
+//            Beat generators - driven by millis(), or by
+//            get_millisecond_timer() when USE_GET_MILLISECOND_TIMER is defined
+// ******************************************************************
+#if defined(USE_GET_MILLISECOND_TIMER)
+uint32_t get_millisecond_timer();
+#define GET_MILLIS get_millisecond_timer
+#else
+#define GET_MILLIS millis
+#endif
+
+LIB8STATIC uint16_t beat88(accum88 beats_per_minute_88, uint32_t timebase = 0) {
+  return (uint16_t)(((GET_MILLIS() - timebase) * beats_per_minute_88 * 280) >> 16);
+}
+
+LIB8STATIC uint16_t beat16(accum88 beats_per_minute, uint32_t timebase = 0) {
+  if (beats_per_minute < 256) beats_per_minute <<= 8;
+  return beat88(beats_per_minute, timebase);
+}
+
+LIB8STATIC uint8_t beat8(accum88 beats_per_minute, uint32_t timebase = 0) {
+  return beat16(beats_per_minute, timebase) >> 8;
+}
+
+LIB8STATIC uint16_t beatsin16(accum88 beats_per_minute, uint16_t lowest = 0, uint16_t highest = 65535,
+                              uint32_t timebase = 0, uint16_t phase_offset = 0) {
+  uint16_t beat = beat16(beats_per_minute, timebase);
+  uint16_t beatsin = (sin16(beat + phase_offset) + 32768);
+  uint16_t rangewidth = highest - lowest;
+  uint16_t scaledbeat = scale16(beatsin, rangewidth);
+  return lowest + scaledbeat;
+}
+
+LIB8STATIC uint8_t beatsin8(accum88 beats_per_minute, uint8_t lowest = 0, uint8_t highest = 255,
+                            uint32_t timebase = 0, uint8_t phase_offset = 0) {
+  uint8_t beat = beat8(beats_per_minute, timebase);
+  uint8_t beatsin = sin8(beat + phase_offset);
+  uint8_t rangewidth = highest - lowest;
+  uint8_t scaledbeat = scale8(beatsin, rangewidth);
+  return lowest + scaledbeat;
+}
+
+
+// ******************************************************************
+//            Pixel types
+// ******************************************************************
+struct CHSV {
+  union {
+    struct {
+      union { uint8_t hue; uint8_t h; };
+      union { uint8_t saturation; uint8_t sat; uint8_t s; };
+      union { uint8_t value; uint8_t val; uint8_t v; };
+    };
+    uint8_t raw[3];
+  };
+
+  inline CHSV() : h(0), s(0), v(0) {}
+  inline CHSV(uint8_t ih, uint8_t is, uint8_t iv) : h(ih), s(is), v(iv) {}
+};
+
+struct CRGB;
+void hsv2rgb_rainbow(const CHSV& hsv, CRGB& rgb);
+
+struct CRGB {
+  union {
+    struct {
+      union { uint8_t r; uint8_t red; };
+      union { uint8_t g; uint8_t green; };
+      union { uint8_t b; uint8_t blue; };
+    };
+    uint8_t raw[3];
+  };
+
+  typedef enum {
+    Black = 0x000000,
+    Blue  = 0x0000FF,
+    Green = 0x008000,
+    Red   = 0xFF0000,
+    White = 0xFFFFFF
+  } HTMLColorCode;
+
+  inline CRGB() {}
+  inline CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+  inline CRGB(uint32_t colorcode) : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+  inline CRGB(HTMLColorCode colorcode) : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+  inline CRGB(const CHSV& rhs) { hsv2rgb_rainbow(rhs, *this); }
+
+  inline CRGB& operator=(const CHSV& rhs) {
+    hsv2rgb_rainbow(rhs, *this);
+    return *this;
+  }
+
+  inline CRGB& operator=(uint32_t colorcode) {
+    r = (colorcode >> 16) & 0xFF;
+    g = (colorcode >> 8) & 0xFF;
+    b = colorcode & 0xFF;
+    return *this;
+  }
+
+  inline uint8_t& operator[](uint8_t x) { return raw[x]; }
+  inline const uint8_t& operator[](uint8_t x) const { return raw[x]; }
+
+  // saturating add, as used by the += in our animations
+  inline CRGB& operator+=(const CRGB& rhs) {
+    r = qadd8(r, rhs.r);
+    g = qadd8(g, rhs.g);
+    b = qadd8(b, rhs.b);
+    return *this;
+  }
+
+  inline CRGB& nscale8(uint8_t scaledown) {
+    r = scale8(r, scaledown);
+    g = scale8(g, scaledown);
+    b = scale8(b, scaledown);
+    return *this;
+  }
+
+  inline CRGB& fadeToBlackBy(uint8_t fadefactor) {
+    return nscale8(255 - fadefactor);
+  }
+
+  inline bool operator==(const CRGB& rhs) const { return r == rhs.r && g == rhs.g && b == rhs.b; }
+  inline bool operator!=(const CRGB& rhs) const { return !(*this == rhs); }
+  inline explicit operator bool() const { return r || g || b; }
+};
+
+
+// ******************************************************************
+//            Palettes
+// ******************************************************************
+typedef enum { NOBLEND = 0, LINEARBLEND = 1 } TBlendType;
+
+typedef uint32_t TProgmemRGBPalette16[16];
+typedef uint8_t TProgmemRGBGradientPalette_byte;
+typedef const TProgmemRGBGradientPalette_byte* TProgmemRGBGradientPalettePtr;
+
+#define DEFINE_GRADIENT_PALETTE(X) extern const TProgmemRGBGradientPalette_byte X[]; \
+                                   const TProgmemRGBGradientPalette_byte X[] =
+
+class CRGBPalette16 {
+  public:
+    CRGB entries[16];
+
+    CRGBPalette16() {}
+    CRGBPalette16(const TProgmemRGBPalette16& rhs) { *this = rhs; }
+    CRGBPalette16(TProgmemRGBGradientPalettePtr progpal) { *this = progpal; }
+
+    CRGBPalette16& operator=(const TProgmemRGBPalette16& rhs);
+    CRGBPalette16& operator=(TProgmemRGBGradientPalettePtr progpal);
+
+    bool operator==(const CRGBPalette16& rhs) const { return memcmp(entries, rhs.entries, sizeof(entries)) == 0; }
+    bool operator!=(const CRGBPalette16& rhs) const { return !(*this == rhs); }
+
+    inline CRGB& operator[](uint8_t x) { return entries[x]; }
+    inline const CRGB& operator[](uint8_t x) const { return entries[x]; }
+};
+
+extern const TProgmemRGBPalette16 RainbowColors_p;
+
+
+// ******************************************************************
+//            Output controllers - the host has no wire to drive, so
+//            showLeds() does nothing (host/sim models the wire timing)
+// ******************************************************************
+class CLEDController {
+  public:
+    CLEDController() : m_Data(nullptr), m_nLeds(0) {}
+    CLEDController(CRGB* data, int nLeds) : m_Data(data), m_nLeds(nLeds) {}
+    virtual ~CLEDController() {}
+
+    virtual void showLeds(uint8_t brightness = 255) { (void)brightness; }
+
+    CLEDController& setLeds(CRGB* data, int nLeds) {
+      m_Data = data;
+      m_nLeds = nLeds;
+      return *this;
+    }
+    CRGB* leds() { return m_Data; }
+    int size() { return m_nLeds; }
+
+  protected:
+    CRGB* m_Data;
+    int m_nLeds;
+};
+
+
+// ******************************************************************
+//            The FastLED object - addLeds() hands out a controller
+//            over the caller's pixels, which never sends anything
+// ******************************************************************
+template <uint8_t DATA_PIN> class NEOPIXEL {};
+
+#define HOST_MAX_CONTROLLERS 8
+
+class CFastLED {
+  public:
+    template <template <uint8_t DATA_PIN> class CHIPSET, uint8_t DATA_PIN>
+    CLEDController& addLeds(CRGB* data, int nLeds) { return addController(data, nLeds); }
+
+    void setBrightness(uint8_t scale) { m_Scale = scale; }
+    uint8_t getBrightness() { return m_Scale; }
+
+  private:
+    CLEDController& addController(CRGB* data, int nLeds);
+
+    CLEDController m_Controllers[HOST_MAX_CONTROLLERS];
+    uint8_t m_nControllers = 0;
+    uint8_t m_Scale = 255;
+};
+
+extern CFastLED FastLED;
+
+
+// ******************************************************************
+//            Color utilities (out of line, like FastLED's colorutils.cpp)
+// ******************************************************************
+CRGB blend(const CRGB& p1, const CRGB& p2, fract8 amountOfP2);
+CRGB ColorFromPalette(const CRGBPalette16& pal, uint8_t index, uint8_t brightness = 255, TBlendType blendType = LINEARBLEND);
+
+void fill_solid(CRGB* leds, int numToFill, const CRGB& color);
+void fill_solid(CRGB* leds, int numToFill, const CHSV& hsvColor);
+void fill_gradient_RGB(CRGB* leds, uint16_t startpos, CRGB startcolor, uint16_t endpos, CRGB endcolor);
+void fill_palette(CRGB* L, uint16_t N, uint8_t startIndex, uint8_t incIndex,
+                  const CRGBPalette16& pal, uint8_t brightness, TBlendType blendType);
+
+void nscale8(CRGB* leds, uint16_t num_leds, uint8_t scale);
+void fadeToBlackBy(CRGB* leds, uint16_t num_leds, uint8_t fadeBy);
+
+
+// ******************************************************************
+//            Noise (8 bit Perlin noise, like FastLED's noise.h)
+// ******************************************************************
+uint8_t inoise8(uint16_t x, uint16_t y, uint16_t z);
+uint8_t inoise8(uint16_t x, uint16_t y);
+uint8_t inoise8(uint16_t x);
+
+
+#endif
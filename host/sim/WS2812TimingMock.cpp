@@ -0,0 +1,94 @@
+/*
+  WS2812TimingMock.cpp  - An OutputBackend for the host that sends nothing, but takes as long as the wire would
+*/
+
+#include "WS2812TimingMock.h"
+
+
+// *********************************************************************************
+//      CONSTRUCTOR
+// *********************************************************************************
+
+WS2812TimingMock::WS2812TimingMock(const uint16_t *stripLengths, uint8_t stripCount, bool parallel, uint32_t latchMicros)
+{
+  _stripCount = stripCount > MAX_OUTPUT_STRIPS ? MAX_OUTPUT_STRIPS : stripCount;
+  _parallel = parallel;
+  _latchMicros = latchMicros;
+
+  for (uint8_t i = 0; i < MAX_OUTPUT_STRIPS; i++) {
+    _stripLengths[i] = i < _stripCount ? stripLengths[i] : 0;
+  }
+}
+
+
+void WS2812TimingMock::ResetStats() {
+
+  _showCount = 0;
+  _totalShowMicros = 0;
+  _maxShowMicros = 0;
+  _pixelsSent = 0;
+}
+
+
+// *********************************************************************************
+//      WIRE TIMING
+// *********************************************************************************
+
+uint32_t WS2812TimingMock::ShowMicros(uint8_t stripMask) const {
+
+  uint8_t allStrips = (uint8_t)((1 << _stripCount) - 1);
+  stripMask &= allStrips;
+  if (!stripMask) {
+    return 0;
+  }
+
+  // every lane goes out together, and the longest one decides when they're done
+  if (_parallel) {
+    uint16_t longest = 0;
+    for (uint8_t i = 0; i < _stripCount; i++) {
+      if (_stripLengths[i] > longest) {
+        longest = _stripLengths[i];
+      }
+    }
+    return (uint32_t)longest * WS2812_MICROS_PER_PIXEL + _latchMicros;
+  }
+
+  uint32_t wireMicros = 0;
+  for (uint8_t i = 0; i < _stripCount; i++) {
+    if (stripMask & (1 << i)) {
+      wireMicros += (uint32_t)_stripLengths[i] * WS2812_MICROS_PER_PIXEL + _latchMicros;
+    }
+  }
+  return wireMicros;
+}
+
+
+uint8_t WS2812TimingMock::Show(uint8_t stripMask, uint8_t brightness) {
+
+  (void)brightness;
+
+  uint8_t allStrips = (uint8_t)((1 << _stripCount) - 1);
+  uint8_t shown = _parallel ? ((stripMask & allStrips) ? allStrips : 0) : (stripMask & allStrips);
+
+  uint32_t wireMicros = ShowMicros(shown);
+  if (!wireMicros) {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < _stripCount; i++) {
+    if (shown & (1 << i)) {
+      _pixelsSent += _stripLengths[i];
+    }
+  }
+
+  _showCount++;
+  _totalShowMicros += wireMicros;
+  if (wireMicros > _maxShowMicros) {
+    _maxShowMicros = wireMicros;
+  }
+
+  // FastLED blocks until the last bit is out, so time passes for the caller too
+  hostAdvanceMicros(wireMicros);
+
+  return shown;
+}
@@ -0,0 +1,61 @@
+/*
+  WS2812TimingMock.h  - An OutputBackend for the host that sends nothing, but takes as long as the wire would
+                      -- WS2812 data runs at 800 kHz: 24 bits of 1.25 us per pixel, then a latch gap
+                      -- Show() advances the virtual clock by the wire time, so a FrameClock driven by
+                         micros() sees the same lateness the Teensy would
+                      -- sequential mode sends the asked-for strips one after another; parallel mode
+                         sends every lane at once for the time of the longest
+*/
+
+#ifndef WS2812TimingMock_h
+#define WS2812TimingMock_h
+
+// ******************************************************************
+//            Includes and Defines
+// ******************************************************************
+#include "OutputBackend.h"
+
+#define WS2812_MICROS_PER_PIXEL 30     // 24 bits at 1.25 us
+#define WS2812_LATCH_MICROS 50         // the low time that ends a frame (newer parts want up to 280)
+
+
+// ******************************************************************
+//            WS2812TimingMock class definitions
+// ******************************************************************
+class WS2812TimingMock : public OutputBackend
+{
+
+  //********** PUBLIC MEMBER VARIABLES AND FUNCTIONS **********
+  public:
+    WS2812TimingMock(const uint16_t *stripLengths, uint8_t stripCount, bool parallel,
+                     uint32_t latchMicros = WS2812_LATCH_MICROS);
+
+    uint8_t Show(uint8_t stripMask, uint8_t brightness);
+    uint8_t GetStripCount() const { return _stripCount; }
+
+    // how long a Show() of stripMask keeps the wire (and, with FastLED, the CPU) busy
+    uint32_t ShowMicros(uint8_t stripMask) const;
+
+    uint32_t GetShowCount() const { return _showCount; }
+    uint64_t GetTotalShowMicros() const { return _totalShowMicros; }
+    uint32_t GetMaxShowMicros() const { return _maxShowMicros; }
+    uint64_t GetPixelsSent() const { return _pixelsSent; }
+    void ResetStats();
+
+
+  //********** PRIVATE MEMBER VARIABLES AND FUNCTIONS **********
+  private:
+    uint16_t _stripLengths[MAX_OUTPUT_STRIPS];
+    uint8_t _stripCount;
+    bool _parallel;
+    uint32_t _latchMicros;
+
+    uint32_t _showCount = 0;
+    uint64_t _totalShowMicros = 0;
+    uint32_t _maxShowMicros = 0;
+    uint64_t _pixelsSent = 0;
+};
+
+
+
+#endif